@@ -15,6 +15,7 @@
 #define USER_DS 0x002B
 #define KERNEL_TSS 0x0030
 #define KERNEL_LDT 0x0038
+#define USER_TLS 0x0043
 
 // Privilege levels
 #define KERNEL_PRIVILEGE	0x0
@@ -26,6 +27,12 @@
 /* Number of vectors in the interrupt descriptor table (IDT) */
 #define NUM_VEC 256
 
+/* Model specific registers for sysenter / sysexit (sysexit uses the
+ * segments 16 and 24 past IA32_SYSENTER_CS, i.e. USER_CS and USER_DS) */
+#define IA32_SYSENTER_CS	0x174
+#define IA32_SYSENTER_ESP	0x175
+#define IA32_SYSENTER_EIP	0x176
+
 #ifndef ASM
 
 /* This structure is used to load descriptor base registers
@@ -128,6 +135,8 @@ extern uint32_t tss_size;
 extern seg_desc_t tss_desc_ptr;
 extern tss_t tss;
 
+extern seg_desc_t tls_desc_ptr;
+
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim) \
 do { \
@@ -148,6 +157,14 @@ do { \
 		str.seg_lim_15_00 = (lim) & 0x0000FFFF; \
 } while(0)
 
+/* Sets the base of the user TLS entry in the GDT */
+#define SET_TLS_BASE(str, addr) \
+do { \
+	str.base_31_24 = ((uint32_t)(addr) & 0xFF000000) >> 24; \
+		str.base_23_16 = ((uint32_t)(addr) & 0x00FF0000) >> 16; \
+		str.base_15_00 = (uint32_t)(addr) & 0x0000FFFF; \
+} while(0)
+
 /* An interrupt descriptor entry (goes into the IDT) */
 typedef union idt_desc_t {
 	uint32_t val[2];
@@ -215,6 +232,16 @@ do {                                    \
 			: "memory" );               \
 } while(0)
 
+/* Load the %gs segment register (which programs use for thread local storage).
+ * The segment's descriptor is only read from the GDT when this happens */
+#define load_gs(desc)                   \
+do {                                    \
+	asm volatile("movw %%ax, %%gs"      \
+			:                           \
+			: "a" (desc)                \
+			: "memory" );               \
+} while(0)
+
 #endif /* ASM */
 
 #endif /* _x86_DESC_H */
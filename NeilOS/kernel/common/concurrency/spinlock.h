@@ -26,9 +26,9 @@ void spin_lock_init(spinlock_t* lock);
 // Lock a spinlock (spin until we can lock it)
 void spin_lock(spinlock_t* lock);
 // Lock a spinlock and disable irq's
-#define spin_lock_irq(lock)					{ cli(); spin_lock(lock) }
+#define spin_lock_irq(lock)					{ cli(); spin_lock(lock); }
 // Lock a spinlock, disable irq's and save the flags
-#define spin_lock_irqsave(lock, flags)		{ cli_and_save(flags); spin_lock(lock) }
+#define spin_lock_irqsave(lock, flags)		{ cli_and_save(flags); spin_lock(lock); }
 
 // Unlock a spinlock
 void spin_unlock(spinlock_t* lock);
@@ -0,0 +1,77 @@
+//
+//  wait_queue.c
+//  NeilOS
+//
+
+#include "wait_queue.h"
+#include <program/task.h>
+
+// Initialize a wait queue
+void wait_queue_init(wait_queue_t* q) {
+	*q = WAIT_QUEUE_EMPTY;
+}
+
+// Add an entry to a wait queue
+void wait_queue_add(wait_queue_t* q, wait_queue_entry_t* entry) {
+	uint32_t flags;
+	spin_lock_irqsave(&q->lock, flags);
+	entry->queue = q;
+	entry->prev = NULL;
+	entry->next = q->head;
+	if (q->head)
+		q->head->prev = entry;
+	q->head = entry;
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+// Add the current thread to a wait queue and get ready to sleep (see thread_sleep)
+void wait_queue_add_current(wait_queue_t* q, wait_queue_entry_t* entry) {
+	entry->thread = current_thread;
+	entry->func = NULL;
+	entry->data = NULL;
+	thread_sleep_prepare();
+	wait_queue_add(q, entry);
+}
+
+// Remove an entry from its wait queue without locking it (entry->next is left alone so wait_queue_wake can keep going)
+void wait_queue_remove_locked(wait_queue_entry_t* entry) {
+	wait_queue_t* q = entry->queue;
+	if (!q)
+		return;
+	
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		q->head = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	entry->queue = NULL;
+}
+
+// Remove an entry from its wait queue
+void wait_queue_remove(wait_queue_entry_t* entry) {
+	wait_queue_t* q = entry->queue;
+	if (!q)
+		return;
+	
+	uint32_t flags;
+	spin_lock_irqsave(&q->lock, flags);
+	wait_queue_remove_locked(entry);
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+// Wake up everything waiting on a queue (events is a mask of POLLIN / POLLOUT / ...). Safe to call from interrupts
+void wait_queue_wake(wait_queue_t* q, uint32_t events) {
+	if (!q->head)
+		return;
+	
+	uint32_t flags;
+	spin_lock_irqsave(&q->lock, flags);
+	for (wait_queue_entry_t* entry = q->head; entry; entry = entry->next) {
+		if (entry->func)
+			entry->func(entry, events);
+		else
+			thread_wake(entry->thread);
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+}
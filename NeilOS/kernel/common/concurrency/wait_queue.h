@@ -0,0 +1,52 @@
+//
+//  wait_queue.h
+//  NeilOS
+//
+
+#ifndef WAIT_QUEUE_H
+#define WAIT_QUEUE_H
+
+#include <common/types.h>
+#include "spinlock.h"
+
+struct thread;
+struct wait_queue;
+
+#define WAIT_QUEUE_EMPTY		(wait_queue_t){ .lock = { 0 }, .head = NULL }
+
+// A waiter on a wait queue
+typedef struct wait_queue_entry {
+	struct thread* thread;
+	// If set, this is called instead of waking the thread (can be called from an interrupt)
+	void (*func)(struct wait_queue_entry* entry, uint32_t events);
+	void* data;
+	
+	struct wait_queue* queue;
+	struct wait_queue_entry* next;
+	struct wait_queue_entry* prev;
+} wait_queue_entry_t;
+
+// List of threads waiting for something to happen (woken up by the producer)
+typedef struct wait_queue {
+	spinlock_t lock;
+	wait_queue_entry_t* head;
+} wait_queue_t;
+
+// Initialize a wait queue
+void wait_queue_init(wait_queue_t* q);
+
+// Add an entry to a wait queue
+void wait_queue_add(wait_queue_t* q, wait_queue_entry_t* entry);
+
+// Add the current thread to a wait queue and get ready to sleep (see thread_sleep)
+void wait_queue_add_current(wait_queue_t* q, wait_queue_entry_t* entry);
+
+// Remove an entry from its wait queue
+void wait_queue_remove(wait_queue_entry_t* entry);
+// Remove an entry from inside its func (wait_queue_wake already holds the queue's lock)
+void wait_queue_remove_locked(wait_queue_entry_t* entry);
+
+// Wake up everything waiting on a queue (events is a mask of POLLIN / POLLOUT / ...). Safe to call from interrupts
+void wait_queue_wake(wait_queue_t* q, uint32_t events);
+
+#endif
@@ -84,6 +84,15 @@ static inline uint32_t inl(uint16_t port)
 	return val;
 }
 
+/* Reads the processor's time stamp counter */
+static inline uint64_t rdtsc()
+{
+	uint32_t low, high;
+	asm volatile("rdtsc"
+			: "=a"(low), "=d"(high));
+	return ((uint64_t)high << 32) | low;
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -111,6 +120,15 @@ do {                                    \
 			: "memory", "cc" );         \
 } while(0)
 
+/* Writes a 64-bit value to a model specific register */
+#define wrmsr(msr, value)               \
+do {                                    \
+	asm volatile("wrmsr"                \
+			:                           \
+			: "c" (msr), "a" ((uint32_t)(value)), "d" ((uint32_t)((uint64_t)(value) >> 32)) \
+			: "memory" );               \
+} while(0)
+
 /* Clear interrupt flag - disables interrupts on this processor */
 #define cli()                           \
 do {                                    \
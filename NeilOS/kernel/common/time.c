@@ -8,6 +8,7 @@
 
 #include "time.h"
 #include <drivers/rtc/rtc.h>
+#include <memory/memory.h>
 #include "lib.h"
 
 #define RTC_COMMAND_PORT	0x70
@@ -30,8 +31,18 @@
 #define RTC_FORMAT_BIN		0x04
 #define RTC_FORMAT_12		0x02
 
+#define CPUID_TSC			(1 << 4)
+
+// How long to measure the time stamp counter against the PIT for
+#define CLOCK_CALIBRATION_MS	250
+
 struct timeval current_time;
 
+// The clock page gets a whole page to itself so nothing else is visible to programs
+uint8_t clock_page_data[FOUR_KB_SIZE] __attribute__((aligned(FOUR_KB_SIZE)));
+clock_page_t* clock_page = (clock_page_t*)clock_page_data;
+bool tsc_supported = false;
+
 // Check if an update is in progress
 bool rtc_update_in_progress() {
 	outb(REGISTER_A_CMD, RTC_COMMAND_PORT);
@@ -228,15 +239,127 @@ void time_load_current() {
 	current_time.tv_usec = 0;
 }
 
+// Divides a 64-bit number by a 32-bit one (the quotient has to fit in 32 bits)
+uint32_t divide_64(uint64_t n, uint32_t d) {
+	uint32_t q, r;
+	asm("divl %4"
+		: "=a"(q), "=d"(r)
+		: "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d));
+	return q;
+}
+
+// Publish the time of the current tick to the clock page
+void clock_page_update(uint64_t tsc) {
+	clock_page->sequence++;
+	asm volatile("" : : : "memory");
+	clock_page->tv_sec = current_time.tv_sec;
+	clock_page->tv_nsec = current_time.tv_usec * NANOS_IN_US;
+	clock_page->tsc_base = tsc;
+	asm volatile("" : : : "memory");
+	clock_page->sequence++;
+}
+
+// Work out the time stamp counter's rate once enough ticks have gone by
+void clock_page_calibrate(uint64_t tsc, int ms) {
+	static bool started = false;
+	static uint64_t start = 0;
+	static uint32_t elapsed_ms = 0;
+	if (!started) {
+		started = true;
+		start = tsc;
+		return;
+	}
+	elapsed_ms += ms;
+	if (elapsed_ms < CLOCK_CALIBRATION_MS)
+		return;
+	
+	uint64_t cycles = tsc - start;
+	uint32_t cycles_per_ms = 0;
+	if (!(cycles >> 32))
+		cycles_per_ms = (uint32_t)cycles / elapsed_ms;
+	if (cycles_per_ms == 0) {
+		// Too slow or too fast to be useful, so programs will keep using the syscall
+		tsc_supported = false;
+		return;
+	}
+	
+	// Nanoseconds per cycle as a fixed point number with as many fractional bits as fit
+	uint32_t shift = 32;
+	while (shift > 0 && (NANOS_IN_MS >> (32 - shift)) >= cycles_per_ms)
+		shift--;
+	clock_page->tsc_shift = shift;
+	clock_page->tsc_mult = divide_64((uint64_t)NANOS_IN_MS << shift, cycles_per_ms);
+}
+
+// Map the clock page into every program
+void time_init_clock_page() {
+	uint32_t eax = 1, ebx, ecx, edx;
+	asm volatile("cpuid"
+				 : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+	tsc_supported = (edx & CPUID_TSC) != 0;
+	
+	memset(clock_page_data, 0, FOUR_KB_SIZE);
+	clock_page_update(0);
+	vm_map_shared_user_page(CLOCK_PAGE_ADDRESS, (uint32_t)vm_virtual_to_physical((uint32_t)clock_page_data));
+}
+
 struct timeval time_get() {
 	return current_time;
 }
 
+// Returns the current time with the time since the last tick filled in from the time stamp counter
+struct timeval time_get_precise() {
+	if (!tsc_supported)
+		return current_time;
+	
+	uint32_t sequence, tv_sec, tv_nsec, mult, shift;
+	uint64_t tsc_base, tsc;
+	do {
+		sequence = clock_page->sequence;
+		asm volatile("" : : : "memory");
+		tv_sec = clock_page->tv_sec;
+		tv_nsec = clock_page->tv_nsec;
+		tsc_base = clock_page->tsc_base;
+		mult = clock_page->tsc_mult;
+		shift = clock_page->tsc_shift;
+		tsc = rdtsc();
+		asm volatile("" : : : "memory");
+	} while ((sequence & 0x1) || sequence != clock_page->sequence);
+	
+	if (mult) {
+		// Never go past the next tick so the time can't jump backwards when it comes
+		uint64_t delta = tsc - tsc_base;
+		uint32_t ns = NANOS_IN_MS - 1;
+		if (!(delta >> 32))
+			ns = ((uint64_t)(uint32_t)delta * mult) >> shift;
+		if (ns >= NANOS_IN_MS)
+			ns = NANOS_IN_MS - 1;
+		tv_nsec += ns;
+		if (tv_nsec >= NANOS_IN_SEC) {
+			tv_nsec -= NANOS_IN_SEC;
+			tv_sec++;
+		}
+	}
+	
+	struct timeval t;
+	t.tv_sec = tv_sec;
+	t.tv_usec = tv_nsec / NANOS_IN_US;
+	return t;
+}
+
 void time_increment_ms(int ms) {
 	current_time.tv_usec += US_IN_MS * ms;
 	unsigned int sec = current_time.tv_usec / US_IN_SEC;
 	current_time.tv_usec -= sec * US_IN_SEC;
 	current_time.tv_sec += sec;
+	
+	if (tsc_supported) {
+		uint64_t tsc = rdtsc();
+		if (!clock_page->tsc_mult)
+			clock_page_calibrate(tsc, ms);
+		clock_page_update(tsc);
+	} else
+		clock_page_update(0);
 }
 
 struct timeval time_add(struct timeval t1, struct timeval t2) {
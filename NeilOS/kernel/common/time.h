@@ -43,6 +43,20 @@ struct timespec {
 	uint32_t tv_nsec;
 };
 
+// Read only page mapped into every program so it can tell the time without a syscall.
+// The time is base + ((rdtsc() - tsc_base) * tsc_mult) >> tsc_shift nanoseconds,
+// read again if sequence was odd or changed while reading.
+#define CLOCK_PAGE_ADDRESS		0x3FF000
+
+typedef struct {
+	volatile uint32_t sequence;		// Odd while the kernel is updating the page
+	uint32_t tv_sec;				// Time at the last tick
+	uint32_t tv_nsec;
+	uint64_t tsc_base;				// Time stamp counter at the last tick
+	uint32_t tsc_mult;				// Nanoseconds per tsc cycle (0 if it isn't calibrated)
+	uint32_t tsc_shift;
+} clock_page_t;
+
 // Returns the current date (GMT)
 date_t get_current_date();
 // Returns a string of the current date
@@ -52,7 +66,9 @@ int sget_current_date(char* str);
 time_t get_current_unix_time();
 
 void time_load_current();
+void time_init_clock_page();
 struct timeval time_get();
+struct timeval time_get_precise();
 void time_increment_ms(int ms);
 struct timeval time_add(struct timeval t1, struct timeval t2);
 struct timeval time_subtract(struct timeval t1, struct timeval t2);
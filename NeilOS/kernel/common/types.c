@@ -8,94 +8,65 @@
 
 #include "types.h"
 
-// Create a 64bit integer
-uint64_t uint64_make(uint32_t high, uint32_t low) {
-	return (uint64_t){ .high = high, .low = low };
-}
-
-// Add two 64bit integers
-uint64_t uint64_add(uint64_t a, uint64_t b) {
-	a.low += b.low;
-	a.high += b.high;
-	// Overflow
-	if (a.low < b.low)
-		a.high++;
-	
-	return a;
-}
+// GCC turns 64 bit division into calls to these (normally from libgcc, which the kernel doesn't link)
+uint64_t __udivmoddi4(uint64_t num, uint64_t den, uint64_t* rem);
+uint64_t __udivdi3(uint64_t num, uint64_t den);
+uint64_t __umoddi3(uint64_t num, uint64_t den);
+int64_t __divdi3(int64_t num, int64_t den);
+int64_t __moddi3(int64_t num, int64_t den);
 
-// Subtract (a - b)
-uint64_t uint64_sub(uint64_t a, uint64_t b) {
-	// Classic two's complement addition (a - b = a + (~b + 1))
-	return uint64_inc(uint64_add(a, uint64_not(b)));
-}
-
-// Increment a 64bit integer
-uint64_t uint64_inc(uint64_t a) {
-	a.low++;
-	if (a.low == 0)
-		a.high++;
+// Unsigned 64 bit division with remainder
+uint64_t __udivmoddi4(uint64_t num, uint64_t den, uint64_t* rem) {
+	uint64_t quot = 0;
 	
-	return a;
-}
-
-// Shift Left
-uint64_t uint64_shl(uint64_t a, uint8_t bits) {
-	if (bits >= 32) {
-		a.high = a.low << (bits - 32);
-		a.low = 0;
-		
-		return a;
+	// Most divisions in the kernel fit in 32 bits, which the CPU can do directly
+	if ((num >> 32) == 0 && (den >> 32) == 0) {
+		if (rem)
+			*rem = (uint32_t)num % (uint32_t)den;
+		return (uint32_t)num / (uint32_t)den;
 	}
 	
-	a.high <<= bits;
-	a.high |= (a.low >> (32 - bits));
-	a.low <<= bits;
-	
-	return a;
-}
-
-// Shift right
-uint64_t uint64_shr(uint64_t a, uint8_t bits) {
-	if (bits >= 32) {
-		a.low = a.high >> (bits - 32);
-		a.high = 0;
-		
-		return a;
+	// Shift and subtract one bit at a time
+	if (den != 0 && den <= num) {
+		int32_t shift = __builtin_clzll(den) - __builtin_clzll(num);
+		den <<= shift;
+		for (; shift >= 0; shift--) {
+			quot <<= 1;
+			if (num >= den) {
+				num -= den;
+				quot |= 1;
+			}
+			den >>= 1;
+		}
 	}
 	
-	a.low >>= bits;
-	a.low |= (a.high & ((1 << bits) - 1)) << (32 - bits);
-	a.high >>= bits;
-	
-	return a;
+	if (rem)
+		*rem = num;
+	return quot;
 }
 
-// Not
-uint64_t uint64_not(uint64_t a) {
-	a.high = ~a.high;
-	a.low = ~a.low;
-	
-	return a;
+// Unsigned division (a / b)
+uint64_t __udivdi3(uint64_t num, uint64_t den) {
+	return __udivmoddi4(num, den, NULL);
 }
 
-// Greater than (a > b)
-bool uint64_greater(uint64_t a, uint64_t b) {
-	if (a.high == b.high)
-		return a.low > b.low;
-	
-	return a.high > b.high;
+// Unsigned remainder (a % b)
+uint64_t __umoddi3(uint64_t num, uint64_t den) {
+	uint64_t rem;
+	__udivmoddi4(num, den, &rem);
+	return rem;
 }
 
-// Less than (a < b)
-bool uint64_less(uint64_t a, uint64_t b) {
-	if (a.high == b.high)
-		return a.low < b.low;
-	
-	return a.high < b.high;
+// Signed division (rounds towards zero)
+int64_t __divdi3(int64_t num, int64_t den) {
+	bool negative = (num < 0) != (den < 0);
+	uint64_t quot = __udivmoddi4((num < 0) ? -(uint64_t)num : num, (den < 0) ? -(uint64_t)den : den, NULL);
+	return negative ? -(int64_t)quot : (int64_t)quot;
 }
 
-// Equal (a == b)
-bool uint64_equal(uint64_t a, uint64_t b) {
-	return (a.high == b.high && a.low == b.low);
+// Signed remainder (has the sign of the dividend)
+int64_t __moddi3(int64_t num, int64_t den) {
+	uint64_t rem;
+	__udivmoddi4((num < 0) ? -(uint64_t)num : num, (den < 0) ? -(uint64_t)den : den, &rem);
+	return (num < 0) ? -(int64_t)rem : (int64_t)rem;
 }
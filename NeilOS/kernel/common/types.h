@@ -28,32 +28,8 @@ typedef unsigned char uint8_t;
 
 typedef char bool;
 
-// Emulate a 64 bit unsigned integer
-typedef  struct __attribute__((__packed__)) {
-	uint32_t high;
-	uint32_t low;
-} uint64_t;
-
-// Create
-uint64_t uint64_make(uint32_t high, uint32_t low);
-// Add (a + b)
-uint64_t uint64_add(uint64_t a, uint64_t b);
-// Subtract (a - b)
-uint64_t uint64_sub(uint64_t a, uint64_t b);
-// Increment (a++)
-uint64_t uint64_inc(uint64_t a);
-// Shift Left (a << bits)
-uint64_t uint64_shl(uint64_t a, uint8_t bits);
-// Shift right (a >> bits)
-uint64_t uint64_shr(uint64_t a, uint8_t bits);
-// Not (~a)
-uint64_t uint64_not(uint64_t a);
-// Greater than (a > b)
-bool uint64_greater(uint64_t a, uint64_t b);
-// Less than (a < b)
-bool uint64_less(uint64_t a, uint64_t b);
-// Equal (a == b)
-bool uint64_equal(uint64_t a, uint64_t b);
+typedef long long int64_t;
+typedef unsigned long long uint64_t;
 
 #endif /* ASM */
 
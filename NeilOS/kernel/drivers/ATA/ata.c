@@ -201,7 +201,7 @@ uint32_t ata_write(file_descriptor_t* f, const void* buf, uint32_t nbytes) {
 		return -EACCES;
 	
 	if (f->mode & FILE_MODE_APPEND)
-		ata_llseek(f, uint64_make(0, 0), SEEK_END);
+		ata_llseek(f, 0, SEEK_END);
 	return ata_partition_write(f->info, buf, nbytes);
 }
 
@@ -268,17 +268,16 @@ disk_info_t ata_open_partition(uint8_t disk, uint8_t partition) {
 	d.bus = disk / 2;
 	d.drive = disk % 2;
 	d.partition = partition;
-	d.lock = SPIN_LOCK_UNLOCKED;
+	d.lock = MUTEX_UNLOCKED;
 	
 	// Assume we are using partition 0 (because we need to read from the whole disk)
-	d.partition_offset = uint64_make(0, 0);
-	d.partition_size = uint64_shl(uint64_make(0, ata_drives[0].num_sectors), NUMBER_OF_SHIFT_BITS_IN_SECTOR);
+	d.partition_offset = 0;
+	d.partition_size = (uint64_t)ata_drives[0].num_sectors << NUMBER_OF_SHIFT_BITS_IN_SECTOR;
 	
 	// Otherwise search for the partition in the MBR partition table
 	if (partition != 0) {
 		disk_partition_t part;
-		ata_partition_llseek(&d, uint64_make(0, MBR_PARTITION_TABLE_START +
-											 (partition - 1) * sizeof(disk_partition_t)), SEEK_SET);
+		ata_partition_llseek(&d, MBR_PARTITION_TABLE_START + (partition - 1) * sizeof(disk_partition_t), SEEK_SET);
 		ata_partition_read(&d, &part, sizeof(disk_partition_t));
 				
 		// Don't open an invalid partition
@@ -288,9 +287,9 @@ disk_info_t ata_open_partition(uint8_t disk, uint8_t partition) {
 		}
 		
 		// Set the correct information
-		d.seek_offset = uint64_make(0, 0);
-		d.partition_offset = uint64_shl(uint64_make(0, part.relative_sector), NUMBER_OF_SHIFT_BITS_IN_SECTOR);
-		d.partition_size = uint64_shl(uint64_make(0, part.num_sectors), NUMBER_OF_SHIFT_BITS_IN_SECTOR);
+		d.seek_offset = 0;
+		d.partition_offset = (uint64_t)part.relative_sector << NUMBER_OF_SHIFT_BITS_IN_SECTOR;
+		d.partition_size = (uint64_t)part.num_sectors << NUMBER_OF_SHIFT_BITS_IN_SECTOR;
 	}
 
 	return d;
@@ -306,40 +305,40 @@ uint32_t ata_partition_read(disk_info_t* d, void* buf, uint32_t bytes) {
 		return 0;
 			
 	// Calculate the correct address
-	uint64_t addr = uint64_add(d->partition_offset, d->seek_offset);
-	uint64_t sector_addr = uint64_shr(addr, NUMBER_OF_SHIFT_BITS_IN_SECTOR);
+	uint64_t addr = d->partition_offset + d->seek_offset;
+	uint64_t sector_addr = addr >> NUMBER_OF_SHIFT_BITS_IN_SECTOR;
 	
 	// If we will read past the end of the partition, adjust bytes accordingly
-	if (uint64_greater(uint64_add(d->seek_offset, uint64_make(0, bytes)), d->partition_size))
-		bytes = uint64_sub(d->partition_size, d->seek_offset).low;
+	if (d->seek_offset + bytes > d->partition_size)
+		bytes = d->partition_size - d->seek_offset;
 	
 	// Get the best read function we can
 	uint32_t (*read)(uint8_t, uint8_t, uint64_t, void*, uint32_t, uint32_t, uint32_t) = ata_pio_read_blocks;
 	if (ata_drives[d->bus * 2 + d->drive].dma)
 		read = ata_dma_read_blocks;
 	
-	uint64_t end_addr = uint64_add(addr, uint64_make(0, bytes));
-	uint32_t num_sectors = uint64_sub(uint64_shr(uint64_sub(end_addr, uint64_make(0, 1)),
-				NUMBER_OF_SHIFT_BITS_IN_SECTOR), uint64_shr(addr, NUMBER_OF_SHIFT_BITS_IN_SECTOR)).low + 1;
+	uint64_t end_addr = addr + bytes;
+	uint32_t num_sectors = ((end_addr - 1) >> NUMBER_OF_SHIFT_BITS_IN_SECTOR) - (addr >> NUMBER_OF_SHIFT_BITS_IN_SECTOR) + 1;
 	uint32_t num_blocks = (num_sectors - 1) / (BLOCK_SIZE / ATA_SECTOR_SIZE) + 1;
-	int z;							// For looping over the blocks
+	uint32_t z = 0;					// For looping over the blocks
 	uint32_t copy_pos = 0;			// For keeping track where in buf we are writing
-	for (z = 0; z < num_blocks; z++) {
-		uint32_t size = BLOCK_SIZE;			// Amount of data to be copied this round
-		uint32_t b_offset = 0;				// Where to start in this block
+	while (z < num_blocks) {
+		uint32_t b_offset = (z == 0) ? ((uint32_t)addr % ATA_SECTOR_SIZE) : 0;	// Where to start in this block
+		uint32_t left = bytes - copy_pos;
+		uint32_t count = 1;					// Number of blocks read this round
+		uint32_t size;						// Amount of data to be copied this round
 		
-		// Account for the offset into the first sector
-		if (z == 0) {
-			b_offset = addr.low % ATA_SECTOR_SIZE;
-			size -= b_offset;
-		}
-		// If we are on the last block, we only need to copy the remaining amount of data
-		if (z == num_blocks - 1) {
-			size = bytes - copy_pos;
-			if (size > BLOCK_SIZE) {
-				// Something went wrong
-				return -ENOMEM;
-			}
+		if (b_offset == 0 && left >= BLOCK_SIZE) {
+			// Read a run of whole blocks with one command
+			count = left / BLOCK_SIZE;
+			if (count > ATA_MAX_TRANSFER_BLOCKS)
+				count = ATA_MAX_TRANSFER_BLOCKS;
+			size = count * BLOCK_SIZE;
+		} else {
+			// Only part of this block is needed
+			size = BLOCK_SIZE - b_offset;
+			if (size > left)
+				size = left;
 		}
 		
 		// Don't do anything if we don't need to
@@ -347,16 +346,21 @@ uint32_t ata_partition_read(disk_info_t* d, void* buf, uint32_t bytes) {
 			break;
 		
 		// Copy this data over (try to avoid copying twice if we don't have to)
-		if (read(d->bus, d->drive, sector_addr, buf + copy_pos, 1, b_offset, size) != BLOCK_SIZE)
+		if (read(d->bus, d->drive, sector_addr, buf + copy_pos, count, b_offset, size) != BLOCK_SIZE * count)
 			break;
 		
 		// Increment our positions
-		sector_addr = uint64_add(sector_addr, uint64_make(0, BLOCK_SIZE / ATA_SECTOR_SIZE));
+		sector_addr += count * (BLOCK_SIZE / ATA_SECTOR_SIZE);
 		copy_pos += size;
+		z += count;
 	}
 	
 	// Update our new seek position
-	d->seek_offset = uint64_add(d->seek_offset, uint64_make(0, copy_pos));
+	d->seek_offset += copy_pos;
+	
+	ata_drive_t* drive = &ata_drives[d->bus * 2 + d->drive];
+	drive->reads++;
+	drive->read_sectors += (copy_pos + ATA_SECTOR_SIZE - 1) >> NUMBER_OF_SHIFT_BITS_IN_SECTOR;
 	
 	// Return the number of bytes copied
 	return copy_pos;
@@ -372,13 +376,13 @@ uint32_t ata_partition_write(disk_info_t* d, const void* buf, uint32_t bytes) {
 		return 0;
 	
 	// Calculate the correct address
-	uint64_t addr = uint64_add(d->partition_offset, d->seek_offset);
-	uint64_t sector_addr = uint64_shr(addr, NUMBER_OF_SHIFT_BITS_IN_SECTOR);
+	uint64_t addr = d->partition_offset + d->seek_offset;
+	uint64_t sector_addr = addr >> NUMBER_OF_SHIFT_BITS_IN_SECTOR;
 
 		
 	// If we will write past the end of the partition, adjust bytes accordingly
-	if (uint64_greater(uint64_add(d->seek_offset, uint64_make(0, bytes)), d->partition_size))
-		bytes = uint64_sub(d->partition_size, d->seek_offset).low;
+	if (d->seek_offset + bytes > d->partition_size)
+		bytes = d->partition_size - d->seek_offset;
 	
 	// Get the best write function we can
 	uint32_t (*write)(uint8_t, uint8_t, uint64_t, const void*, uint32_t) = ata_pio_write_blocks;
@@ -393,63 +397,58 @@ uint32_t ata_partition_write(disk_info_t* d, const void* buf, uint32_t bytes) {
 	if (!temp)
 		return -ENOMEM;
 	
-	uint64_t end_addr = uint64_add(addr, uint64_make(0, bytes));
-	uint32_t num_sectors = uint64_sub(uint64_shr(uint64_sub(end_addr, uint64_make(0, 1)),
-					NUMBER_OF_SHIFT_BITS_IN_SECTOR), uint64_shr(addr, NUMBER_OF_SHIFT_BITS_IN_SECTOR)).low + 1;
+	uint64_t end_addr = addr + bytes;
+	uint32_t num_sectors = ((end_addr - 1) >> NUMBER_OF_SHIFT_BITS_IN_SECTOR) - (addr >> NUMBER_OF_SHIFT_BITS_IN_SECTOR) + 1;
 	uint32_t num_blocks = (num_sectors - 1) / (BLOCK_SIZE / ATA_SECTOR_SIZE) + 1;
-	int z;							// For looping over the blocks
+	uint32_t z = 0;					// For looping over the blocks
 	uint32_t copy_pos = 0;			// For keeping track where in buf we are writing
-	for (z = 0; z < num_blocks; z++) {
-		uint32_t size = BLOCK_SIZE;			// Amount of data to be copied this round
-		uint32_t b_offset = 0;				// Where to start in this block
+	while (z < num_blocks) {
+		uint32_t b_offset = (z == 0) ? ((uint32_t)addr % ATA_SECTOR_SIZE) : 0;	// Where to start in this block
+		uint32_t left = bytes - copy_pos;
 		
-		// Account for the offset into the first block
-		bool needs_read = false;
-		if (z == 0) {
-			b_offset = addr.low % ATA_SECTOR_SIZE;
-			size -= b_offset;
-			needs_read = true;
-		}
-		// If we are on the last block, we only need to copy the remaining amount of data
-		if (z == num_blocks - 1) {
-			size = bytes - copy_pos;
-			if (size > BLOCK_SIZE) {
-				// Something went wrong
-				kfree(temp);
-				return -ENOMEM;
-			}
-			needs_read = true;
+		if (b_offset == 0 && left >= BLOCK_SIZE) {
+			// Write a run of whole blocks directly with one command
+			uint32_t count = left / BLOCK_SIZE;
+			if (count > ATA_MAX_TRANSFER_BLOCKS)
+				count = ATA_MAX_TRANSFER_BLOCKS;
+			if (write(d->bus, d->drive, sector_addr, buf + copy_pos, count) != BLOCK_SIZE * count)
+				break;
+			
+			sector_addr += count * (BLOCK_SIZE / ATA_SECTOR_SIZE);
+			copy_pos += count * BLOCK_SIZE;
+			z += count;
+			continue;
 		}
 		
-		// Don't do anything if we don't need to
+		// Only part of this block is written, so read the rest of it into the temporary buffer
+		uint32_t size = BLOCK_SIZE - b_offset;
+		if (size > left)
+			size = left;
 		if (size == 0)
 			break;
+		if (read(d->bus, d->drive, sector_addr, temp, 1, 0, BLOCK_SIZE) != BLOCK_SIZE)
+			break;
 		
-		// Read the data into the temporary buffer if we need to
-		if (needs_read) {
-			if (read(d->bus, d->drive, sector_addr, temp, 1, 0, BLOCK_SIZE) != BLOCK_SIZE)
-				break;
-			
-			// Copy over the data we need to into the buffer then write it
-			memcpy(temp + b_offset, buf + copy_pos, size);
-			if (write(d->bus, d->drive, sector_addr, temp, 1) != BLOCK_SIZE)
-				break;
-		} else {
-			// Otherwise, just write it directly
-			if (write(d->bus, d->drive, sector_addr, buf + copy_pos, 1) != BLOCK_SIZE)
-				break;
-		}
+		// Copy over the data we need to into the buffer then write it
+		memcpy(temp + b_offset, buf + copy_pos, size);
+		if (write(d->bus, d->drive, sector_addr, temp, 1) != BLOCK_SIZE)
+			break;
 		
 		// Increment our positions
-		sector_addr = uint64_add(sector_addr, uint64_make(0, BLOCK_SIZE / ATA_SECTOR_SIZE));
+		sector_addr += BLOCK_SIZE / ATA_SECTOR_SIZE;
 		copy_pos += size;
+		z++;
 	}
 	
 	// Free our intermediate buffer
 	kfree(temp);
 	
 	// Update our new seek position
-	d->seek_offset = uint64_add(d->seek_offset, uint64_make(0, copy_pos));
+	d->seek_offset += copy_pos;
+	
+	ata_drive_t* drive = &ata_drives[d->bus * 2 + d->drive];
+	drive->writes++;
+	drive->write_sectors += (copy_pos + ATA_SECTOR_SIZE - 1) >> NUMBER_OF_SHIFT_BITS_IN_SECTOR;
 	
 	// Return the number of bytes copied
 	return copy_pos;
@@ -461,12 +460,12 @@ uint64_t ata_partition_llseek(disk_info_t* d, uint64_t offset, int whence) {
 	if (whence == SEEK_SET)
 		d->seek_offset = offset;
 	else if (whence == SEEK_CUR)
-		d->seek_offset = uint64_add(d->seek_offset, offset);
+		d->seek_offset += offset;
 	else
-		d->seek_offset = uint64_add(d->partition_size, offset);
+		d->seek_offset = d->partition_size + offset;
 	
 	// Check we still have a valid range
-	if (uint64_greater(d->seek_offset, d->partition_size))
+	if (d->seek_offset > d->partition_size)
 		d->seek_offset = d->partition_size;
 	
 	return d->seek_offset;
@@ -474,10 +473,10 @@ uint64_t ata_partition_llseek(disk_info_t* d, uint64_t offset, int whence) {
 
 // Lock the disk
 void ata_partition_lock(disk_info_t* d) {
-	spin_lock(&d->lock);
+	down(&d->lock);
 }
 
 // Unlock the disk
 void ata_partition_unlock(disk_info_t* d) {
-	spin_unlock(&d->lock);
+	up(&d->lock);
 }
@@ -9,6 +9,8 @@
 #define BLOCK_SIZE							4096
 #define NUMBER_OF_SHIFT_BITS_IN_SECTOR		9			// 512 = 2^9
 #define NUMBER_OF_SHIFT_BITS_IN_BLOCK		12			// 4096 = 2^12
+// Most blocks sent to the drive in one command (64KB, the most one DMA PRDT entry can hold)
+#define ATA_MAX_TRANSFER_BLOCKS				16
 
 // Sector size in bytes
 #define ATA_SECTOR_SIZE				512
@@ -81,6 +83,12 @@ typedef struct {
 	
 	char model[ATA_MODEL_LENGTH + 1];
 	uint32_t num_sectors;
+	
+	// Statistics
+	uint32_t reads;					// Read requests
+	uint32_t read_sectors;
+	uint32_t writes;				// Write requests
+	uint32_t write_sectors;
 } ata_drive_t;
 
 // The four possible drives
@@ -120,8 +128,8 @@ typedef struct {
 	uint64_t partition_offset;
 	uint64_t seek_offset;
 	
-	// Disk lock
-	spinlock_t lock;
+	// Disk lock (held while the DMA driver sleeps waiting for a transfer)
+	mutex_t lock;
 } disk_info_t;
 
 // Open a particular partition on a particular disk  (partion 0 is the raw disk)
@@ -13,6 +13,9 @@
 #include <common/concurrency/semaphore.h>
 #include <drivers/pci/pci.h>
 #include <drivers/filesystem/filesystem.h>
+#include <program/task.h>
+#include <program/workqueue.h>
+#include <common/time.h>
 #include "pio.h"
 
 // Relative ports for PCI DMA
@@ -41,24 +44,29 @@
 #define DMA_IRQ						0x0E
 
 #define DMA_TIMEOUT					1000000
+// How long to sleep before checking on a transfer again (in case the interrupt doesn't come)
+#define DMA_SLEEP_US				1000
 
 // Base BAR4 port
 uint32_t base_port = 0;
 
-// Buffer for data
-uint8_t sector[BLOCK_SIZE] __attribute__((aligned(BLOCK_SIZE)));
+// Buffer for data (aligned so a single PRDT entry never crosses a 64KB boundary)
+uint8_t dma_buffer[ATA_MAX_TRANSFER_BLOCKS * BLOCK_SIZE]
+	__attribute__((aligned(ATA_MAX_TRANSFER_BLOCKS * BLOCK_SIZE)));
 
 // PRDT table
 uint32_t prdt[2] __attribute__((aligned(sizeof(uint32_t) * 2)));
 
 // Let's us know whether the data transfer has completed
 volatile bool dma_data_ready = false;
+// The driver sleeps here while a transfer is going
+wait_queue_t dma_wait_queue = WAIT_QUEUE_EMPTY;
 
-// Interrupt handler for DMA's
-void ata_dma_handler() {
-	// Disable this interrupt
-	disable_irq(DMA_IRQ);
+void ata_dma_tasklet_func(void* data);
+tasklet_t ata_dma_tasklet = TASKLET_INIT(ata_dma_tasklet_func, NULL);
 	
+// Stop the transfer and clear the interrupt
+void ata_dma_complete() {
 	// Read the BusMaster status byte
 	inb(base_port + IDE_STATUS(ata_previous_drive->bus));
 	
@@ -67,14 +75,34 @@ void ata_dma_handler() {
 	
 	outb(IDE_COMMAND_STOP, base_port + IDE_COMMAND(ata_previous_drive->bus));
 	
-	// Reenable this interrupt
-	send_eoi(DMA_IRQ);
-	enable_irq(DMA_IRQ);
-	
 	// Let the driver know the data transfer is complete
 	dma_data_ready = true;
 }
 
+// Wake up the driver
+void ata_dma_tasklet_func(void* data) {
+	wait_queue_wake(&dma_wait_queue, POLLIN);
+}
+
+// Interrupt handler for DMA's (acknowledges it and leaves waking up the driver to the tasklet)
+void ata_dma_handler(int irq) {
+	ata_dma_complete();
+	tasklet_schedule(&ata_dma_tasklet);
+	
+	send_eoi(DMA_IRQ);
+}
+
+// Sleep until the interrupt says the transfer is done (or a little while has passed)
+void ata_dma_wait() {
+	wait_queue_entry_t entry;
+	wait_queue_add_current(&dma_wait_queue, &entry);
+	if (!dma_data_ready) {
+		struct timeval end = time_add(time_get(), (struct timeval){ 0, DMA_SLEEP_US });
+		thread_sleep(&end);
+	}
+	wait_queue_remove(&entry);
+}
+
 pci_device_t ide_device;
 
 // Initialize the ATA for DMA
@@ -90,18 +118,58 @@ bool ata_dma_init() {
 	return true;
 }
 
+// Send a DMA command for count blocks starting at a sector address (the PRDT must already be loaded)
+void ata_dma_send_command(uint8_t bus, uint64_t address, uint32_t count, bool write) {
+	uint32_t sectors = count * (BLOCK_SIZE / ATA_SECTOR_SIZE);
+	// outb only takes 32 bit values
+	uint32_t address_low = (uint32_t)address;
+	uint32_t address_high = (uint32_t)(address >> 32);
+	
+	// Load the address
+	if (ata_previous_drive->ext) {
+		// Send high bytes first
+		outb((sectors >> 8) & 0xFF, ATA_SECTOR_COUNT_PORT(bus));
+		outb((address_low >> 24) & 0xFF, ATA_LBA_LOW_PORT(bus));
+		outb(address_high & 0xFF, ATA_LBA_MID_PORT(bus));
+		outb((address_high >> 8) & 0xFF, ATA_LBA_HIGH_PORT(bus));
+		// Send low bytes next
+		outb(sectors & 0xFF, ATA_SECTOR_COUNT_PORT(bus));
+		outb(address_low & 0xFF, ATA_LBA_LOW_PORT(bus));
+		outb((address_low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
+		outb((address_low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
+		
+		// DMA transfer command
+		outb(write ? ATA_COMMAND_WRITE_DMA_48 : ATA_COMMAND_READ_DMA_48, ATA_COMMAND_PORT(bus));
+	} else {
+		// Info
+		outb(ATA_DRIVE_SELECT28(ata_previous_drive->drive) | ((address_low >> 24) & 0xF), ATA_DRIVE_PORT(bus));
+		outb(sectors & 0xFF, ATA_SECTOR_COUNT_PORT(bus));
+		outb(address_low & 0xFF, ATA_LBA_LOW_PORT(bus));
+		outb((address_low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
+		outb((address_low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
+		
+		// DMA transfer command
+		outb(write ? ATA_COMMAND_WRITE_DMA_28 : ATA_COMMAND_READ_DMA_28, ATA_COMMAND_PORT(bus));
+	}
+}
+
 // Read blocks from the specified sector address into a buffer (returns bytes read)
 uint32_t ata_dma_read_blocks(uint8_t bus, uint8_t drive, uint64_t address, void* buffer, uint32_t blocks,
 							 uint32_t offset, uint32_t length) {
 	uint32_t c_offset = 0, c_length = 0;
-	// Loop through all the sectors
-	int z;
-	for (z = 0; z < blocks; z++) {
+	// Transfer up to ATA_MAX_TRANSFER_BLOCKS blocks per command
+	uint32_t z = 0;
+	while (z < blocks) {
+		uint32_t count = blocks - z;
+		if (count > ATA_MAX_TRANSFER_BLOCKS)
+			count = ATA_MAX_TRANSFER_BLOCKS;
+		uint32_t size = count * BLOCK_SIZE;
+		
 		request_irq(DMA_IRQ, ata_dma_handler);
 		
-		// Tell it to use one block
-		prdt[0] = (uint32_t)sector - VM_KERNEL_ADDRESS;
-		prdt[1] = (1 << 31) | BLOCK_SIZE;
+		// One PRDT entry covers the whole transfer (a size of 0 means 64KB)
+		prdt[0] = (uint32_t)dma_buffer - VM_KERNEL_ADDRESS;
+		prdt[1] = (1 << 31) | (size & 0xFFFF);
 		outl((uint32_t)prdt - VM_KERNEL_ADDRESS, base_port + IDE_PRD_TABLE(bus));
 		
 		outb(IDE_COMMAND_STOP_READ, base_port + IDE_COMMAND(bus));
@@ -119,32 +187,7 @@ uint32_t ata_dma_read_blocks(uint8_t bus, uint8_t drive, uint64_t address, void*
 				inb(ATA_ALT_STATUS_PORT(bus));
 		}
 		
-		// Load the address
-		if (ata_previous_drive->ext) {
-			// Send high bytes first
-			outb(0, ATA_SECTOR_COUNT_PORT(bus));
-			outb((address.low >> 24) & 0xFF, ATA_LBA_LOW_PORT(bus));
-			outb((address.high >> 0) & 0xFF, ATA_LBA_MID_PORT(bus));
-			outb((address.high >> 8) & 0xFF, ATA_LBA_HIGH_PORT(bus));
-			// Send low bytes next
-			outb(BLOCK_SIZE / ATA_SECTOR_SIZE, ATA_SECTOR_COUNT_PORT(bus));
-			outb(address.low & 0xFF, ATA_LBA_LOW_PORT(bus));
-			outb((address.low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
-			outb((address.low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
-			
-			// DMA transfer command
-			outb(ATA_COMMAND_READ_DMA_48, ATA_COMMAND_PORT(bus));
-		} else {
-			// Info
-			outb(ATA_DRIVE_SELECT28(drive) | ((address.low >> 24) & 0xF), ATA_DRIVE_PORT(bus));
-			outb((BLOCK_SIZE / ATA_SECTOR_SIZE) & 0xFF, ATA_SECTOR_COUNT_PORT(bus));
-			outb((address.low >> 0) & 0xFF, ATA_LBA_LOW_PORT(bus));
-			outb((address.low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
-			outb((address.low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
-			
-			// DMA transfer command
-			outb(ATA_COMMAND_READ_DMA_28, ATA_COMMAND_PORT(bus));
-		}
+		ata_dma_send_command(bus, address, count, false);
 		
 		// Reset our done flag
 		dma_data_ready = false;
@@ -158,25 +201,27 @@ uint32_t ata_dma_read_blocks(uint8_t bus, uint8_t drive, uint64_t address, void*
 		while (!dma_data_ready)  {
 			uint8_t status = inb(ATA_ALT_STATUS_PORT(bus));
 			if (!(status & ATA_STATUS_BUSY)) {
-				ata_dma_handler();
+				ata_dma_complete();
 				break;
 			}
+			ata_dma_wait();
 		}
 		
-		// Copy over the data
+		// Copy over the part of the data that was asked for
 		uint32_t s_offset = (c_offset >= offset) ? 0 : (offset - c_offset);
-		if (s_offset < BLOCK_SIZE) {
+		if (s_offset < size) {
 			uint32_t remaining = (length > c_length) ? (length - c_length) : 0;
-			uint32_t copy_size = (remaining > BLOCK_SIZE) ? BLOCK_SIZE : remaining;
-			if (s_offset + copy_size > BLOCK_SIZE)
-				copy_size = BLOCK_SIZE - s_offset;
-			memcpy(buffer + c_length, sector + s_offset, copy_size);
+			uint32_t copy_size = (remaining > size) ? size : remaining;
+			if (s_offset + copy_size > size)
+				copy_size = size - s_offset;
+			memcpy(buffer + c_length, dma_buffer + s_offset, copy_size);
 			c_length += copy_size;
 		}
-		c_offset += BLOCK_SIZE;
+		c_offset += size;
 		
 		// Get ready for the next address
-		address = uint64_inc(address);
+		address += count * (BLOCK_SIZE / ATA_SECTOR_SIZE);
+		z += count;
 	}
 	
 	return BLOCK_SIZE * blocks;
@@ -184,9 +229,14 @@ uint32_t ata_dma_read_blocks(uint8_t bus, uint8_t drive, uint64_t address, void*
 
 // Write blocks to the specified sector address from a buffer (returns bytes written)
 uint32_t ata_dma_write_blocks(uint8_t bus, uint8_t drive, uint64_t address, const void* buffer, uint32_t blocks) {
-	// Loop through all the sectors
-	int z;
-	for (z = 0; z < blocks; z++) {
+	// Transfer up to ATA_MAX_TRANSFER_BLOCKS blocks per command
+	uint32_t z = 0;
+	while (z < blocks) {
+		uint32_t count = blocks - z;
+		if (count > ATA_MAX_TRANSFER_BLOCKS)
+			count = ATA_MAX_TRANSFER_BLOCKS;
+		uint32_t size = count * BLOCK_SIZE;
+		
 		request_irq(DMA_IRQ, ata_dma_handler);
 		
 		// Check if we need to rechoose the correct bus
@@ -200,9 +250,9 @@ uint32_t ata_dma_write_blocks(uint8_t bus, uint8_t drive, uint64_t address, cons
 				inb(ATA_STATUS_PORT(bus));
 		}
 		
-		// Tell it to use one block
-		prdt[0] = (uint32_t)sector - VM_KERNEL_ADDRESS;
-		prdt[1] = (1 << 31) | BLOCK_SIZE;
+		// One PRDT entry covers the whole transfer (a size of 0 means 64KB)
+		prdt[0] = (uint32_t)dma_buffer - VM_KERNEL_ADDRESS;
+		prdt[1] = (1 << 31) | (size & 0xFFFF);
 		
 		// Load the info
 		outl((uint32_t)prdt - VM_KERNEL_ADDRESS, base_port + IDE_PRD_TABLE(bus));
@@ -213,34 +263,9 @@ uint32_t ata_dma_write_blocks(uint8_t bus, uint8_t drive, uint64_t address, cons
 		dma_data_ready = false;
 		
 		// Copy over the data
-		memcpy(sector, buffer + (z * BLOCK_SIZE), BLOCK_SIZE);
+		memcpy(dma_buffer, buffer + (z * BLOCK_SIZE), size);
 		
-		// Load the address
-		if (ata_previous_drive->ext) {
-			// Send high bytes first
-			outb(0, ATA_SECTOR_COUNT_PORT(bus));
-			outb((address.low >> 24) & 0xFF, ATA_LBA_LOW_PORT(bus));
-			outb((address.high >> 0) & 0xFF, ATA_LBA_MID_PORT(bus));
-			outb((address.high >> 8) & 0xFF, ATA_LBA_HIGH_PORT(bus));
-			// Send low bytes next
-			outb(BLOCK_SIZE / ATA_SECTOR_SIZE, ATA_SECTOR_COUNT_PORT(bus));
-			outb(address.low & 0xFF, ATA_LBA_LOW_PORT(bus));
-			outb((address.low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
-			outb((address.low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
-			
-			// DMA transfer command
-			outb(ATA_COMMAND_WRITE_DMA_48, ATA_COMMAND_PORT(bus));
-		} else {
-			// Info
-			outb(ATA_DRIVE_SELECT28(drive) | ((address.low >> 24) & 0xF), ATA_DRIVE_PORT(bus));
-			outb((BLOCK_SIZE / ATA_SECTOR_SIZE) & 0xFF, ATA_SECTOR_COUNT_PORT(bus));
-			outb((address.low >> 0) & 0xFF, ATA_LBA_LOW_PORT(bus));
-			outb((address.low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
-			outb((address.low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
-			
-			// DMA transfer command
-			outb(ATA_COMMAND_WRITE_DMA_28, ATA_COMMAND_PORT(bus));
-		}
+		ata_dma_send_command(bus, address, count, true);
 		
 		// Start Bus Master command
 		outb(IDE_COMMAND_START_WRITE, base_port + IDE_COMMAND(bus));
@@ -253,10 +278,12 @@ uint32_t ata_dma_write_blocks(uint8_t bus, uint8_t drive, uint64_t address, cons
 				return BLOCK_SIZE * z;
 			if (!(status & ATA_STATUS_BUSY))
 				break;
+			ata_dma_wait();
 		}
 		
 		// Get ready for the next address
-		address = uint64_inc(address);
+		address += count * (BLOCK_SIZE / ATA_SECTOR_SIZE);
+		z += count;
 	}
 	
 	return BLOCK_SIZE * blocks;
@@ -6,6 +6,7 @@
 #include <common/concurrency/semaphore.h>
 #include <drivers/filesystem/filesystem.h>
 #include <drivers/pci/pci.h>
+#include <program/workqueue.h>
 
 #define PIO_IRQ					0x0E
 
@@ -19,13 +20,23 @@
 #define MAX_BLOCK_READ_COUNT		(1024 * 8)
 
 bool pio_has_error = false;
+uint8_t pio_error = 0;
 
-void ata_pio_handler() {
+void ata_pio_tasklet_func(void* data);
+tasklet_t ata_pio_tasklet = TASKLET_INIT(ata_pio_tasklet_func, NULL);
+
+// Report an error the interrupt saw
+void ata_pio_tasklet_func(void* data) {
+	printf("ATA error - 0x%x\n", pio_error);
+}
+
+// Reading the status acknowledges the interrupt (errors are printed by the tasklet)
+void ata_pio_handler(int irq) {
 	uint32_t val = inb(ATA_STATUS_PORT(ata_previous_drive->bus));
 	if (val & ATA_STATUS_ERROR) {
-		uint8_t error = inb(ATA_ERROR_PORT(ata_previous_drive->bus));
-		printf("ATA error - 0x%x\n", error);
+		pio_error = inb(ATA_ERROR_PORT(ata_previous_drive->bus));
 		pio_has_error = true;
+		tasklet_schedule(&ata_pio_tasklet);
 	}
 	
 	send_eoi(PIO_IRQ);
@@ -83,29 +94,32 @@ uint32_t ata_pio_read_blocks(uint8_t bus, uint8_t drive, uint64_t address, void*
 		ata_pio_poll(bus);
 	}
 	
+	// outb only takes 32 bit values
+	uint32_t address_low = (uint32_t)address;
+	uint32_t address_high = (uint32_t)(address >> 32);
 	uint32_t max_sectors = ata_previous_drive->ext ? 0x10000 : 0x100;
 	if (ata_previous_drive->ext) {
 		// Send the high bytes first
 		outb((sectors >> 8) & 0xFF, ATA_SECTOR_COUNT_PORT(bus));
-		outb((address.low >> 24) & 0xFF, ATA_LBA_LOW_PORT(bus));
-		outb((address.high >> 0) & 0xFF, ATA_LBA_MID_PORT(bus));
-		outb((address.high >> 8) & 0xFF, ATA_LBA_HIGH_PORT(bus));
+		outb((address_low >> 24) & 0xFF, ATA_LBA_LOW_PORT(bus));
+		outb(address_high & 0xFF, ATA_LBA_MID_PORT(bus));
+		outb((address_high >> 8) & 0xFF, ATA_LBA_HIGH_PORT(bus));
 
 		// Send low bytes next
 		outb(sectors & 0xFF, ATA_SECTOR_COUNT_PORT(bus));
-		outb((address.low >> 0) & 0xFF, ATA_LBA_LOW_PORT(bus));
-		outb((address.low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
-		outb((address.low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
+		outb(address_low & 0xFF, ATA_LBA_LOW_PORT(bus));
+		outb((address_low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
+		outb((address_low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
 		
 		// Send the command
 		outb(ATA_READ_SECTORS_EXT, ATA_COMMAND_PORT(bus));
 	} else {
 		// Send the data
-		outb(ATA_DRIVE_SELECT28(drive) | ((address.low >> 24) & 0xF), ATA_DRIVE_PORT(bus));
+		outb(ATA_DRIVE_SELECT28(drive) | ((address_low >> 24) & 0xF), ATA_DRIVE_PORT(bus));
 		outb(sectors & 0xFF, ATA_SECTOR_COUNT_PORT(bus));
-		outb((address.low >> 0) & 0xFF, ATA_LBA_LOW_PORT(bus));
-		outb((address.low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
-		outb((address.low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
+		outb(address_low & 0xFF, ATA_LBA_LOW_PORT(bus));
+		outb((address_low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
+		outb((address_low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
 		
 		// Send the command
 		outb(ATA_READ_SECTORS, ATA_COMMAND_PORT(bus));
@@ -162,29 +176,32 @@ uint32_t ata_pio_write_blocks(uint8_t bus, uint8_t drive, uint64_t address, cons
 		ata_pio_poll(bus);
 	}
 	
+	// outb only takes 32 bit values
+	uint32_t address_low = (uint32_t)address;
+	uint32_t address_high = (uint32_t)(address >> 32);
 	uint32_t max_sectors = ata_previous_drive->ext ? 0x10000 : 0x100;
 	if (ata_previous_drive->ext) {
 		// Send the high bytes first
 		outb((sectors >> 8) & 0xFF, ATA_SECTOR_COUNT_PORT(bus));
-		outb((address.low >> 24) & 0xFF, ATA_LBA_LOW_PORT(bus));
-		outb((address.high >> 0) & 0xFF, ATA_LBA_MID_PORT(bus));
-		outb((address.high >> 8) & 0xFF, ATA_LBA_HIGH_PORT(bus));
+		outb((address_low >> 24) & 0xFF, ATA_LBA_LOW_PORT(bus));
+		outb(address_high & 0xFF, ATA_LBA_MID_PORT(bus));
+		outb((address_high >> 8) & 0xFF, ATA_LBA_HIGH_PORT(bus));
 		
 		// Send low bytes next
 		outb(sectors & 0xFF, ATA_SECTOR_COUNT_PORT(bus));
-		outb((address.low >> 0) & 0xFF, ATA_LBA_LOW_PORT(bus));
-		outb((address.low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
-		outb((address.low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
+		outb(address_low & 0xFF, ATA_LBA_LOW_PORT(bus));
+		outb((address_low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
+		outb((address_low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
 		
 		// Send the command
 		outb(ATA_WRITE_SECTORS_EXT, ATA_COMMAND_PORT(bus));
 	} else {
 		// Send the data
-		outb(ATA_DRIVE_SELECT28(drive) | ((address.low >> 24) & 0xF), ATA_DRIVE_PORT(bus));
+		outb(ATA_DRIVE_SELECT28(drive) | ((address_low >> 24) & 0xF), ATA_DRIVE_PORT(bus));
 		outb(sectors & 0xFF, ATA_SECTOR_COUNT_PORT(bus));
-		outb((address.low >> 0) & 0xFF, ATA_LBA_LOW_PORT(bus));
-		outb((address.low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
-		outb((address.low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
+		outb(address_low & 0xFF, ATA_LBA_LOW_PORT(bus));
+		outb((address_low >> 8) & 0xFF, ATA_LBA_MID_PORT(bus));
+		outb((address_low >> 16) & 0xFF, ATA_LBA_HIGH_PORT(bus));
 		
 		// Send the command
 		outb(ATA_WRITE_SECTORS, ATA_COMMAND_PORT(bus));
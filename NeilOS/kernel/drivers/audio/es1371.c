@@ -11,6 +11,7 @@
 #include <memory/memory.h>
 #include <drivers/pic/i8259.h>
 #include <syscalls/interrupt.h>
+#include <program/workqueue.h>
 
 #define CONTROL					0x00
 #define STATUS					0x04
@@ -81,6 +82,10 @@ uint32_t num_devices_open = 0;
 mutex_t devices_open_lock = MUTEX_UNLOCKED;
 spinlock_t sound_lock = SPIN_LOCK_UNLOCKED;
 bool sound_first = true;
+wait_queue_t sound_wait_queue = WAIT_QUEUE_EMPTY;
+
+void es_tasklet_func(void* data);
+tasklet_t es_tasklet = TASKLET_INIT(es_tasklet_func, NULL);
 
 uint32_t es_base_port = 0;
 es_dev_type es_type = ES1370;
@@ -150,19 +155,8 @@ void set_sample_rate(uint32_t rate) {
 	}
 }
 
-void es_handler(int irq) {
-	if (!((inl(es_base_port + STATUS) >> 1) & 0x1)) {
-		send_eoi(irq);
-		return;
-	}
-	
-	// Disable this interrupt
-	disable_irq(irq);
-	
-	uint32_t val = inl(es_base_port + SERIAL_INTERFACE);
-	outl(val & ~SI_INT, es_base_port + SERIAL_INTERFACE);
-	outl(val | SI_INT, es_base_port + SERIAL_INTERFACE);
-	
+// Move on to the next buffer after one has finished playing
+void es_tasklet_func(void* data) {
 	// Make writes happen on the buffer that just played
 	uint32_t samples_left = inl(es_base_port + PLAYBACK2_BUFFER_DEF) >> 16;
 	buffer_index = ((NUM_SECTIONS * samples_left) / (NUM_SAMPLES - 1)) - 1;
@@ -173,10 +167,24 @@ void es_handler(int irq) {
 	
 	// Let readers know we are ready for the next batch of data
 	sound_buffer_id++;
+	wait_queue_wake(&sound_wait_queue, POLLIN);
+}
+
+// Acknowledge the interrupt and leave the rest to the tasklet
+void es_handler(int irq) {
+	if (!((inl(es_base_port + STATUS) >> 1) & 0x1)) {
+		send_eoi(irq);
+		return;
+	}
+	
+	uint32_t val = inl(es_base_port + SERIAL_INTERFACE);
+	outl(val & ~SI_INT, es_base_port + SERIAL_INTERFACE);
+	outl(val | SI_INT, es_base_port + SERIAL_INTERFACE);
+	
+	tasklet_schedule(&es_tasklet);
 	
 	// Say the we've handled this interrupt
 	send_eoi(irq);
-	enable_irq(irq);
 }
 
 void es_init() {
@@ -288,13 +296,19 @@ file_descriptor_t* es_open(const char* filename, uint32_t mode) {
 uint32_t es_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
 	int id = sound_buffer_id;
 	pcb_t* pcb = current_pcb;
+	wait_queue_entry_t entry;
+	wait_queue_add_current(&sound_wait_queue, &entry);
 	while (id == sound_buffer_id && !(pcb && pcb->should_terminate) && !f->closed) {
-		if (signal_occurring(pcb))
+		if (signal_occurring(pcb)) {
+			wait_queue_remove(&entry);
 			return -EINTR;
+		}
 		up(&f->lock);
-		schedule();
+		thread_sleep(NULL);
 		down(&f->lock);
+		thread_sleep_prepare();
 	}
+	wait_queue_remove(&entry);
 	
 	return SECTION_SIZE * sizeof(int16_t);
 }
@@ -337,7 +351,7 @@ uint32_t es_stat(file_descriptor_t* f, sys_stat_type* data) {
 
 // Seek (returns error)
 uint64_t es_llseek(file_descriptor_t* f, uint64_t offset, int whence) {
-	return uint64_make(-1, -ESPIPE);
+	return (uint64_t)-ESPIPE;
 }
 
 // set_volume(double volume [0:1])
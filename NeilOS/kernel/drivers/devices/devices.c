@@ -46,8 +46,8 @@ bool devices_init() {
 		fclose(&file);
 		return false;
 	}
-	uint32_t num = 	fseek(&file, uint64_make(0, 0), SEEK_END).low;
-	fseek(&file, uint64_make(0, 2), SEEK_SET);
+	uint32_t num = 	(uint32_t)fseek(&file, 0, SEEK_END);
+	fseek(&file, 2, SEEK_SET);
 	while (num != 2) {
 		fread(buffer, 512, 1, &file);
 		char* path = path_append(prefix, buffer);
@@ -62,7 +62,7 @@ bool devices_init() {
 		}
 		fclose(&f);
 		kfree(path);
-		num = fseek(&file, uint64_make(0, 2), SEEK_SET).low;
+		num = (uint32_t)fseek(&file, 2, SEEK_SET);
 	}
 	kfree(buffer);
 	fclose(&file);
@@ -48,7 +48,7 @@ uint32_t zero_write(file_descriptor_t* f, const void* buf, uint32_t nbytes) {
 
 // Seek
 uint64_t zero_llseek(file_descriptor_t* f, uint64_t offset, int whence) {
-	return uint64_make(0, 0);
+	return 0;
 }
 
 // Get info
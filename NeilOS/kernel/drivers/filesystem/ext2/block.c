@@ -10,6 +10,29 @@
 #include <drivers/ATA/ata.h>
 #include <memory/allocation/heap.h>
 #include "ext2.h"
+#include "cache.h"
+#include <common/concurrency/semaphore.h>
+#include <common/lib.h>
+
+// In memory copy of a group's block bitmap
+typedef struct {
+	uint8_t* bitmap;					// Loaded the first time the group is used
+	uint32_t free_blocks;
+	uint32_t next_free;					// No blocks before this one are free
+} ext2_group_alloc_t;
+
+// Free blocks set aside for an inode that is being appended to (they aren't marked as used on the disk)
+typedef struct {
+	uint32_t inode;
+	uint32_t start;
+	uint32_t count;
+} ext2_reservation_t;
+
+ext2_group_alloc_t* group_alloc = NULL;
+uint32_t num_alloc_groups = 0;
+ext2_reservation_t reservations[EXT2_BALLOC_NUM_RESERVATIONS];
+uint32_t next_reservation = 0;
+mutex_t alloc_lock = MUTEX_UNLOCKED;
 
 // Internal methods
 bool ext2_allocate_indirect_block(uint32_t first_block_id, uint32_t* output_block_id);
@@ -19,16 +42,12 @@ ext_block_group_descriptor_t ext2_get_block_group_info(uint32_t block_group) {
 	ext_block_group_descriptor_t info;
 	
 	// The block descriptors are in the block after the super block
-	uint64_t addr = uint64_shl(uint64_make(0, ext2_superblock()->first_data_block + 1),
-							   EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
+	uint64_t addr = ext2_get_block_address(ext2_superblock()->first_data_block + 1);
 	// Offset to the correct block group description
-	addr = uint64_add(addr, uint64_make(0, sizeof(ext_block_group_descriptor_t) * block_group));
+	addr += sizeof(ext_block_group_descriptor_t) * block_group;
 	
 	// Read the info
-	ata_partition_lock(ext2_fs());
-	ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-	ata_partition_read(ext2_fs(), &info, sizeof(ext_block_group_descriptor_t));
-	ata_partition_unlock(ext2_fs());
+	ext2_cache_read(addr, &info, sizeof(ext_block_group_descriptor_t), true);
 	
 	return info;
 }
@@ -36,33 +55,15 @@ ext_block_group_descriptor_t ext2_get_block_group_info(uint32_t block_group) {
 // Set information about a block group
 void ext2_set_block_group_info(uint32_t block_group, ext_block_group_descriptor_t* data) {
 	// The block descriptors are in the block after the super block
-	uint64_t addr = uint64_shl(uint64_make(0, ext2_superblock()->first_data_block + 1),
-							   EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
+	uint64_t addr = ext2_get_block_address(ext2_superblock()->first_data_block + 1);
 	// Offset to the correct block group description
-	addr = uint64_add(addr, uint64_make(0, sizeof(ext_block_group_descriptor_t) * block_group));
+	addr += sizeof(ext_block_group_descriptor_t) * block_group;
 	
 	// Write the info
-	ata_partition_lock(ext2_fs());
-	ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-	ata_partition_write(ext2_fs(), data, sizeof(ext_block_group_descriptor_t));
-	ata_partition_unlock(ext2_fs());
+	ext2_cache_write(addr, data, sizeof(ext_block_group_descriptor_t), EXT2_CACHE_METADATA);
 	
-	// Backup blocks are located at groups 1, and then powers of 3, 5, and 7
-	uint32_t num_groups = 1 + ((ext2_superblock()->block_count - 1) / ext2_superblock()->blocks_per_group);
-	uint32_t group;
-	for (group = 1; group < num_groups; group++) {
-		if (!(group == 1 || (group % 3) == 0 || (group % 5) == 0 || (group % 7) == 0))
-			continue;
-		
-		// Update the backup
-		addr = uint64_shl(uint64_make(0, ext2_superblock()->first_data_block + 1 + group * ext2_superblock()->blocks_per_group),
-						  EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
-		addr = uint64_add(addr, uint64_make(0, sizeof(ext_block_group_descriptor_t) * block_group));
-		ata_partition_lock(ext2_fs());
-		ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-		ata_partition_write(ext2_fs(), data, sizeof(ext_block_group_descriptor_t));
-		ata_partition_unlock(ext2_fs());
-	}
+	// The backup copies are written later by the flusher thread or a sync
+	ext2_set_backups_dirty();
 }
 
 // Return the nth block index in the block array for an inode.
@@ -80,14 +81,18 @@ uint32_t ext2_get_block_id_at_index(ext_inode_t* inode, uint32_t index) {
 	index -= total_blocks - 1;
 	total_blocks = 1;
 	
-	// Return our cached version if it is saved
+	// Return our cached version if it is saved (if someone else is using it, just skip it)
 	uint32_t original_index = index - 1;
-	if (inode->cached_block && inode->cached_block_starting_index <= original_index &&
-		inode->cached_block_starting_index + num_entries > original_index)
-		return inode->cached_block[original_index - inode->cached_block_starting_index];
+	bool use_cache = spin_trylock(&inode->cached_block_lock);
+	if (use_cache && inode->cached_block && inode->cached_block_starting_index <= original_index &&
+		inode->cached_block_starting_index + num_entries > original_index) {
+		uint32_t ret = inode->cached_block[original_index - inode->cached_block_starting_index];
+		spin_unlock(&inode->cached_block_lock);
+		return ret;
+	}
 	
 	// Try to allocate a cached block inode
-	if (!inode->cached_block)
+	if (use_cache && !inode->cached_block)
 		inode->cached_block = kmalloc(block_size);
 	
 	// Check for indirect blocks
@@ -104,36 +109,40 @@ uint32_t ext2_get_block_id_at_index(ext_inode_t* inode, uint32_t index) {
 			for (z = 0; z < depth; z++) {
 				uint32_t read_size = sizeof(uint32_t);
 				uint32_t* read_dest = &read_block;
-				uint64_t block_offset = uint64_shl(uint64_make(0, block / divisor), INDEX_SIZE_BITS);
-				if (z == depth - 1 && inode->cached_block) {
+				uint32_t block_offset = (block / divisor) << INDEX_SIZE_BITS;
+				if (z == depth - 1 && use_cache && inode->cached_block) {
 					// Read the block into our cache
 					read_size = block_size;
 					read_dest = inode->cached_block;
 					inode->cached_block_starting_index = original_index - (original_index % num_entries);
-					block_offset = uint64_make(0, 0);
+					block_offset = 0;
 				}
 				
 				// Read the next block index
 				uint64_t addr = ext2_get_block_address(read_block);
-				addr = uint64_add(addr, block_offset);
-				ata_partition_lock(ext2_fs());
-				ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-				ata_partition_read(ext2_fs(), read_dest, read_size);
-				ata_partition_unlock(ext2_fs());
+				addr += block_offset;
+				ext2_cache_read(addr, read_dest, read_size, true);
 				
-				if (z == depth - 1 && inode->cached_block)
-					return inode->cached_block[block / divisor];
+				if (z == depth - 1 && use_cache && inode->cached_block) {
+					uint32_t ret = inode->cached_block[block / divisor];
+					spin_unlock(&inode->cached_block_lock);
+					return ret;
+				}
 				
 				// Update to the next index
 				block %= divisor;
 				divisor /= num_entries;
 			}
 			
+			if (use_cache)
+				spin_unlock(&inode->cached_block_lock);
 			return read_block;
 		}
 	}
 	
 	// No valid block found
+	if (use_cache)
+		spin_unlock(&inode->cached_block_lock);
 	return EXT2_BLOCK_ID_INVALID;
 }
 
@@ -201,19 +210,16 @@ bool ext2_set_block_id_at_index(ext_inode_t* inode, uint32_t index, uint32_t blo
 			// Update the correct entry
 			divisor = total_blocks / num_entries;
 			for (z = 0; z < depth; z++) {
-				ata_partition_lock(ext2_fs());
-				ata_partition_llseek(ext2_fs(), uint64_add(ext2_get_block_address(last_block),
-														   uint64_make(0, (index / divisor) * sizeof(uint32_t))), SEEK_SET);
+				uint64_t addr = ext2_get_block_address(last_block) + (index / divisor) * sizeof(uint32_t);
 				
 				uint32_t old_block = last_block;
 				
 				// Write instead of read on the last one
 				if (z == (depth - 1)) {
-					ata_partition_write(ext2_fs(), &block_id, sizeof(uint32_t));
+					ext2_cache_write(addr, &block_id, sizeof(uint32_t), EXT2_CACHE_METADATA);
 				}
 				else
-					ata_partition_read(ext2_fs(), &last_block, sizeof(uint32_t));
-				ata_partition_unlock(ext2_fs());
+					ext2_cache_read(addr, &last_block, sizeof(uint32_t), true);
 				
 				// Delete the indirect block if we need to
 				if ((index / divisor) == 0 && block_id == EXT2_BLOCK_ID_INVALID)
@@ -234,16 +240,15 @@ bool ext2_set_block_id_at_index(ext_inode_t* inode, uint32_t index, uint32_t blo
 
 // Get the byte address of a block
 uint64_t ext2_get_block_address(uint32_t block_id) {
-	return uint64_shl(uint64_make(0, block_id),
-					  EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
+	return (uint64_t)block_id << (EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
 }
 
 /* Block Allocation */
 
 // Allocates a block and set's the first entry of that block to first_block_id
 bool ext2_allocate_indirect_block(uint32_t first_block_id, uint32_t* output_block_id) {
-	// Allocate a new block
-	uint32_t block = ext2_allocate_block();
+	// Allocate a new block (next to the block it points to)
+	uint32_t block = ext2_allocate_block_near(first_block_id);
 	if (block == EXT2_BLOCK_ID_INVALID)
 		return false;
 	
@@ -258,10 +263,7 @@ bool ext2_allocate_indirect_block(uint32_t first_block_id, uint32_t* output_bloc
 	// Set this single indirect block
 	memset(data, 0, block_size);
 	data[0] = first_block_id;
-	ata_partition_lock(ext2_fs());
-	ata_partition_llseek(ext2_fs(), ext2_get_block_address(block), SEEK_SET);
-	ata_partition_write(ext2_fs(), data, block_size);
-	ata_partition_unlock(ext2_fs());
+	ext2_cache_write(ext2_get_block_address(block), data, block_size, EXT2_CACHE_METADATA);
 	
 	*output_block_id = block;
 	
@@ -269,130 +271,306 @@ bool ext2_allocate_indirect_block(uint32_t first_block_id, uint32_t* output_bloc
 	return true;
 }
 
-// Allocate a new block for use in an inode.
-// Returns the block id of this block or an invalid block id if nothing could be allocated
-uint32_t ext2_allocate_block() {
-	// We can't allocate any if no blocks are free
-	if (ext2_superblock()->free_block_count == 0)
-		return EXT2_BLOCK_ID_INVALID;
-	
-	uint32_t block_size = 1 << (EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
-	uint32_t* bitmap = (uint32_t*)kmalloc(block_size);
-	if (!bitmap)
-		return EXT2_BLOCK_ID_INVALID;
+// Set up the block allocator
+bool ext2_block_alloc_init() {
+	ext_superblock_t* sb = ext2_superblock();
+	num_alloc_groups = (sb->block_count - sb->first_data_block + sb->blocks_per_group - 1) / sb->blocks_per_group;
+	group_alloc = (ext2_group_alloc_t*)kmalloc(sizeof(ext2_group_alloc_t) * num_alloc_groups);
+	if (!group_alloc)
+		return false;
 	
-	// Find the first free block by looping over all the descriptors
+	// The bitmaps are loaded when they are needed, but the free counts are needed to skip full groups
 	uint32_t group;
-	uint32_t num_groups = 1 + ((ext2_superblock()->block_count - 1) / ext2_superblock()->blocks_per_group);
-	uint32_t blocks_per_bitmap_group = 1 << (EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size + 3);	// block_size * 8
-	uint32_t bitmap_blocks_per_group = ((ext2_superblock()->blocks_per_group - 1) >>	// (blocks per group - 1) / (block size * 8) + 1
-										(EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size + 3)) + 1;
-	for (group = 0; group < num_groups; group++) {
-		ext_block_group_descriptor_t desc = ext2_get_block_group_info(group);
-		if (desc.free_blocks == 0)
+	for (group = 0; group < num_alloc_groups; group++) {
+		group_alloc[group].bitmap = NULL;
+		group_alloc[group].free_blocks = ext2_get_block_group_info(group).free_blocks;
+		group_alloc[group].next_free = 0;
+	}
+	memset(reservations, 0, sizeof(reservations));
+	
+	return true;
+}
+
+// Number of blocks in a group (the last one may be short)
+uint32_t balloc_group_size(uint32_t group) {
+	ext_superblock_t* sb = ext2_superblock();
+	uint32_t remaining = sb->block_count - sb->first_data_block - group * sb->blocks_per_group;
+	return (remaining < sb->blocks_per_group) ? remaining : sb->blocks_per_group;
+}
+
+// Size in bytes of a group's bitmap
+uint32_t balloc_bitmap_size() {
+	uint32_t bits = EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size;
+	return (((ext2_superblock()->blocks_per_group - 1) >> (bits + 3)) + 1) << bits;
+}
+
+static inline bool balloc_test(uint8_t* bitmap, uint32_t bit) {
+	return (bitmap[bit / 8] >> (bit % 8)) & 0x1;
+}
+
+// Load a group's bitmap into memory (alloc_lock must be held)
+bool balloc_load_group(uint32_t group) {
+	ext2_group_alloc_t* g = &group_alloc[group];
+	if (g->bitmap)
+		return true;
+	
+	uint32_t block_size = ext2_get_block_size();
+	uint32_t size = balloc_bitmap_size();
+	g->bitmap = (uint8_t*)kmalloc(size);
+	if (!g->bitmap)
+		return false;
+	
+	ext_block_group_descriptor_t desc = ext2_get_block_group_info(group);
+	uint32_t z;
+	for (z = 0; z < size / block_size; z++) {
+		if (ext2_cache_read(ext2_get_block_address(desc.block_bitmap + z), &g->bitmap[z * block_size],
+							block_size, true) != block_size) {
+			kfree(g->bitmap);
+			g->bitmap = NULL;
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+// Returns true if a block is reserved for an inode other than owner (alloc_lock must be held)
+bool balloc_reserved(uint32_t block_id, uint32_t owner) {
+	uint32_t z;
+	for (z = 0; z < EXT2_BALLOC_NUM_RESERVATIONS; z++) {
+		ext2_reservation_t* r = &reservations[z];
+		if (r->count != 0 && r->inode != owner && block_id >= r->start && block_id < r->start + r->count)
+			return true;
+	}
+	
+	return false;
+}
+
+// Find an inode's reservation (alloc_lock must be held)
+ext2_reservation_t* balloc_find_reservation(uint32_t inode) {
+	uint32_t z;
+	for (z = 0; z < EXT2_BALLOC_NUM_RESERVATIONS; z++) {
+		if (reservations[z].count != 0 && reservations[z].inode == inode)
+			return &reservations[z];
+	}
+	
+	return NULL;
+}
+
+// Find a free block in a group between two bits (alloc_lock must be held). Returns -1 if there isn't one
+int32_t balloc_find(uint32_t group, uint32_t start, uint32_t end, uint32_t owner) {
+	uint8_t* bitmap = group_alloc[group].bitmap;
+	uint32_t base = ext2_superblock()->first_data_block + group * ext2_superblock()->blocks_per_group;
+	uint32_t bit = start;
+	while (bit < end) {
+		// Skip over full bytes
+		if ((bit % 8) == 0 && bitmap[bit / 8] == 0xFF) {
+			bit += 8;
 			continue;
+		}
 		
-		// Search for the block in this group that is free
-		uint32_t bitmap_block;
-		for (bitmap_block = desc.block_bitmap; bitmap_block < desc.block_bitmap + bitmap_blocks_per_group; bitmap_block++) {
-			// Read the bitmap
-			ata_partition_lock(ext2_fs());
-			ata_partition_llseek(ext2_fs(), ext2_get_block_address(bitmap_block), SEEK_SET);
-			if (ata_partition_read(ext2_fs(), bitmap, block_size) == -1) {
-				// Error
-				ata_partition_unlock(ext2_fs());
-				kfree(bitmap);
-				return EXT2_BLOCK_ID_INVALID;
-			}
-			ata_partition_unlock(ext2_fs());
-			
-			// Check each block in the bitmap
-			uint32_t blocks;
-			for (blocks = 0; blocks < ext2_superblock()->blocks_per_group / (sizeof(uint32_t) * 8); blocks++) {
-				// If these blocks are taken, don't consider
-				if (bitmap[blocks] == (uint32_t)-1)
-					continue;
-				
-				// Find the first free block
-				uint32_t z;
-				for (z = 0; z < sizeof(uint32_t) * 8; z++) {
-					if ((bitmap[blocks] >> z) & 0x1)
-						continue;
-					
-					// Get which block id this corresponds to
-					uint32_t ret = ext2_superblock()->blocks_per_group * group +
-					(bitmap_block - desc.block_bitmap) * blocks_per_bitmap_group +
-					blocks * sizeof(uint32_t) * 8 + z + ext2_superblock()->first_data_block;
-					
-					// Mark this block as used
-					bitmap[blocks] |= 1 << z;
-					ata_partition_lock(ext2_fs());
-					ata_partition_llseek(ext2_fs(), ext2_get_block_address(bitmap_block), SEEK_SET);
-					ata_partition_write(ext2_fs(), bitmap, block_size);
-					ata_partition_unlock(ext2_fs());
-					
-					// Update the block group descriptor
-					desc.free_blocks--;
-					ext2_set_block_group_info(group, &desc);
-					
-					// Update the super block
-					ext2_superblock()->free_block_count--;
-					ext2_set_superblock();
-										
-					// We are done
-					kfree(bitmap);
-					return ret;
-				}
-			}
+		if (!balloc_test(bitmap, bit) && !balloc_reserved(base + bit, owner))
+			return bit;
+		bit++;
+	}
+	
+	return -1;
+}
+
+// Mark a block as used or free and update the counts (alloc_lock must be held)
+void balloc_mark(uint32_t group, uint32_t bit, bool used) {
+	ext2_group_alloc_t* g = &group_alloc[group];
+	uint32_t block_size = ext2_get_block_size();
+	if (used)
+		g->bitmap[bit / 8] |= 1 << (bit % 8);
+	else
+		g->bitmap[bit / 8] &= ~(1 << (bit % 8));
+	
+	// Write back the bitmap block that changed
+	ext_block_group_descriptor_t desc = ext2_get_block_group_info(group);
+	uint32_t index = bit / (block_size * 8);
+	ext2_cache_write(ext2_get_block_address(desc.block_bitmap + index), &g->bitmap[index * block_size],
+					 block_size, EXT2_CACHE_METADATA);
+	
+	// Update the counts and the hint
+	if (used) {
+		desc.free_blocks--;
+		g->free_blocks--;
+		ext2_superblock()->free_block_count--;
+		if (bit == g->next_free) {
+			uint32_t size = balloc_group_size(group);
+			while (g->next_free < size && balloc_test(g->bitmap, g->next_free))
+				g->next_free++;
 		}
+	} else {
+		desc.free_blocks++;
+		g->free_blocks++;
+		ext2_superblock()->free_block_count++;
+		if (bit < g->next_free)
+			g->next_free = bit;
+	}
+	ext2_set_block_group_info(group, &desc);
+	ext2_set_superblock();
+}
+
+// Allocate a free block as close to goal as possible (alloc_lock must be held)
+uint32_t balloc_allocate(uint32_t goal, uint32_t owner) {
+	ext_superblock_t* sb = ext2_superblock();
+	if (sb->free_block_count == 0)
+		return EXT2_BLOCK_ID_INVALID;
+	
+	uint32_t goal_group = 0, goal_bit = 0;
+	if (goal >= sb->first_data_block && goal < sb->block_count) {
+		goal_group = (goal - sb->first_data_block) / sb->blocks_per_group;
+		goal_bit = (goal - sb->first_data_block) % sb->blocks_per_group;
+	}
+	
+	// Start with the goal's group and move on to the groups after it
+	uint32_t n;
+	for (n = 0; n < num_alloc_groups; n++) {
+		uint32_t group = (goal_group + n) % num_alloc_groups;
+		ext2_group_alloc_t* g = &group_alloc[group];
+		if (g->free_blocks == 0 || !balloc_load_group(group))
+			continue;
+		
+		// Look after the goal first, and then anywhere in the group
+		uint32_t size = balloc_group_size(group);
+		int32_t bit = -1;
+		if (n == 0 && goal_bit > g->next_free)
+			bit = balloc_find(group, goal_bit, size, owner);
+		if (bit < 0)
+			bit = balloc_find(group, g->next_free, size, owner);
+		if (bit < 0)
+			continue;
+		
+		balloc_mark(group, bit, true);
+		return sb->first_data_block + group * sb->blocks_per_group + bit;
 	}
 	
 	// None could be found for some reason (superblock must be faulty)
-	kfree(bitmap);
 	return EXT2_BLOCK_ID_INVALID;
 }
 
-// Mark a block as free for use
-bool ext2_dealloc_block(uint32_t block_id) {
-	// Get the block_group info
-	uint32_t real_id = (block_id - ext2_superblock()->first_data_block);
-	uint32_t group = real_id / ext2_superblock()->blocks_per_group;
-	uint32_t blocks_per_bitmap_group = 1 << (EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size + 3);	// block_size * 8
+// Set aside the free blocks following a block for an inode (alloc_lock must be held)
+void balloc_reserve(uint32_t inode, uint32_t block_id, uint32_t count) {
+	ext_superblock_t* sb = ext2_superblock();
+	if (count > EXT2_BALLOC_MAX_RESERVE_BLOCKS)
+		count = EXT2_BALLOC_MAX_RESERVE_BLOCKS;
+	
+	// Only take the free blocks right after it in the same group
+	uint32_t group = (block_id - sb->first_data_block) / sb->blocks_per_group;
+	uint32_t bit = (block_id - sb->first_data_block) % sb->blocks_per_group + 1;
+	uint32_t size = balloc_group_size(group);
+	uint32_t n = 0;
+	while (n < count && bit + n < size && !balloc_test(group_alloc[group].bitmap, bit + n) &&
+		   !balloc_reserved(block_id + 1 + n, inode))
+		n++;
+	if (n == 0)
+		return;
+	
+	// Reuse the inode's old reservation or replace the oldest one
+	ext2_reservation_t* r = balloc_find_reservation(inode);
+	if (!r)
+		r = &reservations[next_reservation++ % EXT2_BALLOC_NUM_RESERVATIONS];
+	r->inode = inode;
+	r->start = block_id + 1;
+	r->count = n;
+}
+
+// Allocate a new block for use in an inode.
+// Returns the block id of this block or an invalid block id if nothing could be allocated
+uint32_t ext2_allocate_block() {
+	return ext2_allocate_block_near(EXT2_BLOCK_ID_INVALID);
+}
+
+// Allocate a new block as close to goal as possible
+uint32_t ext2_allocate_block_near(uint32_t goal) {
+	down(&alloc_lock);
+	uint32_t ret = balloc_allocate(goal, EXT2_INODE_INVALID);
+	up(&alloc_lock);
 	
-	// Allocate space for the bitmap
-	uint32_t block_size = 1 << (EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
-	uint8_t* bitmap = (uint8_t*)kmalloc(block_size);
-	if (!bitmap)
-		return false;
+	return ret;
+}
+
+// Allocate the block at an index of an inode
+uint32_t ext2_allocate_inode_block(ext_inode_t* inode, uint32_t index, uint32_t count) {
+	ext_superblock_t* sb = ext2_superblock();
+	
+	// Try to put it right after the block before it, or else at the start of the inode's group
+	uint32_t goal = EXT2_BLOCK_ID_INVALID;
+	if (index > 0) {
+		uint32_t prev = ext2_get_block_id_at_index(inode, index - 1);
+		if (prev != EXT2_BLOCK_ID_INVALID)
+			goal = prev + 1;
+	}
+	if (goal == EXT2_BLOCK_ID_INVALID) {
+		uint32_t group = (inode->inode - 1) / sb->inodes_per_group;
+		goal = sb->first_data_block + group * sb->blocks_per_group;
+	}
 	
-	// Read the group
-	ext_block_group_descriptor_t desc = ext2_get_block_group_info(group);
+	down(&alloc_lock);
+	
+	// Use the blocks set aside for this inode if they follow on
+	uint32_t ret = EXT2_BLOCK_ID_INVALID;
+	ext2_reservation_t* r = balloc_find_reservation(inode->inode);
+	if (r && r->start == goal) {
+		uint32_t group = (goal - sb->first_data_block) / sb->blocks_per_group;
+		uint32_t bit = (goal - sb->first_data_block) % sb->blocks_per_group;
+		if (!balloc_test(group_alloc[group].bitmap, bit)) {
+			balloc_mark(group, bit, true);
+			ret = goal;
+		}
+		r->start++;
+		r->count--;
+	} else if (r) {
+		// The file isn't being appended to anymore
+		r->count = 0;
+	}
 	
-	// Figure out which block the block we want to free's bitmap is in
-	uint32_t relative_block = real_id % ext2_superblock()->blocks_per_group;
-	uint32_t bitmap_block = desc.block_bitmap + relative_block / blocks_per_bitmap_group;
-	uint32_t relative_bitmap_block = relative_block % blocks_per_bitmap_group;
+	if (ret == EXT2_BLOCK_ID_INVALID) {
+		ret = balloc_allocate(goal, inode->inode);
+		
+		// Files that are growing get the blocks after this one set aside so that they stay contiguous
+		if (ret != EXT2_BLOCK_ID_INVALID && index > 0)
+			balloc_reserve(inode->inode, ret, (count > EXT2_BALLOC_RESERVE_BLOCKS) ? count : EXT2_BALLOC_RESERVE_BLOCKS);
+	}
 	
-	// Read the bitmap
-	ata_partition_lock(ext2_fs());
-	ata_partition_llseek(ext2_fs(), ext2_get_block_address(bitmap_block), SEEK_SET);
-	ata_partition_read(ext2_fs(), bitmap, block_size);
+	up(&alloc_lock);
 	
-	// Set the specific block as free and write the data back
-	bitmap[relative_bitmap_block / 8] &= ~(1 << (relative_bitmap_block % 8));
-	ata_partition_llseek(ext2_fs(), ext2_get_block_address(bitmap_block), SEEK_SET);
-	ata_partition_write(ext2_fs(), bitmap, block_size);
-	ata_partition_unlock(ext2_fs());
+	return ret;
+}
+
+// Give up the blocks set aside for an inode
+void ext2_discard_reservation(uint32_t inode) {
+	down(&alloc_lock);
+	ext2_reservation_t* r = balloc_find_reservation(inode);
+	if (r)
+		r->count = 0;
+	up(&alloc_lock);
+}
+
+// Mark a block as free for use
+bool ext2_dealloc_block(uint32_t block_id) {
+	ext_superblock_t* sb = ext2_superblock();
+	if (block_id < sb->first_data_block || block_id >= sb->block_count)
+		return false;
 	
-	kfree(bitmap);
+	uint32_t group = (block_id - sb->first_data_block) / sb->blocks_per_group;
+	uint32_t bit = (block_id - sb->first_data_block) % sb->blocks_per_group;
 	
-	// Update the block group info
-	desc.free_blocks++;
-	ext2_set_block_group_info(group, &desc);
+	down(&alloc_lock);
+	if (!balloc_load_group(group)) {
+		up(&alloc_lock);
+		return false;
+	}
 	
-	// Update the superblock
-	ext2_superblock()->free_block_count++;
-	ext2_set_superblock();
+	// Set the specific block as free
+	if (balloc_test(group_alloc[group].bitmap, bit))
+		balloc_mark(group, bit, false);
+	up(&alloc_lock);
+	
+	// Don't write back anything left over for this block
+	ext2_cache_forget(block_id);
 	
 	return true;
 }
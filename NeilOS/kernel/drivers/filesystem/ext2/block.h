@@ -12,6 +12,13 @@
 #include <common/types.h>
 #include "defs.h"
 
+#define EXT2_BALLOC_RESERVE_BLOCKS			16		// Blocks set aside for a file that is being appended to
+#define EXT2_BALLOC_MAX_RESERVE_BLOCKS		256
+#define EXT2_BALLOC_NUM_RESERVATIONS		32		// Number of files that can have blocks set aside
+
+// Set up the block allocator
+bool ext2_block_alloc_init();
+
 // Get information about a block group
 ext_block_group_descriptor_t ext2_get_block_group_info(uint32_t block_group);
 
@@ -30,6 +37,16 @@ uint64_t ext2_get_block_address(uint32_t block_id);
 // Allocate a new block for use in an inode.
 uint32_t ext2_allocate_block();
 
+// Allocate a new block as close to goal as possible
+uint32_t ext2_allocate_block_near(uint32_t goal);
+
+// Allocate the block at an index of an inode, near the block before it. count is how many
+// blocks the caller is about to allocate (used to set aside space for files being appended to)
+uint32_t ext2_allocate_inode_block(ext_inode_t* inode, uint32_t index, uint32_t count);
+
+// Give up the blocks set aside for an inode
+void ext2_discard_reservation(uint32_t inode);
+
 // Mark a block as free for use
 bool ext2_dealloc_block(uint32_t block_id);
 
@@ -0,0 +1,490 @@
+//
+//  cache.c
+//  NeilOS
+//
+
+#include "cache.h"
+#include "ext2.h"
+#include "icache.h"
+#include <drivers/ATA/ata.h>
+#include <memory/allocation/heap.h>
+#include <common/concurrency/semaphore.h>
+#include <common/concurrency/wait_queue.h>
+#include <common/lib.h>
+#include <common/time.h>
+#include <program/task.h>
+
+// A single cached filesystem block
+typedef struct ext_buffer {
+	uint32_t block_id;
+	uint8_t* data;
+
+	// Inode that last dirtied this buffer (EXT2_CACHE_METADATA for metadata)
+	uint32_t owner;
+	bool dirty;
+	struct timeval dirty_time;
+	// Being read from or written to the disk without cache_lock (anyone else has to wait)
+	bool busy;
+
+	// Hash chain
+	struct ext_buffer* hash_next;
+	// LRU list (most recently used at the head)
+	struct ext_buffer* lru_next;
+	struct ext_buffer* lru_prev;
+	// Dirty list (oldest at the head)
+	struct ext_buffer* dirty_next;
+	struct ext_buffer* dirty_prev;
+} ext_buffer_t;
+
+ext_buffer_t* buffer_hash[EXT2_CACHE_HASH_SIZE];
+ext_buffer_t* lru_head = NULL;
+ext_buffer_t* lru_tail = NULL;
+ext_buffer_t* dirty_head = NULL;
+ext_buffer_t* dirty_tail = NULL;
+uint32_t num_buffers = 0;
+uint32_t num_dirty = 0;
+mutex_t cache_lock = MUTEX_UNLOCKED;
+// Woken up when a busy buffer is done with the disk
+wait_queue_t cache_wait = WAIT_QUEUE_EMPTY;
+
+// Initialize the buffer cache
+void ext2_cache_init() {
+	memset(buffer_hash, 0, sizeof(buffer_hash));
+	lru_head = NULL;
+	lru_tail = NULL;
+	dirty_head = NULL;
+	dirty_tail = NULL;
+	num_buffers = 0;
+	num_dirty = 0;
+}
+
+// Helper to get the filesystem block size
+static inline uint32_t ext2_cache_block_size() {
+	return 1 << (EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
+}
+
+// Helpers for the LRU list
+void ext2_cache_lru_unlink(ext_buffer_t* b) {
+	if (b->lru_prev)
+		b->lru_prev->lru_next = b->lru_next;
+	else
+		lru_head = b->lru_next;
+	if (b->lru_next)
+		b->lru_next->lru_prev = b->lru_prev;
+	else
+		lru_tail = b->lru_prev;
+	b->lru_next = NULL;
+	b->lru_prev = NULL;
+}
+
+void ext2_cache_lru_push(ext_buffer_t* b) {
+	b->lru_prev = NULL;
+	b->lru_next = lru_head;
+	if (lru_head)
+		lru_head->lru_prev = b;
+	lru_head = b;
+	if (!lru_tail)
+		lru_tail = b;
+}
+
+// Helpers for the hash table
+ext_buffer_t* ext2_cache_lookup(uint32_t block_id) {
+	ext_buffer_t* b = buffer_hash[block_id % EXT2_CACHE_HASH_SIZE];
+	while (b) {
+		if (b->block_id == block_id)
+			return b;
+		b = b->hash_next;
+	}
+	return NULL;
+}
+
+void ext2_cache_unhash(ext_buffer_t* b) {
+	ext_buffer_t** p = &buffer_hash[b->block_id % EXT2_CACHE_HASH_SIZE];
+	while (*p) {
+		if (*p == b) {
+			*p = b->hash_next;
+			break;
+		}
+		p = &(*p)->hash_next;
+	}
+	b->hash_next = NULL;
+}
+
+// Mark a buffer as dirty (keeps the time it was first dirtied)
+void ext2_cache_mark_dirty(ext_buffer_t* b, uint32_t owner) {
+	b->owner = owner;
+	if (b->dirty)
+		return;
+
+	b->dirty = true;
+	b->dirty_time = time_get();
+	b->dirty_next = NULL;
+	b->dirty_prev = dirty_tail;
+	if (dirty_tail)
+		dirty_tail->dirty_next = b;
+	else
+		dirty_head = b;
+	dirty_tail = b;
+	num_dirty++;
+}
+
+// Mark a buffer as clean
+void ext2_cache_mark_clean(ext_buffer_t* b) {
+	if (!b->dirty)
+		return;
+
+	if (b->dirty_prev)
+		b->dirty_prev->dirty_next = b->dirty_next;
+	else
+		dirty_head = b->dirty_next;
+	if (b->dirty_next)
+		b->dirty_next->dirty_prev = b->dirty_prev;
+	else
+		dirty_tail = b->dirty_prev;
+	b->dirty_next = NULL;
+	b->dirty_prev = NULL;
+	b->dirty = false;
+	num_dirty--;
+}
+
+// Wait for a busy buffer to be done with the disk (cache must be locked, it is unlocked while waiting)
+void ext2_cache_wait() {
+	wait_queue_entry_t entry;
+	wait_queue_add_current(&cache_wait, &entry);
+	up(&cache_lock);
+	thread_sleep(NULL);
+	wait_queue_remove(&entry);
+	down(&cache_lock);
+}
+
+// Find the buffer for a block once it isn't busy (cache must be locked). Returns NULL if it isn't cached
+ext_buffer_t* ext2_cache_find(uint32_t block_id) {
+	ext_buffer_t* b;
+	while ((b = ext2_cache_lookup(block_id)) && b->busy)
+		ext2_cache_wait();
+	return b;
+}
+
+// Write a dirty buffer back to the disk (cache must be locked, it is unlocked during the write).
+// Returns false if the write failed, in which case the buffer stays dirty
+bool ext2_cache_write_buffer(ext_buffer_t* b) {
+	ext2_cache_mark_clean(b);
+	b->busy = true;
+	up(&cache_lock);
+
+	ata_partition_lock(ext2_fs());
+	ata_partition_llseek(ext2_fs(), ext2_get_block_address(b->block_id), SEEK_SET);
+	uint32_t ret = ata_partition_write(ext2_fs(), b->data, ext2_cache_block_size());
+	ata_partition_unlock(ext2_fs());
+
+	down(&cache_lock);
+	b->busy = false;
+	wait_queue_wake(&cache_wait, 0);
+	if (ret == -1) {
+		ext2_cache_mark_dirty(b, b->owner);
+		return false;
+	}
+
+	return true;
+}
+
+// Get the buffer for a block, evicting the least recently used buffer if the cache is full.
+// If read is true, the block contents are read from the disk. The cache must be locked, but it
+// is unlocked while the disk is busy. Returns NULL on failure
+ext_buffer_t* ext2_cache_get(uint32_t block_id, bool read) {
+	uint32_t block_size = ext2_cache_block_size();
+	ext_buffer_t* b = NULL;
+	for (;;) {
+		b = ext2_cache_find(block_id);
+		if (b) {
+			ext2_cache_lru_unlink(b);
+			ext2_cache_lru_push(b);
+			return b;
+		}
+
+		if (num_buffers < EXT2_CACHE_NUM_BUFFERS) {
+			b = kmalloc(sizeof(ext_buffer_t));
+			if (b) {
+				memset(b, 0, sizeof(ext_buffer_t));
+				b->data = kmalloc(block_size);
+				if (!b->data) {
+					kfree(b);
+					b = NULL;
+				} else {
+					num_buffers++;
+					break;
+				}
+			}
+		}
+
+		// Reuse the least recently used buffer that isn't busy
+		b = lru_tail;
+		while (b && b->busy)
+			b = b->lru_prev;
+		if (!b)
+			return NULL;
+		if (!b->dirty) {
+			ext2_cache_unhash(b);
+			ext2_cache_lru_unlink(b);
+			break;
+		}
+
+		// It has to be written back first. Anything can happen while the cache is unlocked for that,
+		// so start over afterwards
+		if (!ext2_cache_write_buffer(b))
+			return NULL;
+	}
+
+	b->block_id = block_id;
+	b->owner = EXT2_CACHE_METADATA;
+	b->hash_next = buffer_hash[block_id % EXT2_CACHE_HASH_SIZE];
+	buffer_hash[block_id % EXT2_CACHE_HASH_SIZE] = b;
+	if (read) {
+		// Other threads can use the cache while the disk is busy (anyone after this block waits)
+		b->busy = true;
+		up(&cache_lock);
+		ata_partition_lock(ext2_fs());
+		ata_partition_llseek(ext2_fs(), ext2_get_block_address(block_id), SEEK_SET);
+		uint32_t ret = ata_partition_read(ext2_fs(), b->data, block_size);
+		ata_partition_unlock(ext2_fs());
+		down(&cache_lock);
+		b->busy = false;
+		wait_queue_wake(&cache_wait, 0);
+		if (ret == -1) {
+			ext2_cache_unhash(b);
+			kfree(b->data);
+			kfree(b);
+			num_buffers--;
+			return NULL;
+		}
+	}
+	ext2_cache_lru_push(b);
+
+	return b;
+}
+
+// Read from a disk address through the buffer cache. If keep is false, blocks that aren't
+// already cached are read straight from the disk (used for file data so it doesn't push out metadata).
+// Returns bytes read
+uint32_t ext2_cache_read(uint64_t addr, void* buffer, uint32_t length, bool keep) {
+	uint32_t bits = EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size;
+	uint32_t block_size = 1 << bits;
+	uint32_t block_id = addr >> bits;
+	uint32_t offset = addr & (block_size - 1);
+	uint32_t pos = 0;
+
+	down(&cache_lock);
+	while (pos < length) {
+		uint32_t size = block_size - offset;
+		if (size > length - pos)
+			size = length - pos;
+
+		ext_buffer_t* b = keep ? ext2_cache_get(block_id, true) : ext2_cache_find(block_id);
+		if (b)
+			memcpy(buffer + pos, &b->data[offset], size);
+		else {
+			// Read straight from the disk, along with the blocks after this one that aren't cached either
+			uint32_t run = 1;
+			while (!keep && pos + size < length && !ext2_cache_lookup(block_id + run)) {
+				uint32_t more = length - pos - size;
+				size += (more > block_size) ? block_size : more;
+				run++;
+			}
+
+			// Other threads can use the cache while the disk is busy
+			up(&cache_lock);
+			ata_partition_lock(ext2_fs());
+			ata_partition_llseek(ext2_fs(), ext2_get_block_address(block_id) + offset,
+								 SEEK_SET);
+			uint32_t ret = ata_partition_read(ext2_fs(), buffer + pos, size);
+			ata_partition_unlock(ext2_fs());
+			down(&cache_lock);
+			if (ret == -1)
+				break;
+			block_id += run - 1;
+		}
+
+		pos += size;
+		block_id++;
+		offset = 0;
+	}
+	up(&cache_lock);
+
+	return pos;
+}
+
+// Write back the oldest buffers until we are under the background dirty ratio (cache must be locked)
+void ext2_cache_balance_dirty() {
+	if (num_dirty * 100 <= EXT2_CACHE_NUM_BUFFERS * EXT2_CACHE_DIRTY_RATIO)
+		return;
+
+	while (dirty_head && num_dirty * 100 > EXT2_CACHE_NUM_BUFFERS * EXT2_CACHE_DIRTY_BACKGROUND_RATIO) {
+		if (!ext2_cache_write_buffer(dirty_head))
+			break;
+	}
+}
+
+// Write to a disk address through the buffer cache. The data is written back to the disk later
+// by the flusher thread, a sync or if too many buffers are dirty. Returns bytes written
+uint32_t ext2_cache_write(uint64_t addr, const void* buffer, uint32_t length, uint32_t owner) {
+	uint32_t bits = EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size;
+	uint32_t block_size = 1 << bits;
+	uint32_t block_id = addr >> bits;
+	uint32_t offset = addr & (block_size - 1);
+	uint32_t pos = 0;
+
+	down(&cache_lock);
+	while (pos < length) {
+		uint32_t size = block_size - offset;
+		if (size > length - pos)
+			size = length - pos;
+
+		// Only read the old contents if we aren't overwriting the whole block
+		ext_buffer_t* b = ext2_cache_get(block_id, size != block_size);
+		if (b) {
+			memcpy(&b->data[offset], buffer + pos, size);
+			ext2_cache_mark_dirty(b, owner);
+		} else {
+			// Write straight through if we couldn't get a buffer
+			ata_partition_lock(ext2_fs());
+			ata_partition_llseek(ext2_fs(), ext2_get_block_address(block_id) + offset,
+								 SEEK_SET);
+			uint32_t ret = ata_partition_write(ext2_fs(), buffer + pos, size);
+			ata_partition_unlock(ext2_fs());
+			if (ret == -1)
+				break;
+		}
+
+		pos += size;
+		block_id++;
+		offset = 0;
+	}
+
+	ext2_cache_balance_dirty();
+	up(&cache_lock);
+
+	return pos;
+}
+
+// Write whole blocks straight to the disk with one request instead of going through the buffer cache.
+// Any cached copies of the blocks are updated to match. Returns bytes written
+uint32_t ext2_cache_write_direct(uint32_t block_id, const void* buffer, uint32_t count) {
+	uint32_t block_size = ext2_cache_block_size();
+
+	down(&cache_lock);
+	// A busy buffer's transfer could land after this one, so wait for all of them first
+	uint32_t z = 0;
+	while (z < count) {
+		ext_buffer_t* b = ext2_cache_lookup(block_id + z);
+		if (b && b->busy) {
+			ext2_cache_wait();
+			z = 0;
+		} else
+			z++;
+	}
+
+	ata_partition_lock(ext2_fs());
+	ata_partition_llseek(ext2_fs(), ext2_get_block_address(block_id), SEEK_SET);
+	uint32_t ret = ata_partition_write(ext2_fs(), buffer, count * block_size);
+	ata_partition_unlock(ext2_fs());
+	if ((int32_t)ret < 0)
+		ret = 0;
+
+	// Cached copies now match the disk
+	for (z = 0; z < ret / block_size; z++) {
+		ext_buffer_t* b = ext2_cache_lookup(block_id + z);
+		if (b) {
+			memcpy(b->data, buffer + z * block_size, block_size);
+			if (b->dirty)
+				ext2_cache_mark_clean(b);
+		}
+	}
+	up(&cache_lock);
+
+	return ret;
+}
+
+// Drop a block from the cache without writing it back (for blocks that have been freed)
+void ext2_cache_forget(uint32_t block_id) {
+	down(&cache_lock);
+	ext_buffer_t* b = ext2_cache_find(block_id);
+	if (b) {
+		ext2_cache_mark_clean(b);
+		ext2_cache_unhash(b);
+		ext2_cache_lru_unlink(b);
+		kfree(b->data);
+		kfree(b);
+		num_buffers--;
+	}
+	up(&cache_lock);
+}
+
+// Write back dirty buffers that have expired (or all of them if all is true).
+// Returns false if any couldn't be written
+bool ext2_cache_writeback(bool all) {
+	struct timeval expire = { EXT2_CACHE_DIRTY_EXPIRE_MS / MS_IN_SEC,
+		(EXT2_CACHE_DIRTY_EXPIRE_MS % MS_IN_SEC) * US_IN_MS };
+
+	bool ret = true;
+	down(&cache_lock);
+	struct timeval now = time_get();
+	// The dirty list is kept in the order buffers were dirtied, so stop at the first young one
+	while (dirty_head) {
+		if (!all && time_less(time_subtract(now, dirty_head->dirty_time), expire))
+			break;
+		// A buffer that fails goes back on the end of the list, so stop instead of retrying it
+		if (!ext2_cache_write_buffer(dirty_head)) {
+			ret = false;
+			break;
+		}
+	}
+	up(&cache_lock);
+
+	return ret;
+}
+
+// Write back the dirty buffers for an inode and all metadata. Returns false if any couldn't be written
+bool ext2_cache_writeback_inode(uint32_t inode) {
+	bool ret = true;
+	down(&cache_lock);
+	ext_buffer_t* b = dirty_head;
+	while (b) {
+		if (b->owner != inode && b->owner != EXT2_CACHE_METADATA) {
+			b = b->dirty_next;
+			continue;
+		}
+		if (!ext2_cache_write_buffer(b)) {
+			ret = false;
+			break;
+		}
+		// The list can change while the cache is unlocked for the write
+		b = dirty_head;
+	}
+	up(&cache_lock);
+
+	return ret;
+}
+
+// Flusher thread that periodically writes back buffers which have been dirty for too long
+void ext2_cache_flusher(void* arg) {
+	struct timeval interval = { EXT2_CACHE_FLUSH_INTERVAL_MS / MS_IN_SEC,
+		(EXT2_CACHE_FLUSH_INTERVAL_MS % MS_IN_SEC) * US_IN_MS };
+
+	for (;;) {
+		ext2_icache_writeback();
+		ext2_write_backups();
+		ext2_cache_writeback(false);
+
+		// Sleep until the next interval
+		struct timeval wake = time_add(time_get(), interval);
+		while (time_less(time_get(), wake)) {
+			thread_sleep_prepare();
+			thread_sleep(&wake);
+		}
+	}
+}
+
+// Start the flusher thread
+void ext2_cache_start_flusher() {
+	kernel_thread_create(ext2_cache_flusher, NULL);
+}
@@ -0,0 +1,51 @@
+//
+//  cache.h
+//  NeilOS
+//
+
+#ifndef EXT2_CACHE_H
+#define EXT2_CACHE_H
+
+#include <common/types.h>
+#include "defs.h"
+
+#define EXT2_CACHE_NUM_BUFFERS				256
+#define EXT2_CACHE_HASH_SIZE				128
+#define EXT2_CACHE_DIRTY_EXPIRE_MS			5000	// Write back buffers that have been dirty this long
+#define EXT2_CACHE_FLUSH_INTERVAL_MS		1000	// How often the flusher thread wakes up
+#define EXT2_CACHE_DIRTY_RATIO				50		// Percent of buffers dirty before writers flush themselves
+#define EXT2_CACHE_DIRTY_BACKGROUND_RATIO	25		// Percent of buffers dirty that writers flush down to
+
+// Owner of buffers that hold filesystem metadata (bitmaps, inode tables, indirect blocks, etc.)
+#define EXT2_CACHE_METADATA					0
+
+// Initialize the buffer cache
+void ext2_cache_init();
+
+// Read from a disk address through the buffer cache. If keep is false, blocks that aren't
+// already cached are read straight from the disk (used for file data so it doesn't push out metadata).
+// Returns bytes read
+uint32_t ext2_cache_read(uint64_t addr, void* buffer, uint32_t length, bool keep);
+
+// Write to a disk address through the buffer cache. The data is written back to the disk later
+// by the flusher thread, a sync or if too many buffers are dirty. Returns bytes written
+uint32_t ext2_cache_write(uint64_t addr, const void* buffer, uint32_t length, uint32_t owner);
+
+// Write whole blocks straight to the disk with one request instead of going through the buffer cache.
+// Any cached copies of the blocks are updated to match. Returns bytes written
+uint32_t ext2_cache_write_direct(uint32_t block_id, const void* buffer, uint32_t count);
+
+// Drop a block from the cache without writing it back (for blocks that have been freed)
+void ext2_cache_forget(uint32_t block_id);
+
+// Write back dirty buffers that have expired (or all of them if all is true).
+// Returns false if any couldn't be written
+bool ext2_cache_writeback(bool all);
+
+// Write back the dirty buffers for an inode and all metadata. Returns false if any couldn't be written
+bool ext2_cache_writeback_inode(uint32_t inode);
+
+// Start the flusher thread
+void ext2_cache_start_flusher();
+
+#endif /* EXT2_CACHE_H */
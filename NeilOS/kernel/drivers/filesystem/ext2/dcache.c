@@ -0,0 +1,183 @@
+//
+//  dcache.c
+//  NeilOS
+//
+
+#include "dcache.h"
+#include <memory/allocation/heap.h>
+#include <common/concurrency/semaphore.h>
+#include <common/lib.h>
+
+// A cached directory entry
+typedef struct ext_dcache_entry {
+	uint32_t parent;
+	uint32_t inode;				// EXT2_INODE_INVALID for a negative entry
+	uint32_t hash;
+	uint32_t name_len;
+	char* name;
+	
+	// Hash chain
+	struct ext_dcache_entry* hash_next;
+	// LRU list (most recently used at the head)
+	struct ext_dcache_entry* lru_next;
+	struct ext_dcache_entry* lru_prev;
+} ext_dcache_entry_t;
+
+ext_dcache_entry_t* dcache_hash[EXT2_DCACHE_HASH_SIZE];
+ext_dcache_entry_t* dcache_lru_head = NULL;
+ext_dcache_entry_t* dcache_lru_tail = NULL;
+uint32_t dcache_num_entries = 0;
+mutex_t dcache_lock = MUTEX_UNLOCKED;
+
+// Hash a (parent, name) pair
+uint32_t ext2_dcache_hash(uint32_t parent, const char* name, uint32_t name_len) {
+	uint32_t hash = 2166136261u ^ parent;
+	uint32_t z;
+	for (z = 0; z < name_len; z++) {
+		hash ^= (uint8_t)name[z];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Helpers for the LRU list
+void ext2_dcache_lru_unlink(ext_dcache_entry_t* e) {
+	if (e->lru_prev)
+		e->lru_prev->lru_next = e->lru_next;
+	else
+		dcache_lru_head = e->lru_next;
+	if (e->lru_next)
+		e->lru_next->lru_prev = e->lru_prev;
+	else
+		dcache_lru_tail = e->lru_prev;
+	e->lru_next = NULL;
+	e->lru_prev = NULL;
+}
+
+void ext2_dcache_lru_push(ext_dcache_entry_t* e) {
+	e->lru_prev = NULL;
+	e->lru_next = dcache_lru_head;
+	if (dcache_lru_head)
+		dcache_lru_head->lru_prev = e;
+	dcache_lru_head = e;
+	if (!dcache_lru_tail)
+		dcache_lru_tail = e;
+}
+
+// Find an entry (cache must be locked)
+ext_dcache_entry_t* ext2_dcache_find(uint32_t parent, const char* name, uint32_t name_len, uint32_t hash) {
+	ext_dcache_entry_t* e = dcache_hash[hash % EXT2_DCACHE_HASH_SIZE];
+	while (e) {
+		if (e->hash == hash && e->parent == parent && e->name_len == name_len &&
+			strncmp(e->name, name, name_len) == 0)
+			return e;
+		e = e->hash_next;
+	}
+	return NULL;
+}
+
+// Remove an entry from the cache and free it (cache must be locked)
+void ext2_dcache_free(ext_dcache_entry_t* e) {
+	ext_dcache_entry_t** p = &dcache_hash[e->hash % EXT2_DCACHE_HASH_SIZE];
+	while (*p) {
+		if (*p == e) {
+			*p = e->hash_next;
+			break;
+		}
+		p = &(*p)->hash_next;
+	}
+	ext2_dcache_lru_unlink(e);
+	
+	kfree(e->name);
+	kfree(e);
+	dcache_num_entries--;
+}
+
+// Look up a name in a directory. Returns true if the entry is cached and places the
+// inode into inode_out (EXT2_INODE_INVALID for names that are known not to exist)
+bool ext2_dcache_lookup(uint32_t parent, const char* name, uint32_t name_len, uint32_t* inode_out) {
+	uint32_t hash = ext2_dcache_hash(parent, name, name_len);
+	
+	down(&dcache_lock);
+	ext_dcache_entry_t* e = ext2_dcache_find(parent, name, name_len, hash);
+	if (!e) {
+		up(&dcache_lock);
+		return false;
+	}
+	
+	ext2_dcache_lru_unlink(e);
+	ext2_dcache_lru_push(e);
+	*inode_out = e->inode;
+	up(&dcache_lock);
+	
+	return true;
+}
+
+// Add an entry to the cache (inode can be EXT2_INODE_INVALID to remember that a name doesn't exist)
+void ext2_dcache_add(uint32_t parent, const char* name, uint32_t name_len, uint32_t inode) {
+	uint32_t hash = ext2_dcache_hash(parent, name, name_len);
+	
+	down(&dcache_lock);
+	ext_dcache_entry_t* e = ext2_dcache_find(parent, name, name_len, hash);
+	if (e) {
+		// Just update the existing entry. A lookup that didn't find the name could have scanned the
+		// directory before it was linked in, so a negative entry never replaces a positive one
+		if (inode != EXT2_INODE_INVALID)
+			e->inode = inode;
+		ext2_dcache_lru_unlink(e);
+		ext2_dcache_lru_push(e);
+		up(&dcache_lock);
+		return;
+	}
+	
+	// Make room if needed
+	if (dcache_num_entries >= EXT2_DCACHE_NUM_ENTRIES && dcache_lru_tail)
+		ext2_dcache_free(dcache_lru_tail);
+	
+	e = (ext_dcache_entry_t*)kmalloc(sizeof(ext_dcache_entry_t));
+	if (!e) {
+		up(&dcache_lock);
+		return;
+	}
+	e->name = (char*)kmalloc(name_len);
+	if (!e->name) {
+		kfree(e);
+		up(&dcache_lock);
+		return;
+	}
+	memcpy(e->name, name, name_len);
+	e->name_len = name_len;
+	e->parent = parent;
+	e->inode = inode;
+	e->hash = hash;
+	
+	e->hash_next = dcache_hash[hash % EXT2_DCACHE_HASH_SIZE];
+	dcache_hash[hash % EXT2_DCACHE_HASH_SIZE] = e;
+	ext2_dcache_lru_push(e);
+	dcache_num_entries++;
+	up(&dcache_lock);
+}
+
+// Remove an entry from the cache
+void ext2_dcache_remove(uint32_t parent, const char* name, uint32_t name_len) {
+	uint32_t hash = ext2_dcache_hash(parent, name, name_len);
+	
+	down(&dcache_lock);
+	ext_dcache_entry_t* e = ext2_dcache_find(parent, name, name_len, hash);
+	if (e)
+		ext2_dcache_free(e);
+	up(&dcache_lock);
+}
+
+// Remove all the entries in a directory (for when it is deleted)
+void ext2_dcache_remove_directory(uint32_t parent) {
+	down(&dcache_lock);
+	ext_dcache_entry_t* e = dcache_lru_head;
+	while (e) {
+		ext_dcache_entry_t* next = e->lru_next;
+		if (e->parent == parent)
+			ext2_dcache_free(e);
+		e = next;
+	}
+	up(&dcache_lock);
+}
@@ -0,0 +1,29 @@
+//
+//  dcache.h
+//  NeilOS
+//
+
+#ifndef EXT2_DCACHE_H
+#define EXT2_DCACHE_H
+
+#include <common/types.h>
+#include "defs.h"
+
+#define EXT2_DCACHE_NUM_ENTRIES		512
+#define EXT2_DCACHE_HASH_SIZE		256
+
+// Look up a name in a directory. Returns true if the entry is cached and places the
+// inode into inode_out (EXT2_INODE_INVALID for names that are known not to exist)
+bool ext2_dcache_lookup(uint32_t parent, const char* name, uint32_t name_len, uint32_t* inode_out);
+
+// Add an entry to the cache (inode can be EXT2_INODE_INVALID to remember that a name doesn't exist,
+// but that never replaces an entry for a name that does)
+void ext2_dcache_add(uint32_t parent, const char* name, uint32_t name_len, uint32_t inode);
+
+// Remove an entry from the cache
+void ext2_dcache_remove(uint32_t parent, const char* name, uint32_t name_len);
+
+// Remove all the entries in a directory (for when it is deleted)
+void ext2_dcache_remove_directory(uint32_t parent);
+
+#endif /* EXT2_DCACHE_H */
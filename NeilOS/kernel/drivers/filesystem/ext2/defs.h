@@ -9,6 +9,8 @@
 #ifndef DEFS_H
 #define DEFS_H
 
+#include <common/concurrency/rwsem.h>
+
 // Unique inodes
 #define EXT2_INODE_INVALID						0x1		// Bad inode
 #define EXT2_INODE_ROOT							0x2		// Root ("/") inode
@@ -93,6 +95,12 @@
 #define EXT2_INODE_MODE_OTHER_EXECUTE			0x0001	// Other execute
 #define EXT2_INODE_MODE_ATTR_ALL				0x01FF	// All R/W/R
 
+// Inode flags
+#define EXT2_INODE_FLAG_INDEX					0x1000	// Directory is indexed with a hash tree
+
+// Superblock flags
+#define EXT2_FLAGS_UNSIGNED_HASH				0x2		// Directory index hashes use unsigned chars
+
 typedef struct {
 	uint32_t inode_count;				// inode count
 	uint32_t block_count;				// Block count
@@ -129,6 +137,27 @@ typedef struct {
 	uint8_t volume_name[16];			// Volume Name
 	uint8_t last_mounted[64];			// Path where volume was last mounted
 	uint32_t algo_bitmap;				// Bitmap compression algorithm
+	uint8_t prealloc_blocks;			// Number of blocks to preallocate for files
+	uint8_t prealloc_dir_blocks;		// Number of blocks to preallocate for directories
+	uint16_t padding;
+	uint8_t journal_uuid[16];			// UUID of the journal superblock
+	uint32_t journal_inode;				// Inode of the journal file
+	uint32_t journal_dev;				// Device of the journal file
+	uint32_t last_orphan;				// Start of the list of inodes to delete
+	uint32_t hash_seed[4];				// Seed for the directory index hash
+	uint8_t def_hash_version;			// Default directory index hash
+	uint8_t journal_backup_type;
+	uint16_t desc_size;
+	uint32_t default_mount_opts;
+	uint32_t first_meta_bg;
+	uint32_t mkfs_time;
+	uint32_t journal_blocks[17];		// Backup of the journal inode's blocks
+	uint32_t block_count_high;
+	uint32_t rblock_count_high;
+	uint32_t free_block_count_high;
+	uint16_t min_extra_isize;
+	uint16_t want_extra_isize;
+	uint32_t flags;						// Miscellaneous flags
 } ext_superblock_t;
 
 typedef struct {
@@ -173,13 +202,23 @@ typedef struct {
 } ext_inode_info_t;
 
 // Structure that contains the data and the inode number
-typedef struct {
+typedef struct ext_inode {
 	ext_inode_info_t info;
 	uint32_t inode;
 	
 	// Caching info
 	uint32_t* cached_block;
 	uint32_t cached_block_starting_index;
+	spinlock_t cached_block_lock;			// Readers share the inode, so only one can use the cached block at a time
+	
+	// Inode cache info (only used by shared inodes from ext2_inode_get)
+	uint32_t ref_count;
+	bool dirty;
+	bool invalid;							// Freed on the disk (out of the cache, the last reference frees it)
+	rw_semaphore_t lock;
+	struct ext_inode* hash_next;
+	struct ext_inode* lru_next;
+	struct ext_inode* lru_prev;
 } ext_inode_t;
 
 #endif
@@ -12,12 +12,19 @@
 #include <memory/allocation/heap.h>
 #include "inode.h"
 #include "block.h"
+#include "cache.h"
+#include "icache.h"
 #include <common/time.h>
+#include <common/concurrency/semaphore.h>
 #include <program/task.h>
 
 // Superblock cache
 ext_superblock_t superblock;
 disk_info_t fs;
+// Whether the superblock and block group descriptor backups need to be written
+bool backups_dirty = false;
+// Protects backups_dirty and writing the backups (the flusher thread and syncs both write them)
+mutex_t backups_lock = MUTEX_UNLOCKED;
 
 // Internal functions
 uint32_t ext2_allocate_block();
@@ -28,7 +35,7 @@ uint64_t ext2_truncate_inode_zero(ext_inode_t* inode, uint64_t size, bool fill);
 bool ext2_init(disk_info_t* disk) {
 	// Load the superblock information
 	ata_partition_lock(disk);
-	ata_partition_llseek(disk, uint64_make(0, SUPERBLOCK_ADDRESS), SEEK_SET);
+	ata_partition_llseek(disk, SUPERBLOCK_ADDRESS, SEEK_SET);
 	ata_partition_read(disk, &superblock, sizeof(ext_superblock_t));
 	ata_partition_unlock(disk);
 	
@@ -38,6 +45,10 @@ bool ext2_init(disk_info_t* disk) {
 	// Cache the disk info
 	fs = *disk;
 	
+	ext2_cache_init();
+	if (!ext2_block_alloc_init())
+		return false;
+	
 	// TODO: optimize the ata_partition to take a variable block_size
 		
 	return true;
@@ -56,31 +67,104 @@ ext_superblock_t* ext2_superblock() {
 // Set the superblock info
 void ext2_set_superblock() {
 	// Modify this superblock
-	ata_partition_lock(&fs);
-	ata_partition_llseek(&fs, uint64_make(0, SUPERBLOCK_ADDRESS), SEEK_SET);
-	ata_partition_write(&fs, &superblock, sizeof(ext_superblock_t));
-	ata_partition_unlock(&fs);
+	ext2_cache_write(SUPERBLOCK_ADDRESS, &superblock, sizeof(ext_superblock_t), EXT2_CACHE_METADATA);
+	
+	// The backups are written later by the flusher thread or a sync
+	ext2_set_backups_dirty();
+}
+
+// Mark the superblock and block group descriptor backups as needing to be written
+void ext2_set_backups_dirty() {
+	down(&backups_lock);
+	backups_dirty = true;
+	up(&backups_lock);
+}
+
+// Is a power of a number (1 counts as a power of anything)
+bool ext2_is_power_of(uint32_t n, uint32_t base) {
+	while (n > 1 && (n % base) == 0)
+		n /= base;
+	return n == 1;
+}
+
+// Whether a block group holds a backup of the superblock and block group descriptors
+bool ext2_group_has_backup(uint32_t group) {
+	// Without sparse superblocks every group has one
+	if (!(superblock.features_ro & EXT2_FEATURES_RO_SPARSE_SUPER))
+		return true;
 	
-	uint16_t backup = superblock.block_group_nr;
+	// Otherwise only groups 0 and 1 and the powers of 3, 5, and 7 do
+	return group <= 1 || ext2_is_power_of(group, 3) || ext2_is_power_of(group, 5) || ext2_is_power_of(group, 7);
+}
+
+// Write the superblock and block group descriptor backups if they have changed.
+// Returns false if they couldn't be written
+bool ext2_write_backups() {
+	down(&backups_lock);
+	if (!backups_dirty) {
+		up(&backups_lock);
+		return true;
+	}
 	
-	// Backup blocks are located at groups 1, and then powers of 3, 5, and 7
+	// Copy the primary block group descriptor table
+	uint32_t bits = EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size;
 	uint32_t num_groups = 1 + ((superblock.block_count - 1) / superblock.blocks_per_group);
+	uint32_t table_size = num_groups * sizeof(ext_block_group_descriptor_t);
+	void* table = kmalloc(table_size);
+	if (!table) {
+		up(&backups_lock);
+		return false;
+	}
+	// Changes made from here on mark them dirty again
+	backups_dirty = false;
+	ext2_cache_read((uint64_t)(superblock.first_data_block + 1) << bits, table, table_size, true);
+	
+	ext_superblock_t backup = superblock;
+	
+	bool ret = true;
 	uint32_t group;
 	for (group = 1; group < num_groups; group++) {
-		if (!(group == 1 || (group % 3) == 0 || (group % 5) == 0 || (group % 7) == 0))
+		if (!ext2_group_has_backup(group))
 			continue;
 		
-		// Update the backup
-		uint64_t addr = uint64_shl(uint64_make(0, superblock.first_data_block + group * superblock.blocks_per_group),
-						  EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
-		superblock.block_group_nr = group;
+		// Update the backup (these are never read, so don't bother caching them)
+		uint64_t addr = (uint64_t)(superblock.first_data_block + group * superblock.blocks_per_group) << bits;
+		backup.block_group_nr = group;
 		ata_partition_lock(&fs);
 		ata_partition_llseek(&fs, addr, SEEK_SET);
-		ata_partition_write(&fs, &superblock, sizeof(ext_superblock_t));
+		if (ata_partition_write(&fs, &backup, sizeof(ext_superblock_t)) == -1)
+			ret = false;
+		ata_partition_llseek(&fs, addr + (1 << bits), SEEK_SET);
+		if (ata_partition_write(&fs, table, table_size) == -1)
+			ret = false;
 		ata_partition_unlock(&fs);
 	}
 	
-	superblock.block_group_nr = backup;
+	// Try again next time
+	if (!ret)
+		backups_dirty = true;
+	up(&backups_lock);
+	kfree(table);
+	
+	return ret;
+}
+
+// Write all cached filesystem data to the disk
+void ext2_sync() {
+	ext2_icache_writeback();
+	ext2_write_backups();
+	ext2_cache_writeback(true);
+}
+
+// Write an inode's cached data and the filesystem metadata to the disk.
+// Returns false if any of it couldn't be written
+bool ext2_sync_inode(ext_inode_t* inode) {
+	ext2_icache_writeback_inode(inode->inode);
+	bool ret = ext2_write_backups();
+	if (!ext2_cache_writeback_inode(inode->inode))
+		ret = false;
+	
+	return ret;
 }
 
 // Gets the block size
@@ -93,11 +177,15 @@ uint32_t ext2_get_block_size() {
 // Return the inode of a particular filesystem entry
 ext_inode_t ext2_open(const char* path) {
 	// Loop through each path component and find the relative inode
-	ext_inode_t inode = ext_inode_create(EXT2_INODE_ROOT);
+	ext_inode_t* dir = ext2_inode_get(EXT2_INODE_ROOT);
+	if (!dir)
+		return ext_inode_create(EXT2_INODE_INVALID);
 	uint32_t path_length = 0;
 	char* component = (char*)kmalloc(strlen(path) + 1);
-	if (!component)
+	if (!component) {
+		ext2_inode_put(dir);
 		return ext_inode_create(EXT2_INODE_INVALID);
+	}
 	
 	while ((path = path_get_component(&path[path_length], 0, &path_length)) != NULL) {
 		// Copy the string over
@@ -105,10 +193,14 @@ ext_inode_t ext2_open(const char* path) {
 		memcpy(component, path, path_length);
 		
 		// Get the next inode
-		inode = ext2_get_relative_inode(component, &inode);
+		down_read(&dir->lock);
+		ext_inode_t next = ext2_get_relative_inode(component, dir);
+		up_read(&dir->lock);
+		ext2_inode_put(dir);
 		
 		// If we can't find the next inode, return error
-		if (inode.inode == EXT2_INODE_INVALID) {
+		dir = ext2_inode_get(next.inode);
+		if (!dir) {
 			kfree(component);
 			return ext_inode_create(EXT2_INODE_INVALID);
 		}
@@ -116,10 +208,16 @@ ext_inode_t ext2_open(const char* path) {
 	kfree(component);
 	
 	// Update the access time of this inode
-	inode.info.atime = get_current_unix_time().val;
-	ext2_set_inode_info(inode.inode, &inode.info);
-
-	// Return the inode found
+	dir->info.atime = get_current_unix_time().val;
+	ext2_set_inode_info(dir->inode, &dir->info);
+	
+	// Return a copy of the inode found
+	ext_inode_t inode;
+	memset(&inode, 0, sizeof(ext_inode_t));
+	inode.inode = dir->inode;
+	inode.info = dir->info;
+	ext2_inode_put(dir);
+	
 	return inode;
 }
 
@@ -159,7 +257,7 @@ ext_inode_t ext2_create(ext_inode_t* parent, const char* name, unsigned int mode
 		}
 		
 		if (!ext2_link_inode(&ret, parent, "..")) {
-			ext2_unlink(&ret, ".");
+			ext2_unlink_entry(&ret, ".", &ret);
 			ext2_dealloc_inode(&ret);
 			return ext_inode_create(EXT2_INODE_INVALID);
 		}
@@ -168,8 +266,8 @@ ext_inode_t ext2_create(ext_inode_t* parent, const char* name, unsigned int mode
 	// Link it in
 	if (!ext2_link_inode(parent, &ret, name)) {
 		if (directory) {
-			ext2_unlink(&ret, ".");
-			ext2_unlink(&ret, "..");
+			ext2_unlink_entry(&ret, ".", &ret);
+			ext2_unlink_entry(&ret, "..", parent);
 		}
 		ext2_dealloc_inode(&ret);
 		return ext_inode_create(EXT2_INODE_INVALID);
@@ -178,19 +276,32 @@ ext_inode_t ext2_create(ext_inode_t* parent, const char* name, unsigned int mode
 	return ret;
 }
 
-// Delete an inode at a particular path
-bool ext2_delete(ext_inode_t* parent, const char* name) {
-	ext_inode_t inode = ext2_get_relative_inode(name, parent);
-	if (inode.inode == EXT2_INODE_INVALID || inode.inode == EXT2_INODE_ROOT)
+// Remove name from parent and drop a link to inode, the inode it names (the caller holds the locks
+// of both if they are shared)
+bool ext2_unlink_entry(ext_inode_t* parent, const char* name, ext_inode_t* inode) {
+	if (!ext2_unlink_inode(parent, name))
 		return false;
 	
+	// Update modified times
+	parent->info.mtime = get_current_unix_time().val;
+	ext2_set_inode_info(parent->inode, &parent->info);
+	
+	// Decrease the link count for this inode
+	inode->info.link_count--;
+	ext2_set_inode_info(inode->inode, &inode->info);
+	
+	return true;
+}
+
+// Delete the shared inode at name in parent (the caller holds the locks of both)
+bool ext2_delete_inode(ext_inode_t* parent, const char* name, ext_inode_t* inode) {
 	// If this is our last hard link, also delete the data
-	uint32_t num_links = ext2_inode_is_directory(&inode) ? 2 : 1;
-	if (inode.info.link_count != num_links) {
+	uint32_t num_links = ext2_inode_is_directory(inode) ? 2 : 1;
+	if (inode->info.link_count != num_links) {
 		// Otherwise, just unlink it
-		if (!ext2_unlink(parent, name)) {
+		if (!ext2_unlink_entry(parent, name, inode)) {
 			// Undo
-			ext2_link_inode(parent, &inode, name);
+			ext2_link_inode(parent, inode, name);
 			return false;
 		}
 		
@@ -198,36 +309,55 @@ bool ext2_delete(ext_inode_t* parent, const char* name) {
 	}
 	
 	// Truncate to 0
-	if (!uint64_equal(ext2_truncate_inode(&inode, uint64_make(0, 0)), uint64_make(0, 0)))
+	if (ext2_truncate_inode(inode, 0) != 0)
 			return false;
 	
 	// Unlink it
-	if (!ext2_unlink(parent, name)) {
+	if (!ext2_unlink_entry(parent, name, inode)) {
 		// Undo
-		ext2_link_inode(parent, &inode, name);
+		ext2_link_inode(parent, inode, name);
 		return false;
 	}
 	
 	// Delete the inode
-	return ext2_dealloc_inode(&inode);
+	return ext2_dealloc_inode(inode);
+}
+
+// Delete an inode at a particular path
+bool ext2_delete(ext_inode_t* parent, const char* name) {
+	ext_inode_t found = ext2_get_relative_inode(name, parent);
+	if (found.inode == EXT2_INODE_INVALID || found.inode == EXT2_INODE_ROOT)
+		return false;
+	
+	// Change the in memory inode that open files share (a copy would overwrite it when written back)
+	ext_inode_t* inode = ext2_inode_get(found.inode);
+	if (!inode)
+		return false;
+	
+	down_write(&inode->lock);
+	bool ret = ext2_delete_inode(parent, name, inode);
+	up_write(&inode->lock);
+	ext2_inode_put(inode);
+	
+	return ret;
 }
 
 // Unlink (remove) an inode (If this is a directory, it must be empty or space will be leaked)
 bool ext2_unlink(ext_inode_t* parent, const char* name) {
-	ext_inode_t inode = ext2_get_relative_inode(name, parent);
-
-	if (!ext2_unlink_inode(parent, name))
+	ext_inode_t found = ext2_get_relative_inode(name, parent);
+	ext_inode_t* inode = ext2_inode_get(found.inode);
+	if (!inode)
 		return false;
 	
-	// Update modified times
-	parent->info.mtime = get_current_unix_time().val;
-	ext2_set_inode_info(parent->inode, &parent->info);
-	
-	// Decrease the link count for this inode
-	inode.info.link_count--;
-	ext2_set_inode_info(inode.inode, &inode.info);
+	// The caller already holds the parent's lock (for ".")
+	if (inode != parent)
+		down_write(&inode->lock);
+	bool ret = ext2_unlink_entry(parent, name, inode);
+	if (inode != parent)
+		up_write(&inode->lock);
+	ext2_inode_put(inode);
 	
-	return true;
+	return ret;
 }
 
 // Hard link an inode
@@ -236,8 +366,13 @@ bool ext2_link(ext_inode_t* inode, ext_inode_t* link_parent, const char* link_na
 	if (inode->inode == EXT2_INODE_INVALID)
 		return false;
 	
-	// Link it in
-	if (!ext2_link_inode(link_parent, inode, link_name))
+	// Link it in (the caller already holds the parent's lock)
+	if (inode != link_parent)
+		down_write(&inode->lock);
+	bool ret = ext2_link_inode(link_parent, inode, link_name);
+	if (inode != link_parent)
+		up_write(&inode->lock);
+	if (!ret)
 		return false;
 	
 	// Update modified times
@@ -256,122 +391,146 @@ uint32_t ext2_read_data(ext_inode_t* inode, uint64_t offset, void* buffer, uint3
 		
 	// Calculate the starting and ending blocks
 	uint32_t block_size = 1 << (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
-	uint32_t start_block = uint64_shr(offset, EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size).low;
-	uint32_t end_block = uint64_shr(uint64_add(offset, uint64_make(0, length)),
-									EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size).low;
+	uint32_t start_block = offset >> (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
+	uint32_t end_block = (offset + length) >> (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
 	
 	// Loop over every block
 	uint32_t z;
 	uint32_t copy_pos = 0;
+	// Blocks that are next to each other on the disk are read together
+	uint64_t run_addr = 0;
+	uint32_t run_size = 0;
 	for (z = start_block; z <= end_block; z++) {
 		uint32_t block_id = ext2_get_block_id_at_index(inode, z);
 		
 		// Seek to the right position
-		uint64_t addr = uint64_shl(uint64_make(0, block_id),
-								   EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
-		ata_partition_lock(&fs);
-		ata_partition_llseek(&fs, addr, SEEK_SET);
+		uint64_t addr = (uint64_t)block_id << (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
 		
 		// Only copy what we need to
 		uint32_t size = block_size;
 		if (z == start_block) {
-			uint32_t copy_offset = offset.low % block_size;
+			uint32_t copy_offset = (uint32_t)offset & (block_size - 1);
 			size -= copy_offset;
 			
-			ata_partition_llseek(&fs, uint64_make(0, copy_offset), SEEK_CUR);
+			addr += copy_offset;
 		}
 		if (z == end_block) {
-			size = length - copy_pos;
+			size = length - copy_pos - run_size;
 			if (size > block_size) {
 				// Something went wrong
-				ata_partition_unlock(&fs);
 				return -1;
 			}
 		}
 		
 		// Don't go for zero length blocks
-		if (size == 0) {
-			ata_partition_unlock(&fs);
+		if (size == 0)
 			break;
-		}
 		
-		// Copy the data over
-		copy_pos += ata_partition_read(&fs, buffer + copy_pos, size);
+		if (run_size != 0 && run_addr + run_size == addr) {
+			run_size += size;
+			continue;
+		}
 		
-		ata_partition_unlock(&fs);
+		// Copy the data over (file data is only kept in the cache if it is already there)
+		if (run_size != 0) {
+			uint32_t ret = ext2_cache_read(run_addr, buffer + copy_pos, run_size, false);
+			copy_pos += ret;
+			if (ret != run_size)
+				return copy_pos;
+		}
+		run_addr = addr;
+		run_size = size;
 	}
+	if (run_size != 0)
+		copy_pos += ext2_cache_read(run_addr, buffer + copy_pos, run_size, false);
 	
 	// Return bytes read
 	return copy_pos;
 }
 
-// Write data to an inode from a specific offset and length.
-// If the offset is out of file range, sufficient space will try to be allocated towards the file.
-uint32_t ext2_write_data(ext_inode_t* inode, uint64_t offset, const void* buffer, uint32_t length) {
+// Write a run of whole blocks straight to the disk (returns bytes written)
+static inline uint32_t ext2_write_run(uint32_t block_id, const void* buffer, uint32_t count) {
+	if (count == 0)
+		return 0;
+	return ext2_cache_write_direct(block_id, buffer, count);
+}
+
+// Write data to an inode. If direct is true, whole blocks are written straight to the disk
+// in runs of blocks that are next to each other instead of going through the buffer cache
+uint32_t ext2_write_data_internal(ext_inode_t* inode, uint64_t offset, const void* buffer, uint32_t length,
+								  bool direct) {
 	if (inode->inode == EXT2_INODE_INVALID)
 		return -1;
 	
 	uint32_t block_size = 1 << (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
 	// Check if we need to allocate any space
-	uint64_t end_pos = uint64_add(offset, uint64_make(0, length));
-	uint64_t space_allocated = uint64_shl(uint64_make(0, inode->info.num_blocks), EXT2_INODE_BLOCK_COUNT_SIZE);
+	uint64_t end_pos = offset + length;
+	uint64_t space_allocated = (uint64_t)inode->info.num_blocks << EXT2_INODE_BLOCK_COUNT_SIZE;
 	// Try and allocate more space if needed
-	if (uint64_greater(end_pos, space_allocated)) {
-		if (!uint64_equal(end_pos, ext2_truncate_inode_zero(inode, end_pos, false)))
+	if (end_pos > space_allocated) {
+		if (end_pos != ext2_truncate_inode_zero(inode, end_pos, false))
 			return -1;
 	}
 	
 	// Calculate the starting and ending blocks
-	uint32_t start_block = uint64_shr(offset, EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size).low;
-	uint32_t end_block = uint64_shr(end_pos, EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size).low;
+	uint32_t start_block = offset >> (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
+	uint32_t end_block = end_pos >> (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
 	
 	// Loop over every block
 	uint32_t z;
 	uint32_t copy_pos = 0;
+	uint32_t run_block = 0, run_count = 0;
 	for (z = start_block; z <= end_block; z++) {
 		uint32_t block_id = ext2_get_block_id_at_index(inode, z);
 		
 		// Seek to the right position
-		uint64_t addr = uint64_shl(uint64_make(0, block_id),
-								   EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
-		ata_partition_lock(&fs);
-		ata_partition_llseek(&fs, addr, SEEK_SET);
+		uint64_t addr = (uint64_t)block_id << (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
 		
 		// Only copy what we need to
 		uint32_t size = block_size;
 		if (z == start_block) {
-			uint32_t copy_offset = offset.low % block_size;
+			uint32_t copy_offset = (uint32_t)offset & (block_size - 1);
 			size -= copy_offset;
 			
-			ata_partition_llseek(&fs, uint64_make(0, copy_offset), SEEK_CUR);
+			addr += copy_offset;
 		}
 		if (z == end_block) {
-			size = length - copy_pos;
+			size = length - copy_pos - run_count * block_size;
 			if (size > block_size) {
 				// Something went wrong
-				ata_partition_unlock(&fs);
 				return -1;
 			}
 		}
 		
 		// Don't go for zero length blocks
-		if (size == 0) {
-			ata_partition_unlock(&fs);
+		if (size == 0)
 			break;
+		
+		// Whole blocks are collected into runs and written together
+		if (direct && size == block_size) {
+			if (run_count != 0 && run_block + run_count == block_id) {
+				run_count++;
+				continue;
+			}
+			copy_pos += ext2_write_run(run_block, buffer + copy_pos, run_count);
+			run_block = block_id;
+			run_count = 1;
+			continue;
 		}
+		copy_pos += ext2_write_run(run_block, buffer + copy_pos, run_count);
+		run_count = 0;
 		
 		// Copy the data over
-		copy_pos += ata_partition_write(&fs, buffer + copy_pos, size);
-		
-		ata_partition_unlock(&fs);
+		copy_pos += ext2_cache_write(addr, buffer + copy_pos, size, inode->inode);
 	}
+	copy_pos += ext2_write_run(run_block, buffer + copy_pos, run_count);
 	
 	// Update the file size if needed
-	uint64_t file_size = uint64_make(inode->info.size_high, inode->info.size);
-	uint64_t true_size = uint64_add(offset, uint64_make(0, copy_pos));
-	if (uint64_less(file_size, true_size)) {
-		inode->info.size_high = true_size.high;
-		inode->info.size = true_size.low;
+	uint64_t file_size = ((uint64_t)inode->info.size_high << 32) | inode->info.size;
+	uint64_t true_size = offset + copy_pos;
+	if (file_size < true_size) {
+		inode->info.size_high = true_size >> 32;
+		inode->info.size = true_size;
 	}
 	// Update inode
 	inode->info.mtime = get_current_unix_time().val;
@@ -382,22 +541,74 @@ uint32_t ext2_write_data(ext_inode_t* inode, uint64_t offset, const void* buffer
 	return copy_pos;
 }
 
+// Write data to an inode from a specific offset and length.
+// If the offset is out of file range, sufficient space will try to be allocated towards the file.
+uint32_t ext2_write_data(ext_inode_t* inode, uint64_t offset, const void* buffer, uint32_t length) {
+	return ext2_write_data_internal(inode, offset, buffer, length, false);
+}
+
+// Copy data from one inode to another without going through user space. The destination's
+// blocks are allocated all at once and whole blocks are written straight to the disk in large runs.
+// Returns bytes copied
+uint32_t ext2_copy_data(ext_inode_t* in, uint64_t in_offset, ext_inode_t* out, uint64_t out_offset,
+						uint32_t length) {
+	if (in->inode == EXT2_INODE_INVALID || out->inode == EXT2_INODE_INVALID)
+		return -1;
+	if (length == 0)
+		return 0;
+	
+	// Allocate the whole destination range up front so its blocks end up next to each other
+	uint64_t end_pos = out_offset + length;
+	uint64_t space_allocated = (uint64_t)out->info.num_blocks << EXT2_INODE_BLOCK_COUNT_SIZE;
+	if (end_pos > space_allocated) {
+		if (end_pos != ext2_truncate_inode_zero(out, end_pos, false))
+			return -1;
+	}
+	
+	uint8_t* buffer = kmalloc(EXT2_COPY_BUFFER_SIZE);
+	if (!buffer)
+		return -1;
+	
+	uint32_t block_size = 1 << (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
+	uint32_t pos = 0;
+	while (pos < length) {
+		// Line each chunk up with the destination's blocks so only the ends are partial
+		uint32_t size = EXT2_COPY_BUFFER_SIZE - ((uint32_t)(out_offset + pos) & (block_size - 1));
+		if (size > length - pos)
+			size = length - pos;
+		
+		uint32_t ret = ext2_read_data(in, in_offset + pos, buffer, size);
+		if ((int32_t)ret <= 0)
+			break;
+		ret = ext2_write_data_internal(out, out_offset + pos, buffer, ret, true);
+		if ((int32_t)ret <= 0)
+			break;
+		
+		pos += ret;
+		if (ret < size)
+			break;
+	}
+	
+	kfree(buffer);
+	
+	return pos;
+}
+
 // Change the size of a file (if increasing the size, optionally, fill it with 0's).
 // Returns the new size of the file
 uint64_t ext2_truncate_inode_zero(ext_inode_t* inode, uint64_t size, bool fill) {
-	uint64_t space_allocated = uint64_shl(uint64_make(0, inode->info.num_blocks), EXT2_INODE_BLOCK_COUNT_SIZE);
-	uint64_t file_size = uint64_make(inode->info.size_high, inode->info.size);
+	uint64_t space_allocated = (uint64_t)inode->info.num_blocks << EXT2_INODE_BLOCK_COUNT_SIZE;
+	uint64_t file_size = ((uint64_t)inode->info.size_high << 32) | inode->info.size;
 	uint32_t block_size = 1 << (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
 	
 	// Increase the size
-	if (uint64_greater(size, file_size)) {
-		if (uint64_greater(size, space_allocated)) {
+	if (size > file_size) {
+		if (size > space_allocated) {
 			// Find out how many blocks we need to allocate
-			uint32_t num_blocks = uint64_shr(uint64_sub(size, uint64_inc(space_allocated)),
-											 EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size).low + 1;
-			uint32_t block_index = uint64_shr(space_allocated, EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size).low;
+			uint32_t num_blocks = ((size - space_allocated - 1) >> (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size)) + 1;
+			uint32_t block_index = space_allocated >> (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
 			while (num_blocks != 0) {
-				uint32_t new_block = ext2_allocate_block();
+				uint32_t new_block = ext2_allocate_inode_block(inode, block_index, num_blocks);
 				if (new_block == EXT2_BLOCK_ID_INVALID)
 					break;
 				
@@ -409,36 +620,35 @@ uint64_t ext2_truncate_inode_zero(ext_inode_t* inode, uint64_t size, bool fill)
 			}
 			
 			if (num_blocks != 0)
-				size = uint64_shl(uint64_make(0, inode->info.num_blocks), EXT2_INODE_BLOCK_COUNT_SIZE);
+				size = (uint64_t)inode->info.num_blocks << EXT2_INODE_BLOCK_COUNT_SIZE;
 		}
 		
 		// Save the new inode data
-		inode->info.size_high = size.high;
-		inode->info.size = size.low;
+		inode->info.size_high = size >> 32;
+		inode->info.size = size;
 		inode->info.mtime = get_current_unix_time().val;
 		ext2_set_inode_info(inode->inode, &inode->info);
 		
 		// Write zero's to this new space
 		if (fill) {
-			uint64_t diff = uint64_sub(size, file_size);
+			uint64_t diff = size - file_size;
 			uint8_t* buffer = (uint8_t*)kmalloc(block_size);
 			if (!buffer)
 				return file_size;
 			memset(buffer, 0, block_size);
 			// Write in block chunks
-			while (!uint64_equal(diff, uint64_make(0, 0))) {
-				uint32_t write_size = uint64_greater(diff, uint64_make(0, block_size)) ? block_size : diff.low;
+			while (diff != 0) {
+				uint32_t write_size = (diff > block_size) ? block_size : diff;
 				write_size = ext2_write_data(inode, file_size, buffer, write_size);
-				diff = uint64_sub(diff, uint64_make(0, write_size));
-				file_size = uint64_add(file_size, uint64_make(0, write_size));
+				diff -= write_size;
+				file_size += write_size;
 			}
 			kfree(buffer);
 		}
-	} else if (uint64_less(size, file_size)) {		// Decrease the size
+	} else if (size < file_size) {		// Decrease the size
 		// Figure out how many blocks we want to dealloc
-		uint32_t num_blocks = uint64_shr(uint64_sub(space_allocated, size),
-										 EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size).low;
-		uint32_t block_index = uint64_shr(space_allocated, EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size).low;
+		uint32_t num_blocks = (space_allocated - size) >> (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
+		uint32_t block_index = space_allocated >> (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
 		while (num_blocks != 0) {
 			block_index--;
 			
@@ -457,11 +667,11 @@ uint64_t ext2_truncate_inode_zero(ext_inode_t* inode, uint64_t size, bool fill)
 		
 		// Correct the size if we have to
 		if (num_blocks != 0)
-			size = uint64_shl(uint64_make(0, inode->info.num_blocks), EXT2_INODE_BLOCK_COUNT_SIZE);
+			size = (uint64_t)inode->info.num_blocks << EXT2_INODE_BLOCK_COUNT_SIZE;
 		
 		// Save the new inode data
-		inode->info.size_high = size.high;
-		inode->info.size = size.low;
+		inode->info.size_high = size >> 32;
+		inode->info.size = size;
 		inode->info.mtime = get_current_unix_time().val;
 		ext2_set_inode_info(inode->inode, &inode->info);
 	}
@@ -482,14 +692,11 @@ uint64_t ext2_truncate_inode(ext_inode_t* inode, uint64_t size) {
 uint64_t ext2_read_directory(ext_inode_t* inode, uint64_t offset, void* buffer, uint32_t length,
 							 uint32_t* length_out, ext_dentry_t* dentry_out) {
 	if (!ext2_inode_is_directory(inode))
-		return uint64_make(0, 0);
+		return 0;
 	
 	// Read the dentry at the offset
 	ext_dentry_t dentry = { 0 };
-	ata_partition_lock(&fs);
-	ata_partition_llseek(&fs, offset, SEEK_SET);
-	ata_partition_read(&fs, &dentry, sizeof(ext_dentry_t));
-	ata_partition_unlock(&fs);
+	ext2_cache_read(offset, &dentry, sizeof(ext_dentry_t), true);
 	
 	// Check if this is a valid entry
 	uint32_t block_size = 1 << (EXT2_BASE_BLOCK_SIZE_BITS + superblock.log_block_size);
@@ -511,9 +718,9 @@ uint64_t ext2_read_directory(ext_inode_t* inode, uint64_t offset, void* buffer,
 		*dentry_out = dentry;
 	
 	// Return the address of the next
-	offset = uint64_add(offset, uint64_make(0, dentry.rec_len));
-	if ((offset.low % block_size) == 0)
-		return uint64_make(0, 0);
+	offset += dentry.rec_len;
+	if (((uint32_t)offset & (block_size - 1)) == 0)
+		return 0;
 	
 	return offset;
 }
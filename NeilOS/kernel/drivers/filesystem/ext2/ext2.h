@@ -15,6 +15,9 @@
 #include "inode.h"
 #include "block.h"
 
+// Size of the buffer used to copy data between inodes
+#define EXT2_COPY_BUFFER_SIZE		(ATA_MAX_TRANSFER_BLOCKS * BLOCK_SIZE)
+
 // Initialize the EXT2 filesytem
 bool ext2_init(disk_info_t* disk);
 
@@ -24,6 +27,17 @@ disk_info_t* ext2_fs();
 ext_superblock_t* ext2_superblock();
 // Set the EXT2 superblock
 void ext2_set_superblock();
+// Mark the superblock and block group descriptor backups as needing to be written
+void ext2_set_backups_dirty();
+// Write the superblock and block group descriptor backups if they have changed.
+// Returns false if they couldn't be written
+bool ext2_write_backups();
+
+// Write all cached filesystem data to the disk
+void ext2_sync();
+// Write an inode's cached data and the filesystem metadata to the disk.
+// Returns false if any of it couldn't be written
+bool ext2_sync_inode(ext_inode_t* inode);
 
 // Gets the block size
 uint32_t ext2_get_block_size();
@@ -37,13 +51,17 @@ ext_inode_t ext2_open(const char* path);
 // so only call this when the file doesn't exist)
 ext_inode_t ext2_create(ext_inode_t* parent, const char* name, unsigned int mode);
 
-// Delete an inode at a particular path
+// Delete an inode at a particular path (the caller holds the parent's lock)
 bool ext2_delete(ext_inode_t* parent, const char* name);
 
 // Unlink (remove) an inode. (If this is a directory, it must be empty or space will be leaked)
 bool ext2_unlink(ext_inode_t* parent, const char* name);
 
-// Hard link an inode
+// Remove name from parent and drop a link to inode, the inode it names (the caller holds the locks
+// of both if they are shared)
+bool ext2_unlink_entry(ext_inode_t* parent, const char* name, ext_inode_t* inode);
+
+// Hard link a shared inode (the caller holds the new parent's lock)
 bool ext2_link(ext_inode_t* inode, ext_inode_t* new_parent, const char* new_name);
 
 /* Files */
@@ -55,6 +73,12 @@ uint32_t ext2_read_data(ext_inode_t* inode, uint64_t offset, void* buffer, uint3
 // If the offset is out of file range, sufficient space will try to be allocated towards the file.
 uint32_t ext2_write_data(ext_inode_t* inode, uint64_t offset, const void* buffer, uint32_t length);
 
+// Copy data from one inode to another without going through user space. The destination's
+// blocks are allocated all at once and whole blocks are written straight to the disk in large runs.
+// Returns bytes copied
+uint32_t ext2_copy_data(ext_inode_t* in, uint64_t in_offset, ext_inode_t* out, uint64_t out_offset,
+						uint32_t length);
+
 // Change the size of a file (if increasing the size, fill it with 0's).
 // Returns the new size of the file
 uint64_t ext2_truncate_inode(ext_inode_t* inode, uint64_t size);
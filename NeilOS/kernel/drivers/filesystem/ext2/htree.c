@@ -0,0 +1,708 @@
+//
+//  htree.c
+//  NeilOS
+//
+
+#include "htree.h"
+#include <memory/allocation/heap.h>
+#include <common/lib.h>
+#include "ext2.h"
+#include "inode.h"
+#include "block.h"
+#include "cache.h"
+
+// Layout of the index blocks
+#define DX_ROOT_INFO_OFFSET			24			// After the "." and ".." entries
+#define DX_NODE_ENTRIES_OFFSET		8			// After the empty dentry covering the node
+#define DX_BLOCK_MASK				0x0FFFFFFF
+#define DX_MAX_LEVELS				2			// The root and one level of nodes
+#define DX_HASH_EOF					0x7FFFFFFF
+
+// One level of the path from the root of the index to a leaf
+typedef struct {
+	int8_t* buffer;
+	uint32_t block_index;				// Which block of the directory this is
+	ext_dx_entry_t* entries;
+	uint32_t at;						// Entry that was followed to the next level
+} dx_frame_t;
+
+// A dentry in a leaf that is being split
+typedef struct {
+	uint32_t hash;
+	uint32_t offset;
+} dx_map_entry_t;
+
+// Returns true if a directory is indexed and the filesystem supports indexed directories
+bool ext2_htree_enabled(ext_inode_t* dir) {
+	return (ext2_superblock()->features_compat & EXT2_FEATURES_COMPAT_DIR_INDEX) &&
+		(dir->info.flags & EXT2_INODE_FLAG_INDEX);
+}
+
+/* Hashing */
+
+#define DX_TEA_DELTA				0x9E3779B9
+#define DX_MD4_K2					013240474631UL
+#define DX_MD4_K3					015666365641UL
+#define DX_MD4_F(x, y, z)			((z) ^ ((x) & ((y) ^ (z))))
+#define DX_MD4_G(x, y, z)			(((x) & (y)) + (((x) ^ (y)) & (z)))
+#define DX_MD4_H(x, y, z)			((x) ^ (y) ^ (z))
+#define DX_MD4_ROUND(f, a, b, c, d, x, s)	(a += f(b, c, d) + (x), a = (a << (s)) | (a >> (32 - (s))))
+
+// The original ext3 hash
+uint32_t dx_legacy_hash(const char* name, uint32_t length, bool is_unsigned) {
+	uint32_t hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+	uint32_t z;
+	for (z = 0; z < length; z++) {
+		int32_t c = is_unsigned ? (int32_t)(uint8_t)name[z] : (int32_t)(int8_t)name[z];
+		uint32_t hash = hash1 + (hash0 ^ (c * 7152373));
+		if (hash & 0x80000000)
+			hash -= 0x7FFFFFFF;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	
+	return hash0 << 1;
+}
+
+// Pack a name into words for the TEA and half MD4 hashes
+void dx_name_to_words(const char* name, int32_t length, uint32_t* buf, int32_t num, bool is_unsigned) {
+	uint32_t pad = (uint32_t)length | ((uint32_t)length << 8);
+	pad |= pad << 16;
+	
+	uint32_t val = pad;
+	if (length > num * 4)
+		length = num * 4;
+	int32_t z;
+	for (z = 0; z < length; z++) {
+		int32_t c = is_unsigned ? (int32_t)(uint8_t)name[z] : (int32_t)(int8_t)name[z];
+		val = c + (val << 8);
+		if ((z % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if (--num >= 0)
+		*buf++ = val;
+	while (--num >= 0)
+		*buf++ = pad;
+}
+
+void dx_tea_transform(uint32_t buf[4], uint32_t in[4]) {
+	uint32_t sum = 0;
+	uint32_t b0 = buf[0], b1 = buf[1];
+	uint32_t z;
+	for (z = 0; z < 16; z++) {
+		sum += DX_TEA_DELTA;
+		b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+		b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+	}
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+void dx_half_md4_transform(uint32_t buf[4], uint32_t in[8]) {
+	uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+	
+	// Round 1
+	DX_MD4_ROUND(DX_MD4_F, a, b, c, d, in[0], 3);
+	DX_MD4_ROUND(DX_MD4_F, d, a, b, c, in[1], 7);
+	DX_MD4_ROUND(DX_MD4_F, c, d, a, b, in[2], 11);
+	DX_MD4_ROUND(DX_MD4_F, b, c, d, a, in[3], 19);
+	DX_MD4_ROUND(DX_MD4_F, a, b, c, d, in[4], 3);
+	DX_MD4_ROUND(DX_MD4_F, d, a, b, c, in[5], 7);
+	DX_MD4_ROUND(DX_MD4_F, c, d, a, b, in[6], 11);
+	DX_MD4_ROUND(DX_MD4_F, b, c, d, a, in[7], 19);
+	
+	// Round 2
+	DX_MD4_ROUND(DX_MD4_G, a, b, c, d, in[1] + DX_MD4_K2, 3);
+	DX_MD4_ROUND(DX_MD4_G, d, a, b, c, in[3] + DX_MD4_K2, 5);
+	DX_MD4_ROUND(DX_MD4_G, c, d, a, b, in[5] + DX_MD4_K2, 9);
+	DX_MD4_ROUND(DX_MD4_G, b, c, d, a, in[7] + DX_MD4_K2, 13);
+	DX_MD4_ROUND(DX_MD4_G, a, b, c, d, in[0] + DX_MD4_K2, 3);
+	DX_MD4_ROUND(DX_MD4_G, d, a, b, c, in[2] + DX_MD4_K2, 5);
+	DX_MD4_ROUND(DX_MD4_G, c, d, a, b, in[4] + DX_MD4_K2, 9);
+	DX_MD4_ROUND(DX_MD4_G, b, c, d, a, in[6] + DX_MD4_K2, 13);
+	
+	// Round 3
+	DX_MD4_ROUND(DX_MD4_H, a, b, c, d, in[3] + DX_MD4_K3, 3);
+	DX_MD4_ROUND(DX_MD4_H, d, a, b, c, in[7] + DX_MD4_K3, 9);
+	DX_MD4_ROUND(DX_MD4_H, c, d, a, b, in[2] + DX_MD4_K3, 11);
+	DX_MD4_ROUND(DX_MD4_H, b, c, d, a, in[6] + DX_MD4_K3, 15);
+	DX_MD4_ROUND(DX_MD4_H, a, b, c, d, in[1] + DX_MD4_K3, 3);
+	DX_MD4_ROUND(DX_MD4_H, d, a, b, c, in[5] + DX_MD4_K3, 9);
+	DX_MD4_ROUND(DX_MD4_H, c, d, a, b, in[0] + DX_MD4_K3, 11);
+	DX_MD4_ROUND(DX_MD4_H, b, c, d, a, in[4] + DX_MD4_K3, 15);
+	
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+// Hash a name with a directory index hash
+uint32_t ext2_htree_hash(const char* name, uint32_t length, uint32_t version) {
+	uint32_t buf[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+	uint32_t in[8];
+	uint32_t hash = 0;
+	
+	// Use the filesystem's seed if it has one
+	uint32_t* seed = ext2_superblock()->hash_seed;
+	if (seed[0] || seed[1] || seed[2] || seed[3])
+		memcpy(buf, seed, sizeof(buf));
+	
+	bool is_unsigned = (version >= EXT2_DX_HASH_LEGACY_UNSIGNED);
+	int32_t left = length;
+	switch (version) {
+		case EXT2_DX_HASH_LEGACY:
+		case EXT2_DX_HASH_LEGACY_UNSIGNED:
+			hash = dx_legacy_hash(name, length, is_unsigned);
+			break;
+		case EXT2_DX_HASH_HALF_MD4:
+		case EXT2_DX_HASH_HALF_MD4_UNSIGNED:
+			do {
+				dx_name_to_words(name, left, in, 8, is_unsigned);
+				dx_half_md4_transform(buf, in);
+				left -= 32;
+				name += 32;
+			} while (left > 0);
+			hash = buf[1];
+			break;
+		case EXT2_DX_HASH_TEA:
+		case EXT2_DX_HASH_TEA_UNSIGNED:
+			do {
+				dx_name_to_words(name, left, in, 4, is_unsigned);
+				dx_tea_transform(buf, in);
+				left -= 16;
+				name += 16;
+			} while (left > 0);
+			hash = buf[0];
+			break;
+	}
+	
+	// The lowest bit marks hash collisions that continue into the next block
+	hash &= ~1;
+	if (hash == (DX_HASH_EOF << 1))
+		hash = (DX_HASH_EOF - 1) << 1;
+	return hash;
+}
+
+/* Blocks */
+
+// Read a block of a directory
+bool dx_read_block(ext_inode_t* dir, uint32_t index, int8_t* buffer) {
+	uint32_t block_id = ext2_get_block_id_at_index(dir, index);
+	if (block_id == EXT2_BLOCK_ID_INVALID)
+		return false;
+	
+	uint32_t block_size = ext2_get_block_size();
+	return ext2_cache_read(ext2_get_block_address(block_id), buffer, block_size, true) == block_size;
+}
+
+// Write a block of a directory
+bool dx_write_block(ext_inode_t* dir, uint32_t index, int8_t* buffer) {
+	uint32_t block_id = ext2_get_block_id_at_index(dir, index);
+	if (block_id == EXT2_BLOCK_ID_INVALID)
+		return false;
+	
+	uint32_t block_size = ext2_get_block_size();
+	return ext2_cache_write(ext2_get_block_address(block_id), buffer, block_size,
+							EXT2_CACHE_METADATA) == block_size;
+}
+
+// Add a new block to the end of a directory
+bool dx_append_block(ext_inode_t* dir, uint32_t* index_out) {
+	uint32_t bits = EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size;
+	uint32_t index = (((uint64_t)dir->info.size_high << 32) | dir->info.size) >> bits;
+	
+	uint32_t block_id = ext2_allocate_inode_block(dir, index, 1);
+	if (block_id == EXT2_BLOCK_ID_INVALID)
+		return false;
+	if (!ext2_set_block_id_at_index(dir, index, block_id)) {
+		ext2_dealloc_block(block_id);
+		return false;
+	}
+	
+	// Update the size
+	dir->info.num_blocks += (1 << bits) >> EXT2_INODE_BLOCK_COUNT_SIZE;
+	uint64_t size = (uint64_t)(index + 1) << bits;
+	dir->info.size_high = size >> 32;
+	dir->info.size = size;
+	ext2_set_inode_info(dir->inode, &dir->info);
+	
+	*index_out = index;
+	return true;
+}
+
+// Stop using the index of a directory (its blocks still read as a normal directory)
+void dx_drop_index(ext_inode_t* dir) {
+	dir->info.flags &= ~EXT2_INODE_FLAG_INDEX;
+	ext2_set_inode_info(dir->inode, &dir->info);
+}
+
+/* Index */
+
+static inline ext_dx_countlimit_t* dx_countlimit(dx_frame_t* frame) {
+	return (ext_dx_countlimit_t*)frame->entries;
+}
+
+// Which block of the directory the current entry of a frame points to
+static inline uint32_t dx_frame_block(dx_frame_t* frame) {
+	return frame->entries[frame->at].block & DX_BLOCK_MASK;
+}
+
+// Free the buffers used by a path
+void dx_release(dx_frame_t* frames) {
+	uint32_t z;
+	for (z = 0; z < DX_MAX_LEVELS; z++) {
+		if (frames[z].buffer)
+			kfree(frames[z].buffer);
+		frames[z].buffer = NULL;
+	}
+}
+
+// Returns true if an index block's entry count is sane
+bool dx_check_entries(dx_frame_t* frame, uint32_t offset) {
+	ext_dx_countlimit_t* countlimit = dx_countlimit(frame);
+	return (countlimit->limit == (ext2_get_block_size() - offset) / sizeof(ext_dx_entry_t) &&
+			countlimit->count > 0 && countlimit->count <= countlimit->limit);
+}
+
+// Find the last entry in an index block whose hash is not above a hash
+void dx_search_entries(dx_frame_t* frame, uint32_t hash) {
+	uint32_t low = 1, high = dx_countlimit(frame)->count;
+	while (low < high) {
+		uint32_t mid = (low + high) / 2;
+		if (frame->entries[mid].hash > hash)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	frame->at = low - 1;
+}
+
+// Get the hash version that a directory's index uses
+uint32_t dx_hash_version(ext_dx_root_info_t* info) {
+	uint32_t version = info->hash_version;
+	if (version <= EXT2_DX_HASH_TEA && (ext2_superblock()->flags & EXT2_FLAGS_UNSIGNED_HASH))
+		version += EXT2_DX_HASH_LEGACY_UNSIGNED;
+	return version;
+}
+
+// Walk the index from the root to the leaf where a name belongs.
+// Returns the number of levels walked, or 0 if the index is damaged
+uint32_t dx_probe(ext_inode_t* dir, const char* name, uint32_t length, uint32_t* hash_out, dx_frame_t* frames) {
+	uint32_t block_size = ext2_get_block_size();
+	memset(frames, 0, sizeof(dx_frame_t) * DX_MAX_LEVELS);
+	
+	// Read the root
+	dx_frame_t* frame = &frames[0];
+	frame->buffer = (int8_t*)kmalloc(block_size);
+	if (!frame->buffer || !dx_read_block(dir, 0, frame->buffer))
+		return 0;
+	
+	ext_dx_root_info_t* info = (ext_dx_root_info_t*)&frame->buffer[DX_ROOT_INFO_OFFSET];
+	if (info->reserved_zero != 0 || info->info_length != sizeof(ext_dx_root_info_t) ||
+		info->hash_version > EXT2_DX_HASH_TEA || info->indirect_levels >= DX_MAX_LEVELS)
+		return 0;
+	uint32_t offset = DX_ROOT_INFO_OFFSET + info->info_length;
+	frame->entries = (ext_dx_entry_t*)&frame->buffer[offset];
+	if (!dx_check_entries(frame, offset))
+		return 0;
+	
+	uint32_t hash = ext2_htree_hash(name, length, dx_hash_version(info));
+	*hash_out = hash;
+	
+	// Go down each level
+	uint32_t levels = info->indirect_levels + 1;
+	uint32_t level;
+	for (level = 0; level < levels; level++) {
+		frame = &frames[level];
+		dx_search_entries(frame, hash);
+		if (level == levels - 1)
+			break;
+	
+		// Read the next node
+		dx_frame_t* next = &frames[level + 1];
+		next->block_index = dx_frame_block(frame);
+		next->buffer = (int8_t*)kmalloc(block_size);
+		if (!next->buffer || !dx_read_block(dir, next->block_index, next->buffer))
+			return 0;
+		next->entries = (ext_dx_entry_t*)&next->buffer[DX_NODE_ENTRIES_OFFSET];
+		if (!dx_check_entries(next, DX_NODE_ENTRIES_OFFSET))
+			return 0;
+	}
+	
+	return levels;
+}
+
+// Move to the next leaf if names with this hash continue into it.
+// Returns false if there is nothing more to search
+bool dx_next_leaf(ext_inode_t* dir, dx_frame_t* frames, uint32_t levels, uint32_t hash) {
+	// Find the lowest level that has another entry
+	int32_t level = levels - 1;
+	while (level >= 0 && frames[level].at + 1 >= dx_countlimit(&frames[level])->count)
+		level--;
+	if (level < 0)
+		return false;
+	
+	frames[level].at++;
+	if ((frames[level].entries[frames[level].at].hash & ~1) != hash)
+		return false;
+	
+	// Load the nodes below it
+	for (level++; level < (int32_t)levels; level++) {
+		dx_frame_t* frame = &frames[level];
+		frame->block_index = dx_frame_block(&frames[level - 1]);
+		if (!dx_read_block(dir, frame->block_index, frame->buffer))
+			return false;
+		frame->at = 0;
+	}
+	
+	return true;
+}
+
+/* Leaves */
+
+// Search a leaf for a name. Returns the inode or EXT2_INODE_INVALID
+uint32_t dx_search_leaf(int8_t* buffer, const char* name, uint32_t length) {
+	uint32_t block_size = ext2_get_block_size();
+	uint32_t pos;
+	for (pos = 0; pos < block_size;) {
+		ext_dentry_t* dentry = (ext_dentry_t*)&buffer[pos];
+		if (dentry->rec_len < EXT2_BASE_DENTRY_SIZE)
+			break;
+	
+		if (dentry->inode != 0 && length == dentry->name_len &&
+			(strncmp(dentry->name, name, length) == 0))
+			return dentry->inode;
+	
+		pos += dentry->rec_len;
+	}
+	
+	return EXT2_INODE_INVALID;
+}
+
+// Put a new entry in the free space of a leaf. Returns false if it doesn't fit
+bool dx_insert_leaf(int8_t* buffer, ext_inode_t* inode, const char* name, uint32_t length) {
+	uint32_t block_size = ext2_get_block_size();
+	uint32_t entry_len = align_bytes(EXT2_BASE_DENTRY_SIZE + length, 4);
+	
+	uint32_t pos;
+	for (pos = 0; pos < block_size;) {
+		ext_dentry_t* dentry = (ext_dentry_t*)&buffer[pos];
+		if (dentry->rec_len < EXT2_BASE_DENTRY_SIZE)
+			return false;
+	
+		// Calculate space used by this dentry
+		uint32_t dentry_len = align_bytes(EXT2_BASE_DENTRY_SIZE + dentry->name_len, 4);
+		if (dentry->inode == 0)
+			dentry_len = 0;
+	
+		if (dentry_len + entry_len <= dentry->rec_len) {
+			uint32_t rec_len = dentry->rec_len - dentry_len;
+			if (dentry_len != 0)
+				dentry->rec_len = dentry_len;
+	
+			ext_dentry_t* new_dentry = (ext_dentry_t*)&buffer[pos + dentry_len];
+			new_dentry->inode = inode->inode;
+			new_dentry->rec_len = rec_len;
+			new_dentry->name_len = length;
+			new_dentry->file_type = ext2_inode_is_directory(inode) ? EXT2_FT_DIR : EXT2_FT_REG_FILE;
+			memcpy(new_dentry->name, name, length);
+			return true;
+		}
+	
+		pos += dentry->rec_len;
+	}
+	
+	return false;
+}
+
+// Copy entries into an empty leaf back to back (the last one takes up the rest of the block)
+void dx_pack_leaf(int8_t* dest, int8_t* src, dx_map_entry_t* map, uint32_t start, uint32_t end) {
+	uint32_t block_size = ext2_get_block_size();
+	memset(dest, 0, block_size);
+	
+	ext_dentry_t* last = (ext_dentry_t*)dest;
+	last->rec_len = block_size;
+	uint32_t pos = 0;
+	uint32_t z;
+	for (z = start; z < end; z++) {
+		ext_dentry_t* dentry = (ext_dentry_t*)&src[map[z].offset];
+		uint32_t len = align_bytes(EXT2_BASE_DENTRY_SIZE + dentry->name_len, 4);
+		memcpy(&dest[pos], dentry, EXT2_BASE_DENTRY_SIZE + dentry->name_len);
+		last = (ext_dentry_t*)&dest[pos];
+		last->rec_len = len;
+		pos += len;
+	}
+	last->rec_len += block_size - pos;
+}
+
+// Split the leaf at the bottom of a path in two by hash and add the new leaf to the index.
+// Returns the hash that starts the new leaf, or 0 on failure
+uint32_t dx_split_leaf(ext_inode_t* dir, dx_frame_t* frames, uint32_t levels, int8_t* leaf,
+					   int8_t* new_leaf, uint32_t hash_version) {
+	uint32_t block_size = ext2_get_block_size();
+	dx_frame_t* frame = &frames[levels - 1];
+	ext_dx_countlimit_t* countlimit = dx_countlimit(frame);
+	
+	// Growing the index itself is not supported
+	if (countlimit->count >= countlimit->limit)
+		return 0;
+	
+	dx_map_entry_t* map = (dx_map_entry_t*)kmalloc(sizeof(dx_map_entry_t) * (block_size / EXT2_BASE_DENTRY_SIZE));
+	int8_t* lower = (int8_t*)kmalloc(block_size);
+	if (!map || !lower)
+		goto fail;
+	
+	// Hash everything in the leaf and sort it
+	uint32_t num = 0;
+	uint32_t pos;
+	for (pos = 0; pos < block_size;) {
+		ext_dentry_t* dentry = (ext_dentry_t*)&leaf[pos];
+		if (dentry->rec_len < EXT2_BASE_DENTRY_SIZE)
+			break;
+	
+		if (dentry->inode != 0) {
+			dx_map_entry_t entry;
+			entry.hash = ext2_htree_hash(dentry->name, dentry->name_len, hash_version);
+			entry.offset = pos;
+	
+			uint32_t z = num++;
+			while (z > 0 && map[z - 1].hash > entry.hash) {
+				map[z] = map[z - 1];
+				z--;
+			}
+			map[z] = entry;
+		}
+	
+		pos += dentry->rec_len;
+	}
+	if (num < 2)
+		goto fail;
+	
+	// Names with the same hash that end up on both sides are marked as continued
+	uint32_t split = num / 2;
+	uint32_t split_hash = map[split].hash;
+	if (map[split - 1].hash == split_hash)
+		split_hash |= 1;
+	
+	uint32_t new_index;
+	if (!dx_append_block(dir, &new_index))
+		goto fail;
+	
+	dx_pack_leaf(new_leaf, leaf, map, split, num);
+	dx_pack_leaf(lower, leaf, map, 0, split);
+	memcpy(leaf, lower, block_size);
+	kfree(lower);
+	kfree(map);
+	
+	// Add the new leaf after the old one
+	uint32_t at = frame->at;
+	memmove(&frame->entries[at + 2], &frame->entries[at + 1],
+			(countlimit->count - at - 1) * sizeof(ext_dx_entry_t));
+	frame->entries[at + 1].hash = split_hash;
+	frame->entries[at + 1].block = new_index;
+	countlimit->count++;
+	if (!dx_write_block(dir, frame->block_index, frame->buffer) ||
+		!dx_write_block(dir, new_index, new_leaf))
+		return 0;
+	
+	return split_hash;
+
+fail:
+	if (map)
+		kfree(map);
+	if (lower)
+		kfree(lower);
+	return 0;
+}
+
+/* Public */
+
+// Find a name using a directory's index
+bool ext2_htree_find(ext_inode_t* dir, const char* name, uint32_t length,
+					 uint32_t* inode_out, uint32_t* block_index_out) {
+	dx_frame_t frames[DX_MAX_LEVELS];
+	uint32_t hash = 0;
+	uint32_t levels = dx_probe(dir, name, length, &hash, frames);
+	int8_t* leaf = levels ? (int8_t*)kmalloc(ext2_get_block_size()) : NULL;
+	if (!leaf) {
+		dx_release(frames);
+		return false;
+	}
+	
+	*inode_out = EXT2_INODE_INVALID;
+	bool valid = true;
+	do {
+		uint32_t index = dx_frame_block(&frames[levels - 1]);
+		if (!dx_read_block(dir, index, leaf)) {
+			valid = false;
+			break;
+		}
+	
+		uint32_t inode = dx_search_leaf(leaf, name, length);
+		if (inode != EXT2_INODE_INVALID) {
+			*inode_out = inode;
+			if (block_index_out)
+				*block_index_out = index;
+			break;
+		}
+	} while (dx_next_leaf(dir, frames, levels, hash));
+	
+	kfree(leaf);
+	dx_release(frames);
+	return valid;
+}
+
+// Add an entry to an indexed directory
+bool ext2_htree_add(ext_inode_t* dir, ext_inode_t* inode, const char* name) {
+	if (!ext2_htree_enabled(dir)) {
+		dx_drop_index(dir);
+		return false;
+	}
+	
+	uint32_t block_size = ext2_get_block_size();
+	uint32_t length = strlen(name);
+	dx_frame_t frames[DX_MAX_LEVELS];
+	uint32_t hash = 0;
+	uint32_t levels = dx_probe(dir, name, length, &hash, frames);
+	int8_t* leaf = levels ? (int8_t*)kmalloc(block_size) : NULL;
+	int8_t* new_leaf = levels ? (int8_t*)kmalloc(block_size) : NULL;
+	if (!leaf || !new_leaf)
+		goto fail;
+	
+	uint32_t index = dx_frame_block(&frames[levels - 1]);
+	if (!dx_read_block(dir, index, leaf))
+		goto fail;
+	
+	// Most of the time there is room in the leaf
+	if (dx_insert_leaf(leaf, inode, name, length)) {
+		if (!dx_write_block(dir, index, leaf))
+			goto fail;
+	} else {
+		// Otherwise split it and put the entry in whichever half it now belongs to
+		ext_dx_root_info_t* info = (ext_dx_root_info_t*)&frames[0].buffer[DX_ROOT_INFO_OFFSET];
+		uint32_t split_hash = dx_split_leaf(dir, frames, levels, leaf, new_leaf, dx_hash_version(info));
+		if (split_hash == 0)
+			goto fail;
+	
+		if (hash >= split_hash) {
+			frames[levels - 1].at++;
+			index = dx_frame_block(&frames[levels - 1]);
+			memcpy(leaf, new_leaf, block_size);
+		}
+		if (!dx_insert_leaf(leaf, inode, name, length) || !dx_write_block(dir, index, leaf))
+			goto fail;
+	}
+	
+	kfree(leaf);
+	kfree(new_leaf);
+	dx_release(frames);
+	return true;
+
+fail:
+	// Fall back to a normal directory
+	if (leaf)
+		kfree(leaf);
+	if (new_leaf)
+		kfree(new_leaf);
+	dx_release(frames);
+	dx_drop_index(dir);
+	return false;
+}
+
+// Turn a directory that has filled its first block into an indexed directory
+bool ext2_htree_create(ext_inode_t* dir) {
+	if (!(ext2_superblock()->features_compat & EXT2_FEATURES_COMPAT_DIR_INDEX) ||
+		(dir->info.flags & EXT2_INODE_FLAG_INDEX))
+		return false;
+	// Only directories with a single block are converted, so everything moves into one leaf
+	if (ext2_get_block_id_at_index(dir, 1) != EXT2_BLOCK_ID_INVALID)
+		return false;
+	
+	uint32_t block_size = ext2_get_block_size();
+	int8_t* root = (int8_t*)kmalloc(block_size);
+	int8_t* leaf = (int8_t*)kmalloc(block_size);
+	if (!root || !leaf || !dx_read_block(dir, 0, root))
+		goto fail;
+	
+	// The block has to start with "." and ".."
+	ext_dentry_t* dot = (ext_dentry_t*)root;
+	if (dot->name_len != 1 || dot->name[0] != '.' || dot->rec_len < EXT2_BASE_DENTRY_SIZE + 4 ||
+		dot->rec_len >= block_size)
+		goto fail;
+	ext_dentry_t* dotdot = (ext_dentry_t*)&root[dot->rec_len];
+	if (dotdot->name_len != 2 || dotdot->name[0] != '.' || dotdot->name[1] != '.' ||
+		dotdot->rec_len < EXT2_BASE_DENTRY_SIZE + 4 || dot->rec_len + dotdot->rec_len > block_size)
+		goto fail;
+	
+	// Move everything else into the first leaf
+	memset(leaf, 0, block_size);
+	ext_dentry_t* last = (ext_dentry_t*)leaf;
+	last->rec_len = block_size;
+	uint32_t leaf_pos = 0;
+	uint32_t pos;
+	for (pos = dot->rec_len + dotdot->rec_len; pos < block_size;) {
+		ext_dentry_t* dentry = (ext_dentry_t*)&root[pos];
+		if (dentry->rec_len < EXT2_BASE_DENTRY_SIZE)
+			break;
+	
+		if (dentry->inode != 0) {
+			uint32_t len = align_bytes(EXT2_BASE_DENTRY_SIZE + dentry->name_len, 4);
+			memcpy(&leaf[leaf_pos], dentry, EXT2_BASE_DENTRY_SIZE + dentry->name_len);
+			last = (ext_dentry_t*)&leaf[leaf_pos];
+			last->rec_len = len;
+			leaf_pos += len;
+		}
+	
+		pos += dentry->rec_len;
+	}
+	last->rec_len += block_size - leaf_pos;
+	
+	uint32_t leaf_index;
+	if (!dx_append_block(dir, &leaf_index) || !dx_write_block(dir, leaf_index, leaf))
+		goto fail;
+	
+	// Build the root
+	ext_dentry_t parent = *dotdot;
+	memset(&root[EXT2_BASE_DENTRY_SIZE + 4], 0, block_size - EXT2_BASE_DENTRY_SIZE - 4);
+	dot->rec_len = EXT2_BASE_DENTRY_SIZE + 4;
+	dotdot = (ext_dentry_t*)&root[dot->rec_len];
+	dotdot->inode = parent.inode;
+	dotdot->rec_len = block_size - dot->rec_len;
+	dotdot->name_len = 2;
+	dotdot->file_type = parent.file_type;
+	dotdot->name[0] = '.';
+	dotdot->name[1] = '.';
+	
+	ext_dx_root_info_t* info = (ext_dx_root_info_t*)&root[DX_ROOT_INFO_OFFSET];
+	info->hash_version = ext2_superblock()->def_hash_version;
+	if (info->hash_version > EXT2_DX_HASH_TEA)
+		info->hash_version = EXT2_DX_HASH_HALF_MD4;
+	info->info_length = sizeof(ext_dx_root_info_t);
+	
+	uint32_t offset = DX_ROOT_INFO_OFFSET + sizeof(ext_dx_root_info_t);
+	ext_dx_entry_t* entries = (ext_dx_entry_t*)&root[offset];
+	ext_dx_countlimit_t* countlimit = (ext_dx_countlimit_t*)entries;
+	countlimit->limit = (block_size - offset) / sizeof(ext_dx_entry_t);
+	countlimit->count = 1;
+	entries[0].block = leaf_index;
+	if (!dx_write_block(dir, 0, root))
+		goto fail;
+	
+	kfree(root);
+	kfree(leaf);
+	
+	dir->info.flags |= EXT2_INODE_FLAG_INDEX;
+	ext2_set_inode_info(dir->inode, &dir->info);
+	return true;
+
+fail:
+	if (root)
+		kfree(root);
+	if (leaf)
+		kfree(leaf);
+	return false;
+}
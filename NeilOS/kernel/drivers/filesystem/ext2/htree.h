@@ -0,0 +1,60 @@
+//
+//  htree.h
+//  NeilOS
+//
+
+#ifndef EXT2_HTREE_H
+#define EXT2_HTREE_H
+
+#include <common/types.h>
+#include "defs.h"
+
+// Directory index hashes
+#define EXT2_DX_HASH_LEGACY				0
+#define EXT2_DX_HASH_HALF_MD4			1
+#define EXT2_DX_HASH_TEA				2
+#define EXT2_DX_HASH_LEGACY_UNSIGNED	3
+#define EXT2_DX_HASH_HALF_MD4_UNSIGNED	4
+#define EXT2_DX_HASH_TEA_UNSIGNED		5
+
+// Follows the "." and ".." entries in the first block of an indexed directory
+typedef struct {
+	uint32_t reserved_zero;
+	uint8_t hash_version;				// Which hash is used for names
+	uint8_t info_length;				// Size of this structure (8)
+	uint8_t indirect_levels;			// Number of index levels below the root
+	uint8_t unused_flags;
+} ext_dx_root_info_t;
+
+// Overlays the hash of the first entry in an index block
+typedef struct {
+	uint16_t limit;						// Max number of entries in this block
+	uint16_t count;						// Number of entries in this block
+} ext_dx_countlimit_t;
+
+// Index entry (block is the index of a block in the directory, not a block ID)
+typedef struct {
+	uint32_t hash;						// Lowest hash found in the block
+	uint32_t block;
+} ext_dx_entry_t;
+
+// Returns true if a directory is indexed and the filesystem supports indexed directories
+bool ext2_htree_enabled(ext_inode_t* dir);
+
+// Hash a name with a directory index hash
+uint32_t ext2_htree_hash(const char* name, uint32_t length, uint32_t version);
+
+// Find a name using a directory's index. inode_out is EXT2_INODE_INVALID if the name doesn't exist
+// and block_index_out (optional) is the block in the directory that holds it.
+// Returns false if the index can't be used
+bool ext2_htree_find(ext_inode_t* dir, const char* name, uint32_t length,
+					 uint32_t* inode_out, uint32_t* block_index_out);
+
+// Add an entry to an indexed directory. If the index can't be kept up to date, it is dropped
+// and false is returned so that the entry can be added like a normal directory
+bool ext2_htree_add(ext_inode_t* dir, ext_inode_t* inode, const char* name);
+
+// Turn a directory that has filled its first block into an indexed directory
+bool ext2_htree_create(ext_inode_t* dir);
+
+#endif /* EXT2_HTREE_H */
@@ -0,0 +1,223 @@
+//
+//  icache.c
+//  NeilOS
+//
+
+#include "icache.h"
+#include "inode.h"
+#include "block.h"
+#include <memory/allocation/heap.h>
+#include <common/concurrency/semaphore.h>
+#include <common/lib.h>
+
+ext_inode_t* inode_hash[EXT2_ICACHE_HASH_SIZE];
+// Inodes with no references (most recently used at the head)
+ext_inode_t* unused_head = NULL;
+ext_inode_t* unused_tail = NULL;
+uint32_t num_unused = 0;
+mutex_t icache_lock = MUTEX_UNLOCKED;
+
+// Helpers for the unused list
+void ext2_icache_unused_unlink(ext_inode_t* i) {
+	if (i->lru_prev)
+		i->lru_prev->lru_next = i->lru_next;
+	else
+		unused_head = i->lru_next;
+	if (i->lru_next)
+		i->lru_next->lru_prev = i->lru_prev;
+	else
+		unused_tail = i->lru_prev;
+	i->lru_next = NULL;
+	i->lru_prev = NULL;
+	num_unused--;
+}
+
+void ext2_icache_unused_push(ext_inode_t* i) {
+	i->lru_prev = NULL;
+	i->lru_next = unused_head;
+	if (unused_head)
+		unused_head->lru_prev = i;
+	unused_head = i;
+	if (!unused_tail)
+		unused_tail = i;
+	num_unused++;
+}
+
+// Find an inode (cache must be locked)
+ext_inode_t* ext2_icache_find(uint32_t inode) {
+	ext_inode_t* i = inode_hash[inode % EXT2_ICACHE_HASH_SIZE];
+	while (i) {
+		if (i->inode == inode)
+			return i;
+		i = i->hash_next;
+	}
+	return NULL;
+}
+
+// Take an inode out of the hash table (cache must be locked)
+void ext2_icache_unhash(ext_inode_t* i) {
+	ext_inode_t** p = &inode_hash[i->inode % EXT2_ICACHE_HASH_SIZE];
+	while (*p) {
+		if (*p == i) {
+			*p = i->hash_next;
+			break;
+		}
+		p = &(*p)->hash_next;
+	}
+	i->hash_next = NULL;
+}
+
+// Free an inode's memory
+void ext2_icache_release(ext_inode_t* i) {
+	if (i->cached_block)
+		kfree(i->cached_block);
+	kfree(i);
+}
+
+// Remove an unused inode from the cache, writing it back if needed (cache must be locked)
+void ext2_icache_free(ext_inode_t* i) {
+	ext2_icache_unhash(i);
+	ext2_icache_unused_unlink(i);
+	
+	if (i->dirty)
+		ext2_write_inode_info(i->inode, &i->info);
+	ext2_discard_reservation(i->inode);
+	ext2_icache_release(i);
+}
+
+// Get the shared in memory inode for an inode number (must be released with ext2_inode_put).
+// Returns NULL if the inode couldn't be loaded
+ext_inode_t* ext2_inode_get(uint32_t inode) {
+	if (inode == EXT2_INODE_INVALID)
+		return NULL;
+	
+	down(&icache_lock);
+	ext_inode_t* i = ext2_icache_find(inode);
+	if (i) {
+		if (i->ref_count == 0)
+			ext2_icache_unused_unlink(i);
+		i->ref_count++;
+		up(&icache_lock);
+		return i;
+	}
+	
+	i = (ext_inode_t*)kmalloc(sizeof(ext_inode_t));
+	if (!i) {
+		up(&icache_lock);
+		return NULL;
+	}
+	memset(i, 0, sizeof(ext_inode_t));
+	i->inode = inode;
+	i->info = ext2_read_inode_info(inode);
+	i->ref_count = 1;
+	i->lock = RW_SEMAPHORE_UNLOCKED;
+	
+	i->hash_next = inode_hash[inode % EXT2_ICACHE_HASH_SIZE];
+	inode_hash[inode % EXT2_ICACHE_HASH_SIZE] = i;
+	up(&icache_lock);
+	
+	return i;
+}
+
+// Release a reference to a shared inode
+void ext2_inode_put(ext_inode_t* inode) {
+	if (!inode)
+		return;
+	
+	down(&icache_lock);
+	if (--inode->ref_count == 0) {
+		if (inode->invalid) {
+			// It's gone from the disk and the cache already
+			ext2_icache_release(inode);
+			up(&icache_lock);
+			return;
+		}
+	
+		// Keep it around in case it is used again soon
+		ext2_icache_unused_push(inode);
+		if (num_unused > EXT2_ICACHE_NUM_UNUSED)
+			ext2_icache_free(unused_tail);
+	}
+	up(&icache_lock);
+}
+
+// Copy out an inode's info if it is in memory
+bool ext2_icache_get_info(uint32_t inode, ext_inode_info_t* info) {
+	down(&icache_lock);
+	ext_inode_t* i = ext2_icache_find(inode);
+	if (i)
+		*info = i->info;
+	up(&icache_lock);
+	
+	return i != NULL;
+}
+
+// Update an inode's info if it is in memory (it is written to the disk later)
+bool ext2_icache_set_info(uint32_t inode, ext_inode_info_t* info) {
+	down(&icache_lock);
+	ext_inode_t* i = ext2_icache_find(inode);
+	if (i) {
+		if (&i->info != info)
+			i->info = *info;
+		i->dirty = true;
+	}
+	up(&icache_lock);
+	
+	return i != NULL;
+}
+
+// Drop the in memory state of an inode that has been freed (an inode still in use is only taken
+// out of the cache, and freed by the last ext2_inode_put)
+void ext2_icache_invalidate(uint32_t inode) {
+	down(&icache_lock);
+	ext_inode_t* i = ext2_icache_find(inode);
+	if (i) {
+		// The inode number can be reused, so nothing can find this one anymore
+		ext2_icache_unhash(i);
+		i->dirty = false;
+		if (i->ref_count == 0) {
+			ext2_icache_unused_unlink(i);
+			ext2_icache_release(i);
+		} else {
+			// It may still be open, so the last ext2_inode_put frees it. Forget the block cache
+			// (wait for anyone using it)
+			i->invalid = true;
+			spin_lock(&i->cached_block_lock);
+			i->cached_block_starting_index = -1;
+			if (i->cached_block) {
+				kfree(i->cached_block);
+				i->cached_block = NULL;
+			}
+			spin_unlock(&i->cached_block_lock);
+		}
+	}
+	up(&icache_lock);
+}
+
+// Write back all dirty inodes
+void ext2_icache_writeback() {
+	down(&icache_lock);
+	uint32_t z;
+	for (z = 0; z < EXT2_ICACHE_HASH_SIZE; z++) {
+		ext_inode_t* i = inode_hash[z];
+		while (i) {
+			if (i->dirty) {
+				ext2_write_inode_info(i->inode, &i->info);
+				i->dirty = false;
+			}
+			i = i->hash_next;
+		}
+	}
+	up(&icache_lock);
+}
+
+// Write back a single inode
+void ext2_icache_writeback_inode(uint32_t inode) {
+	down(&icache_lock);
+	ext_inode_t* i = ext2_icache_find(inode);
+	if (i && i->dirty) {
+		ext2_write_inode_info(i->inode, &i->info);
+		i->dirty = false;
+	}
+	up(&icache_lock);
+}
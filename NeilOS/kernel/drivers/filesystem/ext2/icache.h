@@ -0,0 +1,38 @@
+//
+//  icache.h
+//  NeilOS
+//
+
+#ifndef EXT2_ICACHE_H
+#define EXT2_ICACHE_H
+
+#include <common/types.h>
+#include "defs.h"
+
+#define EXT2_ICACHE_HASH_SIZE		128
+#define EXT2_ICACHE_NUM_UNUSED		128		// Inodes without references that are kept around
+
+// Get the shared in memory inode for an inode number (must be released with ext2_inode_put).
+// Returns NULL if the inode couldn't be loaded
+ext_inode_t* ext2_inode_get(uint32_t inode);
+
+// Release a reference to a shared inode
+void ext2_inode_put(ext_inode_t* inode);
+
+// Copy out an inode's info if it is in memory
+bool ext2_icache_get_info(uint32_t inode, ext_inode_info_t* info);
+
+// Update an inode's info if it is in memory (it is written to the disk later)
+bool ext2_icache_set_info(uint32_t inode, ext_inode_info_t* info);
+
+// Drop the in memory state of an inode that has been freed (an inode still in use is only taken
+// out of the cache, and freed by the last ext2_inode_put)
+void ext2_icache_invalidate(uint32_t inode);
+
+// Write back all dirty inodes
+void ext2_icache_writeback();
+
+// Write back a single inode
+void ext2_icache_writeback_inode(uint32_t inode);
+
+#endif /* EXT2_ICACHE_H */
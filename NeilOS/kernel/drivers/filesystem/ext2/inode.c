@@ -11,47 +11,52 @@
 #include <memory/allocation/heap.h>
 #include "ext2.h"
 #include "block.h"
+#include "cache.h"
+#include "dcache.h"
+#include "icache.h"
+#include "htree.h"
 
-// Get information about an inode
-ext_inode_info_t ext2_get_inode_info(uint32_t inode) {
-	ext_inode_info_t info;
-	
+// Get the disk address of an inode's info
+uint64_t ext2_get_inode_address(uint32_t inode) {
 	// Find which block group the inode resides in
 	uint32_t block_group = (inode - 1) / ext2_superblock()->inodes_per_group;
 	uint32_t local_inode = (inode - 1) % ext2_superblock()->inodes_per_group;
 	
 	// Read the inode relative to its inode table
 	ext_block_group_descriptor_t group_info = ext2_get_block_group_info(block_group);
-	uint64_t addr = uint64_shl(uint64_make(0, group_info.inode_table),
-							   EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
-	addr = uint64_add(addr, uint64_make(0, ext2_superblock()->inode_size * local_inode));
-	
-	// Read the info
-	ata_partition_lock(ext2_fs());
-	ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-	ata_partition_read(ext2_fs(), &info, sizeof(ext_inode_info_t));
-	ata_partition_unlock(ext2_fs());
-	
+	uint64_t addr = (uint64_t)group_info.inode_table << (EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
+	return addr + ext2_superblock()->inode_size * local_inode;
+}
+
+// Read an inode's info from the disk
+ext_inode_info_t ext2_read_inode_info(uint32_t inode) {
+	ext_inode_info_t info;
+	ext2_cache_read(ext2_get_inode_address(inode), &info, sizeof(ext_inode_info_t), true);
 	return info;
 }
 
+// Write an inode's info to the disk
+void ext2_write_inode_info(uint32_t inode, ext_inode_info_t* data) {
+	ext2_cache_write(ext2_get_inode_address(inode), data, sizeof(ext_inode_info_t), EXT2_CACHE_METADATA);
+}
+
+// Get information about an inode
+ext_inode_info_t ext2_get_inode_info(uint32_t inode) {
+	// Use the in memory copy if there is one
+	ext_inode_info_t info;
+	if (ext2_icache_get_info(inode, &info))
+		return info;
+	
+	return ext2_read_inode_info(inode);
+}
+
 // Set information about an inode
 void ext2_set_inode_info(uint32_t inode, ext_inode_info_t* data) {
-	// Find which block group the inode resides in
-	uint32_t block_group = (inode - 1) / ext2_superblock()->inodes_per_group;
-	uint32_t local_inode = (inode - 1) % ext2_superblock()->inodes_per_group;
+	// If the inode is in memory, it will be written back later
+	if (ext2_icache_set_info(inode, data))
+		return;
 	
-	// Read the inode relative to its inode table
-	ext_block_group_descriptor_t group_info = ext2_get_block_group_info(block_group);
-	uint64_t addr = uint64_shl(uint64_make(0, group_info.inode_table),
-							   EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
-	addr = uint64_add(addr, uint64_make(0, ext2_superblock()->inode_size * local_inode));
-	
-	// Read the info
-	ata_partition_lock(ext2_fs());
-	ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-	ata_partition_write(ext2_fs(), data, sizeof(ext_inode_info_t));
-	ata_partition_unlock(ext2_fs());
+	ext2_write_inode_info(inode, data);
 }
 
 // Returns true if the inode is a directory inode
@@ -87,15 +92,11 @@ uint32_t ext2_allocate_inode(bool directory) {
 		uint32_t bitmap_block;
 		for (bitmap_block = desc.inode_bitmap; bitmap_block < desc.inode_bitmap + bitmap_blocks_per_group; bitmap_block++) {
 			// Read the bitmap
-			ata_partition_lock(ext2_fs());
-			ata_partition_llseek(ext2_fs(), ext2_get_block_address(bitmap_block), SEEK_SET);
-			if (ata_partition_read(ext2_fs(), bitmap, block_size) == -1) {
+			if (ext2_cache_read(ext2_get_block_address(bitmap_block), bitmap, block_size, true) != block_size) {
 				// Error
-				ata_partition_unlock(ext2_fs());
 				kfree(bitmap);
 				return EXT2_INODE_INVALID;
 			}
-			ata_partition_unlock(ext2_fs());
 			
 			// Check each block in the bitmap
 			uint32_t blocks;
@@ -117,10 +118,7 @@ uint32_t ext2_allocate_inode(bool directory) {
 					
 					// Mark this inode as used
 					bitmap[blocks] |= 1 << z;
-					ata_partition_lock(ext2_fs());
-					ata_partition_llseek(ext2_fs(), ext2_get_block_address(bitmap_block), SEEK_SET);
-					ata_partition_write(ext2_fs(), bitmap, block_size);
-					ata_partition_unlock(ext2_fs());
+					ext2_cache_write(ext2_get_block_address(bitmap_block), bitmap, block_size, EXT2_CACHE_METADATA);
 					
 					// Update the block group descriptor
 					desc.free_inodes--;
@@ -168,22 +166,26 @@ bool ext2_dealloc_inode(ext_inode_t* inode) {
 	uint32_t relative_bitmap_block = relative_block % inodes_per_bitmap_group;
 	
 	// Read the bitmap
-	ata_partition_lock(ext2_fs());
-	ata_partition_llseek(ext2_fs(), ext2_get_block_address(bitmap_block), SEEK_SET);
-	ata_partition_read(ext2_fs(), bitmap, block_size);
+	ext2_cache_read(ext2_get_block_address(bitmap_block), bitmap, block_size, true);
 	
 	// Set the specific block as free and write the data back
 	bitmap[relative_bitmap_block / 8] &= ~(1 << (relative_bitmap_block % 8));
-	ata_partition_llseek(ext2_fs(), ext2_get_block_address(bitmap_block), SEEK_SET);
-	ata_partition_write(ext2_fs(), bitmap, block_size);
-	ata_partition_unlock(ext2_fs());
+	ext2_cache_write(ext2_get_block_address(bitmap_block), bitmap, block_size, EXT2_CACHE_METADATA);
 	
 	kfree(bitmap);
 	
 	// Update the block group info
 	desc.free_inodes++;
-	if (ext2_inode_is_directory(inode))
+	if (ext2_inode_is_directory(inode)) {
 		desc.used_dirs_count--;
+		
+		// Forget anything cached about this directory's entries since the inode can be reused
+		ext2_dcache_remove_directory(inode->inode);
+	}
+	
+	// The in memory copy is no longer valid either
+	ext2_icache_invalidate(inode->inode);
+	ext2_discard_reservation(inode->inode);
 	
 	ext2_set_block_group_info(group, &desc);
 	
@@ -214,15 +216,25 @@ ext_inode_t ext2_get_relative_inode(const char* path, ext_inode_t* inode) {
 		return ext_inode_create(EXT2_INODE_INVALID);
 	uint32_t path_length = strlen(path);
 	
+	// Check the dentry cache first
+	uint32_t cached_inode = EXT2_INODE_INVALID;
+	if (ext2_dcache_lookup(inode->inode, path, path_length, &cached_inode)) {
+		kfree(buffer);
+		return ext_inode_create(cached_inode);
+	}
+	
+	// Indexed directories only need to look at one block
+	if (ext2_htree_enabled(inode) && ext2_htree_find(inode, path, path_length, &cached_inode, NULL)) {
+		kfree(buffer);
+		ext2_dcache_add(inode->inode, path, path_length, cached_inode);
+		return ext_inode_create(cached_inode);
+	}
+	
 	// Loop over all valid blocks to find a matching inode
 	while ((block_id = ext2_get_block_id_at_index(inode, index++)) != EXT2_BLOCK_ID_INVALID) {
 		// Read the block
-		uint64_t addr = uint64_shl(uint64_make(0, block_id),
-								   EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
-		ata_partition_lock(ext2_fs());
-		ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-		ata_partition_read(ext2_fs(), buffer, block_size);
-		ata_partition_unlock(ext2_fs());
+		uint64_t addr = ext2_get_block_address(block_id);
+		ext2_cache_read(addr, buffer, block_size, true);
 		
 		// Loop through all the possible dentries
 		uint32_t pos;
@@ -233,6 +245,7 @@ ext_inode_t ext2_get_relative_inode(const char* path, ext_inode_t* inode) {
 			if (path_length == dentry->name_len &&
 				(strncmp(dentry->name, path, path_length) == 0)) {
 				// We found a match
+				ext2_dcache_add(inode->inode, path, path_length, dentry->inode);
 				ext_inode_t ret = ext_inode_create(dentry->inode);
 				kfree(buffer);
 				return ret;
@@ -244,7 +257,8 @@ ext_inode_t ext2_get_relative_inode(const char* path, ext_inode_t* inode) {
 	}
 	kfree(buffer);
 	
-	// No matching inode was found
+	// No matching inode was found (remember that so the next lookup doesn't have to search)
+	ext2_dcache_add(inode->inode, path, path_length, EXT2_INODE_INVALID);
 	return ext_inode_create(EXT2_INODE_INVALID);
 }
 
@@ -261,18 +275,21 @@ bool ext2_link_inode(ext_inode_t* parent, ext_inode_t* inode, const char* name)
 	uint32_t name_len = strlen(name);
 	uint32_t entry_len = align_bytes(EXT2_BASE_DENTRY_SIZE + name_len, 4);
 	
+	// Indexed directories keep names grouped by hash (if the index gets dropped, add it normally)
+	if ((parent->info.flags & EXT2_INODE_FLAG_INDEX) && ext2_htree_add(parent, inode, name)) {
+		kfree(buffer);
+		goto linked;
+	}
+	
 	// Loop over all valid blocks to find a matching inode
-	uint64_t last_addr = uint64_make(0, 0);
+	uint64_t last_addr = 0;
 	uint32_t last_pos = 0;
 	
 	// Loop all the blocks
 	while ((block_id = ext2_get_block_id_at_index(parent, index++)) != EXT2_BLOCK_ID_INVALID) {
 		// Read the block
 		uint64_t addr = ext2_get_block_address(block_id);
-		ata_partition_lock(ext2_fs());
-		ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-		ata_partition_read(ext2_fs(), buffer, block_size);
-		ata_partition_unlock(ext2_fs());
+		ext2_cache_read(addr, buffer, block_size, true);
 		
 		// Loop through all the possible dentries
 		uint32_t pos;
@@ -297,16 +314,9 @@ bool ext2_link_inode(ext_inode_t* parent, ext_inode_t* inode, const char* name)
 					dentry->rec_len = dentry_len;
 
 				// Write it
-				ata_partition_lock(ext2_fs());
-				ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-				ata_partition_write(ext2_fs(), buffer, block_size);
-				ata_partition_unlock(ext2_fs());
+				ext2_cache_write(addr, buffer, block_size, EXT2_CACHE_METADATA);
 				kfree(buffer);
-				
-				// Update the linked inode
-				inode->info.link_count++;
-				ext2_set_inode_info(inode->inode, &inode->info);
-				return true;
+				goto linked;
 			}
 			
 			// Update the last address
@@ -318,23 +328,26 @@ bool ext2_link_inode(ext_inode_t* parent, ext_inode_t* inode, const char* name)
 		}
 	}
 	
+	// A directory that outgrows its first block gets indexed if the filesystem supports it
+	if (ext2_htree_create(parent) && ext2_htree_add(parent, inode, name)) {
+		kfree(buffer);
+		goto linked;
+	}
+	
 	// We could not find an available spot so we must make a new block
-	uint32_t new_block = ext2_allocate_block();
+	uint32_t new_block = ext2_allocate_inode_block(parent, index - 1, 1);
 	if (!new_block) {
 		kfree(buffer);
 		return false;
 	}
 	
 	// Update the last entry to point to the end of the block
-	if (!uint64_equal(last_addr, uint64_make(0, 0))) {
+	if (last_addr != 0) {
 		ext_dentry_t* dentry = (ext_dentry_t*)&buffer[last_pos];
 		dentry->rec_len = block_size - last_pos;
 		
 		// Write it
-		ata_partition_lock(ext2_fs());
-		ata_partition_llseek(ext2_fs(), last_addr, SEEK_SET);
-		ata_partition_write(ext2_fs(), buffer, block_size);
-		ata_partition_unlock(ext2_fs());
+		ext2_cache_write(last_addr, buffer, block_size, EXT2_CACHE_METADATA);
 	}
 	
 	// Construct a new dentry
@@ -355,10 +368,7 @@ bool ext2_link_inode(ext_inode_t* parent, ext_inode_t* inode, const char* name)
 	memcpy(buffer, &new_dentry, name_len + EXT2_BASE_DENTRY_SIZE);
 	memcpy(&buffer[entry_len], &new_dentry2, sizeof(ext_dentry_t));
 	uint64_t addr = ext2_get_block_address(new_block);
-	ata_partition_lock(ext2_fs());
-	ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-	ata_partition_write(ext2_fs(), buffer, sizeof(ext_dentry_t) * 2);
-	ata_partition_unlock(ext2_fs());
+	ext2_cache_write(addr, buffer, sizeof(ext_dentry_t) * 2, EXT2_CACHE_METADATA);
 	
 	// Update the blocks
 	if (!ext2_set_block_id_at_index(parent, index - 1, new_block)) {
@@ -369,16 +379,19 @@ bool ext2_link_inode(ext_inode_t* parent, ext_inode_t* inode, const char* name)
 	
 	// Update the size
 	parent->info.num_blocks += block_size >> EXT2_INODE_BLOCK_COUNT_SIZE;
-	uint64_t size = uint64_shl(uint64_make(0, parent->info.num_blocks), EXT2_INODE_BLOCK_COUNT_SIZE);
+	uint64_t size = (uint64_t)parent->info.num_blocks << EXT2_INODE_BLOCK_COUNT_SIZE;
 	
 	// Save the new inode data
-	parent->info.size_high = size.high;
-	parent->info.size = size.low;
+	parent->info.size_high = size >> 32;
+	parent->info.size = size;
 	ext2_set_inode_info(parent->inode, &parent->info);
+	kfree(buffer);
 	
+linked:
 	// Update the linked inode
 	inode->info.link_count++;
 	ext2_set_inode_info(inode->inode, &inode->info);
+	ext2_dcache_add(parent->inode, name, name_len, inode->inode);
 	
 	return true;
 }
@@ -394,14 +407,22 @@ bool ext2_unlink_inode(ext_inode_t* parent, const char* name) {
 		return false;
 	uint32_t name_len = strlen(name);
 	
+	// Indexed directories can tell us which block the entry is in
+	bool indexed = (parent->info.flags & EXT2_INODE_FLAG_INDEX) != 0;
+	uint32_t found_inode = EXT2_INODE_INVALID;
+	if (indexed && ext2_htree_enabled(parent) &&
+		ext2_htree_find(parent, name, name_len, &found_inode, &index)) {
+		if (found_inode == EXT2_INODE_INVALID) {
+			kfree(buffer);
+			return false;
+		}
+	}
+	
 	// Loop over all valid blocks to find a matching inode
 	while ((block_id = ext2_get_block_id_at_index(parent, index++)) != EXT2_BLOCK_ID_INVALID) {
 		// Read the block
 		uint64_t addr = ext2_get_block_address(block_id);
-		ata_partition_lock(ext2_fs());
-		ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-		ata_partition_read(ext2_fs(), buffer, block_size);
-		ata_partition_unlock(ext2_fs());
+		ext2_cache_read(addr, buffer, block_size, true);
 		
 		// Loop through all the possible dentries
 		uint32_t pos;
@@ -409,19 +430,19 @@ bool ext2_unlink_inode(ext_inode_t* parent, const char* name) {
 			ext_dentry_t* dentry = (ext_dentry_t*)&buffer[pos];
 			
 			// Check if we have a match
-			if (name_len == dentry->name_len &&
+			if (dentry->inode != 0 && name_len == dentry->name_len &&
 				(strncmp(dentry->name, name, name_len) == 0)) {
-				// Check if this entire block is empty
-				bool empty = true;
+				// This name doesn't exist anymore
+				ext2_dcache_remove(parent->inode, name, name_len);
+				
+				// Check if this entire block is empty (the blocks of an indexed directory are
+				// referenced by the index, so they are never freed)
+				bool empty = !indexed;
 				uint32_t backup_pos = pos;
-				for (pos = 0; pos < block_size;) {
-					// Don't consider the one we are deleting
-					if (pos == backup_pos)
-						continue;
-					
-					// Check if it is a valid entry
+				for (pos = 0; pos < block_size && empty;) {
+					// Check if it is a valid entry (other than the one we are deleting)
 					dentry = (ext_dentry_t*)&buffer[pos];
-					if (dentry->inode != 0) {
+					if (pos != backup_pos && dentry->inode != 0) {
 						empty = false;
 						break;
 					}
@@ -432,6 +453,7 @@ bool ext2_unlink_inode(ext_inode_t* parent, const char* name) {
 				
 				// Delete this block if it is empty
 				if (empty) {
+					kfree(buffer);
 					if (!ext2_set_block_id_at_index(parent, index - 1, EXT2_BLOCK_ID_INVALID))
 						return false;
 					return ext2_dealloc_block(block_id);
@@ -444,10 +466,8 @@ bool ext2_unlink_inode(ext_inode_t* parent, const char* name) {
 				dentry->rec_len = rec_len;
 				
 				// Write it
-				ata_partition_lock(ext2_fs());
-				ata_partition_llseek(ext2_fs(), addr, SEEK_SET);
-				ata_partition_write(ext2_fs(), buffer, block_size);
-				ata_partition_unlock(ext2_fs());
+				ext2_cache_write(addr, buffer, block_size, EXT2_CACHE_METADATA);
+				kfree(buffer);
 				
 				return true;
 			}
@@ -12,6 +12,10 @@
 #include <common/types.h>
 #include "defs.h"
 
+// Read and write an inode's info on the disk (bypasses the inode cache)
+ext_inode_info_t ext2_read_inode_info(uint32_t inode);
+void ext2_write_inode_info(uint32_t inode, ext_inode_info_t* data);
+
 // Get information about an inode
 ext_inode_info_t ext2_get_inode_info(uint32_t inode);
 
@@ -27,6 +31,9 @@ uint32_t ext2_allocate_inode(bool directory);
 // Dealloc an inode
 bool ext2_dealloc_inode(ext_inode_t* inode);
 
+// Helper function to align things to n bytes
+uint32_t align_bytes(uint32_t bytes, uint32_t n);
+
 // Return the inode for the relative path in relation to the given inode.
 ext_inode_t ext2_get_relative_inode(const char* path, ext_inode_t* info);
 
@@ -4,13 +4,18 @@
 #include <drivers/ATA/ata.h>
 #include <drivers/ipc/pipe/fifo.h>
 #include "ext2/ext2.h"
+#include "ext2/cache.h"
+#include "ext2/icache.h"
 #include "path.h"
+#include "vfs.h"
+#include "tmpfs/tmpfs.h"
+#include "procfs/procfs.h"
 #include <syscalls/interrupt.h>
 
 // Internal information for a file
 typedef struct {
 	uint64_t offset;
-	ext_inode_t inode;
+	ext_inode_t* inode;			// Shared with all other descriptors on this inode
 } file_info_t;
 
 // Internal information for a directory
@@ -18,7 +23,7 @@ typedef struct {
 	uint64_t offset;			// Dentry absolute byte address
 	uint32_t index;				// Dentry index
 	uint32_t bank_index;		// Dentry's bank index in the inode
-	ext_inode_t inode;
+	ext_inode_t* inode;			// Shared with all other descriptors on this inode
 } directory_info_t;
 
 // Filesystem disk partition
@@ -48,7 +53,7 @@ bool device_file_add(char* name, file_descriptor_t* (*open)(const char*, uint32_
 		return false;
 	}
 	
-	uint32_t inode = ((file_info_t*)file.info)->inode.inode;
+	uint32_t inode = ((file_info_t*)file.info)->inode->inode;
 	fclose(&file);
 	
 	device_file_t* t = kmalloc(sizeof(device_file_t));
@@ -92,19 +97,34 @@ bool filesystem_init(char* filesystem) {
 	uint8_t disk = filesystem[4] - '0', partition = 0;
 	if (strlen(filesystem) == 7)
 		partition = filesystem[6] - '0';
-
+	
 	filesystem_fs = ata_open_partition(disk, partition);
 	if (filesystem_fs.bus == (uint8_t)-1)
 		return false;
 		
 	// See if it is an ext2 filesystem
-	if (ext2_init(&filesystem_fs))
+	if (ext2_init(&filesystem_fs)) {
+		// Scratch files never need to reach the disk
+		tmpfs_mount("/tmp", 0);
+		tmpfs_mount("/var/run", 0);
+		procfs_mount("/proc");
 		return true;
+	}
 	
 	// No filesystem driver found
 	return false;
 }
 
+// Start writing back cached filesystem data in the background
+void filesystem_start_writeback() {
+	ext2_cache_start_flusher();
+}
+
+// Write all cached filesystem data to the disk
+void filesystem_sync() {
+	ext2_sync();
+}
+
 // Helper function to get the last path component of a path (must be freed!)
 char* get_last_path_component(const char* filename) {
 	// Get the name
@@ -120,6 +140,12 @@ char* get_last_path_component(const char* filename) {
 	return name;
 }
 
+// Helper function to get the shared inode of a path's parent directory (must be released with ext2_inode_put)
+ext_inode_t* get_parent_inode(const char* filename) {
+	ext_inode_t parent = ext2_get_parent_inode(filename);
+	return ext2_inode_get(parent.inode);
+}
+
 // Get inode
 uint32_t filesystem_get_inode(const char* filename) {
 	ext_inode_t inode = ext2_open(filename);
@@ -131,22 +157,48 @@ bool fopen(const char* filename, uint32_t mode, file_descriptor_t* desc) {
 	memset(desc, 0, sizeof(file_descriptor_t));
 	desc->lock = MUTEX_UNLOCKED;
 	
+	// Let a mounted filesystem handle it if there is one
+	char* rel = NULL;
+	vfs_mount_t* m = vfs_lookup(filename, &rel);
+	if (m) {
+		bool ret = m->ops->open(m->fs, rel, mode, desc);
+		kfree(rel);
+		if (!ret)
+			return false;
+		
+		uint32_t len = strlen(filename);
+		desc->filename = (char*)kmalloc(len + 1);
+		if (!desc->filename) {
+			desc->close(desc);
+			return false;
+		}
+		strcpy(desc->filename, filename);
+		return true;
+	}
+	
 	// Open the file
 	ext_inode_t inode = ext2_open(filename);
 	if (inode.inode == EXT2_INODE_INVALID) {
 		// Try to create it if it doesn't exist
 		if (mode & FILE_MODE_CREATE) {
 			// Get the parent
-			ext_inode_t parent = ext2_get_parent_inode(filename);
-			if (parent.inode == EXT2_INODE_INVALID)
+			ext_inode_t* parent = get_parent_inode(filename);
+			if (!parent)
 				return false;
 			// Get the name
 			char* name = get_last_path_component(filename);
-			if (!name)
+			if (!name) {
+				ext2_inode_put(parent);
 				return false;
+			}
 			
-			// Create it
-			inode = ext2_create(&parent, name, mode & ~FILE_TYPE_DIRECTORY);
+			// Create it (unless someone else did before we got the lock)
+			down_write(&parent->lock);
+			inode = ext2_get_relative_inode(name, parent);
+			if (inode.inode == EXT2_INODE_INVALID)
+				inode = ext2_create(parent, name, mode & ~FILE_TYPE_DIRECTORY);
+			up_write(&parent->lock);
+			ext2_inode_put(parent);
 			kfree(name);
 			if (inode.inode == EXT2_INODE_INVALID)
 				return false;
@@ -176,49 +228,63 @@ bool fopen(const char* filename, uint32_t mode, file_descriptor_t* desc) {
 		return true;
 	}
 	
+	// Use the in memory inode that is shared with other descriptors
+	ext_inode_t* shared = ext2_inode_get(inode.inode);
+	if (!shared)
+		return false;
+	
 	// Copy the filename
 	uint32_t len = strlen(filename);
 	desc->filename = (char*)kmalloc(len + 1);
-	if (!desc->filename)
+	if (!desc->filename) {
+		ext2_inode_put(shared);
 		return false;
+	}
 	strcpy(desc->filename, filename);
 	
 	desc->mode = mode & ~(FILE_MODE_CREATE);
-	if (ext2_inode_is_directory(&inode)) {
+	if (ext2_inode_is_directory(shared)) {
 		// Set up a directory
 		desc->info = (directory_info_t*)kmalloc(sizeof(directory_info_t));
 		if (!desc->info) {
+			ext2_inode_put(shared);
 			kfree(desc->filename);
 			return false;
 		}
 		directory_info_t* dir = (directory_info_t*)desc->info;
 		memset(dir, 0, sizeof(directory_info_t));
-		dir->inode = inode;
-		dir->offset = ext2_get_block_address(ext2_get_block_id_at_index(&dir->inode, 0));
+		dir->inode = shared;
+		dir->offset = ext2_get_block_address(ext2_get_block_id_at_index(dir->inode, 0));
 		
 		desc->read = filesystem_read_directory;
 		desc->write = filesystem_write_directory;
 		desc->llseek = filesystem_llseek_directory;
+		desc->getdents = filesystem_getdents;
 		desc->truncate = NULL;
 		desc->mode = (desc->mode & ~FILE_TYPE_ALL) | FILE_TYPE_DIRECTORY;
 	} else {
 		// Set up a file
 		desc->info = (file_info_t*)kmalloc(sizeof(file_info_t));
 		if (!desc->info) {
+			ext2_inode_put(shared);
 			kfree(desc->filename);
 			return false;
 		}
 		file_info_t* file = (file_info_t*)desc->info;
 		memset(file, 0, sizeof(file_info_t));
-		file->inode = inode;
+		file->inode = shared;
 		
 		desc->read = filesystem_read_file;
 		desc->write = filesystem_write_file;
 		desc->llseek = filesystem_llseek_file;
+		desc->pread = filesystem_pread_file;
+		desc->pwrite = filesystem_pwrite_file;
+		desc->readv = filesystem_readv_file;
+		desc->writev = filesystem_writev_file;
 		desc->can_read = filesystem_can_read_file;
 		desc->truncate = filesystem_truncate;
 		desc->mode = desc->mode & ~FILE_TYPE_ALL;
-		if (inode.info.mode & EXT2_INODE_MODE_FIFO)
+		if (shared->info.mode & EXT2_INODE_MODE_FIFO)
 			desc->mode |= FILE_TYPE_PIPE;
 		else
 			desc->mode |= FILE_TYPE_REGULAR;
@@ -226,68 +292,66 @@ bool fopen(const char* filename, uint32_t mode, file_descriptor_t* desc) {
 		// Delete the file contents if needed
 		if ((desc->mode & FILE_MODE_TRUNCATE) &&
 			((desc->mode & FILE_MODE_WRITE) || (desc->mode & FILE_MODE_APPEND))) {
-			ftruncate(desc, uint64_make(0, 0));
+			ftruncate(desc, 0);
 		}
 	}
 	desc->stat = filesystem_stat;
+	desc->fsync = filesystem_fsync;
 	desc->duplicate = filesystem_duplicate;
 	desc->close = filesystem_close;
 	
 	return true;
 }
 
-// Read a file
-uint32_t fread_file(void* buffer, uint32_t size, uint32_t count, file_descriptor_t* f) {
-	file_info_t* file = (file_info_t*)f->info;
-	uint32_t length = size * count;
-	
+// Read a file at an offset (the inode lock must be held)
+uint32_t fread_file_at(file_info_t* file, void* buffer, uint32_t length, uint64_t offset) {
 	// Don't read past the end of the file
-	uint64_t file_length = uint64_make(file->inode.info.size_high, file->inode.info.size);
-	if (uint64_greater(uint64_add(file->offset, uint64_make(0, length)), file_length))
-		length = uint64_sub(file_length, file->offset).low;
+	uint64_t file_length = ((uint64_t)file->inode->info.size_high << 32) | file->inode->info.size;
+	if (offset >= file_length)
+		return 0;
+	if (offset + length > file_length)
+		length = file_length - offset;
 	
 	// Don't read anything if we aren't reading anything
 	if (length == 0)
 		return 0;
 	
+	return ext2_read_data(file->inode, offset, buffer, length);
+}
+
+// Read a file
+uint32_t fread_file(void* buffer, uint32_t size, uint32_t count, file_descriptor_t* f) {
+	file_info_t* file = (file_info_t*)f->info;
+	
 	// Read the data and set the new position
-	uint32_t ret = ext2_read_data(&file->inode, file->offset, buffer, length);
-	file->offset = uint64_add(file->offset, uint64_make(0, ret));
+	down_read(&file->inode->lock);
+	uint32_t ret = fread_file_at(file, buffer, size * count, file->offset);
+	if ((int32_t)ret > 0)
+		file->offset += ret;
+	up_read(&file->inode->lock);
 	
 	return ret;
 }
 
-// Read a directory
-uint32_t fread_directory(void* buffer, uint32_t size, uint32_t count, file_descriptor_t* f, dirent_t* dirent) {
-	if (size * count == 0)
-		return 0;
-	
-	directory_info_t* dir = (directory_info_t*)f->info;
-	
+// Read the next entry in a directory (the inode lock must be held)
+uint32_t fread_directory_entry(directory_info_t* dir, void* buffer, uint32_t length, ext_dentry_t* dentry) {
 	// If we've read all the files, do nothing
-	if (uint64_equal(dir->offset, uint64_make(0, 0)))
+	if (dir->offset == 0)
 		return 0;
 	
 	// Get the next offset
 	uint32_t ret = 0;
 	while (ret == 0) {
-		ext_dentry_t dentry;
-		uint64_t value = ext2_read_directory(&dir->inode, dir->offset, buffer, size * count, &ret, &dentry);
-		if (dirent) {
-			dirent->ino = dentry.inode;
-			dirent->off = dir->index;
-			dirent->reclen = dentry.rec_len;
-			dirent->type = dentry.file_type;
-		}
+		uint64_t value = ext2_read_directory(dir->inode, dir->offset, buffer, length, &ret, dentry);
 		dir->offset = value;
 		// We've reached the end of the block
-		if (uint64_equal(dir->offset, uint64_make(0, 0))) {
+		if (dir->offset == 0) {
 			// Go to the next block
 			dir->bank_index++;
-			uint32_t block_id = ext2_get_block_id_at_index(&dir->inode, dir->bank_index);
+			uint32_t block_id = ext2_get_block_id_at_index(dir->inode, dir->bank_index);
 			// Get the real next offset
 			if (block_id == EXT2_BLOCK_ID_INVALID) {
-				dir->offset = uint64_make(0, 0);
+				dir->offset = 0;
 				break;
 			}
 			
@@ -300,11 +364,84 @@ uint32_t fread_directory(void* buffer, uint32_t size, uint32_t count, file_descr
 	return ret;
 }
 
+// Read a directory
+uint32_t fread_directory(void* buffer, uint32_t size, uint32_t count, file_descriptor_t* f, dirent_t* dirent) {
+	if (size * count == 0)
+		return 0;
+	
+	directory_info_t* dir = (directory_info_t*)f->info;
+	
+	// If we've read all the files, do nothing
+	if (dir->offset == 0)
+		return 0;
+	
+	ext_dentry_t dentry;
+	down_read(&dir->inode->lock);
+	uint32_t ret = fread_directory_entry(dir, buffer, size * count, &dentry);
+	up_read(&dir->inode->lock);
+	if (dirent) {
+		dirent->ino = dentry.inode;
+		dirent->off = dir->index - 1;
+		dirent->reclen = dentry.rec_len;
+		dirent->type = dentry.file_type;
+	}
+	
+	return ret;
+}
+
+// Read as many directory entries as fit into a buffer
+uint32_t fgetdents(file_descriptor_t* f, void* buffer, uint32_t size) {
+	directory_info_t* dir = (directory_info_t*)f->info;
+	
+	uint32_t pos = 0;
+	char name[EXT2_MAX_NAME_SIZE + 1];
+	down_read(&dir->inode->lock);
+	while (dir->offset != 0) {
+		// Remember where we were in case the entry doesn't fit
+		uint64_t offset = dir->offset;
+		uint32_t index = dir->index;
+		uint32_t bank_index = dir->bank_index;
+		
+		ext_dentry_t dentry;
+		uint32_t len = fread_directory_entry(dir, name, EXT2_MAX_NAME_SIZE, &dentry);
+		if (len == 0)
+			break;
+		
+		uint32_t reclen = (GETDENTS_ENTRY_HEADER_SIZE + len + 1 + 3) & ~3;
+		if (pos + reclen > size) {
+			dir->offset = offset;
+			dir->index = index;
+			dir->bank_index = bank_index;
+			break;
+		}
+		
+		getdents_entry_t* entry = (getdents_entry_t*)((uint8_t*)buffer + pos);
+		entry->ino = dentry.inode;
+		entry->off = dir->index;
+		entry->reclen = reclen;
+		entry->type = dentry.file_type;
+		memcpy(entry->name, name, len);
+		entry->name[len] = 0;
+		pos += reclen;
+	}
+	up_read(&dir->inode->lock);
+	
+	// The buffer can't even hold one entry
+	if (pos == 0 && dir->offset != 0)
+		return -EINVAL;
+	
+	return pos;
+}
+
 // Read a file object
 uint32_t fread(void* buffer, uint32_t size, uint32_t count, file_descriptor_t* file) {
 	if (!(file->mode & FILE_MODE_READ))
 		return -EACCES;
 	
+	// Not an ext2 descriptor
+	if (file->close != filesystem_close)
+		return file->read ? file->read(file, buffer, size * count) : -EINVAL;
+	
 	if (file->mode & FILE_TYPE_REGULAR)
 		return fread_file(buffer, size, count, file);
 	if (file->mode & FILE_TYPE_DIRECTORY)
@@ -313,18 +450,25 @@ uint32_t fread(void* buffer, uint32_t size, uint32_t count, file_descriptor_t* f
 	return -ENOENT;
 }
 
-// Write to a file
-uint32_t fwrite_file(const void* buffer, uint32_t size, uint32_t count, file_descriptor_t* f) {
-	file_info_t* file = (file_info_t*)f->info;
-	uint32_t length = size * count;
-	
+// Write to a file at an offset (the inode lock must be held for writing)
+uint32_t fwrite_file_at(file_info_t* file, const void* buffer, uint32_t length, uint64_t offset) {
 	// Don't write anything if we aren't writing anything
 	if (length == 0)
 		return 0;
 	
+	return ext2_write_data(file->inode, offset, buffer, length);
+}
+
+// Write to a file
+uint32_t fwrite_file(const void* buffer, uint32_t size, uint32_t count, file_descriptor_t* f) {
+	file_info_t* file = (file_info_t*)f->info;
+	
 	// Write the data and set the new position
-	uint32_t ret = ext2_write_data(&file->inode, file->offset, buffer, length);
-	file->offset = uint64_add(file->offset, uint64_make(0, ret));
+	down_write(&file->inode->lock);
+	uint32_t ret = fwrite_file_at(file, buffer, size * count, file->offset);
+	up_write(&file->inode->lock);
+	if ((int32_t)ret > 0)
+		file->offset += ret;
 	
 	return ret;
 }
@@ -339,8 +483,12 @@ uint32_t fwrite(const void* buffer, uint32_t size, uint32_t count, file_descript
 	if (!(file->mode & FILE_MODE_WRITE) && !(file->mode & FILE_MODE_APPEND))
 		return -EACCES;
 	
+	// Not an ext2 descriptor
+	if (file->close != filesystem_close)
+		return file->write ? file->write(file, buffer, size * count) : -EINVAL;
+	
 	if (file->mode & FILE_MODE_APPEND)
-		fseek(file, uint64_make(0, 0), SEEK_END);
+		fseek(file, 0, SEEK_END);
 	
 	if (file->mode & FILE_TYPE_REGULAR)
 		return fwrite_file(buffer, size, count, file);
@@ -353,21 +501,23 @@ uint32_t fwrite(const void* buffer, uint32_t size, uint32_t count, file_descript
 // Seek a file
 uint64_t fseek_file(file_descriptor_t* f, uint64_t offset, int whence) {
 	file_info_t* file = (file_info_t*)f->info;
-	uint64_t file_size = uint64_make(file->inode.info.size_high, file->inode.info.size);
+	uint64_t file_size = ((uint64_t)file->inode->info.size_high << 32) | file->inode->info.size;
 	
 	// Place the new offset
 	if (whence == SEEK_SET)
 		file->offset = offset;
 	else if (whence == SEEK_CUR)
-		file->offset = uint64_add(file->offset, offset);
+		file->offset += offset;
 	else
 		file->offset = file_size;
 	
 	// Check we still have a valid range
-	if (uint64_greater(file->offset, file_size)) {
-		if (f->mode & FILE_MODE_WRITE)
-			file->offset = ext2_truncate_inode(&file->inode, file->offset);
-		else
+	if (file->offset > file_size) {
+		if (f->mode & FILE_MODE_WRITE) {
+			down_write(&file->inode->lock);
+			file->offset = ext2_truncate_inode(file->inode, file->offset);
+			up_write(&file->inode->lock);
+		} else
 			file->offset = file_size;
 	}
 	
@@ -380,45 +530,47 @@ uint64_t fseek_directory(file_descriptor_t* f, uint64_t offset, int whence) {
 	
 	// Find the correct relative offset if we need to
 	if (whence == SEEK_CUR) {
-		if ((offset.high >> 31) & 0x1) {
+		if ((int64_t)offset < 0) {
 			whence = SEEK_SET;
-			offset.low = dir->index + offset.low;
-			offset.high = 0;
-		} else if (offset.high == 0 && offset.low == 0) {
+			offset = (uint32_t)(dir->index + (uint32_t)offset);
+		} else if (offset == 0) {
 			// Just return the current index
-			return uint64_make(0, dir->index);
+			return dir->index;
 		}
 	}
 	
+	down_read(&dir->inode->lock);
+	
 	// Set the new index
 	if (whence == SEEK_SET) {
 		// Load the first entry
 		dir->index = 0;
 		dir->bank_index = 0;
-		dir->offset = ext2_get_block_address(ext2_get_block_id_at_index(&dir->inode, 0));
+		dir->offset = ext2_get_block_address(ext2_get_block_id_at_index(dir->inode, 0));
 	} else if (whence == SEEK_END)
-		offset.low = ~0;				// Go as many times as possible until we hit an error
+		offset = (uint32_t)~0;				// Go as many times as possible until we hit an error
 	
 	// Follow the linked list the desired number of times
 	uint32_t z;
-	uint32_t block_id = ext2_get_block_id_at_index(&dir->inode, dir->bank_index);
-	for (z = 0; z < offset.low; z++) {		
+	uint32_t block_id = ext2_get_block_id_at_index(dir->inode, dir->bank_index);
+	for (z = 0; z < (uint32_t)offset; z++) {		
 		// Get the next offset
 		uint32_t ret = 0;
 		while (ret == 0) {
-			uint64_t value = ext2_read_directory(&dir->inode, dir->offset, NULL, 256, &ret, NULL);
+			uint64_t value = ext2_read_directory(dir->inode, dir->offset, NULL, 256, &ret, NULL);
 			dir->offset = value;
 			// We've reached the end of the block
-			if (uint64_equal(dir->offset, uint64_make(0, 0))) {
+			if (dir->offset == 0) {
 				// Go to the next block
 				dir->bank_index++;
-				block_id = ext2_get_block_id_at_index(&dir->inode, dir->bank_index);
+				block_id = ext2_get_block_id_at_index(dir->inode, dir->bank_index);
 				// Check if we've gone too far
 				if (block_id == EXT2_BLOCK_ID_INVALID) {
-					dir->offset = uint64_make(0, 0);
+					dir->offset = 0;
 					if (ret != 0)
 						dir->index++;
-					return uint64_make(0, dir->index);
+					up_read(&dir->inode->lock);
+					return dir->index;
 				}
 				
 				// Get the real next offset
@@ -426,30 +578,39 @@ uint64_t fseek_directory(file_descriptor_t* f, uint64_t offset, int whence) {
 			}
 		}
 		dir->index++;
-
+	
 	}
+	up_read(&dir->inode->lock);
 	
-	return uint64_make(0, dir->index);
+	return dir->index;
 }
 
 // Seek a file object
 uint64_t fseek(file_descriptor_t* file, uint64_t offset, int whence) {
+	// Not an ext2 descriptor
+	if (file->close != filesystem_close)
+		return file->llseek ? file->llseek(file, offset, whence) : (uint64_t)-ESPIPE;
+	
 	if (file->mode & FILE_TYPE_REGULAR)
 		return fseek_file(file, offset, whence);
 	else if (file->mode & FILE_TYPE_DIRECTORY)
 		return fseek_directory(file, offset, whence);
 	
-	return uint64_make(-1, -ENOENT);
+	return (uint64_t)-ENOENT;
 }
 
 // Truncate a file to a specific size
 uint64_t ftruncate(file_descriptor_t* f, uint64_t size) {
 	if (!(f->mode & FILE_TYPE_REGULAR))
-		return uint64_make(-1, -EACCES);
+		return (uint64_t)-EACCES;
 	
 	file_info_t* file = (file_info_t*)f->info;
 	
-	return ext2_truncate_inode(&file->inode, size);
+	down_write(&file->inode->lock);
+	uint64_t ret = ext2_truncate_inode(file->inode, size);
+	up_write(&file->inode->lock);
+	
+	return ret;
 }
 
 // Truncate a file descriptor
@@ -457,24 +618,61 @@ uint64_t filesystem_truncate(file_descriptor_t* f, uint64_t nsize) {
 	return ftruncate(f, nsize);
 }
 
+// Write a file's cached data to the disk
+int ffsync(file_descriptor_t* f) {
+	bool ret;
+	if (f->mode & FILE_TYPE_REGULAR)
+		ret = ext2_sync_inode(((file_info_t*)f->info)->inode);
+	else if (f->mode & FILE_TYPE_DIRECTORY)
+		ret = ext2_sync_inode(((directory_info_t*)f->info)->inode);
+	else
+		return -EINVAL;
+	
+	return ret ? 0 : -EIO;
+}
+
+// Sync a file descriptor
+uint32_t filesystem_fsync(file_descriptor_t* f) {
+	return ffsync(f);
+}
+
 // Make a directory
 int fmkdir(const char* filename) {
+	char* rel = NULL;
+	vfs_mount_t* m = vfs_lookup(filename, &rel);
+	if (m) {
+		int ret = m->ops->mkdir(m->fs, rel);
+		kfree(rel);
+		return ret;
+	}
+	
 	// If the inode already exists, don't do anything
 	if (ext2_open(filename).inode != EXT2_INODE_INVALID)
 		return -EEXIST;
 	
 	// Get the parent
-	ext_inode_t parent = ext2_get_parent_inode(filename);
-	if (parent.inode == EXT2_INODE_INVALID)
+	ext_inode_t* parent = get_parent_inode(filename);
+	if (!parent)
 		return -ENOENT;
 	
 	// Get the name
 	char* name = get_last_path_component(filename);
-	if (!name)
+	if (!name) {
+		ext2_inode_put(parent);
 		return -ENOMEM;
+	}
 	
-	// Create the directory
-	ext_inode_t inode = ext2_create(&parent, name, FILE_TYPE_DIRECTORY);
+	// Create the directory (checking again now that no one else can modify the parent)
+	down_write(&parent->lock);
+	if (ext2_get_relative_inode(name, parent).inode != EXT2_INODE_INVALID) {
+		up_write(&parent->lock);
+		ext2_inode_put(parent);
+		kfree(name);
+		return -EEXIST;
+	}
+	ext_inode_t inode = ext2_create(parent, name, FILE_TYPE_DIRECTORY);
+	up_write(&parent->lock);
+	ext2_inode_put(parent);
 	kfree(name);
 	
     if (inode.inode == EXT2_INODE_INVALID)
@@ -484,24 +682,47 @@ int fmkdir(const char* filename) {
 
 // Hard link a file or directory
 int flink(file_descriptor_t* file, const char* link_name) {
+	// Links can't cross filesystems
+	char* file_rel = NULL;
+	char* link_rel = NULL;
+	vfs_mount_t* file_mount = vfs_lookup(file->filename, &file_rel);
+	vfs_mount_t* link_mount = vfs_lookup(link_name, &link_rel);
+	if (file_rel)
+		kfree(file_rel);
+	if (file_mount != link_mount) {
+		if (link_rel)
+			kfree(link_rel);
+		return -EXDEV;
+	}
+	if (link_mount) {
+		int ret = link_mount->ops->link(link_mount->fs, file, link_rel);
+		kfree(link_rel);
+		return ret;
+	}
+	
 	ext_inode_t* inode = NULL;
 	if (file->mode & FILE_TYPE_DIRECTORY)
-		inode = &((directory_info_t*)file->info)->inode;
+		inode = ((directory_info_t*)file->info)->inode;
 	else
-		inode = &((file_info_t*)file->info)->inode;
+		inode = ((file_info_t*)file->info)->inode;
 	
 	// Get the parent
-	ext_inode_t parent = ext2_get_parent_inode(link_name);
-	if (parent.inode == EXT2_INODE_INVALID)
+	ext_inode_t* parent = get_parent_inode(link_name);
+	if (!parent)
 		return -ENOENT;
 	
 	// Get the names
 	char* name = get_last_path_component(link_name);
-	if (!name)
+	if (!name) {
+		ext2_inode_put(parent);
 		return -ENOMEM;
+	}
 	
 	// Link
-	bool ret = ext2_link(inode, &parent, name);
+	down_write(&parent->lock);
+	bool ret = ext2_link(inode, parent, name);
+	up_write(&parent->lock);
+	ext2_inode_put(parent);
 	
 	kfree(name);
 	
@@ -511,23 +732,29 @@ int flink(file_descriptor_t* file, const char* link_name) {
 // Helper to unlink
 int fsunlinkalways(const char* filename) {
 	// Get the parent directory
-	ext_inode_t parent = ext2_get_parent_inode(filename);
-	if (parent.inode == EXT2_INODE_INVALID)
+	ext_inode_t* parent = get_parent_inode(filename);
+	if (!parent)
 		return -ENOENT;
 	
 	// Get the name
 	char* name = get_last_path_component(filename);
-	if (!name)
+	if (!name) {
+		ext2_inode_put(parent);
 		return -ENOMEM;
+	}
 	
 	// Ensure that the name is not either "." or ".."
 	if (strncmp(name, ".", 2) == 0 || strncmp(name, "..", 3) == 0) {
+		ext2_inode_put(parent);
 		kfree(name);
 		return -EINVAL;
 	}
 	
 	// Delete the file
-	bool ret = ext2_delete(&parent, name);
+	down_write(&parent->lock);
+	bool ret = ext2_delete(parent, name);
+	up_write(&parent->lock);
+	ext2_inode_put(parent);
 	kfree(name);
 	
     return (ret ? -ENOMEM : 0);
@@ -535,19 +762,31 @@ int fsunlinkalways(const char* filename) {
 
 // Unlink
 int fsunlink(const char* filename) {
+	char* rel = NULL;
+	vfs_mount_t* m = vfs_lookup(filename, &rel);
+	if (m) {
+		int ret = m->ops->unlink(m->fs, rel);
+		kfree(rel);
+		return ret;
+	}
+	
 	ext_inode_t inode = ext2_open(filename);
 	if (inode.inode == EXT2_INODE_INVALID)
 		return -ENOENT;
 	
 	if (inode.info.mode & FILE_TYPE_DIRECTORY) {
 		directory_info_t info;
-		info.inode = inode;
+		memset(&info, 0, sizeof(directory_info_t));
+		info.inode = ext2_inode_get(inode.inode);
+		if (!info.inode)
+			return -ENOMEM;
 		file_descriptor_t f;
 		memset(&f, 0, sizeof(f));
 		f.info = &info;
 		
 		// Check that the directory is empty
-		uint32_t num_entries = fseek_directory(&f, uint64_make(0, 0), SEEK_END).low;
+		uint32_t num_entries = (uint32_t)fseek_directory(&f, 0, SEEK_END);
+		ext2_inode_put(info.inode);
 		if (num_entries > 2)		// . and .. are fine
 			return -ENOTEMPTY;
 	}
@@ -559,7 +798,7 @@ int fsunlink(const char* filename) {
 bool fdelete(file_descriptor_t* file) {
 	if (file->mode & FILE_TYPE_DIRECTORY) {
 		// Check that the directory is empty
-		uint32_t num_entries = fseek_directory(file, uint64_make(0, 0), SEEK_END).low;
+		uint32_t num_entries = (uint32_t)fseek_directory(file, 0, SEEK_END);
 		if (num_entries > 2)		// . and .. are fine
 			return false;
 	}
@@ -569,6 +808,10 @@ bool fdelete(file_descriptor_t* file) {
 
 // Close a file object
 bool fclose(file_descriptor_t* file) {
+	// Not an ext2 descriptor
+	if (file->close != filesystem_close)
+		return file->close(file) == 0;
+	
 	uint32_t ret = true;
 	// Delete it on close if we have to
 	if (file->mode & FILE_MODE_DELETE_ON_CLOSE)
@@ -578,9 +821,9 @@ bool fclose(file_descriptor_t* file) {
 	kfree(file->filename);
 	
 	if (file->mode & FILE_TYPE_DIRECTORY)
-		ext_free_inode(&((directory_info_t*)file->info)->inode);
+		ext2_inode_put(((directory_info_t*)file->info)->inode);
 	else
-		ext_free_inode(&((file_info_t*)file->info)->inode);
+		ext2_inode_put(((file_info_t*)file->info)->inode);
 	
 	kfree(file->info);
 	return ret;
@@ -588,6 +831,14 @@ bool fclose(file_descriptor_t* file) {
 
 // Returns true if path is directory
 bool fisdir(const char* filename) {
+	char* rel = NULL;
+	vfs_mount_t* m = vfs_lookup(filename, &rel);
+	if (m) {
+		bool ret = m->ops->isdir(m->fs, rel);
+		kfree(rel);
+		return ret;
+	}
+	
 	ext_inode_t inode = ext2_open(filename);
 	if (inode.inode == EXT2_INODE_INVALID)
 		return false;
@@ -597,18 +848,28 @@ bool fisdir(const char* filename) {
 
 // Set times
 void fsettime(file_descriptor_t* file, uint32_t atime, uint32_t mtime) {
-	ext_inode_t inode;
+	char* rel = NULL;
+	vfs_mount_t* m = vfs_lookup(file->filename, &rel);
+	if (m) {
+		kfree(rel);
+		m->ops->settime(m->fs, file, atime, mtime);
+		return;
+	}
+	
+	ext_inode_t* inode;
 	if (file->mode & FILE_TYPE_DIRECTORY)
 		inode = ((directory_info_t*)file->info)->inode;
 	else
 		inode = ((file_info_t*)file->info)->inode;
-
+	
 	// Update the times of this inode
-	inode.info.atime = atime;
-	inode.info.mtime = mtime;
+	down_write(&inode->lock);
+	inode->info.atime = atime;
+	inode->info.mtime = mtime;
 	
 	// Write this inode data
-	ext2_set_inode_info(inode.inode, &inode.info);
+	ext2_set_inode_info(inode->inode, &inode->info);
+	up_write(&inode->lock);
 }
 
 // Open a file or directory
@@ -630,11 +891,10 @@ bool filesystem_can_read_file(file_descriptor_t* f) {
 	if (!(f->mode & FILE_MODE_READ))
 		return false;
 	
+	// The inode is shared, so its size is always up to date
 	file_info_t* file = f->info;
-	file->inode.info = ext2_get_inode_info(file->inode.inode);
-	
-	uint64_t file_size = uint64_make(file->inode.info.size_high, file->inode.info.size);
-	return uint64_less(file->offset, file_size);
+	uint64_t file_size = ((uint64_t)file->inode->info.size_high << 32) | file->inode->info.size;
+	return file->offset < file_size;
 }
 
 // Read from a file and return the number of bytes read
@@ -647,6 +907,129 @@ uint32_t filesystem_write_file(file_descriptor_t* f, const void* buf, uint32_t l
 	return fwrite_file(buf, 1, length, f);
 }
 
+// Read from a file at an offset without changing the file position
+uint32_t filesystem_pread_file(file_descriptor_t* f, void* buf, uint32_t length, uint64_t offset) {
+	file_info_t* file = (file_info_t*)f->info;
+	
+	down_read(&file->inode->lock);
+	uint32_t ret = fread_file_at(file, buf, length, offset);
+	up_read(&file->inode->lock);
+	
+	return ret;
+}
+
+// Write to a file at an offset without changing the file position
+uint32_t filesystem_pwrite_file(file_descriptor_t* f, const void* buf, uint32_t length, uint64_t offset) {
+	file_info_t* file = (file_info_t*)f->info;
+	
+	down_write(&file->inode->lock);
+	uint32_t ret = fwrite_file_at(file, buf, length, offset);
+	up_write(&file->inode->lock);
+	
+	return ret;
+}
+
+// Read from a file into multiple buffers (the inode is only locked once)
+uint32_t filesystem_readv_file(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt) {
+	file_info_t* file = (file_info_t*)f->info;
+	uint32_t total = 0;
+	
+	down_read(&file->inode->lock);
+	for (uint32_t z = 0; z < iovcnt; z++) {
+		uint32_t ret = fread_file_at(file, iov[z].base, iov[z].length, file->offset);
+		if ((int32_t)ret < 0) {
+			if (total == 0)
+				total = ret;
+			break;
+		}
+		
+		file->offset += ret;
+		total += ret;
+		// Reached the end of the file
+		if (ret < iov[z].length)
+			break;
+	}
+	up_read(&file->inode->lock);
+	
+	return total;
+}
+
+// Write to a file from multiple buffers (the inode is only locked once)
+uint32_t filesystem_writev_file(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt) {
+	file_info_t* file = (file_info_t*)f->info;
+	uint32_t total = 0;
+	
+	down_write(&file->inode->lock);
+	for (uint32_t z = 0; z < iovcnt; z++) {
+		uint32_t ret = fwrite_file_at(file, iov[z].base, iov[z].length, file->offset);
+		if ((int32_t)ret < 0) {
+			if (total == 0)
+				total = ret;
+			break;
+		}
+		
+		file->offset += ret;
+		total += ret;
+		if (ret < iov[z].length)
+			break;
+	}
+	up_write(&file->inode->lock);
+	
+	return total;
+}
+
+// Is this descriptor a regular ext2 file?
+bool filesystem_is_file(file_descriptor_t* f) {
+	return f->close == filesystem_close && (f->mode & FILE_TYPE_REGULAR);
+}
+
+// Copy data between two ext2 files without going through user space. If an offset is NULL,
+// that file's position is used and moved forward. Returns bytes copied
+uint32_t filesystem_copy_file_range(file_descriptor_t* in, uint64_t* in_offset, file_descriptor_t* out,
+									uint64_t* out_offset, uint32_t length) {
+	file_info_t* src = (file_info_t*)in->info;
+	file_info_t* dst = (file_info_t*)out->info;
+	uint64_t* src_pos = in_offset ? in_offset : &src->offset;
+	uint64_t* dst_pos = out_offset ? out_offset : &dst->offset;
+	
+	// Always lock the inodes in the same order so copies going opposite ways can't deadlock
+	if (src->inode == dst->inode)
+		down_write(&dst->inode->lock);
+	else if (src->inode < dst->inode) {
+		down_read(&src->inode->lock);
+		down_write(&dst->inode->lock);
+	} else {
+		down_write(&dst->inode->lock);
+		down_read(&src->inode->lock);
+	}
+	
+	uint32_t ret = 0;
+	uint64_t file_length = ((uint64_t)src->inode->info.size_high << 32) | src->inode->info.size;
+	if (*src_pos < file_length) {
+		if (*src_pos + length > file_length)
+			length = file_length - *src_pos;
+		
+		// Can't copy a range of a file on top of itself
+		if (src->inode == dst->inode && *src_pos < *dst_pos + length && *dst_pos < *src_pos + length)
+			ret = -EINVAL;
+		else {
+			ret = ext2_copy_data(src->inode, *src_pos, dst->inode, *dst_pos, length);
+			if ((int32_t)ret < 0)
+				ret = -ENOSPC;
+			else {
+				*src_pos += ret;
+				*dst_pos += ret;
+			}
+		}
+	}
+	
+	if (src->inode != dst->inode)
+		up_read(&src->inode->lock);
+	up_write(&dst->inode->lock);
+	
+	return ret;
+}
+
 // Seek to an offset in the file
 uint64_t filesystem_llseek_file(file_descriptor_t* f, uint64_t offset, int whence) {
 	return fseek_file(f, offset, whence);
@@ -662,6 +1045,11 @@ uint32_t filesystem_readdir(file_descriptor_t* f, void* buf, uint32_t length, di
 	return fread_directory(buf, 1, length, f, dirent);
 }
 
+// Read as many packed directory entries as fit into the buffer
+uint32_t filesystem_getdents(file_descriptor_t* f, void* buf, uint32_t length) {
+	return fgetdents(f, buf, length);
+}
+
 // Write to a directory (which means link a new file in)
 uint32_t filesystem_write_directory(file_descriptor_t* f, const void* buf, uint32_t length) {
 	return fwrite_directory(buf, 1, length, f);
@@ -678,12 +1066,12 @@ uint32_t filesystem_stat(file_descriptor_t* f, sys_stat_type* ret) {
 	
 	ext_inode_info_t* info = NULL;
 	if (f->mode & FILE_TYPE_REGULAR) {
-		info = &(((file_info_t*)f->info)->inode.info);
-		ret->inode = ((file_info_t*)f->info)->inode.inode;
+		info = &(((file_info_t*)f->info)->inode->info);
+		ret->inode = ((file_info_t*)f->info)->inode->inode;
 	}
 	else if (f->mode & FILE_TYPE_DIRECTORY) {
-		info = &(((directory_info_t*)f->info)->inode.info);
-		ret->inode = ((directory_info_t*)f->info)->inode.inode;
+		info = &(((directory_info_t*)f->info)->inode->info);
+		ret->inode = ((directory_info_t*)f->info)->inode->inode;
 	}
 	if (!info)
 		return -1;
@@ -729,18 +1117,6 @@ file_descriptor_t* filesystem_duplicate(file_descriptor_t* f) {
 			return NULL;
 		}
 		memcpy(d->info, f->info, sizeof(file_info_t));
-		file_info_t* dinfo = d->info;
-		file_info_t* finfo = f->info;
-		if (dinfo->inode.cached_block) {
-			uint32_t block_size = 1 << (EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
-			dinfo->inode.cached_block = kmalloc(block_size);
-			if (!dinfo->inode.cached_block) {
-				kfree(d->filename);
-				kfree(d);
-				return NULL;
-			}
-			memcpy(dinfo->inode.cached_block, finfo->inode.cached_block, block_size);
-		}
 	} else {
 		d->info = kmalloc(sizeof(directory_info_t));
 		if (!d->info) {
@@ -749,20 +1125,14 @@ file_descriptor_t* filesystem_duplicate(file_descriptor_t* f) {
 			return NULL;
 		}
 		memcpy(d->info, f->info, sizeof(directory_info_t));
-		directory_info_t* dinfo = d->info;
-		directory_info_t* finfo = f->info;
-		if (dinfo->inode.cached_block) {
-			uint32_t block_size = 1 << (EXT2_BASE_BLOCK_SIZE_BITS + ext2_superblock()->log_block_size);
-			dinfo->inode.cached_block = kmalloc(block_size);
-			if (!dinfo->inode.cached_block) {
-				kfree(d->filename);
-				kfree(d);
-				return NULL;
-			}
-			memcpy(dinfo->inode.cached_block, finfo->inode.cached_block, block_size);
-		}
 	}
 	
+	// Both descriptors share the same inode
+	if (f->mode & FILE_TYPE_REGULAR)
+		ext2_inode_get(((file_info_t*)f->info)->inode->inode);
+	else
+		ext2_inode_get(((directory_info_t*)f->info)->inode->inode);
+	
 	return d;
 }
 
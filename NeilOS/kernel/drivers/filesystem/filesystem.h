@@ -12,6 +12,10 @@ file_descriptor_t* (*device_file_get_for_inode(uint32_t inode))(const char*, uin
 
 // Initialize the filesystem.
 bool filesystem_init(char* filesystem);
+// Start writing back cached filesystem data in the background (must be called with interrupts disabled)
+void filesystem_start_writeback();
+// Write all cached filesystem data to the disk
+void filesystem_sync();
 
 // For internal use
 bool fopen(const char* filename, uint32_t mode, file_descriptor_t* desc);
@@ -27,6 +31,9 @@ uint64_t fseek(file_descriptor_t* file, uint64_t offset, int whence);
 // Change size
 uint64_t ftruncate(file_descriptor_t* file, uint64_t size);
 
+// Write cached data to the disk
+int ffsync(file_descriptor_t* file);
+
 // Make directory (delete directory is just delete on close)
 int fmkdir(const char* filename);
 
@@ -50,16 +57,27 @@ file_descriptor_t* filesystem_open(const char* filename, uint32_t mode);
 uint32_t filesystem_read_file(file_descriptor_t* f, void* buf, uint32_t length);
 uint32_t filesystem_write_file(file_descriptor_t* f, const void* buf, uint32_t length);
 uint64_t filesystem_llseek_file(file_descriptor_t* f, uint64_t offset, int whence);
+uint32_t filesystem_pread_file(file_descriptor_t* f, void* buf, uint32_t length, uint64_t offset);
+uint32_t filesystem_pwrite_file(file_descriptor_t* f, const void* buf, uint32_t length, uint64_t offset);
+uint32_t filesystem_readv_file(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt);
+uint32_t filesystem_writev_file(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt);
 uint32_t filesystem_stat(file_descriptor_t* f, sys_stat_type* data);
 uint64_t filesystem_truncate(file_descriptor_t* f, uint64_t nsize);
+uint32_t filesystem_fsync(file_descriptor_t* f);
 
 bool filesystem_can_read_file(file_descriptor_t* f);
 
+// Copying between files
+bool filesystem_is_file(file_descriptor_t* f);
+uint32_t filesystem_copy_file_range(file_descriptor_t* in, uint64_t* in_offset, file_descriptor_t* out,
+									uint64_t* out_offset, uint32_t length);
+
 uint32_t filesystem_read_directory(file_descriptor_t* f, void* buf, uint32_t length);
 uint32_t filesystem_write_directory(file_descriptor_t* f, const void* buf, uint32_t length);
 uint64_t filesystem_llseek_directory(file_descriptor_t* f, uint64_t offset, int whence);
 
 uint32_t filesystem_readdir(file_descriptor_t* f, void* buf, uint32_t length, dirent_t* dirent);
+uint32_t filesystem_getdents(file_descriptor_t* f, void* buf, uint32_t length);
 
 file_descriptor_t* filesystem_duplicate(file_descriptor_t* f);
 
@@ -0,0 +1,748 @@
+//
+//  procfs.c
+//  NeilOS
+//
+
+#include "procfs.h"
+#include <common/lib.h>
+#include <memory/memory.h>
+#include <memory/allocation/heap.h>
+#include <memory/allocation/page_allocator.h>
+#include <drivers/ATA/ata.h>
+#include <drivers/filesystem/vfs.h>
+#include <drivers/filesystem/ext2/defs.h>
+#include <program/task.h>
+#include <syscalls/impl/sysfs.h>
+#include <syscalls/interrupt.h>
+
+// Kinds of files
+typedef enum {
+	PROCFS_ROOT = 1,
+	PROCFS_MEMINFO,
+	PROCFS_INTERRUPTS,
+	PROCFS_DISKSTATS,
+	PROCFS_PID,
+	PROCFS_PID_STATUS,
+	PROCFS_PID_STAT,
+	PROCFS_PID_MAPS,
+	PROCFS_PID_FD,
+	PROCFS_PID_FD_ENTRY,
+} procfs_type_t;
+
+#define PROCFS_INODE(pid, fd, type)		(((pid) << 16) | ((fd) << 4) | (type))
+#define PROCFS_NAME_SIZE				16
+#define PROCFS_LINE_SIZE				128
+
+// A name in a directory that is always there
+typedef struct {
+	const char* name;
+	procfs_type_t type;
+} procfs_static_entry_t;
+
+procfs_static_entry_t procfs_root_entries[] = {
+	{ "meminfo", PROCFS_MEMINFO },
+	{ "interrupts", PROCFS_INTERRUPTS },
+	{ "diskstats", PROCFS_DISKSTATS },
+	{ "self", PROCFS_PID },
+};
+#define PROCFS_NUM_ROOT_ENTRIES			(sizeof(procfs_root_entries) / sizeof(procfs_static_entry_t))
+
+procfs_static_entry_t procfs_pid_entries[] = {
+	{ "status", PROCFS_PID_STATUS },
+	{ "stat", PROCFS_PID_STAT },
+	{ "maps", PROCFS_PID_MAPS },
+	{ "fd", PROCFS_PID_FD },
+};
+#define PROCFS_NUM_PID_ENTRIES			(sizeof(procfs_pid_entries) / sizeof(procfs_static_entry_t))
+
+// Text that grows as it is generated
+typedef struct {
+	char* data;
+	uint32_t length;
+	uint32_t capacity;
+} procfs_buffer_t;
+
+// Information for an open file or directory
+typedef struct {
+	procfs_type_t type;
+	uint32_t pid;
+	uint32_t fd;
+	uint64_t offset;					// Byte offset for files, entry index for directories
+	
+	// Contents are only generated on the first read
+	bool generated;
+	procfs_buffer_t buffer;				// Files
+	uint32_t* ids;						// Directories (pids or fds)
+	uint32_t num_ids;
+} procfs_file_t;
+
+// Add a string to a buffer
+void procfs_append(procfs_buffer_t* b, const char* str, uint32_t length) {
+	if (b->length + length + 1 > b->capacity) {
+		uint32_t capacity = b->capacity ? b->capacity : 256;
+		while (b->length + length + 1 > capacity)
+			capacity *= 2;
+		char* data = kmalloc(capacity);
+		if (!data)
+			return;
+		if (b->data) {
+			memcpy(data, b->data, b->length);
+			kfree(b->data);
+		}
+		b->data = data;
+		b->capacity = capacity;
+	}
+	
+	memcpy(&b->data[b->length], str, length);
+	b->length += length;
+	b->data[b->length] = 0;
+}
+
+// Add formatted text to a buffer (one line at most PROCFS_LINE_SIZE long)
+#define procfs_printf(b, ...)	do { \
+									char line[PROCFS_LINE_SIZE]; \
+									int32_t len = sprintf(line, __VA_ARGS__); \
+									procfs_append(b, line, len); \
+								} while (0)
+
+// Add a string to a buffer
+static inline void procfs_puts(procfs_buffer_t* b, const char* str) {
+	procfs_append(b, str, strlen(str));
+}
+
+/* Generators */
+
+// Memory usage
+void procfs_generate_meminfo(procfs_buffer_t* b) {
+	uint32_t used, total;
+	heap_get_usage(&used, &total);
+	procfs_printf(b, "HeapUsed:\t%u kB\n", used / 1024);
+	procfs_printf(b, "HeapTotal:\t%u kB\n", total / 1024);
+	
+	page_get_usage(&used, &total);
+	procfs_printf(b, "PagesUsed:\t%u kB\n", used / 1024);
+	procfs_printf(b, "PagesTotal:\t%u kB\n", total / 1024);
+	
+	page_four_kb_get_usage(&used, &total);
+	procfs_printf(b, "FourKBPagesUsed:\t%u\n", used);
+	procfs_printf(b, "FourKBPagesTotal:\t%u\n", total);
+}
+
+// Number of times each IRQ has fired
+void procfs_generate_interrupts(procfs_buffer_t* b) {
+	for (uint32_t z = 0; z < NUMBER_OF_USER_INTERRUPTS; z++)
+		procfs_printf(b, "%d:\t%u\n", z, pic_counts[z]);
+}
+
+// Disk requests (reads, sectors read, writes, sectors written, model)
+void procfs_generate_diskstats(procfs_buffer_t* b) {
+	for (uint32_t z = 0; z < 4; z++) {
+		ata_drive_t* drive = &ata_drives[z];
+		if (!drive->present)
+			continue;
+	
+		procfs_printf(b, "disk%d\t%u\t%u\t%u\t%u\t", z, drive->reads, drive->read_sectors,
+					  drive->writes, drive->write_sectors);
+		procfs_puts(b, drive->model);
+		procfs_puts(b, "\n");
+	}
+}
+
+// Short name of a task
+const char* procfs_task_name(pcb_t* pcb) {
+	if (pcb->argv && pcb->argv[0])
+		return pcb->argv[0];
+	return "kernel";
+}
+
+// Letter for the state of a task
+char procfs_task_state(pcb_t* pcb) {
+	switch (pcb->state) {
+		case RUNNING:
+		case READY:
+			return 'R';
+		case SUSPENDED:
+			return 'S';
+		case FINISHED:
+			return 'Z';
+		default:
+			return 'U';
+	}
+}
+
+// Add up the scheduler statistics of every thread
+void procfs_task_threads(pcb_t* pcb, uint32_t* num, uint32_t* ticks, uint32_t* switches) {
+	*num = 0;
+	*ticks = 0;
+	*switches = 0;
+	
+	thread_t* t = pcb->threads;
+	if (t)
+		down(&t->lock);
+	while (t) {
+		(*num)++;
+		*ticks += t->ticks;
+		*switches += t->switches;
+	
+		thread_t* prev = t;
+		t = t->next;
+		if (t)
+			down(&t->lock);
+		up(&prev->lock);
+	}
+}
+
+// Readable status of a task
+void procfs_generate_status(pcb_t* pcb, void* data) {
+	procfs_buffer_t* b = data;
+	uint32_t threads, ticks, switches;
+	procfs_task_threads(pcb, &threads, &ticks, &switches);
+	
+	procfs_puts(b, "Name:\t");
+	procfs_puts(b, procfs_task_name(pcb));
+	procfs_printf(b, "\nState:\t%c\n", procfs_task_state(pcb));
+	procfs_printf(b, "Pid:\t%u\n", pcb->task->pid);
+	procfs_printf(b, "PPid:\t%u\n", (pcb->parent && pcb->parent->task) ? pcb->parent->task->pid : 0);
+	procfs_printf(b, "Threads:\t%u\n", threads);
+	procfs_printf(b, "Ticks:\t%u\n", ticks);
+	procfs_printf(b, "Switches:\t%u\n", switches);
+	procfs_printf(b, "Brk:\t0x%#x\n", pcb->brk);
+	procfs_printf(b, "SigPnd:\t0x%#x\n", pcb->signal_pending);
+	procfs_printf(b, "SigBlk:\t0x%#x\n", pcb->signal_mask);
+	if (pcb->working_dir) {
+		procfs_puts(b, "Cwd:\t");
+		procfs_puts(b, pcb->working_dir);
+		procfs_puts(b, "\n");
+	}
+}
+
+// One line status of a task (pid (name) state ppid threads ticks switches brk)
+void procfs_generate_stat(pcb_t* pcb, void* data) {
+	procfs_buffer_t* b = data;
+	uint32_t threads, ticks, switches;
+	procfs_task_threads(pcb, &threads, &ticks, &switches);
+	
+	procfs_printf(b, "%u (", pcb->task->pid);
+	procfs_puts(b, procfs_task_name(pcb));
+	procfs_printf(b, ") %c %u %u %u %u %u\n", procfs_task_state(pcb),
+				  (pcb->parent && pcb->parent->task) ? pcb->parent->task->pid : 0,
+				  threads, ticks, switches, pcb->brk);
+}
+
+// Memory regions of a task
+void procfs_generate_maps(pcb_t* pcb, void* data) {
+	procfs_buffer_t* b = data;
+	
+	// Program, heap and stack pages
+	for (page_list_t* p = pcb->page_list; p; p = p->next) {
+		if (p->mmapped)
+			continue;
+		procfs_printf(b, "%#x-%#x r%cxp %#x [anon]\n", p->vaddr, p->vaddr + FOUR_MB_SIZE,
+					  (p->permissions & MEMORY_WRITE) ? 'w' : '-', 0);
+	}
+	
+	// mmapped regions
+	for (mmap_list_t* m = pcb->user_mappings; m; m = m->next) {
+		procfs_printf(b, "%#x-%#x %c%c-%c %#x ", m->start, m->end,
+					  (m->permissions & MEMORY_READ) ? 'r' : '-', (m->permissions & MEMORY_WRITE) ? 'w' : '-',
+					  m->shared ? 's' : 'p', m->offset);
+		procfs_puts(b, (m->file && m->file->filename) ? m->file->filename : "[anon]");
+		procfs_puts(b, "\n");
+	}
+}
+
+// What a descriptor is
+typedef struct {
+	procfs_buffer_t* buffer;
+	uint32_t fd;
+} procfs_fd_request_t;
+
+void procfs_generate_fd_entry(pcb_t* pcb, void* data) {
+	procfs_fd_request_t* request = data;
+	procfs_buffer_t* b = request->buffer;
+	
+	down(&pcb->descriptor_lock);
+	descriptor_table_t* t = pcb->descriptors;
+	file_descriptor_t* d = (t && request->fd < t->size) ? t->files[request->fd] : NULL;
+	if (d) {
+		if (d->filename)
+			procfs_puts(b, d->filename);
+		else if (d->mode & FILE_TYPE_PIPE)
+			procfs_puts(b, "pipe");
+		else if (d->type == STANDARD_INOUT_TYPE)
+			procfs_puts(b, "terminal");
+		else
+			procfs_printf(b, "type %d", d->type);
+		procfs_printf(b, "\nmode 0x%x\n", d->mode);
+		procfs_printf(b, "flags 0x%x\n", t->flags[request->fd]);
+	}
+	up(&pcb->descriptor_lock);
+}
+
+// List of open descriptors
+typedef struct {
+	uint32_t* fds;
+	uint32_t num;
+} procfs_fd_list_t;
+
+void procfs_list_fds(pcb_t* pcb, void* data) {
+	procfs_fd_list_t* list = data;
+	
+	down(&pcb->descriptor_lock);
+	descriptor_table_t* t = pcb->descriptors;
+	list->fds = t ? kmalloc(t->size * sizeof(uint32_t)) : NULL;
+	if (list->fds) {
+		for (uint32_t z = 0; z < t->size; z++) {
+			if (t->files[z])
+				list->fds[list->num++] = z;
+		}
+	}
+	up(&pcb->descriptor_lock);
+}
+
+// Generate the contents of a file or the listing of a directory
+void procfs_generate(procfs_file_t* file) {
+	if (file->generated)
+		return;
+	file->generated = true;
+	
+	procfs_buffer_t* b = &file->buffer;
+	switch (file->type) {
+		case PROCFS_ROOT: {
+			uint32_t num = task_list_get_pids(NULL, 0);
+			file->ids = kmalloc((num + 1) * sizeof(uint32_t));
+			if (file->ids) {
+				file->num_ids = task_list_get_pids(file->ids, num);
+				if (file->num_ids > num)
+					file->num_ids = num;
+			}
+			break;
+		}
+		case PROCFS_PID_FD: {
+			procfs_fd_list_t list = { NULL, 0 };
+			pcb_perform_for_pid(file->pid, procfs_list_fds, &list);
+			file->ids = list.fds;
+			file->num_ids = list.num;
+			break;
+		}
+		case PROCFS_MEMINFO:
+			procfs_generate_meminfo(b);
+			break;
+		case PROCFS_INTERRUPTS:
+			procfs_generate_interrupts(b);
+			break;
+		case PROCFS_DISKSTATS:
+			procfs_generate_diskstats(b);
+			break;
+		case PROCFS_PID_STATUS:
+			pcb_perform_for_pid(file->pid, procfs_generate_status, b);
+			break;
+		case PROCFS_PID_STAT:
+			pcb_perform_for_pid(file->pid, procfs_generate_stat, b);
+			break;
+		case PROCFS_PID_MAPS:
+			pcb_perform_for_pid(file->pid, procfs_generate_maps, b);
+			break;
+		case PROCFS_PID_FD_ENTRY: {
+			procfs_fd_request_t request = { b, file->fd };
+			pcb_perform_for_pid(file->pid, procfs_generate_fd_entry, &request);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+/* Paths */
+
+// Parse a decimal number
+bool procfs_parse_number(const char* str, uint32_t length, uint32_t* out) {
+	if (length == 0 || length > 9)
+		return false;
+	
+	uint32_t ret = 0;
+	for (uint32_t z = 0; z < length; z++) {
+		if (str[z] < '0' || str[z] > '9')
+			return false;
+		ret = ret * 10 + (str[z] - '0');
+	}
+	
+	*out = ret;
+	return true;
+}
+
+// Used to check that a task exists
+void procfs_task_exists(pcb_t* pcb, void* data) {
+}
+
+// Figure out what a path refers to
+bool procfs_parse(const char* path, procfs_file_t* file) {
+	file->type = PROCFS_ROOT;
+	
+	uint32_t pos = 0;
+	uint32_t length = strlen(path);
+	while (pos < length) {
+		uint32_t start = pos;
+		while (pos < length && path[pos] != '/')
+			pos++;
+		const char* name = &path[start];
+		uint32_t name_len = pos - start;
+		pos++;
+	
+		switch (file->type) {
+			case PROCFS_ROOT: {
+				bool found = false;
+				for (uint32_t z = 0; z < PROCFS_NUM_ROOT_ENTRIES; z++) {
+					if (strlen(procfs_root_entries[z].name) == name_len &&
+						strncmp(procfs_root_entries[z].name, name, name_len) == 0) {
+						file->type = procfs_root_entries[z].type;
+						found = true;
+						break;
+					}
+				}
+				if (found && file->type == PROCFS_PID) {
+					// "self" is the current task
+					if (!current_pcb || !current_pcb->task)
+						return false;
+					file->pid = current_pcb->task->pid;
+				} else if (!found) {
+					if (!procfs_parse_number(name, name_len, &file->pid))
+						return false;
+					if (!pcb_perform_for_pid(file->pid, procfs_task_exists, NULL))
+						return false;
+					file->type = PROCFS_PID;
+				}
+				break;
+			}
+			case PROCFS_PID: {
+				bool found = false;
+				for (uint32_t z = 0; z < PROCFS_NUM_PID_ENTRIES; z++) {
+					if (strlen(procfs_pid_entries[z].name) == name_len &&
+						strncmp(procfs_pid_entries[z].name, name, name_len) == 0) {
+						file->type = procfs_pid_entries[z].type;
+						found = true;
+						break;
+					}
+				}
+				if (!found)
+					return false;
+				break;
+			}
+			case PROCFS_PID_FD:
+				if (!procfs_parse_number(name, name_len, &file->fd) || file->fd >= NUMBER_OF_DESCRIPTORS)
+					return false;
+				file->type = PROCFS_PID_FD_ENTRY;
+				break;
+			default:
+				// Files have nothing under them
+				return false;
+		}
+	}
+	
+	return true;
+}
+
+// Whether a kind of file is a directory
+static inline bool procfs_is_directory(procfs_type_t type) {
+	return type == PROCFS_ROOT || type == PROCFS_PID || type == PROCFS_PID_FD;
+}
+
+// Get an entry in a directory ("." and ".." come first)
+bool procfs_dir_entry_at(procfs_file_t* file, uint32_t index, char* name, uint32_t* ino, bool* is_dir) {
+	procfs_generate(file);
+	
+	if (index < 2) {
+		strcpy(name, (index == 0) ? "." : "..");
+		*ino = PROCFS_INODE(file->pid, 0, file->type);
+		*is_dir = true;
+		return true;
+	}
+	index -= 2;
+	
+	// Names that are always there
+	procfs_static_entry_t* entries = NULL;
+	uint32_t num_entries = 0;
+	if (file->type == PROCFS_ROOT) {
+		entries = procfs_root_entries;
+		num_entries = PROCFS_NUM_ROOT_ENTRIES;
+	} else if (file->type == PROCFS_PID) {
+		entries = procfs_pid_entries;
+		num_entries = PROCFS_NUM_PID_ENTRIES;
+	}
+	if (index < num_entries) {
+		strcpy(name, entries[index].name);
+		*ino = PROCFS_INODE(file->pid, 0, entries[index].type);
+		*is_dir = procfs_is_directory(entries[index].type);
+		return true;
+	}
+	index -= num_entries;
+	
+	// Tasks or descriptors
+	if (index >= file->num_ids)
+		return false;
+	itoa(file->ids[index], name, 10);
+	if (file->type == PROCFS_ROOT) {
+		*ino = PROCFS_INODE(file->ids[index], 0, PROCFS_PID);
+		*is_dir = true;
+	} else {
+		*ino = PROCFS_INODE(file->pid, file->ids[index], PROCFS_PID_FD_ENTRY);
+		*is_dir = false;
+	}
+	
+	return true;
+}
+
+/* Descriptor calls */
+
+// Read from a file
+uint32_t procfs_read_file(file_descriptor_t* f, void* buf, uint32_t length) {
+	procfs_file_t* file = f->info;
+	procfs_generate(file);
+	
+	if (file->offset >= file->buffer.length)
+		return 0;
+	if (file->offset + length > file->buffer.length)
+		length = file->buffer.length - file->offset;
+	memcpy(buf, &file->buffer.data[file->offset], length);
+	file->offset += length;
+	
+	return length;
+}
+
+// Read from a file at an offset without changing the file position
+uint32_t procfs_pread_file(file_descriptor_t* f, void* buf, uint32_t length, uint64_t offset) {
+	procfs_file_t* file = f->info;
+	procfs_generate(file);
+	
+	if (offset >= file->buffer.length)
+		return 0;
+	if (offset + length > file->buffer.length)
+		length = file->buffer.length - offset;
+	memcpy(buf, &file->buffer.data[offset], length);
+	
+	return length;
+}
+
+// Seek in a file or directory (directory offsets are entry indices)
+uint64_t procfs_llseek(file_descriptor_t* f, uint64_t offset, int whence) {
+	procfs_file_t* file = f->info;
+	
+	uint64_t base = 0;
+	if (whence == SEEK_CUR)
+		base = file->offset;
+	else if (whence == SEEK_END) {
+		procfs_generate(file);
+		if (procfs_is_directory(file->type)) {
+			base = 2 + file->num_ids;
+			if (file->type == PROCFS_ROOT)
+				base += PROCFS_NUM_ROOT_ENTRIES;
+			else if (file->type == PROCFS_PID)
+				base += PROCFS_NUM_PID_ENTRIES;
+		} else
+			base = file->buffer.length;
+	}
+	
+	if ((int64_t)(base + offset) < 0)
+		return (uint64_t)-EINVAL;
+	
+	file->offset = base + offset;
+	return file->offset;
+}
+
+// Read the name of the next directory entry
+uint32_t procfs_read_directory(file_descriptor_t* f, void* buf, uint32_t length) {
+	procfs_file_t* file = f->info;
+	
+	char name[PROCFS_NAME_SIZE];
+	uint32_t ino;
+	bool is_dir;
+	if (length == 0 || !procfs_dir_entry_at(file, file->offset, name, &ino, &is_dir))
+		return 0;
+	file->offset++;
+	
+	uint32_t name_len = strlen(name);
+	uint32_t copy = (name_len < length) ? name_len : length;
+	memcpy(buf, name, copy);
+	if (copy < length)
+		((char*)buf)[copy] = 0;
+	
+	return copy;
+}
+
+// Read as many directory entries as fit into a buffer
+uint32_t procfs_getdents(file_descriptor_t* f, void* buf, uint32_t size) {
+	procfs_file_t* file = f->info;
+	
+	uint32_t pos = 0;
+	char name[PROCFS_NAME_SIZE];
+	uint32_t ino;
+	bool is_dir;
+	while (procfs_dir_entry_at(file, file->offset, name, &ino, &is_dir)) {
+		uint32_t name_len = strlen(name);
+		uint32_t reclen = (GETDENTS_ENTRY_HEADER_SIZE + name_len + 1 + 3) & ~3;
+		if (pos + reclen > size) {
+			// The buffer can't even hold one entry
+			if (pos == 0)
+				return -EINVAL;
+			break;
+		}
+	
+		// Use the same entry types as ext2
+		getdents_entry_t* entry = (getdents_entry_t*)((uint8_t*)buf + pos);
+		entry->ino = ino;
+		entry->off = file->offset + 1;
+		entry->reclen = reclen;
+		entry->type = is_dir ? EXT2_FT_DIR : EXT2_FT_REG_FILE;
+		memcpy(entry->name, name, name_len + 1);
+	
+		pos += reclen;
+		file->offset++;
+	}
+	
+	return pos;
+}
+
+// Get info about a file or directory
+uint32_t procfs_stat(file_descriptor_t* f, sys_stat_type* data) {
+	procfs_file_t* file = f->info;
+	memset(data, 0, sizeof(sys_stat_type));
+	
+	// Sizes are only known once something has been read
+	data->dev_id = PROCFS_DEV_ID;
+	data->inode = PROCFS_INODE(file->pid, file->fd, file->type);
+	data->mode = f->mode;
+	data->num_links = 1;
+	data->size = procfs_is_directory(file->type) ? 0 : file->buffer.length;
+	data->block_size = FOUR_KB_SIZE;
+	
+	return 0;
+}
+
+// Able to read a file
+bool procfs_can_read(file_descriptor_t* f) {
+	return true;
+}
+
+// Duplicate a descriptor (the copy keeps its own snapshot)
+file_descriptor_t* procfs_duplicate(file_descriptor_t* f) {
+	procfs_file_t* file = f->info;
+	
+	file_descriptor_t* d = (file_descriptor_t*)kmalloc(sizeof(file_descriptor_t));
+	if (!d)
+		return NULL;
+	memcpy(d, f, sizeof(file_descriptor_t));
+	d->lock = MUTEX_UNLOCKED;
+	
+	procfs_file_t* info = kmalloc(sizeof(procfs_file_t));
+	uint32_t name_len = strlen(f->filename);
+	d->filename = kmalloc(name_len + 1);
+	if (!info || !d->filename) {
+		if (info)
+			kfree(info);
+		if (d->filename)
+			kfree(d->filename);
+		kfree(d);
+		return NULL;
+	}
+	memcpy(d->filename, f->filename, name_len + 1);
+	memset(info, 0, sizeof(procfs_file_t));
+	info->type = file->type;
+	info->pid = file->pid;
+	info->fd = file->fd;
+	info->offset = file->offset;
+	d->info = info;
+	
+	return d;
+}
+
+// Close a descriptor
+uint32_t procfs_close(file_descriptor_t* f) {
+	procfs_file_t* file = f->info;
+	if (file->buffer.data)
+		kfree(file->buffer.data);
+	if (file->ids)
+		kfree(file->ids);
+	kfree(file);
+	if (f->filename)
+		kfree(f->filename);
+	
+	return 0;
+}
+
+/* Mount calls */
+
+// Open a file or directory (nothing is generated until it is read)
+bool procfs_open(void* fs, const char* path, uint32_t mode, file_descriptor_t* desc) {
+	// Everything is read only
+	if (mode & (FILE_MODE_WRITE | FILE_MODE_APPEND | FILE_MODE_TRUNCATE | FILE_MODE_DELETE_ON_CLOSE))
+		return false;
+	
+	procfs_file_t* file = kmalloc(sizeof(procfs_file_t));
+	if (!file)
+		return false;
+	memset(file, 0, sizeof(procfs_file_t));
+	if (!procfs_parse(path, file)) {
+		kfree(file);
+		return false;
+	}
+	
+	memset(desc, 0, sizeof(file_descriptor_t));
+	desc->lock = MUTEX_UNLOCKED;
+	desc->info = file;
+	desc->mode = mode & ~(FILE_MODE_CREATE | FILE_MODE_EXCLUSIVE | FILE_TYPE_ALL);
+	if (procfs_is_directory(file->type)) {
+		desc->mode |= FILE_TYPE_DIRECTORY;
+		desc->read = procfs_read_directory;
+		desc->getdents = procfs_getdents;
+	} else {
+		desc->mode |= FILE_TYPE_REGULAR;
+		desc->read = procfs_read_file;
+		desc->pread = procfs_pread_file;
+		desc->can_read = procfs_can_read;
+	}
+	desc->llseek = procfs_llseek;
+	desc->stat = procfs_stat;
+	desc->duplicate = procfs_duplicate;
+	desc->close = procfs_close;
+	
+	return true;
+}
+
+// Nothing can be created
+int procfs_mkdir(void* fs, const char* path) {
+	return -EROFS;
+}
+
+int procfs_link(void* fs, file_descriptor_t* file, const char* link_name) {
+	return -EROFS;
+}
+
+int procfs_unlink(void* fs, const char* path) {
+	return -EROFS;
+}
+
+// Returns true if a path is a directory
+bool procfs_isdir(void* fs, const char* path) {
+	procfs_file_t file;
+	memset(&file, 0, sizeof(procfs_file_t));
+	
+	return procfs_parse(path, &file) && procfs_is_directory(file.type);
+}
+
+// Times are always now
+void procfs_settime(void* fs, file_descriptor_t* file, uint32_t atime, uint32_t mtime) {
+}
+
+vfs_ops_t procfs_ops = {
+	.open = procfs_open,
+	.mkdir = procfs_mkdir,
+	.link = procfs_link,
+	.unlink = procfs_unlink,
+	.isdir = procfs_isdir,
+	.settime = procfs_settime,
+};
+
+// Mount the process information filesystem at a path
+bool procfs_mount(const char* path) {
+	return vfs_mount(path, &procfs_ops, NULL) == 0;
+}
@@ -0,0 +1,16 @@
+//
+//  procfs.h
+//  NeilOS
+//
+
+#ifndef PROCFS_H
+#define PROCFS_H
+
+#include <common/types.h>
+
+#define PROCFS_DEV_ID			0x200
+
+// Mount the process information filesystem at a path
+bool procfs_mount(const char* path);
+
+#endif /* PROCFS_H */
@@ -0,0 +1,824 @@
+//
+//  tmpfs.c
+//  NeilOS
+//
+
+#include "tmpfs.h"
+#include <common/lib.h>
+#include <common/time.h>
+#include <memory/memory.h>
+#include <memory/allocation/heap.h>
+#include <memory/allocation/page_allocator.h>
+#include <drivers/filesystem/vfs.h>
+#include <drivers/filesystem/ext2/defs.h>
+#include <syscalls/impl/sysfs.h>
+#include <syscalls/interrupt.h>
+
+// Information for an open file or directory
+typedef struct {
+	tmpfs_t* fs;
+	tmpfs_node_t* node;
+	uint64_t offset;					// Byte offset for files, entry index for directories
+	char* path;							// Path inside the filesystem
+} tmpfs_file_t;
+
+uint32_t tmpfs_next_dev_id = 0x100;
+
+// Current time for node timestamps
+static inline uint32_t tmpfs_now() {
+	return get_current_unix_time().val;
+}
+
+// Allocate a node
+tmpfs_node_t* tmpfs_node_create(tmpfs_t* fs, uint32_t mode) {
+	tmpfs_node_t* node = kmalloc(sizeof(tmpfs_node_t));
+	if (!node)
+		return NULL;
+	memset(node, 0, sizeof(tmpfs_node_t));
+	
+	node->inode = fs->next_inode++;
+	node->mode = mode;
+	node->atime = node->mtime = node->ctime = tmpfs_now();
+	
+	return node;
+}
+
+// Change the size of a file, freeing any pages past the end (tree lock must be held for writing)
+void tmpfs_node_resize(tmpfs_t* fs, tmpfs_node_t* node, uint32_t size) {
+	uint32_t keep = (size == 0) ? 0 : ((size - 1) / FOUR_KB_SIZE + 1);
+	for (uint32_t z = keep; z < node->num_pages; z++) {
+		if (node->pages[z]) {
+			page_free_aligned_four_kb(node->pages[z]);
+			node->pages[z] = NULL;
+			fs->num_pages--;
+		}
+	}
+	
+	// Clear the rest of the last page so that growing the file again reads zeros
+	uint32_t page_offset = size & (FOUR_KB_SIZE - 1);
+	if (size < node->size && page_offset != 0 && keep <= node->num_pages && node->pages[keep - 1])
+		memset((uint8_t*)node->pages[keep - 1] + page_offset, 0, FOUR_KB_SIZE - page_offset);
+	
+	node->size = size;
+	node->mtime = node->ctime = tmpfs_now();
+}
+
+// Free a node once nothing refers to it (tree lock must be held for writing)
+void tmpfs_node_release(tmpfs_t* fs, tmpfs_node_t* node) {
+	if (node->link_count != 0 || node->open_count != 0)
+		return;
+	
+	// Directories are only unlinked once they are empty
+	tmpfs_node_resize(fs, node, 0);
+	if (node->pages)
+		kfree(node->pages);
+	kfree(node);
+}
+
+// Make sure a file's page array can hold a number of pages
+bool tmpfs_node_reserve(tmpfs_node_t* node, uint32_t count) {
+	if (count <= node->num_pages)
+		return true;
+	
+	uint32_t num = node->num_pages ? node->num_pages : 8;
+	while (num < count)
+		num *= 2;
+	
+	void** pages = kmalloc(num * sizeof(void*));
+	if (!pages)
+		return false;
+	memset(pages, 0, num * sizeof(void*));
+	if (node->pages) {
+		memcpy(pages, node->pages, node->num_pages * sizeof(void*));
+		kfree(node->pages);
+	}
+	node->pages = pages;
+	node->num_pages = num;
+	
+	return true;
+}
+
+// Read from a file at an offset (tree lock must be held)
+uint32_t tmpfs_node_read(tmpfs_node_t* node, void* buffer, uint32_t length, uint64_t offset) {
+	if (offset >= node->size)
+		return 0;
+	if (offset + length > node->size)
+		length = node->size - offset;
+	
+	uint32_t pos = offset;
+	uint32_t copied = 0;
+	while (copied < length) {
+		uint32_t page = pos / FOUR_KB_SIZE;
+		uint32_t page_offset = pos & (FOUR_KB_SIZE - 1);
+		uint32_t size = FOUR_KB_SIZE - page_offset;
+		if (size > length - copied)
+			size = length - copied;
+	
+		// Holes read as zeros
+		if (page < node->num_pages && node->pages[page])
+			memcpy((uint8_t*)buffer + copied, (uint8_t*)node->pages[page] + page_offset, size);
+		else
+			memset((uint8_t*)buffer + copied, 0, size);
+	
+		copied += size;
+		pos += size;
+	}
+	
+	return copied;
+}
+
+// Write to a file at an offset, allocating pages as needed (tree lock must be held for writing)
+uint32_t tmpfs_node_write(tmpfs_t* fs, tmpfs_node_t* node, const void* buffer, uint32_t length, uint64_t offset) {
+	if (length == 0)
+		return 0;
+	// Sizes are 32 bits
+	if (offset + length > 0xFFFFFFFF)
+		return -EFBIG;
+	
+	uint32_t end = offset + length;
+	if (!tmpfs_node_reserve(node, (end - 1) / FOUR_KB_SIZE + 1))
+		return -ENOSPC;
+	
+	uint32_t pos = offset;
+	uint32_t copied = 0;
+	while (copied < length) {
+		uint32_t page = pos / FOUR_KB_SIZE;
+		uint32_t page_offset = pos & (FOUR_KB_SIZE - 1);
+		uint32_t size = FOUR_KB_SIZE - page_offset;
+		if (size > length - copied)
+			size = length - copied;
+	
+		if (!node->pages[page]) {
+			if (fs->max_pages != 0 && fs->num_pages >= fs->max_pages)
+				break;
+			node->pages[page] = page_get_aligned_four_kb();
+			if (!node->pages[page])
+				break;
+			memset(node->pages[page], 0, FOUR_KB_SIZE);
+			fs->num_pages++;
+		}
+		memcpy((uint8_t*)node->pages[page] + page_offset, (const uint8_t*)buffer + copied, size);
+	
+		copied += size;
+		pos += size;
+	}
+	if (copied == 0)
+		return -ENOSPC;
+	
+	if (offset + copied > node->size)
+		node->size = offset + copied;
+	node->mtime = node->ctime = tmpfs_now();
+	
+	return copied;
+}
+
+// Find a name in a directory (tree lock must be held)
+tmpfs_entry_t* tmpfs_dir_find(tmpfs_node_t* dir, const char* name, uint32_t length, tmpfs_entry_t** prev_out) {
+	tmpfs_entry_t* prev = NULL;
+	for (tmpfs_entry_t* e = dir->entries; e; e = e->next) {
+		if (e->name_len == length && strncmp(e->name, name, length) == 0) {
+			if (prev_out)
+				*prev_out = prev;
+			return e;
+		}
+		prev = e;
+	}
+	
+	return NULL;
+}
+
+// Add a name to a directory (tree lock must be held for writing)
+bool tmpfs_dir_add(tmpfs_node_t* dir, const char* name, uint32_t length, tmpfs_node_t* node) {
+	tmpfs_entry_t* e = kmalloc(sizeof(tmpfs_entry_t));
+	if (!e)
+		return false;
+	e->name = kmalloc(length + 1);
+	if (!e->name) {
+		kfree(e);
+		return false;
+	}
+	memcpy(e->name, name, length);
+	e->name[length] = 0;
+	e->name_len = length;
+	e->node = node;
+	e->next = NULL;
+	
+	// Keep the order things were created in for directory listings
+	if (dir->entries_tail)
+		dir->entries_tail->next = e;
+	else
+		dir->entries = e;
+	dir->entries_tail = e;
+	dir->num_entries++;
+	dir->mtime = dir->ctime = tmpfs_now();
+	
+	node->link_count++;
+	if (node->mode & FILE_TYPE_DIRECTORY)
+		node->parent = dir;
+	
+	return true;
+}
+
+// Remove a name from a directory (tree lock must be held for writing)
+void tmpfs_dir_remove(tmpfs_node_t* dir, tmpfs_entry_t* e, tmpfs_entry_t* prev) {
+	if (prev)
+		prev->next = e->next;
+	else
+		dir->entries = e->next;
+	if (dir->entries_tail == e)
+		dir->entries_tail = prev;
+	dir->num_entries--;
+	dir->mtime = dir->ctime = tmpfs_now();
+	
+	e->node->link_count--;
+	if (e->node->mode & FILE_TYPE_DIRECTORY)
+		e->node->parent = NULL;
+	
+	kfree(e->name);
+	kfree(e);
+}
+
+// Find the node at a path (tree lock must be held)
+tmpfs_node_t* tmpfs_lookup(tmpfs_t* fs, const char* path, uint32_t length) {
+	tmpfs_node_t* node = fs->root;
+	uint32_t pos = 0;
+	while (pos < length) {
+		if (!(node->mode & FILE_TYPE_DIRECTORY))
+			return NULL;
+	
+		uint32_t start = pos;
+		while (pos < length && path[pos] != '/')
+			pos++;
+		tmpfs_entry_t* e = tmpfs_dir_find(node, &path[start], pos - start, NULL);
+		if (!e)
+			return NULL;
+		node = e->node;
+		pos++;
+	}
+	
+	return node;
+}
+
+// Find the directory that holds the last component of a path (tree lock must be held)
+tmpfs_node_t* tmpfs_lookup_parent(tmpfs_t* fs, const char* path, const char** name_out, uint32_t* length_out) {
+	uint32_t length = strlen(path);
+	uint32_t pos = length;
+	while (pos > 0 && path[pos - 1] != '/')
+		pos--;
+	
+	*name_out = &path[pos];
+	*length_out = length - pos;
+	
+	tmpfs_node_t* parent = tmpfs_lookup(fs, path, (pos == 0) ? 0 : (pos - 1));
+	if (!parent || !(parent->mode & FILE_TYPE_DIRECTORY))
+		return NULL;
+	
+	return parent;
+}
+
+// Get the entry at an index in a directory ("." and ".." come first) (tree lock must be held)
+bool tmpfs_dir_entry_at(tmpfs_node_t* dir, uint32_t index, const char** name_out, uint32_t* length_out,
+						tmpfs_node_t** node_out) {
+	if (index == 0) {
+		*name_out = ".";
+		*length_out = 1;
+		*node_out = dir;
+		return true;
+	} else if (index == 1) {
+		*name_out = "..";
+		*length_out = 2;
+		*node_out = dir->parent ? dir->parent : dir;
+		return true;
+	}
+	
+	index -= 2;
+	tmpfs_entry_t* e = dir->entries;
+	while (e && index > 0) {
+		e = e->next;
+		index--;
+	}
+	if (!e)
+		return false;
+	
+	*name_out = e->name;
+	*length_out = e->name_len;
+	*node_out = e->node;
+	return true;
+}
+
+// Unlink a path (tree lock must be held for writing)
+int tmpfs_unlink_locked(tmpfs_t* fs, const char* path) {
+	// The mount point itself can't be removed
+	if (path[0] == 0)
+		return -EBUSY;
+	
+	const char* name;
+	uint32_t length;
+	tmpfs_node_t* parent = tmpfs_lookup_parent(fs, path, &name, &length);
+	if (!parent)
+		return -ENOENT;
+	
+	tmpfs_entry_t* prev = NULL;
+	tmpfs_entry_t* e = tmpfs_dir_find(parent, name, length, &prev);
+	if (!e)
+		return -ENOENT;
+	
+	tmpfs_node_t* node = e->node;
+	if ((node->mode & FILE_TYPE_DIRECTORY) && node->num_entries != 0)
+		return -ENOTEMPTY;
+	
+	tmpfs_dir_remove(parent, e, prev);
+	tmpfs_node_release(fs, node);
+	
+	return 0;
+}
+
+/* Descriptor calls */
+
+// Read from a file
+uint32_t tmpfs_read_file(file_descriptor_t* f, void* buf, uint32_t length) {
+	tmpfs_file_t* file = f->info;
+	
+	down_read(&file->fs->lock);
+	uint32_t ret = tmpfs_node_read(file->node, buf, length, file->offset);
+	file->offset += ret;
+	up_read(&file->fs->lock);
+	
+	return ret;
+}
+
+// Write to a file
+uint32_t tmpfs_write_file(file_descriptor_t* f, const void* buf, uint32_t length) {
+	tmpfs_file_t* file = f->info;
+	
+	down_write(&file->fs->lock);
+	if (f->mode & FILE_MODE_APPEND)
+		file->offset = file->node->size;
+	uint32_t ret = tmpfs_node_write(file->fs, file->node, buf, length, file->offset);
+	if ((int32_t)ret > 0)
+		file->offset += ret;
+	up_write(&file->fs->lock);
+	
+	return ret;
+}
+
+// Read from a file at an offset without changing the file position
+uint32_t tmpfs_pread_file(file_descriptor_t* f, void* buf, uint32_t length, uint64_t offset) {
+	tmpfs_file_t* file = f->info;
+	
+	down_read(&file->fs->lock);
+	uint32_t ret = tmpfs_node_read(file->node, buf, length, offset);
+	up_read(&file->fs->lock);
+	
+	return ret;
+}
+
+// Write to a file at an offset without changing the file position
+uint32_t tmpfs_pwrite_file(file_descriptor_t* f, const void* buf, uint32_t length, uint64_t offset) {
+	tmpfs_file_t* file = f->info;
+	
+	down_write(&file->fs->lock);
+	uint32_t ret = tmpfs_node_write(file->fs, file->node, buf, length, offset);
+	up_write(&file->fs->lock);
+	
+	return ret;
+}
+
+// Seek in a file
+uint64_t tmpfs_llseek_file(file_descriptor_t* f, uint64_t offset, int whence) {
+	tmpfs_file_t* file = f->info;
+	
+	uint64_t base = 0;
+	if (whence == SEEK_CUR)
+		base = file->offset;
+	else if (whence == SEEK_END) {
+		down_read(&file->fs->lock);
+		base = file->node->size;
+		up_read(&file->fs->lock);
+	}
+	
+	// Can't seek to before the start
+	if ((int64_t)(base + offset) < 0)
+		return (uint64_t)-EINVAL;
+	
+	file->offset = base + offset;
+	return file->offset;
+}
+
+// Change the size of a file
+uint64_t tmpfs_truncate(file_descriptor_t* f, uint64_t size) {
+	tmpfs_file_t* file = f->info;
+	if (!(file->node->mode & FILE_TYPE_REGULAR))
+		return (uint64_t)-EISDIR;
+	if (size > 0xFFFFFFFF)
+		return (uint64_t)-EFBIG;
+	
+	down_write(&file->fs->lock);
+	if (size > 0 && !tmpfs_node_reserve(file->node, (uint32_t)(size - 1) / FOUR_KB_SIZE + 1)) {
+		up_write(&file->fs->lock);
+		return (uint64_t)-ENOSPC;
+	}
+	tmpfs_node_resize(file->fs, file->node, size);
+	up_write(&file->fs->lock);
+	
+	return size;
+}
+
+// Get info about a file or directory
+uint32_t tmpfs_stat(file_descriptor_t* f, sys_stat_type* data) {
+	tmpfs_file_t* file = f->info;
+	memset(data, 0, sizeof(sys_stat_type));
+	
+	down_read(&file->fs->lock);
+	tmpfs_node_t* node = file->node;
+	data->dev_id = file->fs->dev_id;
+	data->inode = node->inode;
+	data->mode = f->mode;
+	data->num_links = node->link_count;
+	data->size = node->size;
+	data->block_size = FOUR_KB_SIZE;
+	data->num_512_blocks = (node->size + 511) / 512;
+	data->atime.val = node->atime;
+	data->mtime.val = node->mtime;
+	data->ctime.val = node->ctime;
+	up_read(&file->fs->lock);
+	
+	return 0;
+}
+
+// Data is never on a disk
+uint32_t tmpfs_fsync(file_descriptor_t* f) {
+	return 0;
+}
+
+// Able to read a file
+bool tmpfs_can_read_file(file_descriptor_t* f) {
+	if (!(f->mode & FILE_MODE_READ))
+		return false;
+	
+	tmpfs_file_t* file = f->info;
+	return file->offset < file->node->size;
+}
+
+// Able to write to a file
+bool tmpfs_can_write_file(file_descriptor_t* f) {
+	return (f->mode & (FILE_MODE_WRITE | FILE_MODE_APPEND)) != 0;
+}
+
+// Read the name of the next directory entry
+uint32_t tmpfs_read_directory(file_descriptor_t* f, void* buf, uint32_t length) {
+	tmpfs_file_t* file = f->info;
+	if (length == 0)
+		return 0;
+	
+	const char* name;
+	uint32_t name_len;
+	tmpfs_node_t* node;
+	down_read(&file->fs->lock);
+	if (!tmpfs_dir_entry_at(file->node, file->offset, &name, &name_len, &node)) {
+		up_read(&file->fs->lock);
+		return 0;
+	}
+	uint32_t copy = (name_len < length) ? name_len : length;
+	memcpy(buf, name, copy);
+	if (copy < length)
+		((char*)buf)[copy] = 0;
+	up_read(&file->fs->lock);
+	file->offset++;
+	
+	return copy;
+}
+
+// Read as many directory entries as fit into a buffer
+uint32_t tmpfs_getdents(file_descriptor_t* f, void* buf, uint32_t size) {
+	tmpfs_file_t* file = f->info;
+	
+	uint32_t pos = 0;
+	bool more = false;
+	down_read(&file->fs->lock);
+	for (;;) {
+		const char* name;
+		uint32_t name_len;
+		tmpfs_node_t* node;
+		if (!tmpfs_dir_entry_at(file->node, file->offset, &name, &name_len, &node))
+			break;
+	
+		uint32_t reclen = (GETDENTS_ENTRY_HEADER_SIZE + name_len + 1 + 3) & ~3;
+		if (pos + reclen > size) {
+			more = true;
+			break;
+		}
+	
+		// Use the same entry types as ext2
+		getdents_entry_t* entry = (getdents_entry_t*)((uint8_t*)buf + pos);
+		entry->ino = node->inode;
+		entry->off = file->offset + 1;
+		entry->reclen = reclen;
+		entry->type = (node->mode & FILE_TYPE_DIRECTORY) ? EXT2_FT_DIR : EXT2_FT_REG_FILE;
+		memcpy(entry->name, name, name_len);
+		entry->name[name_len] = 0;
+	
+		pos += reclen;
+		file->offset++;
+	}
+	up_read(&file->fs->lock);
+	
+	// The buffer can't even hold one entry
+	if (pos == 0 && more)
+		return -EINVAL;
+	
+	return pos;
+}
+
+// Seek in a directory (the offset is the index of an entry)
+uint64_t tmpfs_llseek_directory(file_descriptor_t* f, uint64_t offset, int whence) {
+	tmpfs_file_t* file = f->info;
+	
+	uint64_t base = 0;
+	if (whence == SEEK_CUR)
+		base = file->offset;
+	else if (whence == SEEK_END) {
+		down_read(&file->fs->lock);
+		base = file->node->num_entries + 2;
+		up_read(&file->fs->lock);
+	}
+	
+	if ((int64_t)(base + offset) < 0)
+		return (uint64_t)-EINVAL;
+	
+	file->offset = base + offset;
+	return file->offset;
+}
+
+// Duplicate a descriptor
+file_descriptor_t* tmpfs_duplicate(file_descriptor_t* f) {
+	tmpfs_file_t* file = f->info;
+	
+	file_descriptor_t* d = (file_descriptor_t*)kmalloc(sizeof(file_descriptor_t));
+	if (!d)
+		return NULL;
+	memcpy(d, f, sizeof(file_descriptor_t));
+	d->lock = MUTEX_UNLOCKED;
+	
+	tmpfs_file_t* info = kmalloc(sizeof(tmpfs_file_t));
+	if (!info) {
+		kfree(d);
+		return NULL;
+	}
+	memcpy(info, file, sizeof(tmpfs_file_t));
+	d->info = info;
+	
+	uint32_t path_len = strlen(file->path);
+	uint32_t name_len = strlen(f->filename);
+	info->path = kmalloc(path_len + 1);
+	d->filename = kmalloc(name_len + 1);
+	if (!info->path || !d->filename) {
+		if (info->path)
+			kfree(info->path);
+		if (d->filename)
+			kfree(d->filename);
+		kfree(info);
+		kfree(d);
+		return NULL;
+	}
+	memcpy(info->path, file->path, path_len + 1);
+	memcpy(d->filename, f->filename, name_len + 1);
+	
+	down_write(&file->fs->lock);
+	file->node->open_count++;
+	up_write(&file->fs->lock);
+	
+	return d;
+}
+
+// Close a descriptor
+uint32_t tmpfs_close(file_descriptor_t* f) {
+	tmpfs_file_t* file = f->info;
+	uint32_t ret = 0;
+	
+	down_write(&file->fs->lock);
+	if (f->mode & FILE_MODE_DELETE_ON_CLOSE) {
+		if (tmpfs_unlink_locked(file->fs, file->path) != 0)
+			ret = -1;
+	}
+	file->node->open_count--;
+	tmpfs_node_release(file->fs, file->node);
+	up_write(&file->fs->lock);
+	
+	if (f->filename)
+		kfree(f->filename);
+	kfree(file->path);
+	kfree(file);
+	
+	return ret;
+}
+
+/* Mount calls */
+
+// Open a file or directory
+bool tmpfs_open(void* data, const char* path, uint32_t mode, file_descriptor_t* desc) {
+	tmpfs_t* fs = data;
+	
+	// Fifos and devices need a disk inode
+	if (mode & FILE_TYPE_PIPE)
+		return false;
+	
+	tmpfs_file_t* file = kmalloc(sizeof(tmpfs_file_t));
+	if (!file)
+		return false;
+	memset(file, 0, sizeof(tmpfs_file_t));
+	uint32_t path_len = strlen(path);
+	file->path = kmalloc(path_len + 1);
+	if (!file->path) {
+		kfree(file);
+		return false;
+	}
+	memcpy(file->path, path, path_len + 1);
+	file->fs = fs;
+	
+	down_write(&fs->lock);
+	tmpfs_node_t* node = tmpfs_lookup(fs, path, path_len);
+	if (node && (mode & FILE_MODE_CREATE) && (mode & FILE_MODE_EXCLUSIVE))
+		node = NULL;
+	else if (!node && (mode & FILE_MODE_CREATE)) {
+		// Create a new file
+		const char* name;
+		uint32_t name_len;
+		tmpfs_node_t* parent = tmpfs_lookup_parent(fs, path, &name, &name_len);
+		if (parent && name_len != 0) {
+			node = tmpfs_node_create(fs, FILE_TYPE_REGULAR);
+			if (node && !tmpfs_dir_add(parent, name, name_len, node)) {
+				kfree(node);
+				node = NULL;
+			}
+		}
+	}
+	if (!node) {
+		up_write(&fs->lock);
+		kfree(file->path);
+		kfree(file);
+		return false;
+	}
+	
+	// Delete the file contents if needed
+	if ((node->mode & FILE_TYPE_REGULAR) && (mode & FILE_MODE_TRUNCATE) &&
+		((mode & FILE_MODE_WRITE) || (mode & FILE_MODE_APPEND)))
+		tmpfs_node_resize(fs, node, 0);
+	node->open_count++;
+	up_write(&fs->lock);
+	file->node = node;
+	
+	memset(desc, 0, sizeof(file_descriptor_t));
+	desc->lock = MUTEX_UNLOCKED;
+	desc->info = file;
+	desc->mode = (mode & ~(FILE_MODE_CREATE | FILE_TYPE_ALL)) | node->mode;
+	if (node->mode & FILE_TYPE_DIRECTORY) {
+		desc->read = tmpfs_read_directory;
+		desc->llseek = tmpfs_llseek_directory;
+		desc->getdents = tmpfs_getdents;
+	} else {
+		desc->read = tmpfs_read_file;
+		desc->write = tmpfs_write_file;
+		desc->llseek = tmpfs_llseek_file;
+		desc->pread = tmpfs_pread_file;
+		desc->pwrite = tmpfs_pwrite_file;
+		desc->truncate = tmpfs_truncate;
+		desc->can_read = tmpfs_can_read_file;
+		desc->can_write = tmpfs_can_write_file;
+	}
+	desc->stat = tmpfs_stat;
+	desc->fsync = tmpfs_fsync;
+	desc->duplicate = tmpfs_duplicate;
+	desc->close = tmpfs_close;
+	
+	return true;
+}
+
+// Make a directory
+int tmpfs_mkdir(void* data, const char* path) {
+	tmpfs_t* fs = data;
+	
+	down_write(&fs->lock);
+	if (tmpfs_lookup(fs, path, strlen(path))) {
+		up_write(&fs->lock);
+		return -EEXIST;
+	}
+	
+	const char* name;
+	uint32_t name_len;
+	tmpfs_node_t* parent = tmpfs_lookup_parent(fs, path, &name, &name_len);
+	if (!parent) {
+		up_write(&fs->lock);
+		return -ENOENT;
+	}
+	
+	tmpfs_node_t* node = tmpfs_node_create(fs, FILE_TYPE_DIRECTORY);
+	if (!node || !tmpfs_dir_add(parent, name, name_len, node)) {
+		if (node)
+			kfree(node);
+		up_write(&fs->lock);
+		return -ENOMEM;
+	}
+	up_write(&fs->lock);
+	
+	return 0;
+}
+
+// Hard link a file
+int tmpfs_link(void* data, file_descriptor_t* f, const char* link_name) {
+	tmpfs_t* fs = data;
+	tmpfs_file_t* file = f->info;
+	if (file->fs != fs)
+		return -EXDEV;
+	if (file->node->mode & FILE_TYPE_DIRECTORY)
+		return -EPERM;
+	
+	down_write(&fs->lock);
+	if (tmpfs_lookup(fs, link_name, strlen(link_name))) {
+		up_write(&fs->lock);
+		return -EEXIST;
+	}
+	
+	const char* name;
+	uint32_t name_len;
+	tmpfs_node_t* parent = tmpfs_lookup_parent(fs, link_name, &name, &name_len);
+	if (!parent) {
+		up_write(&fs->lock);
+		return -ENOENT;
+	}
+	bool ret = tmpfs_dir_add(parent, name, name_len, file->node);
+	up_write(&fs->lock);
+	
+	return ret ? 0 : -ENOMEM;
+}
+
+// Unlink a file or (empty) directory
+int tmpfs_unlink(void* data, const char* path) {
+	tmpfs_t* fs = data;
+	
+	down_write(&fs->lock);
+	int ret = tmpfs_unlink_locked(fs, path);
+	up_write(&fs->lock);
+	
+	return ret;
+}
+
+// Returns true if a path is a directory
+bool tmpfs_isdir(void* data, const char* path) {
+	tmpfs_t* fs = data;
+	
+	down_read(&fs->lock);
+	tmpfs_node_t* node = tmpfs_lookup(fs, path, strlen(path));
+	bool ret = node && (node->mode & FILE_TYPE_DIRECTORY);
+	up_read(&fs->lock);
+	
+	return ret;
+}
+
+// Set the times of an open file
+void tmpfs_settime(void* data, file_descriptor_t* f, uint32_t atime, uint32_t mtime) {
+	tmpfs_t* fs = data;
+	tmpfs_file_t* file = f->info;
+	
+	down_write(&fs->lock);
+	file->node->atime = atime;
+	file->node->mtime = mtime;
+	up_write(&fs->lock);
+}
+
+vfs_ops_t tmpfs_ops = {
+	.open = tmpfs_open,
+	.mkdir = tmpfs_mkdir,
+	.link = tmpfs_link,
+	.unlink = tmpfs_unlink,
+	.isdir = tmpfs_isdir,
+	.settime = tmpfs_settime,
+};
+
+// Create a tmpfs and mount it at a path (max_pages is the limit on file data, 0 for none)
+bool tmpfs_mount(const char* path, uint32_t max_pages) {
+	tmpfs_t* fs = kmalloc(sizeof(tmpfs_t));
+	if (!fs)
+		return false;
+	memset(fs, 0, sizeof(tmpfs_t));
+	fs->lock = RW_SEMAPHORE_UNLOCKED;
+	fs->next_inode = TMPFS_ROOT_INODE;
+	fs->dev_id = tmpfs_next_dev_id++;
+	fs->max_pages = max_pages;
+	
+	fs->root = tmpfs_node_create(fs, FILE_TYPE_DIRECTORY);
+	if (!fs->root) {
+		kfree(fs);
+		return false;
+	}
+	// The root always stays around
+	fs->root->link_count = 1;
+	
+	if (vfs_mount(path, &tmpfs_ops, fs) != 0) {
+		kfree(fs->root);
+		kfree(fs);
+		return false;
+	}
+	
+	return true;
+}
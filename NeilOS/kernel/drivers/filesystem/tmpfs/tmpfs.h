@@ -0,0 +1,60 @@
+//
+//  tmpfs.h
+//  NeilOS
+//
+
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include <common/types.h>
+#include <common/concurrency/rwsem.h>
+#include <syscalls/descriptor.h>
+
+#define TMPFS_ROOT_INODE		2
+
+struct tmpfs_entry;
+
+// A file or directory kept in memory
+typedef struct tmpfs_node {
+	uint32_t inode;
+	uint32_t mode;						// FILE_TYPE_REGULAR or FILE_TYPE_DIRECTORY
+	uint32_t link_count;				// Directory entries that point to this node
+	uint32_t open_count;				// Descriptors that use this node
+	uint32_t atime;
+	uint32_t mtime;
+	uint32_t ctime;
+
+	// Regular files
+	uint32_t size;
+	void** pages;						// 4kb pages of data (NULL for holes)
+	uint32_t num_pages;					// Length of the pages array
+
+	// Directories
+	struct tmpfs_entry* entries;
+	struct tmpfs_entry* entries_tail;
+	uint32_t num_entries;
+	struct tmpfs_node* parent;
+} tmpfs_node_t;
+
+// Name of a node in a directory
+typedef struct tmpfs_entry {
+	char* name;
+	uint32_t name_len;
+	tmpfs_node_t* node;
+	struct tmpfs_entry* next;
+} tmpfs_entry_t;
+
+// One mounted instance
+typedef struct {
+	tmpfs_node_t* root;
+	uint32_t next_inode;
+	uint32_t dev_id;
+	uint32_t num_pages;					// Pages used by file data
+	uint32_t max_pages;					// Limit on pages for file data (0 for no limit)
+	rw_semaphore_t lock;				// Protects the whole tree
+} tmpfs_t;
+
+// Create a tmpfs and mount it at a path (max_pages is the limit on file data, 0 for none)
+bool tmpfs_mount(const char* path, uint32_t max_pages);
+
+#endif /* TMPFS_H */
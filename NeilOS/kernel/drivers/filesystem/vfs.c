@@ -0,0 +1,132 @@
+//
+//  vfs.c
+//  NeilOS
+//
+
+#include "vfs.h"
+#include "filesystem.h"
+#include <common/lib.h>
+#include <memory/allocation/heap.h>
+#include <syscalls/interrupt.h>
+
+// Mounts are only ever added (at the front), so lookups can walk the list without a lock
+vfs_mount_t* volatile vfs_mounts = NULL;
+semaphore_t vfs_mounts_lock = MUTEX_UNLOCKED;
+
+// Normalize a path (no leading or trailing slashes, "." and ".." resolved). Must be freed
+char* vfs_normalize(const char* path) {
+	uint32_t len = strlen(path);
+	char* ret = kmalloc(len + 1);
+	if (!ret)
+		return NULL;
+	
+	uint32_t pos = 0, out = 0;
+	while (pos < len) {
+		// Skip slashes
+		while (path[pos] == '/')
+			pos++;
+		if (pos >= len)
+			break;
+	
+		// Find the component
+		uint32_t start = pos;
+		while (pos < len && path[pos] != '/')
+			pos++;
+		uint32_t comp_len = pos - start;
+	
+		if (comp_len == 1 && path[start] == '.')
+			continue;
+		if (comp_len == 2 && path[start] == '.' && path[start + 1] == '.') {
+			// Go back a component (the root is its own parent)
+			while (out > 0 && ret[out - 1] != '/')
+				out--;
+			if (out > 0)
+				out--;
+			continue;
+		}
+	
+		if (out > 0)
+			ret[out++] = '/';
+		memcpy(&ret[out], &path[start], comp_len);
+		out += comp_len;
+	}
+	ret[out] = 0;
+	
+	return ret;
+}
+
+// Mount a filesystem at an absolute path (the mount point is created on the root filesystem if needed)
+int vfs_mount(const char* path, vfs_ops_t* ops, void* fs) {
+	vfs_mount_t* m = kmalloc(sizeof(vfs_mount_t));
+	if (!m)
+		return -ENOMEM;
+	memset(m, 0, sizeof(vfs_mount_t));
+	m->path = vfs_normalize(path);
+	if (!m->path) {
+		kfree(m);
+		return -ENOMEM;
+	}
+	m->path_len = strlen(m->path);
+	m->ops = ops;
+	m->fs = fs;
+	
+	// Can't mount over the root
+	if (m->path_len == 0) {
+		kfree(m->path);
+		kfree(m);
+		return -EBUSY;
+	}
+	
+	// Create every directory leading up to the mount point so that it shows up in listings
+	for (uint32_t z = 1; z <= m->path_len; z++) {
+		if (z != m->path_len && m->path[z] != '/')
+			continue;
+		char c = m->path[z];
+		m->path[z] = 0;
+		fmkdir(m->path);
+		m->path[z] = c;
+	}
+	
+	down(&vfs_mounts_lock);
+	m->next = vfs_mounts;
+	vfs_mounts = m;
+	up(&vfs_mounts_lock);
+	
+	return 0;
+}
+
+// Find the mounted filesystem that holds a path. Returns NULL if the path is on the root filesystem,
+// otherwise path_out is set to the normalized path relative to the mount point (must be freed)
+vfs_mount_t* vfs_lookup(const char* path, char** path_out) {
+	if (!vfs_mounts || !path)
+		return NULL;
+	
+	char* normalized = vfs_normalize(path);
+	if (!normalized)
+		return NULL;
+	
+	// Use the deepest mount that contains the path
+	vfs_mount_t* found = NULL;
+	for (vfs_mount_t* m = vfs_mounts; m; m = m->next) {
+		if (strncmp(normalized, m->path, m->path_len) != 0)
+			continue;
+		if (normalized[m->path_len] != 0 && normalized[m->path_len] != '/')
+			continue;
+		if (!found || m->path_len > found->path_len)
+			found = m;
+	}
+	if (!found) {
+		kfree(normalized);
+		return NULL;
+	}
+	
+	// Strip the mount point off
+	uint32_t start = found->path_len;
+	if (normalized[start] == '/')
+		start++;
+	uint32_t len = strlen(&normalized[start]);
+	memmove(normalized, &normalized[start], len + 1);
+	*path_out = normalized;
+	
+	return found;
+}
@@ -0,0 +1,40 @@
+//
+//  vfs.h
+//  NeilOS
+//
+
+#ifndef VFS_H
+#define VFS_H
+
+#include <common/types.h>
+#include <syscalls/descriptor.h>
+
+// Operations of a filesystem that can be mounted. Paths are relative to the mount point,
+// have no leading or trailing slashes and no "." or ".." components ("" is the mount point itself)
+typedef struct {
+	bool (*open)(void* fs, const char* path, uint32_t mode, file_descriptor_t* desc);
+	int (*mkdir)(void* fs, const char* path);
+	int (*link)(void* fs, file_descriptor_t* file, const char* link_name);
+	int (*unlink)(void* fs, const char* path);
+	bool (*isdir)(void* fs, const char* path);
+	void (*settime)(void* fs, file_descriptor_t* file, uint32_t atime, uint32_t mtime);
+} vfs_ops_t;
+
+// A filesystem mounted on top of the root filesystem
+typedef struct vfs_mount {
+	char* path;					// Normalized mount point
+	uint32_t path_len;
+	vfs_ops_t* ops;
+	void* fs;
+
+	struct vfs_mount* next;
+} vfs_mount_t;
+
+// Mount a filesystem at an absolute path (the mount point is created on the root filesystem if needed)
+int vfs_mount(const char* path, vfs_ops_t* ops, void* fs);
+
+// Find the mounted filesystem that holds a path. Returns NULL if the path is on the root filesystem,
+// otherwise path_out is set to the normalized path relative to the mount point (must be freed)
+vfs_mount_t* vfs_lookup(const char* path, char** path_out);
+
+#endif /* VFS_H */
@@ -37,6 +37,7 @@ typedef struct mq_list {
 	uint32_t num_open;
 	bool dealloc_on_close;
 	semaphore_t lock;
+	wait_queue_t wait;				// Woken up when a message is sent or received
 	
 	struct mq_list* next;
 	struct mq_list* prev;
@@ -77,6 +78,7 @@ mq_list_t* mq_get(const char* filename, bool allocate, bool increment_open) {
 		return NULL;
 	memset(t, 0, sizeof(mq_list_t));
 	t->lock = MUTEX_LOCKED;
+	wait_queue_init(&t->wait);
 	if (increment_open)
 		t->num_open = 1;
 	t->name = kmalloc(name_len);
@@ -149,6 +151,7 @@ file_descriptor_t* mq_open(const char* filename, uint32_t mode) {
 		return NULL;
 	}
 	d->info = info;
+	d->wait_queue = &info->wait;
 	
 	return d;
 }
@@ -185,12 +188,15 @@ uint32_t mq_send(file_descriptor_t* f, const void* buf, uint32_t bytes, uint32_t
 	msg->length = bytes;
 	msg->priority = priority;
 	
-	// Block until there is room
+	// Sleep until there is room
 	mq_list_t* info = f->info;
+	wait_queue_entry_t entry;
+	wait_queue_add_current(&info->wait, &entry);
 	down(&info->lock);
 	while (!(f->mode & FILE_MODE_NONBLOCKING) && !(current_pcb && current_pcb->should_terminate) && !f->closed) {
 		if (signal_occurring(current_pcb)) {
 			up(&info->lock);
+			wait_queue_remove(&entry);
 			kfree(msg->buffer);
 			kfree(msg);
 			return -EINTR;
@@ -199,10 +205,12 @@ uint32_t mq_send(file_descriptor_t* f, const void* buf, uint32_t bytes, uint32_t
 			break;
 		up(&info->lock);
 		up(&f->lock);
-		schedule();
+		thread_sleep(NULL);
 		down(&f->lock);
+		thread_sleep_prepare();
 		down(&info->lock);
 	}
+	wait_queue_remove(&entry);
 	if (info->attr.mq_curmsgs >= MAX_NUM_MESSAGES) {
 		up(&info->lock);
 		kfree(msg->buffer);
@@ -236,6 +244,7 @@ uint32_t mq_send(file_descriptor_t* f, const void* buf, uint32_t bytes, uint32_t
 	}
 	info->attr.mq_curmsgs++;
 	up(&info->lock);
+	wait_queue_wake(&info->wait, POLLIN);
 	
 	return 0;
 }
@@ -246,21 +255,26 @@ uint32_t mq_receive(file_descriptor_t* f, void* buf, uint32_t bytes, uint32_t* p
 		return -EINVAL;
 	
 	mq_list_t* info = f->info;
+	wait_queue_entry_t entry;
+	wait_queue_add_current(&info->wait, &entry);
 	down(&info->lock);
-	// Block until there is a message
+	// Sleep until there is a message
 	while (!(f->mode & FILE_MODE_NONBLOCKING) && !(current_pcb && current_pcb->should_terminate) && !f->closed) {
 		if (signal_occurring(current_pcb)) {
 			up(&info->lock);
+			wait_queue_remove(&entry);
 			return -EINTR;
 		}
 		if (info->attr.mq_curmsgs != 0)
 			break;
 		up(&info->lock);
 		up(&f->lock);
-		schedule();
+		thread_sleep(NULL);
 		down(&f->lock);
+		thread_sleep_prepare();
 		down(&info->lock);
 	}
+	wait_queue_remove(&entry);
 	if (info->attr.mq_curmsgs == 0) {
 		up(&info->lock);
 		return -EAGAIN;
@@ -285,6 +299,7 @@ uint32_t mq_receive(file_descriptor_t* f, void* buf, uint32_t bytes, uint32_t* p
 	if (info->priority_tails[msg->priority] == msg)
 		info->priority_tails[msg->priority] = NULL;
 	up(&info->lock);
+	wait_queue_wake(&info->wait, POLLOUT);
 	
 	// Dealloc the message
 	kfree(msg->buffer);
@@ -257,7 +257,7 @@ uint32_t fifo_close(file_descriptor_t* fd) {
 
 // Seek a pipe (returns error)
 uint64_t fifo_llseek(file_descriptor_t* f, uint64_t offset, int whence) {
-	return uint64_make(-1, -ESPIPE);
+	return (uint64_t)-ESPIPE;
 }
 
 // Duplicate a fifo
@@ -9,18 +9,206 @@
 #include "pipe.h"
 #include <common/lib.h>
 #include <memory/allocation/heap.h>
+#include <memory/allocation/page_allocator.h>
+#include <memory/memory.h>
 #include <program/task.h>
 #include <common/concurrency/semaphore.h>
 #include <syscalls/interrupt.h>
 
+// A page of pipe data (can be shared between pipes by tee and splice)
 typedef struct {
-	uint8_t* buffer;
-	uint32_t pos;
+	uint8_t* data;
+	volatile uint32_t ref_count;
+} pipe_page_t;
+
+// The part of a page that holds data
+typedef struct {
+	pipe_page_t* page;
+	uint32_t offset;
+	uint32_t length;
+} pipe_buffer_t;
+
+typedef struct {
+	// Ring of buffers (count buffers starting at head)
+	pipe_buffer_t buffers[PIPE_NUM_BUFFERS];
+	uint32_t head;
+	uint32_t count;
+	uint32_t size;					// Bytes in the buffers
+	pipe_page_t* spare;				// Free page kept so that a busy pipe doesn't keep allocating
+	
 	file_descriptor_t* reader;
 	file_descriptor_t* writer;
 	semaphore_t lock;
+	wait_queue_t wait;				// Woken up when data is read or written or an end is closed
 } pipe_info_t;
 
+// The nth buffer in the ring
+#define PIPE_BUFFER(info, n)		(&(info)->buffers[((info)->head + (n)) % PIPE_NUM_BUFFERS])
+
+// Get a page for data (uses the spare page if there is one)
+pipe_page_t* pipe_page_alloc(pipe_info_t* info) {
+	pipe_page_t* page = info->spare;
+	if (page) {
+		info->spare = NULL;
+		page->ref_count = 1;
+		return page;
+	}
+	
+	page = (pipe_page_t*)kmalloc(sizeof(pipe_page_t));
+	if (!page)
+		return NULL;
+	page->data = page_get_aligned_four_kb();
+	if (!page->data) {
+		kfree(page);
+		return NULL;
+	}
+	page->ref_count = 1;
+	
+	return page;
+}
+
+// Add a reference to a page
+void pipe_page_retain(pipe_page_t* page) {
+	uint32_t flags;
+	cli_and_save(flags);
+	page->ref_count++;
+	restore_flags(flags);
+}
+
+// Drop a reference to a page (an unused page becomes the spare page if the pipe doesn't have one)
+void pipe_page_release(pipe_info_t* info, pipe_page_t* page) {
+	uint32_t flags;
+	cli_and_save(flags);
+	uint32_t refs = --page->ref_count;
+	restore_flags(flags);
+	if (refs != 0)
+		return;
+	
+	if (info && !info->spare) {
+		info->spare = page;
+		return;
+	}
+	page_free_aligned_four_kb(page->data);
+	kfree(page);
+}
+
+// Remove the first buffer from the ring (drop_page is false if the page reference was handed to someone else)
+void pipe_buffer_pop(pipe_info_t* info, bool drop_page) {
+	pipe_buffer_t* b = PIPE_BUFFER(info, 0);
+	if (drop_page)
+		pipe_page_release(info, b->page);
+	b->page = NULL;
+	info->size -= b->length;
+	info->head = (info->head + 1) % PIPE_NUM_BUFFERS;
+	info->count--;
+}
+
+// Get the buffer that new data can be added to and how much room it has (NULL if the pipe is full).
+// The last buffer is appended to if its page isn't shared, otherwise a new buffer is started
+pipe_buffer_t* pipe_buffer_tail(pipe_info_t* info, uint32_t* room) {
+	if (info->count != 0) {
+		pipe_buffer_t* tail = PIPE_BUFFER(info, info->count - 1);
+		uint32_t end = tail->offset + tail->length;
+		if (tail->page->ref_count == 1 && end != FOUR_KB_SIZE) {
+			*room = FOUR_KB_SIZE - end;
+			return tail;
+		}
+	}
+	if (info->count == PIPE_NUM_BUFFERS)
+		return NULL;
+	
+	pipe_page_t* page = pipe_page_alloc(info);
+	if (!page)
+		return NULL;
+	pipe_buffer_t* tail = PIPE_BUFFER(info, info->count);
+	tail->page = page;
+	tail->offset = 0;
+	tail->length = 0;
+	info->count++;
+	*room = FOUR_KB_SIZE;
+	
+	return tail;
+}
+
+// Number of bytes that can be written without blocking
+uint32_t pipe_space(pipe_info_t* info) {
+	uint32_t space = (PIPE_NUM_BUFFERS - info->count) * FOUR_KB_SIZE;
+	if (info->count != 0) {
+		pipe_buffer_t* tail = PIPE_BUFFER(info, info->count - 1);
+		if (tail->page->ref_count == 1)
+			space += FOUR_KB_SIZE - (tail->offset + tail->length);
+	}
+	return space;
+}
+
+// Copy data into a pipe (returns how much fit)
+uint32_t pipe_copy_in(pipe_info_t* info, const uint8_t* buf, uint32_t length) {
+	uint32_t copied = 0;
+	while (copied < length) {
+		uint32_t room = 0;
+		pipe_buffer_t* tail = pipe_buffer_tail(info, &room);
+		if (!tail)
+			break;
+	
+		uint32_t amount = (room < length - copied) ? room : (length - copied);
+		memcpy(&tail->page->data[tail->offset + tail->length], &buf[copied], amount);
+		tail->length += amount;
+		info->size += amount;
+		copied += amount;
+	}
+	return copied;
+}
+
+// Copy data out of a pipe (returns how much was copied)
+uint32_t pipe_copy_out(pipe_info_t* info, uint8_t* buf, uint32_t length) {
+	uint32_t copied = 0;
+	while (copied < length && info->count != 0) {
+		pipe_buffer_t* b = PIPE_BUFFER(info, 0);
+		uint32_t amount = (b->length < length - copied) ? b->length : (length - copied);
+		memcpy(&buf[copied], &b->page->data[b->offset], amount);
+		b->offset += amount;
+		b->length -= amount;
+		info->size -= amount;
+		copied += amount;
+		if (b->length == 0)
+			pipe_buffer_pop(info, true);
+	}
+	return copied;
+}
+
+// Sleep until a pipe has data (or room if writing) or the other end is closed. Must hold info->lock
+// and the locks of first and second (which can be NULL). These are dropped while sleeping
+uint32_t pipe_wait(pipe_info_t* info, bool writing, bool nonblocking, file_descriptor_t* first, file_descriptor_t* second) {
+	wait_queue_entry_t entry;
+	wait_queue_add_current(&info->wait, &entry);
+	uint32_t ret = 0;
+	while (writing ? (pipe_space(info) == 0 && info->reader) : (info->size == 0 && info->writer)) {
+		if (nonblocking) {
+			ret = -EAGAIN;
+			break;
+		}
+		if (current_pcb->should_terminate || first->closed || (second && second->closed) ||
+			signal_occurring(current_pcb)) {
+			ret = -EINTR;
+			break;
+		}
+	
+		up(&info->lock);
+		if (second)
+			up(&second->lock);
+		up(&first->lock);
+		thread_sleep(NULL);
+		down(&first->lock);
+		if (second)
+			down(&second->lock);
+		thread_sleep_prepare();
+		down(&info->lock);
+	}
+	wait_queue_remove(&entry);
+	
+	return ret;
+}
+
 // Open a (unnamed) pipe
 file_descriptor_t* pipe_open(const char* filename, uint32_t mode) {
 	file_descriptor_t* f = (file_descriptor_t*)kmalloc(sizeof(file_descriptor_t));
@@ -31,26 +219,24 @@ file_descriptor_t* pipe_open(const char* filename, uint32_t mode) {
 	f->lock = MUTEX_UNLOCKED;
 	if (mode & FILE_MODE_READ) {
 		f->read = pipe_read;
+		f->readv = pipe_readv;
+		f->can_read = pipe_can_read;
 	} else if (mode & FILE_MODE_WRITE) {
 		f->write = pipe_write;
+		f->can_write = pipe_can_write;
 		pipe_info_t* info = (pipe_info_t*)kmalloc(sizeof(pipe_info_t));
 		if (!info) {
 			kfree(f);
 			return NULL;
 		}
 		
-		// The writer is the original owner of the buffer
-		info->buffer = (uint8_t*)kmalloc(PIPE_MAX_BUFFER_SIZE);
-		if (!info->buffer) {
-			kfree(info);
-			kfree(f);
-			return NULL;
-		}
-		info->pos = 0;
-		info->reader = NULL;
+		// The writer is the original owner of the buffers (pages are allocated as they are needed)
+		memset(info, 0, sizeof(pipe_info_t));
 		info->writer = f;
 		info->lock = MUTEX_UNLOCKED;
+		wait_queue_init(&info->wait);
 		f->info = info;
+		f->wait_queue = &info->wait;
 	}
 	f->stat = pipe_stat;
 	f->llseek = pipe_llseek;
@@ -67,6 +253,7 @@ bool pipe_connect(file_descriptor_t* input, file_descriptor_t* output) {
 	pipe_info_t* output_info = (pipe_info_t*)output->info;
 	
 	input->info = output_info;
+	input->wait_queue = &output_info->wait;
 	output_info->reader = input;
 	
 	return true;
@@ -74,39 +261,33 @@ bool pipe_connect(file_descriptor_t* input, file_descriptor_t* output) {
 
 // Read a pipe
 uint32_t pipe_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
+	iovec_t iov = { buf, bytes };
+	return pipe_readv(f, &iov, 1);
+}
+
+// Read a pipe into multiple buffers
+uint32_t pipe_readv(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt) {
 	pipe_info_t* info = (pipe_info_t*)f->info;
 	
-	// Writer pipe was closed and no data left
+	// Sleep until there is data (returns 0 once the writer has closed and there's nothing left)
 	down(&info->lock);
-	if (!info->writer && info->pos == 0) {
-		up(&info->lock);
-		return 0;
-	}
-	
-	if ((f->mode & FILE_MODE_NONBLOCKING) &&
-		info->pos == 0) {
-		up(&info->lock);
-		return 0;
-	}
-	
-	// Block until there is data
-	while (info->pos == 0 && !current_pcb->should_terminate && !f->closed) {
+	uint32_t ret = pipe_wait(info, false, (f->mode & FILE_MODE_NONBLOCKING), f, NULL);
+	if (ret == -EAGAIN)
+		ret = 0;
+	if (ret != 0) {
 		up(&info->lock);
-		up(&f->lock);
-		schedule();
-		down(&f->lock);
-		down(&info->lock);
+		return ret;
 	}
 	
-	// Read the data in
-	uint32_t min = (bytes < info->pos) ? bytes : info->pos;
-	memcpy(buf, info->buffer, min);
-	if (min < info->pos)
-		memmove(info->buffer, &info->buffer[min], info->pos - min);
-	info->pos -= min;
+	uint32_t copied = 0;
+	for (uint32_t z = 0; z < iovcnt && info->size != 0; z++)
+		copied += pipe_copy_out(info, iov[z].base, iov[z].length);
 	up(&info->lock);
 	
-	return min;
+	if (copied != 0)
+		wait_queue_wake(&info->wait, POLLOUT);
+	
+	return copied;
 }
 
 // Write to a pipe
@@ -118,36 +299,66 @@ uint32_t pipe_write(file_descriptor_t* f, const void* buf, uint32_t bytes) {
 	if (!info->reader) {
 		up(&info->lock);
 		signal_send(current_pcb, SIGPIPE);
-        return -EPIPE;
+		return -EPIPE;
 	}
 	
-	if ((f->mode & FILE_MODE_NONBLOCKING) &&
-		info->pos == PIPE_MAX_BUFFER_SIZE) {
-		up(&info->lock);
-		return 0;
-	}
-
-	// Block until the pipe isn't full
-	while (info->pos == PIPE_MAX_BUFFER_SIZE && !current_pcb->should_terminate && !f->closed) {
-		if (signal_occurring(current_pcb)) {
-			up(&info->lock);
-			return -EINTR;
+	// Blocking writes sleep until everything has been written, nonblocking writes only write what fits
+	bool nonblocking = (f->mode & FILE_MODE_NONBLOCKING);
+	uint32_t written = 0;
+	while (written < bytes && info->reader) {
+		uint32_t ret = pipe_wait(info, true, nonblocking, f, NULL);
+		if (ret != 0) {
+			if (written == 0 && ret != -EAGAIN)
+				written = ret;
+			break;
+		}
+		if (!info->reader)
+			break;
+	
+		ret = pipe_copy_in(info, (const uint8_t*)buf + written, bytes - written);
+		if (ret == 0 && pipe_space(info) != 0) {
+			// Couldn't get a page
+			if (written == 0)
+				written = -ENOMEM;
+			break;
 		}
+		written += ret;
+	
+		// Let the reader start on what's there
 		up(&info->lock);
-		up(&f->lock);
-		schedule();
-		down(&f->lock);
+		wait_queue_wake(&info->wait, POLLIN);
 		down(&info->lock);
 	}
+	if (written == 0 && !info->reader) {
+		up(&info->lock);
+		signal_send(current_pcb, SIGPIPE);
+		return -EPIPE;
+	}
+	up(&info->lock);
 	
-	// Write the data
-	uint32_t remaining = PIPE_MAX_BUFFER_SIZE - info->pos;
-	uint32_t min = (bytes > remaining) ? remaining : bytes;
-	memcpy(&info->buffer[info->pos], buf, min);
-	info->pos += min;
+	return written;
+}
+
+// Whether a read wouldn't block
+bool pipe_can_read(file_descriptor_t* f) {
+	pipe_info_t* info = (pipe_info_t*)f->info;
+	if (!info)
+		return false;
+	
+	down(&info->lock);
+	bool ret = (info->size != 0 || !info->writer);
 	up(&info->lock);
+	return ret;
+}
+
+// Whether a write wouldn't block
+bool pipe_can_write(file_descriptor_t* f) {
+	pipe_info_t* info = (pipe_info_t*)f->info;
 	
-	return min;
+	down(&info->lock);
+	bool ret = (pipe_space(info) != 0 || !info->reader);
+	up(&info->lock);
+	return ret;
 }
 
 // Get info about a pipe
@@ -155,10 +366,10 @@ uint32_t pipe_stat(file_descriptor_t* f, sys_stat_type* data) {
 	pipe_info_t* info = (pipe_info_t*)f->info;
 	memset(data, 0, sizeof(sys_stat_type));
 	data->dev_id = 1;
-	data->block_size = PIPE_MAX_BUFFER_SIZE;
+	data->block_size = FOUR_KB_SIZE;
 	if (info) {
 		down(&info->lock);
-		data->size = info->pos;
+		data->size = info->size;
 		data->num_links = (info->reader != NULL) + (info->writer != NULL);
 		up(&info->lock);
 	}
@@ -170,7 +381,7 @@ uint32_t pipe_stat(file_descriptor_t* f, sys_stat_type* data) {
 
 // Seek a pipe (returns error)
 uint64_t pipe_llseek(file_descriptor_t* f, uint64_t offset, int whence) {
-	return uint64_make(-1, -ESPIPE);
+	return (uint64_t)-ESPIPE;
 }
 
 // Close a pipe
@@ -180,16 +391,27 @@ uint32_t pipe_close(file_descriptor_t* fd) {
 		if (!info)
 			return 0;
 		
+		down(&info->lock);
 		if (fd->mode & FILE_MODE_WRITE)
 			info->writer = NULL;
 		else
 			info->reader = NULL;
 		
 		if (!info->reader && !info->writer) {
-			if (info->buffer)
-				kfree(info->buffer);
+			while (info->count != 0)
+				pipe_buffer_pop(info, true);
+			// Nothing references the spare page, so free it directly
+			if (info->spare) {
+				page_free_aligned_four_kb(info->spare->data);
+				kfree(info->spare);
+			}
 			kfree(info);
+			return 0;
 		}
+		up(&info->lock);
+		
+		// Let the other end know
+		wait_queue_wake(&info->wait, POLLHUP | POLLIN | POLLOUT);
 	}
 	
 	return 0;
@@ -200,3 +422,249 @@ file_descriptor_t* pipe_duplicate(file_descriptor_t* fd) {
 	fd->ref_count++;
 	return fd;
 }
+
+// Whether a descriptor is an end of a pipe
+bool pipe_is_pipe(file_descriptor_t* f) {
+	return f->close == pipe_close;
+}
+
+// Lock two semaphores in a consistent order
+void pipe_lock_pair(semaphore_t* first, semaphore_t* second) {
+	if (first > second) {
+		semaphore_t* temp = first;
+		first = second;
+		second = temp;
+	}
+	down(first);
+	if (second != first)
+		down(second);
+}
+
+// Unlock two semaphores locked with pipe_lock_pair
+void pipe_unlock_pair(semaphore_t* first, semaphore_t* second) {
+	if (second != first)
+		up(second);
+	up(first);
+}
+
+// Move buffers from one pipe to another without copying (both info locks must be held).
+// If share is set, the source keeps its data (tee)
+uint32_t pipe_transfer(pipe_info_t* src, pipe_info_t* dst, uint32_t length, bool share) {
+	uint32_t moved = 0;
+	uint32_t index = 0;
+	while (moved < length && index < src->count && dst->count < PIPE_NUM_BUFFERS) {
+		pipe_buffer_t* from = PIPE_BUFFER(src, index);
+		uint32_t amount = (from->length < length - moved) ? from->length : (length - moved);
+	
+		pipe_buffer_t* to = PIPE_BUFFER(dst, dst->count);
+		to->page = from->page;
+		to->offset = from->offset;
+		to->length = amount;
+		dst->count++;
+		dst->size += amount;
+		moved += amount;
+	
+		if (share)
+			pipe_page_retain(from->page);
+		else if (amount == from->length) {
+			// Hand the whole buffer over
+			pipe_buffer_pop(src, false);
+			continue;
+		} else {
+			// Split the buffer between the two pipes
+			pipe_page_retain(from->page);
+			from->offset += amount;
+			from->length -= amount;
+			src->size -= amount;
+		}
+		index++;
+	}
+	return moved;
+}
+
+// Move or share data between two pipes
+uint32_t pipe_splice_pipes(file_descriptor_t* in, file_descriptor_t* out, uint32_t length, bool nonblocking, bool share) {
+	pipe_info_t* src = (pipe_info_t*)in->info;
+	pipe_info_t* dst = (pipe_info_t*)out->info;
+	if (src == dst)
+		return -EINVAL;
+	file_descriptor_t* first = (in < out) ? in : out;
+	file_descriptor_t* second = (in < out) ? out : in;
+	
+	// Wait for data and then for room
+	down(&src->lock);
+	uint32_t ret = pipe_wait(src, false, nonblocking, first, second);
+	bool empty = (src->size == 0);
+	up(&src->lock);
+	if (ret != 0 || empty)
+		return ret;
+	
+	down(&dst->lock);
+	if (dst->reader)
+		ret = pipe_wait(dst, true, nonblocking, first, second);
+	if (!dst->reader) {
+		up(&dst->lock);
+		signal_send(current_pcb, SIGPIPE);
+		return -EPIPE;
+	}
+	up(&dst->lock);
+	if (ret != 0)
+		return ret;
+	
+	pipe_lock_pair(&src->lock, &dst->lock);
+	uint32_t moved = pipe_transfer(src, dst, length, share);
+	pipe_unlock_pair(&src->lock, &dst->lock);
+	
+	if (moved != 0) {
+		if (!share)
+			wait_queue_wake(&src->wait, POLLOUT);
+		wait_queue_wake(&dst->wait, POLLIN);
+	}
+	return moved;
+}
+
+// Write data from a pipe to a descriptor straight out of the pipe's pages
+uint32_t pipe_splice_to(file_descriptor_t* in, file_descriptor_t* out, uint64_t* offset, uint32_t length, bool nonblocking) {
+	pipe_info_t* src = (pipe_info_t*)in->info;
+	if ((offset && !out->pwrite) || (!offset && !out->write))
+		return offset ? -ESPIPE : -EINVAL;
+	
+	down(&src->lock);
+	uint32_t total = pipe_wait(src, false, nonblocking, (in < out) ? in : out, (in < out) ? out : in);
+	if (total != 0) {
+		up(&src->lock);
+		return total;
+	}
+	
+	while (total < length && src->count != 0) {
+		pipe_buffer_t* b = PIPE_BUFFER(src, 0);
+		uint32_t amount = (b->length < length - total) ? b->length : (length - total);
+		uint8_t* data = &b->page->data[b->offset];
+		uint32_t ret = offset ? out->pwrite(out, data, amount, *offset) : out->write(out, data, amount);
+		if ((int32_t)ret <= 0) {
+			if (total == 0)
+				total = ret;
+			break;
+		}
+	
+		if (offset)
+			*offset += ret;
+		b->offset += ret;
+		b->length -= ret;
+		src->size -= ret;
+		if (b->length == 0)
+			pipe_buffer_pop(src, true);
+		total += ret;
+		if (ret < amount)
+			break;
+	}
+	up(&src->lock);
+	
+	if ((int32_t)total > 0)
+		wait_queue_wake(&src->wait, POLLOUT);
+	return total;
+}
+
+// Read data from a descriptor straight into a pipe's pages
+uint32_t pipe_splice_from(file_descriptor_t* in, uint64_t* offset, file_descriptor_t* out, uint32_t length, bool nonblocking) {
+	pipe_info_t* dst = (pipe_info_t*)out->info;
+	if ((offset && !in->pread) || (!offset && !in->read))
+		return offset ? -ESPIPE : -EINVAL;
+	
+	down(&dst->lock);
+	uint32_t total = 0;
+	if (dst->reader)
+		total = pipe_wait(dst, true, nonblocking, (in < out) ? in : out, (in < out) ? out : in);
+	if (!dst->reader) {
+		up(&dst->lock);
+		signal_send(current_pcb, SIGPIPE);
+		return -EPIPE;
+	}
+	if (total != 0) {
+		up(&dst->lock);
+		return total;
+	}
+	
+	while (total < length) {
+		uint32_t room = 0;
+		pipe_buffer_t* tail = pipe_buffer_tail(dst, &room);
+		if (!tail) {
+			if (total == 0 && pipe_space(dst) != 0)
+				total = -ENOMEM;
+			break;
+		}
+	
+		uint32_t amount = (room < length - total) ? room : (length - total);
+		uint8_t* data = &tail->page->data[tail->offset + tail->length];
+		uint32_t ret = offset ? in->pread(in, data, amount, *offset) : in->read(in, data, amount);
+		if ((int32_t)ret <= 0) {
+			// Don't leave an empty buffer behind
+			if (tail->length == 0) {
+				pipe_page_release(dst, tail->page);
+				tail->page = NULL;
+				dst->count--;
+			}
+			if (total == 0)
+				total = ret;
+			break;
+		}
+	
+		if (offset)
+			*offset += ret;
+		tail->length += ret;
+		dst->size += ret;
+		total += ret;
+		if (ret < amount)
+			break;
+	}
+	up(&dst->lock);
+	
+	if ((int32_t)total > 0)
+		wait_queue_wake(&dst->wait, POLLIN);
+	return total;
+}
+
+// Move data between a pipe and another descriptor without copying it through user space
+// (offsets can only be given for descriptors that aren't pipes)
+uint32_t pipe_splice(file_descriptor_t* in, uint64_t* in_offset, file_descriptor_t* out, uint64_t* out_offset,
+					 uint32_t length, uint32_t flags) {
+	bool in_pipe = pipe_is_pipe(in);
+	bool out_pipe = pipe_is_pipe(out);
+	if ((!in_pipe && !out_pipe) || in == out)
+		return -EINVAL;
+	if ((in_pipe && in_offset) || (out_pipe && out_offset))
+		return -ESPIPE;
+	if ((in_pipe && !(in->mode & FILE_MODE_READ)) || (out_pipe && !(out->mode & FILE_MODE_WRITE)))
+		return -EBADF;
+	if (length == 0)
+		return 0;
+	
+	pipe_lock_pair(&in->lock, &out->lock);
+	bool nonblocking = (flags & SPLICE_F_NONBLOCK);
+	uint32_t ret = 0;
+	if (in_pipe && out_pipe)
+		ret = pipe_splice_pipes(in, out, length, nonblocking, false);
+	else if (in_pipe)
+		ret = pipe_splice_to(in, out, out_offset, length, nonblocking);
+	else
+		ret = pipe_splice_from(in, in_offset, out, length, nonblocking);
+	pipe_unlock_pair(&in->lock, &out->lock);
+	
+	return ret;
+}
+
+// Copy data from one pipe to another without consuming it (the pages are shared)
+uint32_t pipe_tee(file_descriptor_t* in, file_descriptor_t* out, uint32_t length, uint32_t flags) {
+	if (!pipe_is_pipe(in) || !pipe_is_pipe(out) || in == out)
+		return -EINVAL;
+	if (!(in->mode & FILE_MODE_READ) || !(out->mode & FILE_MODE_WRITE))
+		return -EBADF;
+	if (length == 0)
+		return 0;
+	
+	pipe_lock_pair(&in->lock, &out->lock);
+	uint32_t ret = pipe_splice_pipes(in, out, length, (flags & SPLICE_F_NONBLOCK), true);
+	pipe_unlock_pair(&in->lock, &out->lock);
+	
+	return ret;
+}
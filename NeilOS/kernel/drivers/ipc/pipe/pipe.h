@@ -12,8 +12,17 @@
 #include <common/types.h>
 #include <syscalls/descriptor.h>
 
+// Size of a fifo's buffer
 #define PIPE_MAX_BUFFER_SIZE		1024
 
+// Number of page sized buffers in a pipe's ring
+#define PIPE_NUM_BUFFERS			16
+
+// Flags for splice and tee
+#define SPLICE_F_MOVE				0x1
+#define SPLICE_F_NONBLOCK			0x2
+#define SPLICE_F_MORE				0x4
+
 // Open a (unnamed) pipe
 file_descriptor_t* pipe_open(const char* filename, uint32_t mode);
 
@@ -23,9 +32,18 @@ bool pipe_connect(file_descriptor_t* input, file_descriptor_t* output);
 // Read a pipe
 uint32_t pipe_read(file_descriptor_t* f, void* buf, uint32_t bytes);
 
+// Read a pipe into multiple buffers
+uint32_t pipe_readv(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt);
+
 // Write to a pipe
 uint32_t pipe_write(file_descriptor_t* f, const void* buf, uint32_t bytes);
 
+// Whether a read wouldn't block
+bool pipe_can_read(file_descriptor_t* f);
+
+// Whether a write wouldn't block
+bool pipe_can_write(file_descriptor_t* f);
+
 // Get info about a pipe
 uint32_t pipe_stat(file_descriptor_t* f, sys_stat_type* data);
 
@@ -38,4 +56,15 @@ uint32_t pipe_close(file_descriptor_t* fd);
 // Duplicate a pipe
 file_descriptor_t* pipe_duplicate(file_descriptor_t* fd);
 
+// Whether a descriptor is an end of a pipe
+bool pipe_is_pipe(file_descriptor_t* f);
+
+// Move data between a pipe and another descriptor without copying it through user space
+// (offsets can only be given for descriptors that aren't pipes)
+uint32_t pipe_splice(file_descriptor_t* in, uint64_t* in_offset, file_descriptor_t* out, uint64_t* out_offset,
+					 uint32_t length, uint32_t flags);
+
+// Copy data from one pipe to another without consuming it (the pages are shared)
+uint32_t pipe_tee(file_descriptor_t* in, file_descriptor_t* out, uint32_t length, uint32_t flags);
+
 #endif /* PIPE_H */
@@ -178,7 +178,7 @@ file_descriptor_t* shm_open(const char* filename, uint32_t mode) {
 	d->info = info;
 	
 	if (mode & FILE_MODE_TRUNCATE)
-		shm_truncate(d, uint64_make(0, 0));
+		shm_truncate(d, 0);
 	
 	return d;
 }
@@ -196,15 +196,15 @@ uint32_t shm_write(file_descriptor_t* f, const void* buf, uint32_t bytes) {
 
 // Seek a shared memory region (nop)
 uint64_t shm_llseek(file_descriptor_t* f, uint64_t offset, int whence) {
-	return uint64_make(0, 0);
+	return 0;
 }
 
 // Resize a shared memory region
 uint64_t shm_truncate(file_descriptor_t* f, uint64_t s) {
 	if (!(f->mode & FILE_MODE_WRITE))
-		return uint64_make(-1, -1);
+		return (uint64_t)-1;
 	
-	uint32_t size = s.low;
+	uint32_t size = s;
 	
 	shm_list_t* t = f->info;
 	down(&t->lock);
@@ -267,7 +267,7 @@ uint64_t shm_truncate(file_descriptor_t* f, uint64_t s) {
 	t->size = size;
 	up(&t->lock);
 	
-	return uint64_make(0, size);
+	return size;
 }
 
 // Get info
@@ -4,6 +4,7 @@
 #include <syscalls/interrupt.h>
 #include <common/lib.h>
 #include <drivers/mouse/mouse.h>
+#include <program/workqueue.h>
 
 #define KEYBOARD_IRQ		0x1
 
@@ -22,6 +23,10 @@
 #define KEYBOARD_ENABLE				0xAE
 #define KEYBOARD_RESET				0xFF
 
+// Bytes from the interrupt waiting for the tasklet and keys waiting for the handler (powers of 2)
+#define KEYBOARD_BUFFER_SIZE		64
+#define KEYBOARD_EVENT_BUFFER_SIZE	64
+
 //initializes array of all keyboard characters
 uint8_t basic_keycodes_press[0x84] = {
 	0, F9_KEY, 0, F5_KEY,
@@ -69,15 +74,38 @@ modifier_keys_t modifier_keys;
 volatile unsigned int keyboard_packet_id = 0;
 unsigned char keyboard_code = 0;
 bool keyboard_pressed = false;
+wait_queue_t keyboard_wait_queue = WAIT_QUEUE_EMPTY;
+
+typedef struct {
+	uint32_t id;					// Last packet read
+} keyboard_info_t;
+
+typedef struct {
+	uint8_t keycode;
+	bool pressed;
+	modifier_keys_t modifier_keys;
+} keyboard_event_t;
+
+// Filled by the interrupt and emptied by the tasklet
+uint8_t keyboard_buffer[KEYBOARD_BUFFER_SIZE];
+volatile uint32_t keyboard_buffer_head = 0, keyboard_buffer_tail = 0;
+
+// Filled by the tasklet and emptied by the work
+keyboard_event_t keyboard_events[KEYBOARD_EVENT_BUFFER_SIZE];
+volatile uint32_t keyboard_events_head = 0, keyboard_events_tail = 0;
+
+void keyboard_tasklet_func(void* data);
+void keyboard_work_func(work_t* work);
+tasklet_t keyboard_tasklet = TASKLET_INIT(keyboard_tasklet_func, NULL);
+work_t keyboard_work = WORK_INIT(keyboard_work_func, NULL);
 
 /* special_scancode
 	DESCRIPTION: This checks for special characters
-	INPUTS: the pointer to a bool that tells if a special character is pressed
+	INPUTS: the byte from the keyboard and the pointer to a bool that tells if a special character is pressed
 	OUTPUTS: Returns character that was pressed, otherwise returns 0 if none of the special characters are pressed
 
 */
-unsigned char special_scancode(bool* pressed) {
-	unsigned char input = inb(KEYBOARD_DATA_PORT);
+unsigned char special_scancode(unsigned char input, bool* pressed) {
 	*pressed = !lastWasF0;
 	
 	lastWasF0 = false;
@@ -126,17 +154,15 @@ unsigned char special_scancode(bool* pressed) {
 }
 
 /*	interpret_scancode 
-	DESCRIPTION: checks the current keyboard data port and outputs a character accordingly
-	INPUTS: pointer to bool with key pressed
+	DESCRIPTION: checks a byte from the keyboard data port and outputs a character accordingly
+	INPUTS: the byte and pointer to bool with key pressed
 	OUTPUTS: unsigned char of which character was pressed
 */
-unsigned char interpret_scancode(bool* pressed) {
+unsigned char interpret_scancode(unsigned char input, bool* pressed) {
 	if (lastWasE0) {
-		return special_scancode(pressed);
+		return special_scancode(input, pressed);
 	}
 	
-	unsigned char input = inb(KEYBOARD_DATA_PORT);
-	
 	if (input < 0x84) {
 		*pressed = !lastWasF0;
 		lastWasF0 = false;
@@ -193,48 +219,80 @@ void update_modifier_keys(unsigned char keycode, bool pressed) {
 	}
 }
 
-void keyboard_handle() {
+// Save a byte read from the keyboard for the tasklet (called from the interrupt)
+void keyboard_receive(uint8_t data) {
+	// Drop it if the tasklet is that far behind
+	if (keyboard_buffer_tail - keyboard_buffer_head < KEYBOARD_BUFFER_SIZE) {
+		keyboard_buffer[keyboard_buffer_tail % KEYBOARD_BUFFER_SIZE] = data;
+		keyboard_buffer_tail++;
+	}
+	tasklet_schedule(&keyboard_tasklet);
+}
+
+// Turn a byte into a key and let the devices know
+void keyboard_handle(uint8_t data) {
 	//set-up a boolean and then pass its memory address to interpret scancode.
 	//scancode will change pressed accordingly.
 	bool pressed = false;
-	unsigned char keycode = interpret_scancode(&pressed);
+	unsigned char keycode = interpret_scancode(data, &pressed);
 	
 	update_modifier_keys(keycode, pressed);
 	
+	if (keycode == 0)
+		return;
+	
 	// Let the devices know
-	if (keycode != 0) {
-		keyboard_code = keycode;
-		keyboard_pressed = pressed;
-		keyboard_packet_id++;
+	keyboard_code = keycode;
+	keyboard_pressed = pressed;
+	keyboard_packet_id++;
+	wait_queue_wake(&keyboard_wait_queue, POLLIN);
+	
+	// The user handler can take a while (the terminal draws the key), so it runs in a kernel thread
+	if (user_handler && keyboard_events_tail - keyboard_events_head < KEYBOARD_EVENT_BUFFER_SIZE) {
+		keyboard_event_t* event = &keyboard_events[keyboard_events_tail % KEYBOARD_EVENT_BUFFER_SIZE];
+		event->keycode = keycode;
+		event->pressed = pressed;
+		event->modifier_keys = modifier_keys;
+		keyboard_events_tail++;
+		queue_work(NULL, &keyboard_work);
 	}
+}
 	
-	// Call the user handler if it exists
-	if (user_handler && keycode != 0)
-		user_handler(keycode, modifier_keys, pressed);
+// Handle the bytes the interrupt saved
+void keyboard_tasklet_func(void* data) {
+	while (keyboard_buffer_head != keyboard_buffer_tail) {
+		keyboard_handle(keyboard_buffer[keyboard_buffer_head % KEYBOARD_BUFFER_SIZE]);
+		keyboard_buffer_head++;
+	}
+}
+
+// Call the user handler for each key
+void keyboard_work_func(work_t* work) {
+	while (keyboard_events_head != keyboard_events_tail) {
+		keyboard_event_t event = keyboard_events[keyboard_events_head % KEYBOARD_EVENT_BUFFER_SIZE];
+		keyboard_events_head++;
+		if (user_handler)
+			user_handler(event.keycode, event.modifier_keys, event.pressed);
+	}
 }
 
 /*	keyboard_handler 
-	DESCRIPTION: handles a keyboard interrupt
+	DESCRIPTION: handles a keyboard interrupt (just reads the data, the tasklet does the rest)
 	INPUTS: irq number
 	OUTPUTS: none
 */
 void keyboard_handler(int irq) {
-	// Disable this interrupt
-	disable_irq(KEYBOARD_IRQ);
-	
-	// Say the we've handled this interrupt
-	send_eoi(irq);
-	
 	int status = inb(KEYBOARD_COMMAND_PORT);
 	while (status & DATA_BIT) {
 		if (status & MOUSE_BIT)
-			mouse_handle();
+			mouse_receive(inb(KEYBOARD_DATA_PORT));
 		else
-			keyboard_handle();
+			keyboard_receive(inb(KEYBOARD_DATA_PORT));
 		status = inb(KEYBOARD_COMMAND_PORT);
 	}
 	
-	enable_irq(KEYBOARD_IRQ);
+	// Say the we've handled this interrupt
+	send_eoi(irq);
 }
 
 // Initialize the keyboard, write to ports, returns false on failure
@@ -292,14 +350,23 @@ file_descriptor_t* keyboard_open(const char* filename, uint32_t mode) {
 		return NULL;
 	}
 	memcpy(d->filename, filename, namelen + 1);
+	d->info = kmalloc(sizeof(keyboard_info_t));
+	if (!d->info) {
+		kfree(d->filename);
+		kfree(d);
+		return NULL;
+	}
+	((keyboard_info_t*)d->info)->id = keyboard_packet_id;
 	
 	// Assign the functions
 	d->read = keyboard_read;
 	d->write = keyboard_write;
 	d->stat = keyboard_stat;
+	d->can_read = keyboard_can_read;
 	d->llseek = keyboard_llseek;
 	d->duplicate = keyboard_duplicate;
 	d->close = keyboard_close;
+	d->wait_queue = &keyboard_wait_queue;
 	
 	return d;
 }
@@ -318,17 +385,25 @@ uint32_t keyboard_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
 	if (bytes != KEYBOARD_STRUCT_SIZE)
 		return -EINVAL;
 	
+	// Sleep until there is a packet that hasn't been read
+	keyboard_info_t* info = (keyboard_info_t*)f->info;
 	if (!(f->mode & FILE_MODE_NONBLOCKING)) {
-		unsigned int id = keyboard_packet_id;
 		pcb_t* pcb = current_pcb;
-		while (id == keyboard_packet_id && !(pcb && pcb->should_terminate) && !f->closed) {
-			if (signal_occurring(pcb))
+		wait_queue_entry_t entry;
+		wait_queue_add_current(&keyboard_wait_queue, &entry);
+		while (info->id == keyboard_packet_id && !(pcb && pcb->should_terminate) && !f->closed) {
+			if (signal_occurring(pcb)) {
+				wait_queue_remove(&entry);
 				return -EINTR;
+			}
 			up(&f->lock);
-			schedule();
+			thread_sleep(NULL);
 			down(&f->lock);
+			thread_sleep_prepare();
 		}
+		wait_queue_remove(&entry);
 	}
+	info->id = keyboard_packet_id;
 	
 	((uint8_t*)buf)[0] = keyboard_pressed;
 	((uint8_t*)buf)[1] = keyboard_code;
@@ -341,6 +416,11 @@ uint32_t keyboard_write(file_descriptor_t* f, const void* buf, uint32_t nbytes)
 	return 0;
 }
 
+// Whether there is a packet that hasn't been read
+bool keyboard_can_read(file_descriptor_t* f) {
+	return ((keyboard_info_t*)f->info)->id != keyboard_packet_id;
+}
+
 // Get info
 uint32_t keyboard_stat(file_descriptor_t* f, sys_stat_type* data) {
 	data->dev_id = f->type;
@@ -351,7 +431,7 @@ uint32_t keyboard_stat(file_descriptor_t* f, sys_stat_type* data) {
 
 // Seek a keyboard (returns error)
 uint64_t keyboard_llseek(file_descriptor_t* f, uint64_t offset, int whence) {
-	return uint64_make(-1, -ESPIPE);
+	return (uint64_t)-ESPIPE;
 }
 
 // Duplicate the file handle
@@ -367,6 +447,13 @@ file_descriptor_t* keyboard_duplicate(file_descriptor_t* f) {
 		return NULL;
 	}
 	memcpy(d->filename, f->filename, namelen + 1);
+	d->info = kmalloc(sizeof(keyboard_info_t));
+	if (!d->info) {
+		kfree(d->filename);
+		kfree(d);
+		return NULL;
+	}
+	memcpy(d->info, f->info, sizeof(keyboard_info_t));
 	d->lock = MUTEX_UNLOCKED;
 	
 	return d;
@@ -375,5 +462,6 @@ file_descriptor_t* keyboard_duplicate(file_descriptor_t* f) {
 // Close the keyboard
 uint32_t keyboard_close(file_descriptor_t* fd) {
 	kfree(fd->filename);
+	kfree(fd->info);
 	return 0;
 }
@@ -73,7 +73,8 @@ bool keyboard_init();
 void register_keychange(void (*handler)(uint8_t key, modifier_keys_t modifier_keys,
 										bool pressed));
 
-void keyboard_handle();
+// Save a byte read from the keyboard for its tasklet (called from interrupts)
+void keyboard_receive(uint8_t data);
 
 // Initialize the keyboard
 file_descriptor_t* keyboard_open(const char* filename, uint32_t mode);
@@ -84,6 +85,9 @@ uint32_t keyboard_read(file_descriptor_t* f, void* buf, uint32_t bytes);
 // Nop
 uint32_t keyboard_write(file_descriptor_t* f, const void* buf, uint32_t nbytes);
 
+// Whether there is a packet that hasn't been read
+bool keyboard_can_read(file_descriptor_t* f);
+
 // Get info
 uint32_t keyboard_stat(file_descriptor_t* f, sys_stat_type* data);
 
@@ -11,6 +11,7 @@
 #include <drivers/pic/i8259.h>
 #include <drivers/keyboard/keyboard.h>
 #include <drivers/graphics/graphics.h>
+#include <program/workqueue.h>
 
 #define COMMAND_PORT			0x64
 #define DATA_PORT				0x60
@@ -35,6 +36,8 @@
 #define MOUSE_IRQ				12
 
 #define MOUSE_PACKET_SIZE		4
+// Bytes from the interrupt waiting for the tasklet (power of 2)
+#define MOUSE_BUFFER_SIZE		64
 
 #define OVERFLOW_Y(x)				((x >> 7) & 0x1)
 #define OVERFLOW_X(x)				((x >> 6) & 0x1)
@@ -65,6 +68,7 @@ int scroll_dx = 0, scroll_dy = 0;
 int left_down = 0, right_down = 0, middle_down = 0;
 mutex_t mouse_lock = MUTEX_UNLOCKED;
 volatile unsigned int mouse_packet_id = 0;
+wait_queue_t mouse_wait_queue = WAIT_QUEUE_EMPTY;
 
 typedef struct {
 	uint32_t id;
@@ -72,8 +76,16 @@ typedef struct {
 	bool pass;
 } mouse_info_t;
 
-void mouse_handle() {
-	mouse_bytes[mouse_index++] = inb(DATA_PORT);
+// Filled by the interrupt and emptied by the tasklet
+uint8_t mouse_buffer[MOUSE_BUFFER_SIZE];
+volatile uint32_t mouse_buffer_head = 0, mouse_buffer_tail = 0;
+
+void mouse_tasklet_func(void* data);
+tasklet_t mouse_tasklet = TASKLET_INIT(mouse_tasklet_func, NULL);
+
+// Add a byte to the packet and update everything once the packet is complete
+void mouse_handle(uint8_t data) {
+	mouse_bytes[mouse_index++] = data;
 	if (mouse_index == MOUSE_PACKET_SIZE) {
 		mouse_index = 0;
 		if (!(OVERFLOW_Y(mouse_bytes[MOUSE_BYTE_STATUS]) || OVERFLOW_X(mouse_bytes[MOUSE_BYTE_STATUS]))) {
@@ -128,6 +140,7 @@ void mouse_handle() {
 				scroll_dx != 0 || scroll_dy != 0) {
 				// Update
 				mouse_packet_id++;
+				wait_queue_wake(&mouse_wait_queue, POLLIN);
 				
 				// Tell the graphics to update the cursor position
 				if (graphics_enabled())
@@ -137,22 +150,37 @@ void mouse_handle() {
 	}
 }
 
+// Save a byte read from the mouse for the tasklet (called from the interrupt)
+void mouse_receive(uint8_t data) {
+	// Drop it if the tasklet is that far behind
+	if (mouse_buffer_tail - mouse_buffer_head < MOUSE_BUFFER_SIZE) {
+		mouse_buffer[mouse_buffer_tail % MOUSE_BUFFER_SIZE] = data;
+		mouse_buffer_tail++;
+	}
+	tasklet_schedule(&mouse_tasklet);
+}
+
+// Handle the bytes the interrupt saved
+void mouse_tasklet_func(void* data) {
+	while (mouse_buffer_head != mouse_buffer_tail) {
+		mouse_handle(mouse_buffer[mouse_buffer_head % MOUSE_BUFFER_SIZE]);
+		mouse_buffer_head++;
+	}
+}
+
+// Just reads the data (the tasklet does the rest)
 void mouse_handler(int irq) {
-	// Disable this interrupt
-	disable_irq(MOUSE_IRQ);
-	
 	int status = inb(COMMAND_PORT);
 	while (status & DATA_BIT) {
 		if (status & MOUSE_BIT)
-			mouse_handle();
+			mouse_receive(inb(DATA_PORT));
 		else
-			keyboard_handle();
+			keyboard_receive(inb(DATA_PORT));
 		status = inb(COMMAND_PORT);
 	}
 	
 	// Say the we've handled this interrupt
 	send_eoi(irq);
-	enable_irq(MOUSE_IRQ);
 }
 
 void mouse_wait(int type) {
@@ -251,6 +279,7 @@ file_descriptor_t* mouse_open(const char* filename, uint32_t mode) {
 	d->llseek = mouse_llseek;
 	d->duplicate = mouse_duplicate;
 	d->close = mouse_close;
+	d->wait_queue = &mouse_wait_queue;
 	
 	return d;
 }
@@ -274,13 +303,19 @@ uint32_t mouse_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
 	if (!(f->mode & FILE_MODE_NONBLOCKING) && !info->pass) {
 		unsigned int id = mouse_packet_id;
 		pcb_t* pcb = current_pcb;
+		wait_queue_entry_t entry;
+		wait_queue_add_current(&mouse_wait_queue, &entry);
 		while (id == mouse_packet_id && !(pcb && pcb->should_terminate) && !f->closed) {
-			if (signal_occurring(pcb))
+			if (signal_occurring(pcb)) {
+				wait_queue_remove(&entry);
 				return -EINTR;
+			}
 			up(&f->lock);
-			schedule();
+			thread_sleep(NULL);
 			down(&f->lock);
+			thread_sleep_prepare();
 		}
+		wait_queue_remove(&entry);
 	}
 	info->pass = false;
 	
@@ -347,7 +382,7 @@ uint32_t mouse_stat(file_descriptor_t* f, sys_stat_type* data) {
 
 // Seek a mouse (returns error)
 uint64_t mouse_llseek(file_descriptor_t* f, uint64_t offset, int whence) {
-	return uint64_make(-1, -ESPIPE);
+	return (uint64_t)-ESPIPE;
 }
 
 // Duplicate the file handle
@@ -14,7 +14,8 @@
 
 void mouse_init();
 
-void mouse_handle();
+// Save a byte read from the mouse for its tasklet (called from interrupts)
+void mouse_receive(uint8_t data);
 
 // Initialize the mouse
 file_descriptor_t* mouse_open(const char* filename, uint32_t mode);
@@ -63,17 +63,20 @@ void rtc_handler(int irq) {
 			continue;
 		
 		// Update all rtc descrptors
+		descriptor_table_t* table = pcb->descriptors;
+		if (!table)
+			continue;
 		int z;
-		for (z = 0; z < NUMBER_OF_DESCRIPTORS; z++) {
-			if (!pcb->descriptors[z])
+		for (z = 0; z < table->size; z++) {
+			if (!table->files[z])
 				continue;
-			if (pcb->descriptors[z]->type != RTC_FILE_TYPE)
+			if (table->files[z]->type != RTC_FILE_TYPE)
 				continue;
-			if (!pcb->descriptors[z]->info)
+			if (!table->files[z]->info)
 				continue;
 			
 			// Update its counter by 1
-			rtc_info_t* info = pcb->descriptors[z]->info;
+			rtc_info_t* info = table->files[z]->info;
 			info->counter++;
 			
 			// If something has just finished "read" switch to it
@@ -17,6 +17,8 @@ uint32_t buffer_tail = 0;
 // Head of circular buffer
 uint32_t buffer_head = 0;
 uint32_t buffer_size = 0;
+// Woken up when there is new input
+wait_queue_t terminal_wait_queue = WAIT_QUEUE_EMPTY;
 
 //array of shifted values
 uint8_t shift_map[] = {
@@ -537,6 +539,13 @@ void handle_keys(uint8_t keycode, modifier_keys_t modifier_keys, bool pressed) {
 	}
 }
 
+// Handle a key and wake up anything waiting for input
+void terminal_handle_keys(uint8_t keycode, modifier_keys_t modifier_keys, bool pressed) {
+	handle_keys(keycode, modifier_keys, pressed);
+	if (pressed)
+		wait_queue_wake(&terminal_wait_queue, POLLIN);
+}
+
 void terminal_init() {
 	// Clear the buffer
 	memset(buffer, 0, MAX_TERMINAL_BUFFER_LENGTH);
@@ -546,7 +555,7 @@ void terminal_init() {
 	clear();
 	
 	// Register keyboard events
-	register_keychange(handle_keys);
+	register_keychange(terminal_handle_keys);
 	
 	// Setup the default termios
 	memset(&termios, 0, sizeof(termios_t));
@@ -592,6 +601,7 @@ file_descriptor_t* terminal_open(const char* filename, uint32_t mode) {
 	// Assign the functions
 	d->read = terminal_read;
 	d->write = terminal_write;
+	d->writev = terminal_writev;
 	d->stat = terminal_stat;
 	d->llseek = terminal_llseek;
 	d->ioctl = terminal_ioctl;
@@ -599,6 +609,7 @@ file_descriptor_t* terminal_open(const char* filename, uint32_t mode) {
 	d->can_write = terminal_can_write;
 	d->duplicate = terminal_duplicate;
 	d->close = terminal_close;
+	d->wait_queue = &terminal_wait_queue;
 	
 	return d;
 }
@@ -617,12 +628,16 @@ uint32_t read_helper(void* buf, uint32_t bytes) {
 	return z;
 }
 
-// Stores a buffered string of input (blocks until enter is pressed).
-// The string returned must support editing of the input string
-// using backspace and the arrow keys.
-// inputs: file descriptor, buffer pointer and the bytes
-// ouutputs: returns how many bytes were read
-uint32_t terminal_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
+// Sleep until there is new input or end is reached (if not NULL). The current thread must be on the wait queue
+void terminal_sleep(file_descriptor_t* f, struct timeval* end) {
+	up(&f->lock);
+	thread_sleep(end);
+	down(&f->lock);
+	thread_sleep_prepare();
+}
+
+// Read from the input buffer according to the termios settings
+uint32_t terminal_read_input(file_descriptor_t* f, void* buf, uint32_t bytes) {
 	pcb_t* pcb = current_pcb;
 	if (termios.lflag & ICANON) {
 		while (!(f->mode & FILE_MODE_NONBLOCKING) && !(pcb && pcb->should_terminate) && !f->closed) {
@@ -641,9 +656,7 @@ uint32_t terminal_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
 			if (found)
 				break;
 			
-			up(&f->lock);
-			schedule();
-			down(&f->lock);
+			terminal_sleep(f, NULL);
 		}
 		
 		// Copy bytes one by one, stopping at NULL terminating character or newline
@@ -678,9 +691,7 @@ uint32_t terminal_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
 				if (signal_occurring(pcb))
 					return -EINTR;
 				
-				up(&f->lock);
-				schedule();
-				down(&f->lock);
+				terminal_sleep(f, &end);
 			}
 			return read_helper(buf, bytes);
 		} else if (min > 0 && time == 0) {
@@ -693,9 +704,7 @@ uint32_t terminal_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
 				if (signal_occurring(pcb))
 					return -EINTR;
 				
-				up(&f->lock);
-				schedule();
-				down(&f->lock);
+				terminal_sleep(f, NULL);
 			}
 			return read_helper(buf, less);
 		} else {
@@ -709,9 +718,7 @@ uint32_t terminal_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
 				if (signal_occurring(pcb))
 					return -EINTR;
 				
-				up(&f->lock);
-				schedule();
-				down(&f->lock);
+				terminal_sleep(f, NULL);
 			}
 			uint32_t orig = buffer_size;
 			while (orig < less) {
@@ -721,9 +728,7 @@ uint32_t terminal_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
 					if (signal_occurring(pcb))
 						return -EINTR;
 					
-					up(&f->lock);
-					schedule();
-					down(&f->lock);
+					terminal_sleep(f, &end);
 				}
 				if (buffer_size == orig)
 					break;
@@ -736,17 +741,28 @@ uint32_t terminal_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
 	return 0;
 }
 
-// Writes a string to the terminal (returns how many bytes were written)
-//inputs: file descriptor, buffer pointer and the bytes
-//outputs: -1 for failure and the bytes for success
-uint32_t terminal_write(file_descriptor_t* f, const void* buf, uint32_t nbytes) {
+// Stores a buffered string of input (blocks until enter is pressed).
+// The string returned must support editing of the input string
+// using backspace and the arrow keys.
+// inputs: file descriptor, buffer pointer and the bytes
+// ouutputs: returns how many bytes were read
+uint32_t terminal_read(file_descriptor_t* f, void* buf, uint32_t bytes) {
+	wait_queue_entry_t entry;
+	wait_queue_add_current(&terminal_wait_queue, &entry);
+	uint32_t ret = terminal_read_input(f, buf, bytes);
+	wait_queue_remove(&entry);
+	
+	return ret;
+}
+
+// Print characters to the terminal without updating the cursor
+void terminal_print(const void* buf, uint32_t nbytes) {
 	// Loop over and print all the characters
 	uint8_t* cbuf = (uint8_t*)buf;
 	for(uint32_t i = 0; i < nbytes;) {
 		if (!handle_control_chars(cbuf, &i, nbytes))
 			putc(cbuf[i++]);
 	}
-	cursor_position_refresh();
 	
 #if OUTPUT_LOG
 	static char buffer[2048];
@@ -761,11 +777,31 @@ uint32_t terminal_write(file_descriptor_t* f, const void* buf, uint32_t nbytes)
 		buffer[buffer_pos++] = cbuf[z];
 	}
 #endif
+}
+
+// Writes a string to the terminal (returns how many bytes were written)
+//inputs: file descriptor, buffer pointer and the bytes
+//outputs: -1 for failure and the bytes for success
+uint32_t terminal_write(file_descriptor_t* f, const void* buf, uint32_t nbytes) {
+	terminal_print(buf, nbytes);
+	cursor_position_refresh();
 	
 	// Return the number of bytes written
 	return nbytes;
 }
 
+// Write multiple buffers to the terminal (only refreshes the cursor once)
+uint32_t terminal_writev(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt) {
+	uint32_t total = 0;
+	for (uint32_t z = 0; z < iovcnt; z++) {
+		terminal_print(iov[z].base, iov[z].length);
+		total += iov[z].length;
+	}
+	cursor_position_refresh();
+	
+	return total;
+}
+
 // Get info
 uint32_t terminal_stat(file_descriptor_t* f, sys_stat_type* data) {
 	data->dev_id = f->type;
@@ -776,7 +812,7 @@ uint32_t terminal_stat(file_descriptor_t* f, sys_stat_type* data) {
 
 // Seek a terminal (not supported).
 uint64_t terminal_llseek(file_descriptor_t* f, uint64_t offset, int whence) {
-	return uint64_make(-1, -ESPIPE);
+	return (uint64_t)-ESPIPE;
 }
 
 // ioctl
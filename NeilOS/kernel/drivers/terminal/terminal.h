@@ -108,6 +108,9 @@ uint32_t terminal_read(file_descriptor_t* f, void* buf, uint32_t bytes);
 // Writes a string to the terminal
 uint32_t terminal_write(file_descriptor_t* f, const void* buf, uint32_t nbytes);
 
+// Writes multiple buffers to the terminal
+uint32_t terminal_writev(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt);
+
 // Get info
 uint32_t terminal_stat(file_descriptor_t* f, sys_stat_type* data);
 
@@ -18,6 +18,7 @@
 #include <drivers/terminal/terminal.h>
 #include <drivers/pit/pit.h>
 #include <program/task.h>
+#include <program/workqueue.h>
 #include <drivers/devices/devices.h>
 #include <drivers/mouse/mouse.h>
 #include <drivers/audio/es1371.h>
@@ -34,7 +35,7 @@
  * Virtual Memory Manager (bitmap for 4mb pages)
  * Elf file loading
  * libc (static newlib)
- * Signals
+ * Signals (delivered in user space with sigframes)
  * C++ User support
  * Pipes
  * Named Pipes (FIFOs)
@@ -52,6 +53,8 @@
  * Posix Message Queues
  * API
  * VMWare Graphics Driver (2D and 3D)
+ * Thread Local Storage (TLS)
+ * Kernel Threads (with workqueues and tasklets for interrupt bottom halves)
  */
 
 /* TODO (could be improved):
@@ -61,16 +64,11 @@
 	their whole alloted time), and compare it to their alloted time. If they use all of it,
 	give them more time next quantum (to a limit), otherwise give them less.
  	* Process / thread user priorities?
- * Signals - make the signal execute in user space, not kernel space (same with dylib init's)
- * Dynamic libraries - lazy linking, dynamic constructors / destructors
+ * Dylib initializers - run them in user space instead of kernel space
+ * Dynamic libraries - dynamic constructors / destructors
  * Disk Scheduling / Improvements
- * Kernel Threads
- * Filesystem - multiple processes or threads writing to the same inode (i.e. fmkdir("/hi") and fmkdir("/bye")
-	may cause an issue because they both modify the "." inode's contents at the same time
- 		* can probably be fixed by r/w lock per inode
  * Store working directory as inode and have relative opens relative to the inode instead of path
  * Implement MS_INVALIDATE for msync (needs way to easily located all other mapped versions of the same file^^^^)
- * Thread Local Storage (TLS)
  * For shared memory and mqueues, could make a /dev/mqueue/ directory and put all open mqueues in there
  * Could improve read speed of large reads by reading entire block and caching it (because fread only
  	does 0x400 at a time)
@@ -98,7 +96,6 @@
  		don't use the correct esp because there is no ring switch
  * bin/dash -> / -> / -> etc, eventually crashes
  * bin/bash crashes if TERM!=dumb
- * Implement CLOSE_ON_EXEC
  * cat "binary file" crashes because it tries to output nonexistant escape sequences
  * echo what > /dev/null -> pointer being freed not allocated
  * First program may load NeilOS.lib at 0x3800000 vs 0x1400000
@@ -148,7 +145,6 @@
  * Dylib Lazy Linking?
  * Get libtool working?
  * Page files on disk?
-	* Could make loading a program only load entry point page and then lazy load the rest?
  * Module support?
  * OpenGL
  	* Could implement own library and only implement things I want
@@ -241,6 +237,7 @@ entry (unsigned long magic, unsigned long addr)
 	// Initialize the scheduler
 	pit_init();
 	time_load_current();
+	time_init_clock_page();
 	pit_register_handler(scheduler_tick);
 	
 	devices_init();
@@ -264,6 +261,11 @@ entry (unsigned long magic, unsigned long addr)
 	//fsunlink("/var/log/output.log");
 	LOG_OUTPUT_DEBUG("System booted");
 	
+	// Start the filesystem write back thread and the workqueue's thread (they can't be switched to until we are running)
+	cli();
+	filesystem_start_writeback();
+	workqueue_init();
+	
 	// Run the first program (auto enables interrupts)
 	run(pcb);
 	
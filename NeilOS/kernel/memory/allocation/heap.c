@@ -61,6 +61,18 @@ void heap_perform_unlock() {
 	up(&heap_lock);
 }
 
+// Get the number of bytes in use and the total size of the heap
+void heap_get_usage(uint32_t* used, uint32_t* total) {
+	*used = 0;
+	*total = 0;
+	down(&heap_lock);
+	for (heap_block_t* h = heap; h; h = h->next) {
+		*used += h->space_used;
+		*total += MAX_SIZE;
+	}
+	up(&heap_lock);
+}
+
 // Returns a pointer to newly allocated memory or NULL if it cannot be allocated
 void* kmalloc(uint32_t real_size) {
 	// TODO: we are wasting a lot of memory, but doing this breaks things
@@ -17,6 +17,9 @@ void* kmalloc(uint32_t size);
 void kfree(void* addr);
 
 void heap_perform_lock();
+
+// Get the number of bytes in use and the total size of the heap
+void heap_get_usage(uint32_t* used, uint32_t* total);
 void heap_perform_unlock();
 
 #endif /* heap_h */
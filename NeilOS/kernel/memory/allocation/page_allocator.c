@@ -452,3 +452,42 @@ void page_physical_free_impl(void* addr, void* vaddr, bool use_vadr) {
 	
 	up(&buddy_lock);
 }
+
+// Get the number of bytes handed out and the total size of the page pool
+void page_get_usage(uint32_t* used, uint32_t* total) {
+	down(&buddy_lock);
+	*used = space_used;
+	up(&buddy_lock);
+	*total = MAX_PAGE_SIZE;
+}
+
+// Get the number of 4kb pages in use and available in the 4kb page pool
+void page_four_kb_get_usage(uint32_t* used, uint32_t* total) {
+	*used = 0;
+	*total = 0;
+	
+	down(&four_kb_lock);
+	vm_lock();
+	uint32_t vaddr = vm_get_next_unmapped_page(VIRTUAL_MEMORY_KERNEL);
+	if (!vaddr) {
+		vm_unlock();
+		up(&four_kb_lock);
+		return;
+	}
+	page_four_kb_t* t = four_kb_pages;
+	while (t) {
+		vm_map_page(vaddr, (uint32_t)t, MEMORY_RW | MEMORY_KERNEL, false);
+		t = (page_four_kb_t*)vaddr;
+		
+		// The first entry holds this header
+		for (uint32_t z = 1; z < FOUR_MB_SIZE / FOUR_KB_SIZE; z++) {
+			if (t->entries[z])
+				(*used)++;
+		}
+		*total += FOUR_MB_SIZE / FOUR_KB_SIZE - 1;
+		t = t->next;
+	}
+	vm_unmap_page(vaddr, true);
+	vm_unlock();
+	up(&four_kb_lock);
+}
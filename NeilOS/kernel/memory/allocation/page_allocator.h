@@ -50,4 +50,10 @@ void page_free(void* addr);
 // Free kernel pages (physical addresses)
 void page_physical_free(void* addr);
 
+// Get the number of bytes handed out and the total size of the page pool
+void page_get_usage(uint32_t* used, uint32_t* total);
+
+// Get the number of 4kb pages in use and available in the 4kb page pool
+void page_four_kb_get_usage(uint32_t* used, uint32_t* total);
+
 #endif /* page_allocator_h */
@@ -75,6 +75,14 @@ void vm_unlock() {
 	up(&page_directory_lock);
 }
 
+// Returns true if a range of 4MB pages would be inside the region reserved for dylibs
+bool vm_overlaps_dylib_region(uint32_t page, uint32_t pages, uint32_t type) {
+	if (type != VIRTUAL_MEMORY_USER)
+		return false;
+
+	return (page + pages > VM_DYLIB_START / FOUR_MB_SIZE && page < VM_DYLIB_END / FOUR_MB_SIZE);
+}
+
 // Gets the address of the next unmapped 4MB page of the specific type
 uint32_t vm_get_next_unmapped_page(uint32_t type) {
 	return vm_get_next_unmapped_pages(1, type);
@@ -104,7 +112,7 @@ uint32_t vm_get_next_unmapped_pages(uint32_t pages, uint32_t type) {
 						break;
 					}
 				}
-				if (all)
+				if (all && !vm_overlaps_dylib_region(sizeof(uint32_t) * 8 * z + q, pages, type))
 					return FOUR_MB_SIZE * (sizeof(uint32_t) * 8 * z + q);
 			}
 		}
@@ -136,7 +144,7 @@ uint32_t vm_get_next_unmapped_pages_from_back(uint32_t pages, uint32_t type) {
 						break;
 					}
 				}
-				if (all)
+				if (all && !vm_overlaps_dylib_region(sizeof(uint32_t) * 8 * z + q, pages, type))
 					return FOUR_MB_SIZE * (sizeof(uint32_t) * 8 * z + q);
 			}
 		}
@@ -176,6 +184,14 @@ void vm_map_page(uint32_t vaddr, uint32_t paddr, uint32_t permissions, bool pres
 	invalidate_page_address((void*)vaddr);
 }
 
+// Maps a 4KB page below 4MB read only into every program (persists across context switches)
+void vm_map_shared_user_page(uint32_t vaddr, uint32_t paddr) {
+	// The first 4MB is never unmapped on a context switch, so programs can use the page table's user bit
+	page_directory[0] |= PAGE_USER_BIT;
+	page_table[vaddr / FOUR_KB_SIZE] = paddr | PAGE_PRESENT_BIT | PAGE_USER_BIT;
+	flush_tlb();
+}
+
 // Maps a virtual address (4MB aligned) to a physical page table (4kb aligned)
 void vm_map_page_table(uint32_t vaddr, uint32_t* page_table, uint32_t* page_table_vaddr, uint32_t permissions) {
 	uint32_t page = vaddr / FOUR_MB_SIZE;
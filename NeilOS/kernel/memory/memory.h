@@ -8,6 +8,8 @@
 /*
 	Virtual Memory Map
 	0GB-3GB: User
+		0x3FF000: Clock page (read only, shared by every program)
+		2GB-2.5GB: Dylibs (0x80000000)
 	3GB-4GB: Kernel (0xC0000000)
  */
 
@@ -16,6 +18,10 @@
 #define VIRTUAL_MEMORY_USER				1
 #define VM_KERNEL_ADDRESS			0xC0000000
 
+// Dylibs get a base in here that is the same in every process (not given out to anything else)
+#define VM_DYLIB_START				0x80000000
+#define VM_DYLIB_END				0xA0000000
+
 // Page permissions
 #define MEMORY_READ					(1 << 0)
 #define MEMORY_WRITE				(1 << 1)
@@ -50,6 +56,9 @@ uint32_t vm_get_next_unmapped_pages_from_back(uint32_t pages, uint32_t type);
 // Do not set preserves context to true for kernel pages because they already are persistent.
 void vm_map_page(uint32_t vaddr, uint32_t paddr, uint32_t permissions, bool preserve_context);
 
+// Maps a 4KB page below 4MB read only into every program (persists across context switches)
+void vm_map_shared_user_page(uint32_t vaddr, uint32_t paddr);
+
 // Maps a virtual address (4MB aligned) to a physical page table (4kb aligned)
 void vm_map_page_table(uint32_t vaddr, uint32_t* page_table, uint32_t* page_table_vaddr, uint32_t permissions);
 
@@ -20,6 +20,7 @@ mmap_list_t* mmap_list_create(uint32_t start, uint32_t end, uint32_t permissions
 	memset(t, 0, sizeof(mmap_list_t));
 	t->start = start;
 	t->end = end;
+	t->file_end = end;
 	t->permissions = permissions;
 	t->shared = shared;
 	t->lock = MUTEX_UNLOCKED;
@@ -155,6 +156,7 @@ bool mmap_list_region_remove(mmap_list_t** list, uint32_t start, uint32_t end, p
 				up(&t->lock);
 				return false;
 			}
+			copy->file_end = t->file_end;
 			t->start = end;
 			up(&t->lock);
 			mmap_list_link(copy, list);
@@ -210,21 +212,26 @@ bool mmap_list_process(mmap_list_t* list, uint32_t address, uint32_t code, pcb_t
 		down(&page->lock);
 		
 		// Copy over data
-		if (region->file) {
+		uint32_t length = 0;
+		if (region->file && address_4kb_aligned < region->file_end) {
 			// Read in the data
+			length = region->file_end - address_4kb_aligned;
+			if (length > FOUR_KB_SIZE)
+				length = FOUR_KB_SIZE;
 			uint32_t seek_pos = region->offset + address_4kb_aligned - region->start;
-			region->file->llseek(region->file, uint64_make(0, seek_pos), SEEK_SET);
-			uint32_t rem = FOUR_KB_SIZE;
+			region->file->llseek(region->file, seek_pos, SEEK_SET);
+			uint32_t rem = length;
 			int32_t num = 0;
-			while ((num = region->file->read(region->file, (void*)address_4kb_aligned, rem)) > 0) {
+			while ((num = region->file->read(region->file, (void*)(address_4kb_aligned + length - rem), rem)) > 0) {
 				rem -= num;
 				if (rem == 0)
 					break;
 			}
-		} else {
-			// Fill with 0's
-			memset((void*)address_4kb_aligned, 0, FOUR_KB_SIZE);
+			length -= rem;
 		}
+		// Fill the rest with 0's
+		if (length < FOUR_KB_SIZE)
+			memset((void*)(address_4kb_aligned + length), 0, FOUR_KB_SIZE - length);
 	}
 	
 	// Update the corresponding 4kb mapping to not include writing if needed
@@ -276,6 +283,7 @@ mmap_list_t* mmap_list_copy(mmap_list_t* list) {
 			mmap_list_dealloc_list(head);
 			return NULL;
 		}
+		l->file_end = t->file_end;
 		
 		if (!head)
 			head = l;
@@ -307,7 +315,7 @@ void mmap_list_sync(mmap_list_t* list, uint32_t start, uint32_t end, bool invali
 		uint32_t e = (end < t->end) ? end : t->end;
 		if (s < e && t->file && t->shared && (t->permissions & MEMORY_WRITE)) {
 			// Write the interval to the file
-			t->file->llseek(t->file, uint64_make(0, s - t->start + t->offset), SEEK_SET);
+			t->file->llseek(t->file, s - t->start + t->offset, SEEK_SET);
 			t->file->write(t->file, (const void*)s, e - s);
 		}
 		
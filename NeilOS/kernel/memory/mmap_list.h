@@ -25,6 +25,7 @@ typedef struct mmap_list {
 	uint32_t permissions;
 	file_descriptor_t* file;
 	uint32_t offset;
+	uint32_t file_end;	// Address past which the file isn't read from (the rest is zero filled)
 	bool shared;
 	
 	mutex_t lock;
@@ -11,9 +11,16 @@
 #include "task.h"
 #include <program/loader/elf.h>
 
+// Number of entries a symbol cache starts with
+#define DYLIB_CACHE_INITIAL_SIZE	64
+
 dylib_list_t* dylibs = NULL;
 semaphore_t dylib_lock = MUTEX_UNLOCKED;
 
+// 4MB pages of the dylib region that have been given to a dylib
+#define DYLIB_REGION_PAGES			((VM_DYLIB_END - VM_DYLIB_START) / FOUR_MB_SIZE)
+uint32_t dylib_region_bitmap[DYLIB_REGION_PAGES / 32];
+
 // Gets the actual name of a dylib given its "name"
 char* dylib_get_real_name(char* name) {
 	if (!name)
@@ -124,6 +131,59 @@ dylib_t* dylib_load(char* name) {
 	return t->dylib;
 }
 
+// Give a dylib a base in the dylib region (returns false if there is no room)
+bool dylib_vend_base(dylib_t* dylib, uint32_t num_pages) {
+	down(&dylib_lock);
+	for (uint32_t z = 0; z + num_pages <= DYLIB_REGION_PAGES; z++) {
+		bool all = true;
+		for (uint32_t n = 0; n < num_pages; n++) {
+			if (dylib_region_bitmap[(z + n) / 32] & (1 << ((z + n) % 32))) {
+				all = false;
+				break;
+			}
+		}
+		if (!all)
+			continue;
+		
+		for (uint32_t n = 0; n < num_pages; n++)
+			dylib_region_bitmap[(z + n) / 32] |= (1 << ((z + n) % 32));
+		up(&dylib_lock);
+		
+		dylib->base = VM_DYLIB_START + z * FOUR_MB_SIZE;
+		dylib->num_pages = num_pages;
+		return true;
+	}
+	up(&dylib_lock);
+	
+	return false;
+}
+
+// Give back a dylib's base
+void dylib_release_base(dylib_t* dylib) {
+	if (!dylib->base)
+		return;
+	
+	uint32_t start = (dylib->base - VM_DYLIB_START) / FOUR_MB_SIZE;
+	down(&dylib_lock);
+	for (uint32_t n = start; n < start + dylib->num_pages; n++)
+		dylib_region_bitmap[n / 32] &= ~(1 << (n % 32));
+	up(&dylib_lock);
+	dylib->base = 0;
+}
+
+// Returns true if a dylib can be mapped at its base in the current process
+bool dylib_base_is_free(dylib_t* dylib, uint32_t num_pages) {
+	if (!dylib->base)
+		return false;
+	
+	for (uint32_t n = 0; n < num_pages; n++) {
+		if (vm_is_page_mapped(dylib->base + n * FOUR_MB_SIZE))
+			return false;
+	}
+	
+	return true;
+}
+
 // Create a dylib that serves as basically the symbol table holder for a task
 dylib_t* dylib_create_from_pcb(pcb_t* pcb) {
 	dylib_t* dylib = kmalloc(sizeof(dylib_t));
@@ -210,9 +270,11 @@ bool dylib_list_copy_for_pcb(dylib_list_t* list, pcb_t* pcb) {
 		return false;
 	
 	memset(l, 0, sizeof(dylib_list_t));
+	l->lock = MUTEX_UNLOCKED;
 	l->dylib = list->dylib;
 	l->dylib->num_instances++;
 	l->offset = list->offset;
+	l->tls_offset = list->tls_offset;
 	
 	// We must place this at the back because the order of linking is important for duplicate symbols
 	dylib_list_push_back(&pcb->dylibs, l);
@@ -292,9 +354,10 @@ bool dylib_load_for_task(dylib_t* dylib, pcb_t* pcb) {
 	}
 	up(&dylib->lock);
 	
-	// Map these pages to a new offset
+	// Map these pages at the dylib's base so that they are already relocated (or a new offset if it is taken)
 	vm_lock();
-	uint32_t vaddr = vm_get_next_unmapped_pages(num_pages, VIRTUAL_MEMORY_USER);
+	uint32_t vaddr = dylib_base_is_free(dylib, num_pages) ? dylib->base :
+		vm_get_next_unmapped_pages(num_pages, VIRTUAL_MEMORY_USER);
 	if (!vaddr) {
 		vm_unlock();
 		page_list_dealloc(pl);
@@ -441,37 +504,231 @@ void* dylib_get_symbol_address_hash(dylib_t* dylib, uint32_t hash, char* name, b
 	return NULL;
 }
 
+// Get the symbol address for a specific symbol using the GNU hash table
+void* dylib_get_symbol_address_gnu_hash(dylib_t* dylib, uint32_t hash, char* name, bool* found) {
+	uint32_t len = strlen(name) + 1;
+	*found = false;
+	down(&dylib->lock);
+	dylib_gnu_hash_section_t* table = &dylib->gnu_hash;
+	
+	// The bloom filter rules out most symbols that aren't in here
+	uint32_t word = table->bloom[(hash / 32) % table->bloom_size];
+	uint32_t mask = (1 << (hash % 32)) | (1 << ((hash >> table->bloom_shift) % 32));
+	if ((word & mask) != mask) {
+		up(&dylib->lock);
+		return NULL;
+	}
+	
+	uint32_t index = table->buckets[hash % table->nbuckets];
+	if (index < table->symoffset) {
+		up(&dylib->lock);
+		return NULL;
+	}
+	
+	// Chains are sorted by bucket and the last entry of one has its low bit set
+	while (index < dylib->num_symbols && index - table->symoffset < table->nchains) {
+		uint32_t chain_hash = table->chains[index - table->symoffset];
+		if ((hash | 1) == (chain_hash | 1) && dylib->symbols[index].valid &&
+			strncmp(&dylib->symbol_names[dylib->symbols[index].name_index], name, len) == 0) {
+			*found = true;
+			void* ret = dylib->symbols[index].addr;
+			up(&dylib->lock);
+			return ret;
+		}
+		if (chain_hash & 1)
+			break;
+		index++;
+	}
+	up(&dylib->lock);
+	return NULL;
+}
+
 // Get the symbol address for a specific symbol
 void* dylib_get_symbol_address(dylib_t* dylib, char* name, bool* found) {
 	return dylib_get_symbol_address_hash(dylib, elf_compute_hash(name), name, found);
 }
 
+// Look up a symbol in a cache (must hold the lock of the list that owns it)
+bool dylib_symbol_cache_get(dylib_symbol_cache_t* cache, uint32_t hash, char* name, void** addr) {
+	if (!cache)
+		return false;
+	
+	uint32_t len = strlen(name) + 1;
+	for (uint32_t z = hash & (cache->capacity - 1); cache->entries[z].name != 0;
+		 z = (z + 1) & (cache->capacity - 1)) {
+		dylib_cache_entry_t* entry = &cache->entries[z];
+		if (entry->hash == hash && strncmp(&cache->names[entry->name - 1], name, len) == 0) {
+			*addr = entry->addr;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+// Double the number of entries in a cache
+bool dylib_symbol_cache_grow(dylib_symbol_cache_t* cache) {
+	uint32_t capacity = cache->capacity ? cache->capacity * 2 : DYLIB_CACHE_INITIAL_SIZE;
+	dylib_cache_entry_t* entries = kmalloc(capacity * sizeof(dylib_cache_entry_t));
+	if (!entries)
+		return false;
+	memset(entries, 0, capacity * sizeof(dylib_cache_entry_t));
+	
+	// Rehash
+	for (uint32_t z = 0; z < cache->capacity; z++) {
+		if (cache->entries[z].name == 0)
+			continue;
+		uint32_t i = cache->entries[z].hash & (capacity - 1);
+		while (entries[i].name != 0)
+			i = (i + 1) & (capacity - 1);
+		entries[i] = cache->entries[z];
+	}
+	
+	if (cache->entries)
+		kfree(cache->entries);
+	cache->entries = entries;
+	cache->capacity = capacity;
+	
+	return true;
+}
+
+// Add a resolved symbol to a list's cache (must hold the list's lock)
+void dylib_symbol_cache_add(dylib_list_t* list, uint32_t hash, char* name, void* addr) {
+	if (!list->cache) {
+		list->cache = kmalloc(sizeof(dylib_symbol_cache_t));
+		if (!list->cache)
+			return;
+		memset(list->cache, 0, sizeof(dylib_symbol_cache_t));
+	}
+	dylib_symbol_cache_t* cache = list->cache;
+	
+	// Keep the table at most three quarters full
+	if ((cache->count + 1) * 4 > cache->capacity * 3 && !dylib_symbol_cache_grow(cache))
+		return;
+	
+	// Copy the name
+	uint32_t len = strlen(name) + 1;
+	if (cache->names_length + len > cache->names_capacity) {
+		uint32_t capacity = cache->names_capacity ? cache->names_capacity : DYLIB_CACHE_INITIAL_SIZE * 16;
+		while (cache->names_length + len > capacity)
+			capacity *= 2;
+		char* names = kmalloc(capacity);
+		if (!names)
+			return;
+		if (cache->names) {
+			memcpy(names, cache->names, cache->names_length);
+			kfree(cache->names);
+		}
+		cache->names = names;
+		cache->names_capacity = capacity;
+	}
+	memcpy(&cache->names[cache->names_length], name, len);
+	
+	uint32_t z = hash & (cache->capacity - 1);
+	while (cache->entries[z].name != 0)
+		z = (z + 1) & (cache->capacity - 1);
+	cache->entries[z].hash = hash;
+	cache->entries[z].name = cache->names_length + 1;
+	cache->entries[z].addr = addr;
+	cache->names_length += len;
+	cache->count++;
+}
+
+// Dealloc a symbol cache
+void dylib_symbol_cache_dealloc(dylib_symbol_cache_t* cache) {
+	if (!cache)
+		return;
+	
+	if (cache->entries)
+		kfree(cache->entries);
+	if (cache->names)
+		kfree(cache->names);
+	kfree(cache);
+}
+
 // Get the symbol address for a specific symbol
 void* dylib_get_symbol_address_list(dylib_list_t* list, char* name, bool* found) {
-	*found = false;
-	uint32_t hash = elf_compute_hash(name);
+	return dylib_get_symbol_address_list_hashed(list, name, elf_compute_hash(name),
+												elf_compute_gnu_hash(name), found);
+}
+
+// Find the entry of a list that defines a symbol and the symbol's value in it (before adding the entry's offset)
+dylib_list_t* dylib_list_find_symbol(dylib_list_t* list, char* name, uint32_t hash,
+									 uint32_t gnu_hash, uint32_t* value) {
 	dylib_list_t* t = list;
 	if (t)
 		down(&t->lock);
 	while (t) {
-		void* ret = NULL;
+		bool found = false;
+		void* addr = NULL;
+		if (t->dylib) {
+			if (t->dylib->gnu_hash.nbuckets != 0)
+				addr = dylib_get_symbol_address_gnu_hash(t->dylib, gnu_hash, name, &found);
+			else if (t->dylib->hash.nbuckets != 0)
+				addr = dylib_get_symbol_address_hash(t->dylib, hash, name, &found);
+			else
+				addr = dylib_get_symbol_address_name(t->dylib, name, &found);
+		}
+		if (found) {
+			up(&t->lock);
+			*value = (uint32_t)addr;
+			return t;
+		}
+		
+		dylib_list_t* prev = t;
+		t = t->next;
+		if (t)
+			down(&t->lock);
+		up(&prev->lock);
+	}
+	
+	return NULL;
+}
+
+// Get the symbol address for a specific symbol with its hashes already computed
+void* dylib_get_symbol_address_list_hashed(dylib_list_t* list, char* name, uint32_t hash,
+										   uint32_t gnu_hash, bool* found) {
+	*found = false;
+	if (!list)
+		return NULL;
+	
+	// Check if this has already been resolved
+	down(&list->lock);
+	void* ret = NULL;
+	if (dylib_symbol_cache_get(list->cache, gnu_hash, name, &ret)) {
+		*found = true;
+		up(&list->lock);
+		return ret;
+	}
+	
+	// The first entry stays locked so that the result can be cached
+	dylib_list_t* t = list;
+	while (t) {
 		if (t->dylib) {
-			if (t->dylib->hash.nbuckets != 0)
+			if (t->dylib->gnu_hash.nbuckets != 0)
+				ret = dylib_get_symbol_address_gnu_hash(t->dylib, gnu_hash, name, found);
+			else if (t->dylib->hash.nbuckets != 0)
 				ret = dylib_get_symbol_address_hash(t->dylib, hash, name, found);
 			else
 				ret = dylib_get_symbol_address_name(t->dylib, name, found);
 		}
 		if (*found) {
-			up(&t->lock);
-			return (void*)((uint32_t)ret + t->offset);
+			ret = (void*)((uint32_t)ret + t->offset);
+			if (t != list)
+				up(&t->lock);
+			dylib_symbol_cache_add(list, gnu_hash, name, ret);
+			up(&list->lock);
+			return ret;
 		}
 		
 		dylib_list_t* prev = t;
 		t = t->next;
 		if (t)
 			down(&t->lock);
-		up(&prev->lock);
+		if (prev != list)
+			up(&prev->lock);
 	}
+	up(&list->lock);
 	return NULL;
 }
 
@@ -588,14 +845,18 @@ void dylib_dealloc(dylib_t* dylib) {
 		kfree(dylib->hash.buckets);
 	if (dylib->hash.chains)
 		kfree(dylib->hash.chains);
+	if (dylib->gnu_hash.data)
+		kfree(dylib->gnu_hash.data);
 	if (dylib->init_array)
 		kfree(dylib->init_array);
 	page_list_dealloc(dylib->page_list);
+	dylib_release_base(dylib);
 	
 	dylib_list_t* t = dylib->dylibs;
 	while (t) {
 		dylib_list_t* prev = t;
 		t = t->next;
+		dylib_symbol_cache_dealloc(prev->cache);
 		kfree(prev);
 	}
 	
@@ -609,6 +870,7 @@ void dylib_list_dealloc(dylib_list_t* d) {
 		dylib_unload_for_task(d->dylib);
 		dylib_list_t* prev = d;
 		d = d->next;
+		dylib_symbol_cache_dealloc(prev->cache);
 		kfree(prev);
 	}
 }
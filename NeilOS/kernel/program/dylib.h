@@ -16,9 +16,34 @@
 struct pcb;
 struct dylib;
 
+// Function in the C library that lazily bound PLT entries jump to on their first call
+#define DYLIB_LAZY_RESOLVER		"_dl_runtime_resolve"
+
+// An already resolved symbol
+typedef struct {
+	uint32_t hash;					// GNU hash of the name
+	uint32_t name;					// Offset into the names plus one (0 if the entry is empty)
+	void* addr;
+} dylib_cache_entry_t;
+
+// Symbols that have been resolved through a dylib list (only found symbols are cached
+// as dylibs only get added to the back of a list)
+typedef struct {
+	dylib_cache_entry_t* entries;
+	uint32_t capacity;				// Power of two
+	uint32_t count;
+	
+	char* names;
+	uint32_t names_length;
+	uint32_t names_capacity;
+} dylib_symbol_cache_t;
+
 typedef struct dylib_list {
 	struct dylib* dylib;
 	uint32_t offset;
+	uint32_t tls_offset;			// The dylib's TLS block is at the thread pointer minus this
+	
+	dylib_symbol_cache_t* cache;	// For lookups that start at this entry
 	
 	semaphore_t lock;
 	struct dylib_list* prev;
@@ -42,12 +67,16 @@ typedef struct {
 		} __attribute__((packed));
 	};
 	uint32_t size;
+	uint32_t addend;				// What the file had at offset (before any relocation)
+	uint32_t hash;					// Hashes of the symbol's name
+	uint32_t gnu_hash;
 } dylib_rel_t;
 
 typedef struct {
 	dylib_rel_t* rels;
 	char* rel_names;
 	uint32_t num_rels;
+	uint32_t addr;					// Link-time address (to find the PLT's relocations)
 } dylib_rel_section_t;
 
 typedef struct {
@@ -63,11 +92,28 @@ typedef struct {
 	uint32_t* chains;
 } dylib_hash_section_t;
 
+typedef struct {
+	uint32_t nbuckets;
+	uint32_t symoffset;				// Index of the first symbol in the table
+	uint32_t bloom_size;
+	uint32_t bloom_shift;
+	uint32_t nchains;
+	uint32_t* bloom;				// All point into data
+	uint32_t* buckets;
+	uint32_t* chains;
+	uint32_t* data;
+} dylib_gnu_hash_section_t;
+
 typedef struct dylib {
 	char* name;
 	page_list_t* page_list;
 	
+	// Where the dylib gets mapped in every process (0 if it has none). page_list is relocated for here
+	uint32_t base;
+	uint32_t num_pages;
+	
 	dylib_hash_section_t hash;
+	dylib_gnu_hash_section_t gnu_hash;
 	
 	dylib_symbol* symbols;
 	char* symbol_names;
@@ -79,6 +125,16 @@ typedef struct dylib {
 	dylib_list_t* dylibs;
 	uint32_t num_instances;			// Number of objects that are linked against this dylib
 	
+	// Link-time addresses of the PLT's GOT and relocations for lazy binding (0 if there is no PLT)
+	uint32_t pltgot;
+	uint32_t jmprel;
+	
+	// TLS template (from PT_TLS, tls_size is 0 if there is none)
+	uint32_t tls_image;				// Link-time address
+	uint32_t tls_image_size;
+	uint32_t tls_size;
+	uint32_t tls_align;
+	
 	// Init function
 	uint32_t init;
 	void (**init_array)();
@@ -93,6 +149,12 @@ bool dylib_is_loaded(char* name);
 // Load a dylib
 dylib_t* dylib_load(char* name);
 
+// Give a dylib a base in the dylib region (returns false if there is no room)
+bool dylib_vend_base(dylib_t* dylib, uint32_t num_pages);
+
+// Give back a dylib's base
+void dylib_release_base(dylib_t* dylib);
+
 // Copy a dylib list for a task
 bool dylib_list_copy_for_pcb(dylib_list_t* list, struct pcb* pcb);
 
@@ -123,6 +185,17 @@ void* dylib_get_symbol_address(dylib_t* dylib, char* name, bool* found);
 // Get the symbol address for a specific symbol
 void* dylib_get_symbol_address_list(dylib_list_t* dylibs, char* name, bool* found);
 
+// Dealloc a symbol cache
+void dylib_symbol_cache_dealloc(dylib_symbol_cache_t* cache);
+
+// Find the entry of a list that defines a symbol and the symbol's value in it (before adding the entry's offset)
+dylib_list_t* dylib_list_find_symbol(dylib_list_t* dylibs, char* name, uint32_t hash,
+									 uint32_t gnu_hash, uint32_t* value);
+
+// Get the symbol address for a specific symbol with its hashes already computed
+void* dylib_get_symbol_address_list_hashed(dylib_list_t* dylibs, char* name, uint32_t hash,
+										   uint32_t gnu_hash, bool* found);
+
 // Perform initialization functions for a list of dylibs
 void dylib_list_perform_init(dylib_list_t* list);
 
@@ -12,6 +12,8 @@
 #include <program/task.h>
 #include <memory/page_list.h>
 #include <program/dylib.h>
+#include <memory/mmap_list.h>
+#include <syscalls/impl/sysmem.h>
 
 #define ELF_MAGIC_NUMBER			0x464c457f
 
@@ -31,6 +33,7 @@
 #define ELF_SEGMENT_DYNAMIC			2
 #define ELF_SEGMENT_INTERP			3
 #define ELF_SEGMENT_NOTE			4
+#define ELF_SEGMENT_TLS				7
 
 #define ELF_FLAGS_EXECUTABLE		1
 #define ELF_FLAGS_WRITABLE			2
@@ -54,12 +57,19 @@
 #define ELF_SECTION_GROUP			17
 #define ELF_SECTION_SYMTAB			18		// extended section indices
 #define ELF_SECTION_NUM				19		// number of defined types
+#define ELF_SECTION_GNU_HASH		0x6ffffff6	// GNU symbol hash map (with a bloom filter)
 
 #define ELF_DYNAMIC_NULL			0
 #define ELF_DYNAMIC_NEEDED			1
+#define ELF_DYNAMIC_PLTGOT			3
 #define ELF_DYNAMIC_STRTAB			5
 #define ELF_DYNAMIC_INIT			12
 #define ELF_DYNAMIC_FINI			13
+#define ELF_DYNAMIC_JMPREL			23
+
+// GOT entries reserved for lazy binding
+#define ELF_GOT_OBJECT				1		// Pushed by the PLT header (which object is being bound)
+#define ELF_GOT_RESOLVER			2		// Where the PLT header jumps to
 
 #define ELF_REL_NONE				0
 #define ELF_REL_32					1
@@ -72,9 +82,16 @@
 #define ELF_REL_RELATIVE			8
 #define ELF_REL_GOTOFF				9
 #define ELF_REL_GOTPC				10
+#define ELF_REL_TLS_TPOFF			14		// Negative offset from the thread pointer
+#define ELF_REL_TLS_DTPMOD32		35		// Module id (for __tls_get_addr)
+#define ELF_REL_TLS_DTPOFF32		36		// Offset in the module's block
+#define ELF_REL_TLS_TPOFF32			37		// Positive offset back from the thread pointer
 
 #define ELF_SYMBOL_UNDEFINED		0
 
+// Size of the buffer sections are read through
+#define ELF_WINDOW_SIZE				(16 * 1024)
+
 typedef struct {
 	uint32_t magic_number;		// 0x464c457f
 	uint8_t bit;				// 1 = 32bit, 2 = 64bit
@@ -105,7 +122,7 @@ typedef struct {
 	uint32_t size;				// Size of segment in file
 	uint32_t mem_size;			// Size of segment in memory
 	uint32_t flags;				// executable, writable, readable
-	uint32_t _unused2;
+	uint32_t align;
 } __attribute__((packed)) elf_program_header_t;
 
 typedef struct {
@@ -146,6 +163,18 @@ typedef struct {
 	uint16_t shindex;
 } elf_symbol_table_t;
 
+// Reads the entries of a section a piece at a time instead of all at once
+typedef struct {
+	file_descriptor_t* file;
+	uint32_t offset;			// Of the section in the file
+	uint32_t entry_size;
+	uint32_t num_entries;
+	uint32_t first;				// Index of the first entry in the buffer
+	uint32_t count;				// Number of entries in the buffer
+	uint32_t capacity;
+	uint8_t* buffer;
+} elf_window_t;
+
 // Check that an elf file is valid
 bool elf_check_valid(char* filename, file_descriptor_t* file, elf_header_t* header) {
 	// Check it is valid
@@ -177,12 +206,64 @@ void* elf_read_data(file_descriptor_t* file, uint32_t addr, uint32_t size) {
 	if (!buffer)
 		return NULL;
 	
-	fseek(file, uint64_make(0, addr), SEEK_SET);
+	fseek(file, addr, SEEK_SET);
 	fread(buffer, size, 1, file);
 	
 	return buffer;
 }
 
+// Get a string table by its section index (loading it if it hasn't been yet)
+char* elf_load_strtab(elf_section_header_t* sections, uint32_t index, file_descriptor_t* file, char** strtabs) {
+	if (!strtabs[index] && sections[index].type == ELF_SECTION_STRING_TABLE)
+		strtabs[index] = elf_read_data(file, sections[index].offset, sections[index].size);
+	return strtabs[index];
+}
+
+// Set up a window over the entries of a section
+bool elf_window_init(elf_window_t* window, file_descriptor_t* file, elf_section_header_t* section,
+					 uint32_t entry_size) {
+	memset(window, 0, sizeof(elf_window_t));
+	window->file = file;
+	window->offset = section->offset;
+	window->entry_size = entry_size;
+	window->num_entries = section->size / entry_size;
+	window->capacity = ELF_WINDOW_SIZE / entry_size;
+	if (window->capacity > window->num_entries)
+		window->capacity = window->num_entries;
+	if (window->capacity == 0)
+		return true;
+	
+	window->buffer = kmalloc(window->capacity * entry_size);
+	return (window->buffer != NULL);
+}
+
+// Get an entry through a window (reads in the part of the section it is in if needed)
+void* elf_window_get(elf_window_t* window, uint32_t index) {
+	if (index >= window->num_entries)
+		return NULL;
+	
+	if (index < window->first || index >= window->first + window->count) {
+		window->first = index;
+		window->count = window->num_entries - index;
+		if (window->count > window->capacity)
+			window->count = window->capacity;
+		fseek(window->file, window->offset + index * window->entry_size, SEEK_SET);
+		if (fread(window->buffer, window->entry_size, window->count, window->file) != window->count) {
+			window->count = 0;
+			return NULL;
+		}
+	}
+	
+	return &window->buffer[(index - window->first) * window->entry_size];
+}
+
+// Free a window's buffer
+void elf_window_free(elf_window_t* window) {
+	if (window->buffer)
+		kfree(window->buffer);
+	window->buffer = NULL;
+}
+
 bool elf_load_common(elf_header_t* header, file_descriptor_t* file,
 					 elf_program_header_t** program_headers, elf_section_header_t** section_headers,
 					 char*** strtabs) {
@@ -201,37 +282,36 @@ bool elf_load_common(elf_header_t* header, file_descriptor_t* file,
 			return false;
 	}
 	
+	// String tables get loaded when they are first needed (except for the section names)
 	if (strtabs) {
 		*strtabs = (char**)kmalloc(sizeof(char**) * header->section_header_num_entries);
 		if (!(*strtabs))
 			return false;
 		memset(*strtabs, 0, sizeof(char**) * header->section_header_num_entries);
-		for (uint32_t z = 0; z < header->section_header_num_entries; z++) {
-			if ((*section_headers)[z].type == ELF_SECTION_STRING_TABLE) {
-				(*strtabs)[z] = elf_read_data(file, (*section_headers)[z].offset, (*section_headers)[z].size);
-				if (!(*strtabs)[z])
-					return false;
-			}
-		}
+		if (!elf_load_strtab(*section_headers, header->section_header_name_index, file, *strtabs))
+			return false;
 	}
 	
 	return true;
 }
 
 // Find the associated strtab for the given address
-char* elf_get_strtab(elf_section_header_t* sections, uint32_t num_sections, uint32_t addr, char** strtabs) {
+char* elf_get_strtab(elf_section_header_t* sections, uint32_t num_sections, uint32_t addr,
+					 file_descriptor_t* file, char** strtabs) {
 	for (uint32_t z = 0; z < num_sections; z++) {
 		if (sections[z].addr == addr)
-			return strtabs[z];
+			return elf_load_strtab(sections, z, file, strtabs);
 	}
 	return NULL;
 }
 
-// Returns the name of a symbol
-char* elf_get_symbol_name(elf_section_header_t* section, elf_symbol_table_t* symtab,
-						  uint32_t sym_index, char** strtabs) {
-	char* strtab = strtabs[section->link];
-	return &strtab[symtab[sym_index].name];
+// Returns the name of a symbol from a symbol table section
+char* elf_get_symbol_name(elf_section_header_t* sections, elf_section_header_t* symtab_section,
+						  elf_symbol_table_t* symbol, file_descriptor_t* file, char** strtabs) {
+	char* strtab = elf_load_strtab(sections, symtab_section->link, file, strtabs);
+	if (!strtab || symbol->name >= sections[symtab_section->link].size)
+		return NULL;
+	return &strtab[symbol->name];
 }
 
 // Load a symbol table
@@ -242,40 +322,49 @@ bool elf_load_symbol_table(elf_section_header_t* sections, elf_header_t* header,
 	for (uint32_t z = 0; z < header->section_header_num_entries; z++) {
 		elf_section_header_t* section_header = &sections[z];
 		if (strncmp(symtab_name, &section_names[section_header->name], len + 1) == 0) {
-			elf_symbol_table_t* dynsym = elf_read_data(file, section_header->offset, section_header->size);
-			if (!dynsym)
+			elf_window_t window;
+			if (!elf_window_init(&window, file, section_header, sizeof(elf_symbol_table_t)))
 				return false;
 			
-			uint32_t num_symbols = section_header->size / sizeof(elf_symbol_table_t);
+			uint32_t num_symbols = window.num_entries;
 			down(&dylib->lock);
 			dylib->symbols = (dylib_symbol*)kmalloc(num_symbols * sizeof(dylib_symbol));
 			if (!dylib->symbols) {
 				up(&dylib->lock);
-				kfree(dynsym);
+				elf_window_free(&window);
 				return false;
 			}
-			char* strtab = strtabs[section_header->link];
-			uint32_t str_len = sections[section_header->link].size;
-			dylib->symbol_names = kmalloc(str_len + 1);
+			// Read the names straight in (the string table is only needed here)
+			elf_section_header_t* strtab = &sections[section_header->link];
+			dylib->symbol_names = kmalloc(strtab->size + 1);
 			if (!dylib->symbol_names) {
 				kfree(dylib->symbols);
 				dylib->symbols = NULL;
-				kfree(dynsym);
+				elf_window_free(&window);
 				up(&dylib->lock);
 				return false;
 			}
-			memcpy(dylib->symbol_names, strtab, str_len + 1);
+			if (strtabs[section_header->link])
+				memcpy(dylib->symbol_names, strtabs[section_header->link], strtab->size);
+			else {
+				fseek(file, strtab->offset, SEEK_SET);
+				fread(dylib->symbol_names, strtab->size, 1, file);
+			}
+			dylib->symbol_names[strtab->size] = 0;
 			
 			// Load the symbol info
 			for (uint32_t i = 0; i < num_symbols; i++) {
-				dylib->symbols[i].name_index = dynsym[i].name;
-				dylib->symbols[i].addr = (void*)(offset + dynsym[i].value);
-				dylib->symbols[i].valid = dynsym[i].shindex != ELF_SYMBOL_UNDEFINED;
+				elf_symbol_table_t* symbol = elf_window_get(&window, i);
+				if (!symbol)
+					break;
+				dylib->symbols[i].name_index = symbol->name;
+				dylib->symbols[i].addr = (void*)(offset + symbol->value);
+				dylib->symbols[i].valid = symbol->shindex != ELF_SYMBOL_UNDEFINED;
 				dylib->num_symbols++;
 			}
 			up(&dylib->lock);
 			
-			kfree(dynsym);
+			elf_window_free(&window);
 			
 			break;
 		}
@@ -296,10 +385,56 @@ uint32_t elf_compute_hash(char* name) {
 	return h;
 }
 
+// Compute the GNU hash of a symbol name
+uint32_t elf_compute_gnu_hash(char* name) {
+	uint32_t h = 5381;
+	while (*name)
+		h = (h << 5) + h + (uint8_t)*name++;
+	return h;
+}
+
+// Load a GNU hash table
+bool elf_load_gnu_hash_table(elf_section_header_t* section, file_descriptor_t* file, dylib_t* dylib) {
+	uint32_t* buffer = elf_read_data(file, section->offset, section->size);
+	if (!buffer)
+		return false;
+	
+	// Header is nbuckets, symoffset, bloom_size, bloom_shift
+	uint32_t words = section->size / sizeof(uint32_t);
+	if (words < 4 || buffer[0] == 0 || buffer[2] == 0 || 4 + buffer[2] + buffer[0] > words) {
+		// Fall back to the other tables
+		kfree(buffer);
+		return true;
+	}
+	
+	down(&dylib->lock);
+	dylib_gnu_hash_section_t* table = &dylib->gnu_hash;
+	table->nbuckets = buffer[0];
+	table->symoffset = buffer[1];
+	table->bloom_size = buffer[2];
+	table->bloom_shift = buffer[3];
+	table->bloom = &buffer[4];
+	table->buckets = &table->bloom[table->bloom_size];
+	table->chains = &table->buckets[table->nbuckets];
+	table->nchains = words - 4 - table->bloom_size - table->nbuckets;
+	table->data = buffer;
+	up(&dylib->lock);
+	
+	return true;
+}
+
 // Load a hash table
 bool elf_load_hash_table(elf_section_header_t* sections, elf_header_t* header,
 						 file_descriptor_t* file, char* section_names, char** strtabs,
 						 dylib_t* dylib) {
+	for (uint32_t q = 0; q < header->section_header_num_entries; q++) {
+		if (sections[q].type == ELF_SECTION_GNU_HASH) {
+			if (!elf_load_gnu_hash_table(&sections[q], file, dylib))
+				return false;
+			break;
+		}
+	}
+	
 	for (uint32_t q = 0; q < header->section_header_num_entries; q++) {
 		if (sections[q].type != ELF_SECTION_HASH)
 			continue;
@@ -341,46 +476,110 @@ bool elf_load_hash_table(elf_section_header_t* sections, elf_header_t* header,
 	return true;
 }
 
-// Perform relocation for a dylib
+// Point a PLT's GOT at the resolver so that functions get bound on their first call
+void elf_setup_lazy_binding(uint32_t got, uint32_t object, void* resolver) {
+	// Only write if needed so that a prelinked GOT can stay shared
+	uint32_t* entries = (uint32_t*)got;
+	if (entries[ELF_GOT_OBJECT] != object)
+		entries[ELF_GOT_OBJECT] = object;
+	if (entries[ELF_GOT_RESOLVER] != (uint32_t)resolver)
+		entries[ELF_GOT_RESOLVER] = (uint32_t)resolver;
+}
+
+// Compute the value of a dylib relocation mapped at offset (returns false if its symbol wasn't found)
+bool elf_dylib_relocation_value(dylib_rel_t* rel, char* rel_names, dylib_list_t* dylibs,
+								uint32_t offset, bool lazy, uint32_t* value) {
+	// The slot points back into the PLT until the function is first called
+	if (rel->type == ELF_REL_RELATIVE || (rel->type == ELF_REL_JUMP_SLOT && lazy)) {
+		*value = rel->addend + offset;
+		return true;
+	}
+	
+	bool found = false;
+	uint32_t symbol = (uint32_t)dylib_get_symbol_address_list_hashed(dylibs, &rel_names[rel->name_index],
+																	 rel->hash, rel->gnu_hash, &found);
+	if (!found) {
+		//printf("Undefined symbol - %s\n", &rel_names[rel->name_index]);
+		return false;
+	}
+	
+	switch (rel->type) {
+		case ELF_REL_PC32:
+			*value = rel->addend + symbol - (rel->offset + offset);
+			break;
+		case ELF_REL_32:
+			*value = rel->addend + symbol;
+			break;
+		default:
+			*value = symbol;
+			break;
+	}
+	
+	return true;
+}
+
+// Compute the value of a TLS relocation for a symbol at value in a block tls_offset below the thread pointer
+uint32_t elf_tls_relocation_value(uint32_t type, uint32_t addend, uint32_t value, uint32_t tls_offset) {
+	switch (type) {
+		case ELF_REL_TLS_TPOFF:
+			return addend + value - tls_offset;
+		case ELF_REL_TLS_TPOFF32:
+			return addend + tls_offset - value;
+		case ELF_REL_TLS_DTPMOD32:
+			// All TLS is static, so where a module's block is works as its id
+			return tls_offset;
+		default:
+			return addend + value;
+	}
+}
+
+// Perform relocation for a dylib (the rels' addends must have been saved by elf_prelink_dylib)
 bool elf_perform_relocation_dylib(dylib_rel_section_t* rel_sections, uint32_t num_rel_sections,
-								  dylib_list_t* dylibs, uint32_t offset) {
+								  dylib_list_t* dylibs, uint32_t offset, uint32_t tls_offset, bool lazy) {
 	for (uint32_t q = 0; q < num_rel_sections; q++) {
 		dylib_rel_t* rels = rel_sections[q].rels;
 		char* rel_names = rel_sections[q].rel_names;
 		for (uint32_t z = 0; z < rel_sections[q].num_rels; z++) {
-			void** dest = (void**)(rels[z].offset + offset);
+			uint32_t* dest = (uint32_t*)(rels[z].offset + offset);
 			switch (rels[z].type) {
-				case ELF_REL_GLOB_DATA:
-				case ELF_REL_COPY:
-				case ELF_REL_JUMP_SLOT: {
+				case ELF_REL_COPY: {
 					bool found = false;
-					void* value = dylib_get_symbol_address_list(dylibs, &rel_names[rels[z].name_index], &found);
-					if (!found) {
-						//printf("Undefined symbol - %s %s\n", &rel_names[rels[z].name_index]);
-						//ret = false;
-						continue;
-					}
-					//printf("Symbol(%d) - %s (0x%x)\n", (rels[z].type == ELF_REL_COPY),
-					//&rel_names[rels[z].name_index], value);
-					if (rels[z].type == ELF_REL_COPY)
+					void* value = dylib_get_symbol_address_list_hashed(dylibs, &rel_names[rels[z].name_index],
+																	   rels[z].hash, rels[z].gnu_hash, &found);
+					if (found)
 						memcpy(dest, value, rels[z].size);
-					else
-						*dest = value;
-					break;
-				}
-				case ELF_REL_RELATIVE: {
-					*dest += offset;
 					break;
 				}
+				case ELF_REL_GLOB_DATA:
+				case ELF_REL_JUMP_SLOT:
+				case ELF_REL_RELATIVE:
 				case ELF_REL_PC32:
-					*dest -= (uint32_t)dest;
 				case ELF_REL_32: {
-					bool found = false;
-					void* value = dylib_get_symbol_address_list(dylibs, &rel_names[rels[z].name_index], &found);
-					if (!found) {
+					uint32_t value = 0;
+					if (!elf_dylib_relocation_value(&rels[z], rel_names, dylibs, offset, lazy, &value))
 						continue;
+					// Pages that were prelinked for this offset are shared until they get written to
+					if (*dest != value)
+						*dest = value;
+					break;
+				}
+				case ELF_REL_TLS_TPOFF:
+				case ELF_REL_TLS_TPOFF32:
+				case ELF_REL_TLS_DTPMOD32:
+				case ELF_REL_TLS_DTPOFF32: {
+					// Without a symbol it is the dylib's own TLS
+					uint32_t value = 0;
+					uint32_t module_offset = tls_offset;
+					if (rels[z].index != 0) {
+						dylib_list_t* d = dylib_list_find_symbol(dylibs, &rel_names[rels[z].name_index],
+																 rels[z].hash, rels[z].gnu_hash, &value);
+						if (!d)
+							continue;
+						module_offset = d->tls_offset;
 					}
-					*dest += (uint32_t)value;
+					value = elf_tls_relocation_value(rels[z].type, rels[z].addend, value, module_offset);
+					if (*dest != value)
+						*dest = value;
 					break;
 				}
 				default:
@@ -393,33 +592,112 @@ bool elf_perform_relocation_dylib(dylib_rel_section_t* rel_sections, uint32_t nu
 	return true;
 }
 
+// Save the addends of a dylib's relocations and relocate its pages (mapped at image) for its base.
+// Symbols are resolved against the dylib and the dylibs it needs, which is what most processes will get
+void elf_prelink_dylib(dylib_t* dylib, uint32_t image) {
+	down(&dylib->lock);
+	for (uint32_t q = 0; q < dylib->num_rel_sections; q++) {
+		dylib_rel_section_t* section = &dylib->rel_sections[q];
+		for (uint32_t z = 0; z < section->num_rels; z++)
+			section->rels[z].addend = *(uint32_t*)(section->rels[z].offset + image);
+	}
+	uint32_t base = dylib->base;
+	bool lazy = (dylib->pltgot && dylib->jmprel);
+	up(&dylib->lock);
+	if (!base)
+		return;
+	
+	// Make the list to resolve symbols with (only dylibs that also have a base)
+	dylib_list_t* list = NULL;
+	dylib_list_t* self = kmalloc(sizeof(dylib_list_t));
+	if (!self)
+		return;
+	memset(self, 0, sizeof(dylib_list_t));
+	self->lock = MUTEX_UNLOCKED;
+	self->dylib = dylib;
+	self->offset = base;
+	list = self;
+	
+	dylib_list_t* last = self;
+	down(&dylib->lock);
+	for (dylib_list_t* d = dylib->dylibs; d; d = d->next) {
+		if (!d->dylib->base)
+			continue;
+		dylib_list_t* t = kmalloc(sizeof(dylib_list_t));
+		if (!t)
+			break;
+		memset(t, 0, sizeof(dylib_list_t));
+		t->lock = MUTEX_UNLOCKED;
+		t->dylib = d->dylib;
+		t->offset = d->dylib->base;
+		t->prev = last;
+		last->next = t;
+		last = t;
+	}
+	up(&dylib->lock);
+	
+	// Write what the relocations would be at the base (copies are left to each process)
+	for (uint32_t q = 0; q < dylib->num_rel_sections; q++) {
+		dylib_rel_section_t* section = &dylib->rel_sections[q];
+		for (uint32_t z = 0; z < section->num_rels; z++) {
+			dylib_rel_t* rel = &section->rels[z];
+			if (rel->type != ELF_REL_GLOB_DATA && rel->type != ELF_REL_JUMP_SLOT && rel->type != ELF_REL_RELATIVE &&
+				rel->type != ELF_REL_PC32 && rel->type != ELF_REL_32)
+				continue;
+			
+			uint32_t value = 0;
+			if (elf_dylib_relocation_value(rel, section->rel_names, list, base, lazy, &value))
+				*(uint32_t*)(rel->offset + image) = value;
+		}
+	}
+	
+	while (list) {
+		dylib_list_t* prev = list;
+		list = list->next;
+		dylib_symbol_cache_dealloc(prev->cache);
+		kfree(prev);
+	}
+}
+
 // Perform relocation
 bool elf_perform_relocation(elf_section_header_t* sections, elf_header_t* header,
 							file_descriptor_t* file, char* section_names, char** strtabs,
-							dylib_list_t* dylibs, uint32_t offset, bool relative) {
+							dylib_list_t* dylibs, uint32_t offset, uint32_t tls_offset, bool relative, bool lazy) {
 	bool ret = true;
-	for (uint32_t z = 0; z < header->section_header_num_entries; z++) {
+	for (uint32_t z = 0; z < header->section_header_num_entries && ret; z++) {
 		elf_section_header_t* section = &sections[z];
 		if (section->type == ELF_SECTION_RELOCATION) {
-			elf_rel_t* rels = elf_read_data(file, section->offset, section->size);
-			if (!rels)
+			// Read the relocations and their symbols a window at a time
+			elf_window_t rels, symtab;
+			if (!elf_window_init(&rels, file, section, sizeof(elf_rel_t)))
 				return false;
-			
-			// Get associated symbol table
-			elf_symbol_table_t* symtab = elf_read_data(file, sections[section->link].offset,
-													   sections[section->link].size);
-			if (!symtab) {
-				kfree(rels);
+			elf_section_header_t* symtab_section = &sections[section->link];
+			if (!elf_window_init(&symtab, file, symtab_section, sizeof(elf_symbol_table_t))) {
+				elf_window_free(&rels);
 				return false;
 			}
 			
-			for (uint32_t i = 0; i < section->size / sizeof(elf_rel_t); i++) {
-				void** dest = (void**)(rels[i].offset + offset);
-				switch (rels[i].type) {
+			for (uint32_t i = 0; i < rels.num_entries; i++) {
+				elf_rel_t* rel = elf_window_get(&rels, i);
+				if (!rel) {
+					ret = false;
+					break;
+				}
+				void** dest = (void**)(rel->offset + offset);
+				switch (rel->type) {
 					case ELF_REL_GLOB_DATA:
 					case ELF_REL_COPY:
 					case ELF_REL_JUMP_SLOT: {
-						char* symbol_name = elf_get_symbol_name(&sections[section->link], symtab, rels[i].index, strtabs);
+						// The slot points back into the PLT until the function is first called
+						if (rel->type == ELF_REL_JUMP_SLOT && lazy) {
+							if (relative)
+								*dest += offset;
+							break;
+						}
+						elf_symbol_table_t* symbol = elf_window_get(&symtab, rel->index);
+						char* symbol_name = symbol ? elf_get_symbol_name(sections, symtab_section, symbol, file, strtabs) : NULL;
+						if (!symbol_name)
+							continue;
 						// Try to find it within our symbol tables
 						bool found = false;
 						void* value = dylib_get_symbol_address_list(dylibs, symbol_name, &found);
@@ -428,12 +706,11 @@ bool elf_perform_relocation(elf_section_header_t* sections, elf_header_t* header
 								   symbol_name, &section_names[section->name], dest);*/
 							continue;
 						}
-						/*printf("Symbol(%d) - %s (*0x%x = 0x%x) at 0x%x\n", (rels[i].type == ELF_REL_COPY),
+						/*printf("Symbol(%d) - %s (*0x%x = 0x%x) at 0x%x\n", (rel->type == ELF_REL_COPY),
 							   symbol_name, value, *(uint32_t*)value, dest);*/
-						if (rels[i].type == ELF_REL_COPY) {
-							uint32_t size = symtab[rels[i].index].size;
-							memcpy(dest, value, size);
-						} else
+						if (rel->type == ELF_REL_COPY)
+							memcpy(dest, value, symbol->size);
+						else
 							*dest = value;
 						break;
 					}
@@ -446,7 +723,10 @@ bool elf_perform_relocation(elf_section_header_t* sections, elf_header_t* header
 						*dest -= (uint32_t)dest;
 					case ELF_REL_32: {
 						bool found = false;
-						char* symbol_name = elf_get_symbol_name(&sections[section->link], symtab, rels[i].index, strtabs);
+						elf_symbol_table_t* symbol = elf_window_get(&symtab, rel->index);
+						char* symbol_name = symbol ? elf_get_symbol_name(sections, symtab_section, symbol, file, strtabs) : NULL;
+						if (!symbol_name)
+							continue;
 						void* value = dylib_get_symbol_address_list(dylibs, symbol_name, &found);
 						if (!found) {
 							continue;
@@ -454,20 +734,198 @@ bool elf_perform_relocation(elf_section_header_t* sections, elf_header_t* header
 						*dest += (uint32_t)value;
 						break;
 					}
+					case ELF_REL_TLS_TPOFF:
+					case ELF_REL_TLS_TPOFF32:
+					case ELF_REL_TLS_DTPMOD32:
+					case ELF_REL_TLS_DTPOFF32: {
+						// Without a symbol it is the program's own TLS
+						uint32_t value = 0;
+						uint32_t module_offset = tls_offset;
+						if (rel->index != 0) {
+							elf_symbol_table_t* symbol = elf_window_get(&symtab, rel->index);
+							char* symbol_name = symbol ? elf_get_symbol_name(sections, symtab_section, symbol, file, strtabs) : NULL;
+							if (!symbol_name)
+								continue;
+							if (symbol->shindex != 0)
+								value = symbol->value;
+							else {
+								dylib_list_t* d = dylib_list_find_symbol(dylibs, symbol_name, elf_compute_hash(symbol_name),
+																		 elf_compute_gnu_hash(symbol_name), &value);
+								if (!d)
+									continue;
+								module_offset = d->tls_offset;
+							}
+						}
+						*(uint32_t*)dest = elf_tls_relocation_value(rel->type, *(uint32_t*)dest, value, module_offset);
+						break;
+					}
 					default:
-						printf("Unknown relative symbol type: %d.\n", rels[i].type);
-						return false;
+						printf("Unknown relative symbol type: %d.\n", rel->type);
+						ret = false;
+						break;
 				}
+				if (!ret)
+					break;
 			}
 			
-			kfree(symtab);
-			kfree(rels);
+			elf_window_free(&symtab);
+			elf_window_free(&rels);
 		}
 	}
 	
 	return ret;
 }
 
+// Copy a relocation section (and the names of its symbols) into a dylib's rel_sections
+bool elf_load_rel_section(elf_section_header_t* sections, elf_section_header_t* section,
+						  file_descriptor_t* file, char** strtabs, dylib_t* dylib) {
+	// Read the relocations and their symbols a window at a time
+	elf_window_t rels, symtab;
+	if (!elf_window_init(&rels, file, section, sizeof(elf_rel_t)))
+		return false;
+	if (!elf_window_init(&symtab, file, &sections[section->link], sizeof(elf_symbol_table_t))) {
+		elf_window_free(&rels);
+		return false;
+	}
+	
+	// Allocate rel table
+	uint32_t num_rels = rels.num_entries;
+	
+	dylib_rel_t* dylib_rels = kmalloc(sizeof(dylib_rel_t) * num_rels);
+	if (!dylib_rels) {
+		elf_window_free(&symtab);
+		elf_window_free(&rels);
+		return false;
+	}
+	uint32_t strtab_index = sections[section->link].link;
+	uint32_t str_len = sections[strtab_index].size;
+	char* strtab = elf_load_strtab(sections, strtab_index, file, strtabs);
+	down(&dylib->lock);
+	dylib_rel_section_t* rel_section = &dylib->rel_sections[dylib->num_rel_sections];
+	rel_section->rel_names = strtab ? kmalloc(str_len) : NULL;
+	if (!rel_section->rel_names) {
+		up(&dylib->lock);
+		kfree(dylib_rels);
+		elf_window_free(&symtab);
+		elf_window_free(&rels);
+		return false;
+	}
+	memcpy(rel_section->rel_names, strtab, str_len);
+	
+	rel_section->rels = dylib_rels;
+	rel_section->num_rels = 0;
+	rel_section->addr = section->addr;
+	dylib->num_rel_sections++;
+	
+	// Copy the info
+	bool ret = true;
+	for (uint32_t i = 0; i < num_rels; i++) {
+		elf_rel_t* rel = elf_window_get(&rels, i);
+		elf_symbol_table_t* symbol = rel ? elf_window_get(&symtab, rel->index) : NULL;
+		if (!symbol) {
+			ret = false;
+			break;
+		}
+		dylib_rels[i].offset = rel->offset;
+		dylib_rels[i].value = rel->value;
+		dylib_rels[i].name_index = symbol->name;
+		dylib_rels[i].size = symbol->size;
+		// Hash once here instead of on every lookup
+		char* name = &rel_section->rel_names[dylib_rels[i].name_index];
+		dylib_rels[i].hash = elf_compute_hash(name);
+		dylib_rels[i].gnu_hash = elf_compute_gnu_hash(name);
+		rel_section->num_rels++;
+	}
+	up(&dylib->lock);
+	
+	elf_window_free(&symtab);
+	elf_window_free(&rels);
+	
+	return ret;
+}
+
+// Get the 4kb pages a segment covers
+void elf_segment_pages(elf_program_header_t* program_header, uint32_t* start, uint32_t* end) {
+	*start = program_header->vaddr & ~(FOUR_KB_SIZE - 1);
+	*end = program_header->vaddr + program_header->mem_size;
+	if ((*end % FOUR_KB_SIZE) != 0)
+		*end += FOUR_KB_SIZE - (*end % FOUR_KB_SIZE);
+}
+
+// Returns true if the loadable segments can be mapped from the file (they need to be page aligned
+// with the file and not share any pages)
+bool elf_can_map_segments(elf_program_header_t* program_headers, uint32_t num_program_headers) {
+	for (uint32_t z = 0; z < num_program_headers; z++) {
+		elf_program_header_t* a = &program_headers[z];
+		if (a->type != ELF_SEGMENT_LOAD)
+			continue;
+		if (a->mem_size < a->size || a->mem_size == 0 || (a->vaddr % FOUR_KB_SIZE) != (a->offset % FOUR_KB_SIZE))
+			return false;
+		
+		uint32_t start, end;
+		elf_segment_pages(a, &start, &end);
+		for (uint32_t i = z + 1; i < num_program_headers; i++) {
+			if (program_headers[i].type != ELF_SEGMENT_LOAD)
+				continue;
+			uint32_t s, e;
+			elf_segment_pages(&program_headers[i], &s, &e);
+			if (s < end && start < e)
+				return false;
+		}
+	}
+	
+	return true;
+}
+
+// Map a segment from the file so that its pages get read in (or zeroed for bss) on their first use
+bool elf_map_segment(elf_program_header_t* program_header, file_descriptor_t* file, pcb_t* pcb) {
+	uint32_t start, end;
+	elf_segment_pages(program_header, &start, &end);
+	if (mmap_list_region_exists(pcb->user_mappings, start, end))
+		return false;
+	
+	// Everything is writable like the rest of the program (relocation writes into it too)
+	mmap_list_t* mapping = mmap_list_create(start, end, MEMORY_RW, file,
+											program_header->offset - (program_header->vaddr - start), false);
+	if (!mapping)
+		return false;
+	mapping->file_end = program_header->vaddr + program_header->size;
+	if (!map_contigous_pages(pcb, start, (end - start) / FOUR_KB_SIZE, MEMORY_RW, false, NULL, 0, 0)) {
+		mmap_list_dealloc(mapping, NULL, NULL);
+		return false;
+	}
+	mmap_list_link(mapping, &pcb->user_mappings);
+	
+	return true;
+}
+
+// Give the program and each of its dylibs a place for their TLS below the thread pointer (the program's
+// block has to be right below it for code that was linked to use fixed offsets)
+void elf_layout_tls(pcb_t* pcb) {
+	uint32_t align = pcb->tls_align ? pcb->tls_align : 1;
+	uint32_t total = (pcb->tls_size + align - 1) & ~(align - 1);
+	pcb->tls_offset = total;
+	pcb->dylibs->tls_offset = total;
+	
+	uint32_t max_align = align;
+	for (dylib_list_t* t = pcb->dylibs->next; t; t = t->next) {
+		down(&t->dylib->lock);
+		uint32_t size = t->dylib->tls_size;
+		align = t->dylib->tls_align ? t->dylib->tls_align : 1;
+		up(&t->dylib->lock);
+		if (size == 0)
+			continue;
+		
+		total = (total + size + align - 1) & ~(align - 1);
+		t->tls_offset = total;
+		if (align > max_align)
+			max_align = align;
+	}
+	
+	pcb->tls_total_size = total;
+	pcb->tls_total_align = max_align;
+}
+
 // Load an elf into memory
 bool elf_load(char* filename, pcb_t* pcb) {
 	file_descriptor_t file;
@@ -477,6 +935,10 @@ bool elf_load(char* filename, pcb_t* pcb) {
 		return false;
 	
 	pcb->entry = header.entry;
+	pcb->tls_image = 0;
+	pcb->tls_image_size = 0;
+	pcb->tls_size = 0;
+	pcb->tls_align = 0;
 	
 	bool ret = false;
 	
@@ -489,14 +951,30 @@ bool elf_load(char* filename, pcb_t* pcb) {
 		goto cleanup;
 	char* section_names = strtabs[header.section_header_name_index];
 	
-	// Load program headers
+	// Load program headers (segments are read in from the file as they get used if they can be)
+	bool demand_paged = elf_can_map_segments(program_headers, header.program_header_num_entries);
 	uint16_t z;
 	for (z = 0; z < header.program_header_num_entries; z++) {
 		elf_program_header_t* program_header = &program_headers[z];
 		
+		// The template every thread's TLS starts out as (it is inside one of the loaded segments)
+		if (program_header->type == ELF_SEGMENT_TLS) {
+			pcb->tls_image = program_header->vaddr;
+			pcb->tls_image_size = program_header->size;
+			pcb->tls_size = program_header->mem_size;
+			pcb->tls_align = program_header->align;
+			continue;
+		}
+		
 		if (program_header->type != ELF_SEGMENT_LOAD)
 			continue;
 		
+		if (demand_paged) {
+			if (!elf_map_segment(program_header, &file, pcb))
+				goto cleanup;
+			continue;
+		}
+		
 		// Check that we can load this segment into memory and allocate new pages if needed
 		uint32_t pos = program_header->vaddr - (program_header->vaddr % FOUR_MB_SIZE);
 		uint32_t real_size = program_header->mem_size > program_header->size ?
@@ -509,7 +987,7 @@ bool elf_load(char* filename, pcb_t* pcb) {
 		}
 		
 		// Load the program segment into memory
-		fseek(&file, uint64_make(0, program_header->offset), SEEK_SET);
+		fseek(&file, program_header->offset, SEEK_SET);
 		fread((void*)program_header->vaddr, program_header->size, 1, &file);
 		if (program_header->size < program_header->mem_size) {
 			memset((void*)(program_header->vaddr + program_header->size), 0,
@@ -534,7 +1012,7 @@ bool elf_load(char* filename, pcb_t* pcb) {
 			char* strtab = NULL;
 			for (uint32_t i = 0; i < section_header->size / sizeof(elf_dynamic_tag_t); i++) {
 				if (tags[i].tag == ELF_DYNAMIC_STRTAB) {
-					strtab = elf_get_strtab(section_headers, header.section_header_num_entries, tags[i].value, strtabs);
+					strtab = elf_get_strtab(section_headers, header.section_header_num_entries, tags[i].value, &file, strtabs);
 					if (!strtab) {
 						kfree(tags);
 						goto cleanup;
@@ -551,26 +1029,59 @@ bool elf_load(char* filename, pcb_t* pcb) {
 						kfree(tags);
 						goto cleanup;
 					}
-				}
+				} else if (tags[i].tag == ELF_DYNAMIC_PLTGOT)
+					dylib->pltgot = tags[i].value;
+				else if (tags[i].tag == ELF_DYNAMIC_JMPREL)
+					dylib->jmprel = tags[i].value;
 			}
 			
 			kfree(tags);
 		}
 	}
 	
-	// Setup dylibs
+	// Functions are bound on their first call unless LD_BIND_NOW was set
+	void* resolver = NULL;
+	if (!pcb->bind_now) {
+		bool found = false;
+		resolver = dylib_get_symbol_address_list(pcb->dylibs, DYLIB_LAZY_RESOLVER, &found);
+		if (!found)
+			resolver = NULL;
+	}
+	
+	// Every module's TLS needs a place before TLS relocations can be done
+	elf_layout_tls(pcb);
+	
+	// Setup dylibs (the executable is object 0)
 	dylib_list_t* t = pcb->dylibs->next;
+	uint32_t object = 1;
 	while (t) {
-		if (!elf_load_dylib_for_task(t->dylib, pcb, t->offset))
+		if (!elf_load_dylib_for_task(t->dylib, pcb, t->offset, t->tls_offset, object++, resolver))
 			goto cleanup;
 		
 		t = t->next;
 	}
 	
+	// Keep the PLT's relocations around so that they can be bound later
+	bool lazy = (resolver && dylib->pltgot && dylib->jmprel);
+	if (lazy) {
+		lazy = false;
+		for (z = 0; z < header.section_header_num_entries; z++) {
+			elf_section_header_t* section = &section_headers[z];
+			if (section->type != ELF_SECTION_RELOCATION || section->addr != dylib->jmprel)
+				continue;
+			dylib->rel_sections = kmalloc(sizeof(dylib_rel_section_t));
+			if (dylib->rel_sections)
+				lazy = elf_load_rel_section(section_headers, section, &file, strtabs, dylib);
+			break;
+		}
+	}
+	
 	// Perform relocation (but don't include symbols from ourself)
 	if (!elf_perform_relocation(section_headers, &header, &file, section_names, strtabs,
-								pcb->dylibs->next, 0, true))
+								pcb->dylibs->next, 0, pcb->tls_offset, true, lazy))
 		goto cleanup;
+	if (lazy)
+		elf_setup_lazy_binding(dylib->pltgot, 0, resolver);
 	
 	// Load hash table
 	if (!elf_load_hash_table(section_headers, &header, &file, section_names, strtabs, pcb->dylibs->dylib))
@@ -606,6 +1117,7 @@ bool elf_load_dylib(char* filename, dylib_t* dylib) {
 		return false;
 	
 	bool ret = false;
+	bool mapped = false;
 	
 	elf_program_header_t* program_headers = NULL;
 	elf_section_header_t* section_headers = NULL;
@@ -622,6 +1134,17 @@ bool elf_load_dylib(char* filename, dylib_t* dylib) {
 	for (z = 0; z < header.program_header_num_entries; z++) {
 		elf_program_header_t* program_header = &program_headers[z];
 		
+		// Each process gives the dylib's TLS a place when it gets loaded
+		if (program_header->type == ELF_SEGMENT_TLS) {
+			down(&dylib->lock);
+			dylib->tls_image = program_header->vaddr;
+			dylib->tls_image_size = program_header->size;
+			dylib->tls_size = program_header->mem_size;
+			dylib->tls_align = program_header->align;
+			up(&dylib->lock);
+			continue;
+		}
+		
 		if (program_header->type != ELF_SEGMENT_LOAD)
 			continue;
 		
@@ -640,7 +1163,10 @@ bool elf_load_dylib(char* filename, dylib_t* dylib) {
 		}
 	}
 	
-	// Offset these pages and map them
+	// Pick where the dylib will live in every process (it can still be loaded elsewhere if this fails)
+	dylib_vend_base(dylib, num_pages);
+	
+	// Offset these pages and map them (stays mapped until the dylib has been relocated for its base)
 	vm_lock();
 	uint32_t offset = vm_get_next_unmapped_pages(num_pages, VIRTUAL_MEMORY_USER);
 	down(&dylib->lock);
@@ -652,6 +1178,7 @@ bool elf_load_dylib(char* filename, dylib_t* dylib) {
 	}
 	up(&dylib->lock);
 	vm_unlock();
+	mapped = true;
 	
 	// Acutally load the program segment
 	for (z = 0; z < header.program_header_num_entries; z++) {
@@ -662,18 +1189,13 @@ bool elf_load_dylib(char* filename, dylib_t* dylib) {
 		
 		// Load the program segment into memory
 		uint32_t real_vaddr = program_header->vaddr + offset;
-		fseek(&file, uint64_make(0, program_header->offset), SEEK_SET);
+		fseek(&file, program_header->offset, SEEK_SET);
 		fread((void*)real_vaddr, program_header->size, 1, &file);
 		if (program_header->size < program_header->mem_size) {
 			memset((void*)(real_vaddr + program_header->size), 0,
 				   program_header->mem_size - program_header->size);
 		}
 	}
-
-	// Unmap the pages
-	down(&dylib->lock);
-	page_list_unmap_list(dylib->page_list, true);
-	up(&dylib->lock);
 	
 	// Load the dynamic symbol table
 	if (!elf_load_symbol_table(section_headers, &header, &file, section_names, strtabs, dylib, 0, ".dynsym"))
@@ -687,7 +1209,7 @@ bool elf_load_dylib(char* filename, dylib_t* dylib) {
 			num_rel_sections++;
 	}
 	down(&dylib->lock);
-	dylib->rel_sections = kmalloc(sizeof(dylib_rel_section_t));
+	dylib->rel_sections = kmalloc(sizeof(dylib_rel_section_t) * num_rel_sections);
 	if (!dylib->rel_sections) {
 		up(&dylib->lock);
 		goto cleanup;
@@ -698,58 +1220,8 @@ bool elf_load_dylib(char* filename, dylib_t* dylib) {
 	for (uint32_t z = 0; z < header.section_header_num_entries; z++) {
 		elf_section_header_t* section = &section_headers[z];
 		if (section->type == ELF_SECTION_RELOCATION) {
-			elf_rel_t* rels = elf_read_data(&file, section->offset, section->size);
-			if (!rels)
-				goto cleanup;
-			
-			// Get associated symbol table
-			elf_symbol_table_t* symtab = elf_read_data(&file, section_headers[section->link].offset,
-													   section_headers[section->link].size);
-			if (!symtab) {
-				kfree(rels);
-				goto cleanup;
-			}
-			
-			// Allocate rel table
-			uint32_t num_rels = section->size / sizeof(elf_rel_t);
-			
-			dylib_rel_t* dylib_rels = kmalloc(sizeof(dylib_rel_t) * num_rels);
-			if (!dylib_rels) {
-				kfree(symtab);
-				kfree(rels);
+			if (!elf_load_rel_section(section_headers, section, &file, strtabs, dylib))
 				goto cleanup;
-			}
-			uint32_t strtab_index = section_headers[section->link].link;
-			uint32_t str_len = section_headers[strtab_index].size;
-			down(&dylib->lock);
-			dylib->rel_sections[dylib->num_rel_sections].rel_names = kmalloc(str_len);
-			if (!dylib->rel_sections[dylib->num_rel_sections].rel_names) {
-				up(&dylib->lock);
-				kfree(dylib_rels);
-				kfree(symtab);
-				kfree(rels);
-				goto cleanup;
-			}
-			memcpy(dylib->rel_sections[dylib->num_rel_sections].rel_names, strtabs[strtab_index], str_len);
-			
-			dylib->rel_sections[dylib->num_rel_sections].rels = dylib_rels;
-			dylib->rel_sections[dylib->num_rel_sections++].num_rels = 0;
-			uint32_t dylib_num_rels = 0;
-			
-			// Copy the info
-			for (uint32_t i = 0; i < section->size / sizeof(elf_rel_t); i++) {
-				dylib_rels[dylib_num_rels].offset = rels[i].offset;
-				dylib_rels[dylib_num_rels].value = rels[i].value;
-				dylib_rels[dylib_num_rels].name_index = symtab[rels[i].index].name;
-				dylib_rels[dylib_num_rels].size = symtab[rels[i].index].size;
-				
-				dylib_num_rels++;
-				dylib->rel_sections[dylib->num_rel_sections - 1].num_rels++;
-			}
-			up(&dylib->lock);
-			
-			kfree(symtab);
-			kfree(rels);
 		}
 	}
 	
@@ -769,7 +1241,7 @@ bool elf_load_dylib(char* filename, dylib_t* dylib) {
 			char* strtab = NULL;
 			for (uint32_t i = 0; i < section_header->size / sizeof(elf_dynamic_tag_t); i++) {
 				if (tags[i].tag == ELF_DYNAMIC_STRTAB) {
-					strtab = elf_get_strtab(section_headers, header.section_header_num_entries, tags[i].value, strtabs);
+					strtab = elf_get_strtab(section_headers, header.section_header_num_entries, tags[i].value, &file, strtabs);
 					if (!strtab) {
 						kfree(tags);
 						goto cleanup;
@@ -779,11 +1251,14 @@ bool elf_load_dylib(char* filename, dylib_t* dylib) {
 			}
 			
 			for (uint32_t i = 0; i < section_header->size / sizeof(elf_dynamic_tag_t); i++) {
-				if (tags[i].tag == ELF_DYNAMIC_INIT) {
-					down(&dylib->lock);
+				down(&dylib->lock);
+				if (tags[i].tag == ELF_DYNAMIC_INIT)
 					dylib->init = tags[i].value;
-					up(&dylib->lock);
-				}
+				else if (tags[i].tag == ELF_DYNAMIC_PLTGOT)
+					dylib->pltgot = tags[i].value;
+				else if (tags[i].tag == ELF_DYNAMIC_JMPREL)
+					dylib->jmprel = tags[i].value;
+				up(&dylib->lock);
 			}
 			
 			kfree(tags);
@@ -807,7 +1282,7 @@ bool elf_load_dylib(char* filename, dylib_t* dylib) {
 			char* strtab = NULL;
 			for (uint32_t i = 0; i < section_header->size / sizeof(elf_dynamic_tag_t); i++) {
 				if (tags[i].tag == ELF_DYNAMIC_STRTAB) {
-					strtab = elf_get_strtab(section_headers, header.section_header_num_entries, tags[i].value, strtabs);
+					strtab = elf_get_strtab(section_headers, header.section_header_num_entries, tags[i].value, &file, strtabs);
 					if (!strtab) {
 						kfree(tags);
 						goto cleanup;
@@ -830,9 +1305,21 @@ bool elf_load_dylib(char* filename, dylib_t* dylib) {
 		}
 	}
 	
+	// Relocate the pages for the base now that the needed dylibs have theirs
+	elf_prelink_dylib(dylib, offset);
+	
 	ret = true;
 	
 cleanup:
+	// Unmap the pages
+	if (mapped) {
+		down(&dylib->lock);
+		page_list_unmap_list(dylib->page_list, true);
+		up(&dylib->lock);
+	}
+	if (!ret)
+		dylib_release_base(dylib);
+	
 	fclose(&file);
 	if (program_headers)
 		kfree(program_headers);
@@ -849,13 +1336,59 @@ cleanup:
 }
 
 // Copy information and perform relocation for a dylib
-bool elf_load_dylib_for_task(dylib_t* dylib, pcb_t* pcb, uint32_t offset) {
+bool elf_load_dylib_for_task(dylib_t* dylib, pcb_t* pcb, uint32_t offset, uint32_t tls_offset,
+							 uint32_t object, void* resolver) {
 	//struct timeval time = time_get();
+	bool lazy = (resolver && dylib->pltgot && dylib->jmprel);
 	if (!elf_perform_relocation_dylib(dylib->rel_sections, dylib->num_rel_sections,
-										pcb->dylibs, offset))
+										pcb->dylibs, offset, tls_offset, lazy))
 		return false;
+	if (lazy)
+		elf_setup_lazy_binding(dylib->pltgot + offset, object, resolver);
 	/*struct timeval t2 = time_subtract(time_get(), time);
 	printf("%d ms - %s\n", t2.tv_sec * 1000 + t2.tv_usec / 1000, dylib->name ? dylib->name : "");*/
 	
 	return true;
 }
+
+// Bind a lazily linked function of an object (index in the task's dylib list) on its first call
+void* elf_bind_lazy_symbol(pcb_t* pcb, uint32_t object, uint32_t rel_offset) {
+	dylib_list_t* t = pcb->dylibs;
+	for (uint32_t z = 0; t && z < object; z++)
+		t = t->next;
+	if (!t)
+		return NULL;
+	
+	// Find the relocation for the slot
+	dylib_t* dylib = t->dylib;
+	char* name = NULL;
+	uint32_t hash = 0, gnu_hash = 0;
+	void** dest = NULL;
+	down(&dylib->lock);
+	for (uint32_t z = 0; z < dylib->num_rel_sections; z++) {
+		dylib_rel_section_t* section = &dylib->rel_sections[z];
+		if (section->addr != dylib->jmprel)
+			continue;
+		uint32_t index = rel_offset / sizeof(elf_rel_t);
+		if (index < section->num_rels && section->rels[index].type == ELF_REL_JUMP_SLOT) {
+			name = &section->rel_names[section->rels[index].name_index];
+			hash = section->rels[index].hash;
+			gnu_hash = section->rels[index].gnu_hash;
+			dest = (void**)(section->rels[index].offset + t->offset);
+		}
+		break;
+	}
+	up(&dylib->lock);
+	if (!name)
+		return NULL;
+	
+	// The executable doesn't include symbols from itself
+	bool found = false;
+	void* value = dylib_get_symbol_address_list_hashed(object == 0 ? pcb->dylibs->next : pcb->dylibs,
+													   name, hash, gnu_hash, &found);
+	if (!found)
+		return NULL;
+	
+	*dest = value;
+	return value;
+}
@@ -19,10 +19,18 @@ bool elf_load(char* filename, pcb_t* pcb);
 // Load dynamic library
 bool elf_load_dylib(char* filename, dylib_t* dylib);
 
-// Copy information and perform relocation for a dylib
-bool elf_load_dylib_for_task(dylib_t* dylib, pcb_t* pcb, uint32_t offset);
+// Copy information and perform relocation for a dylib (the object-th in the task's list, with its TLS
+// tls_offset below the thread pointer). Functions are bound on their first call through resolver unless it is NULL
+bool elf_load_dylib_for_task(dylib_t* dylib, pcb_t* pcb, uint32_t offset, uint32_t tls_offset,
+							 uint32_t object, void* resolver);
+
+// Bind a lazily linked function on its first call (returns its address or NULL if it doesn't exist)
+void* elf_bind_lazy_symbol(pcb_t* pcb, uint32_t object, uint32_t rel_offset);
 
 // Compute the hash of a symbol name
 uint32_t elf_compute_hash(char* name);
 
+// Compute the GNU hash of a symbol name
+uint32_t elf_compute_gnu_hash(char* name);
+
 #endif /* ELF_H */
@@ -8,9 +8,71 @@
 
 #include "signal.h"
 #include <program/task.h>
+#include <boot/x86_desc.h>
+#include <common/lib.h>
+#include <syscalls/interrupt.h>
 
-extern void sigreturn();
-extern void sigjmp(uint32_t exex, void* ret, uint32_t signum);
+// Code copied into each signal frame that calls sigreturn once the handler returns
+extern void sigreturn_trampoline_start();
+extern void sigreturn_trampoline_end();
+#define SIGRETURN_TRAMPOLINE_SIZE	8
+
+// These can't be blocked
+#define SIGNAL_UNBLOCKABLE			((1 << SIGKILL) | (1 << SIGSTOP))
+
+// Flags a program can change with sigreturn (CF, PF, AF, ZF, SF, TF, DF, OF, AC)
+#define EFLAGS_USER					0x40DD5
+#define EFLAGS_TF					(1 << 8)
+#define EFLAGS_DF					(1 << 10)
+
+// Pushed onto the program's stack to run a handler (the handler returns into the trampoline)
+typedef struct {
+	uint32_t ret;
+	uint32_t signum;
+	siginfo_t* info;
+	ucontext_t* context;
+	siginfo_t info_data;
+	ucontext_t context_data;
+	uint8_t trampoline[SIGRETURN_TRAMPOLINE_SIZE];
+} sigframe_t;
+
+// What pusha saves
+typedef struct {
+	uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+} pusha_regs_t;
+
+// The kernel stack when a syscall returns (see is_syscall in interrupt_asm.S)
+typedef struct {
+	uint32_t gs, fs, es, ds;
+	pusha_regs_t regs;				// ebp is the kernel's and eax is the syscall number
+	uint32_t ebp_arg;
+	uint32_t eax;					// Return value
+	uint32_t ebp;
+	uint32_t ret;
+	uint32_t number;
+	iret_t iret;
+} syscall_frame_t;
+
+// The kernel stack when an interrupt returns (see interrupt in interrupt_asm.S). The stubs save
+// some registers themselves before that, so where the rest of them are depends on the interrupt
+typedef struct {
+	uint32_t gs, fs, es, ds;
+	pusha_regs_t regs;				// eax is the interrupt number
+	uint32_t ret;
+	uint32_t stub[];
+} interrupt_frame_t;
+
+// Where the program's registers are in one of the frames
+typedef struct {
+	uint32_t* edi;
+	uint32_t* esi;
+	uint32_t* ebp;
+	uint32_t* ebx;
+	uint32_t* edx;
+	uint32_t* ecx;
+	uint32_t* eax;
+	iret_t* iret;
+} signal_regs_t;
 
 // Default signal actions
 // Do nothing
@@ -131,9 +193,9 @@ void signal_unblock(struct pcb* pcb, sigset_t mask) {
 void signal_wait(struct pcb* pcb, const sigset_t* mask) {
 	down(&current_pcb->lock);
 
-	// Save the sigmask
-	pcb->signal_save_mask[0] = pcb->signal_mask;
-	pcb->signal_mask = *mask;
+	// Save the sigmask (the handler puts it back)
+	pcb->signal_suspend_mask = pcb->signal_mask;
+	pcb->signal_mask = *mask & ~SIGNAL_UNBLOCKABLE;
 	pcb->signal_waiting = true;
 	
 	// Wait for this to be changed
@@ -150,9 +212,10 @@ void signal_wait(struct pcb* pcb, const sigset_t* mask) {
 // Send a signal
 void signal_send(pcb_t* pcb, uint32_t signum) {
 	signal_set_pending(pcb, signum, true);
+	pcb->signal_from_user &= ~(1 << signum);
 }
 
-// Handle signals (returns true if signal is used)
+// Handle signals (caught signals are run when the thread goes back to the program)
 void signal_handle(pcb_t* pcb) {
 	// Check for alarms
 	if (pcb->alarm.val != 0 && pcb->alarm.val <= get_current_unix_time().val) {
@@ -163,44 +226,235 @@ void signal_handle(pcb_t* pcb) {
 	if (!signal_pending(pcb))
 		return;
 	
-	// Check which one
+	// Check which one (only one caught signal can be waiting for the thread at a time)
 	int signum;
 	for (signum = 1; signum < NUMBER_OF_SIGNALS; signum++) {
-		if (signal_is_pending(pcb, signum) && !signal_is_masked(pcb, signum))
+		if (!signal_is_pending(pcb, signum) || signal_is_masked(pcb, signum))
+			continue;
+		sighandler_t handler = pcb->signal_handlers[signum].handler;
+		if (handler == SIG_DFL || handler == SIG_IGN || current_thread->signal_deliver == 0)
 			break;
 	}
+	if (signum == NUMBER_OF_SIGNALS)
+		return;
 	
 	// Mark this signal as no longer pending and mark as a signal occurring
 	signal_set_pending(pcb, signum, false);
 	pcb->signal_occurred = true;
 	
-	// Get the executable address
-	uint32_t exec_addr = (uint32_t)pcb->signal_handlers[signum].handler;
-	if (exec_addr == (uint32_t)NULL) {
+	sighandler_t handler = pcb->signal_handlers[signum].handler;
+	if (handler == SIG_IGN)
+		return;
+	if (handler == SIG_DFL) {
 		signal_defaults[signum - 1](pcb);
 		return;
 	}
 	
-	// Save the sigmask
-	pcb->signal_save_mask[signum] = pcb->signal_mask;
-	pcb->signal_mask |= pcb->signal_handlers[signum].mask;
-	signal_set_masked(pcb, signum, true);
+	current_thread->signal_deliver = signum;
+	if (pcb->signal_waiting) {
+		pcb->signal_waiting = false;
+		pcb->signal_suspended = true;
+	}
+}
+
+// Returns true if a stack pointer is on a thread's alternate stack
+bool signal_on_stack(thread_t* t, uint32_t sp) {
+	uint32_t start = (uint32_t)t->signal_stack.sp;
+	return (t->signal_stack.size != 0 && sp > start && sp <= start + t->signal_stack.size);
+}
+
+// Whether the current thread's program is running on its alternate stack
+bool signal_on_alternate_stack() {
+	syscall_frame_t* frame = (syscall_frame_t*)((uint32_t)current_thread + USER_KERNEL_STACK_SIZE -
+												sizeof(syscall_frame_t));
+	return signal_on_stack(current_thread, frame->iret.esp);
+}
+
+// Push a signal frame onto the program's stack and have it return into the thread's caught signal's handler
+void signal_deliver(signal_regs_t* regs) {
+	thread_t* t = current_thread;
+	pcb_t* pcb = t->pcb;
+	uint32_t signum = t->signal_deliver;
+	t->signal_deliver = 0;
+	
+	// The handler could have changed since the signal was handled
+	sigaction_t* action = &pcb->signal_handlers[signum];
+	if (action->handler == SIG_IGN)
+		return;
+	if (action->handler == SIG_DFL) {
+		signal_defaults[signum - 1](pcb);
+		return;
+	}
+	
+	// Use the alternate stack if the handler wants it (and we aren't already on it)
+	uint32_t sp = regs->iret->esp;
+	bool on_stack = signal_on_stack(t, sp);
+	if ((action->flags & SA_ONSTACK) && t->signal_stack.size != 0 &&
+		!(t->signal_stack.flags & SS_DISABLE) && !on_stack)
+		sp = (uint32_t)t->signal_stack.sp + t->signal_stack.size;
+	
+	// The handler's arguments start 16 byte aligned like after any other call
+	uint32_t addr = ((sp - sizeof(sigframe_t) + sizeof(uint32_t)) & ~0xF) - sizeof(uint32_t);
+	sigframe_t* uframe = (sigframe_t*)addr;
+	
+	// Fill out the frame here and copy it over once it's done
+	sigframe_t frame;
+	frame.ret = (uint32_t)uframe->trampoline;
+	frame.signum = signum;
+	frame.info = &uframe->info_data;
+	frame.context = &uframe->context_data;
+	frame.info_data.signo = signum;
+	frame.info_data.code = (pcb->signal_from_user & (1 << signum)) ? SI_USER : 0;
+	frame.info_data.value = 0;
+	
+	ucontext_t* context = &frame.context_data;
+	context->flags = 0;
+	context->link = NULL;
+	context->stack = t->signal_stack;
+	if (t->signal_stack.size == 0)
+		context->stack.flags = SS_DISABLE;
+	else if (on_stack)
+		context->stack.flags |= SS_ONSTACK;
+	context->mcontext.edi = *regs->edi;
+	context->mcontext.esi = *regs->esi;
+	context->mcontext.ebp = *regs->ebp;
+	context->mcontext.ebx = *regs->ebx;
+	context->mcontext.edx = *regs->edx;
+	context->mcontext.ecx = *regs->ecx;
+	context->mcontext.eax = *regs->eax;
+	context->mcontext.eip = regs->iret->eip;
+	context->mcontext.eflags = regs->iret->eflags;
+	context->mcontext.esp = regs->iret->esp;
+	
+	// Block the signal (and whatever the handler asked for, which is shifted like sigprocmask's) until the handler returns
+	sigset_t mask = pcb->signal_suspended ? pcb->signal_suspend_mask : pcb->signal_mask;
+	context->sigmask = mask >> 1;
+	
+	uint32_t trampoline_size = (uint32_t)sigreturn_trampoline_end - (uint32_t)sigreturn_trampoline_start;
+	memcpy(frame.trampoline, (void*)sigreturn_trampoline_start, trampoline_size);
+	
+	// The stack could have overflowed (or not be the program's at all), in which case the program can't
+	// be let back in to fault again, so it gets a SIGSEGV that can't be caught
+	if (addr < USER_ADDRESS || addr > sp || sp > VM_KERNEL_ADDRESS || !user_memcpy(uframe, &frame, sizeof(sigframe_t))) {
+		pcb->signal_handlers[SIGSEGV].handler = SIG_DFL;
+		signal_defaults[SIGSEGV - 1](pcb);
+		return;
+	}
+	
+	pcb->signal_from_user &= ~(1 << signum);
+	pcb->signal_suspended = false;
+	pcb->signal_mask = (mask | (action->mask << 1) | (1 << signum)) & ~SIGNAL_UNBLOCKABLE;
+	
+	regs->iret->eip = (uint32_t)action->handler;
+	regs->iret->esp = addr;
+	regs->iret->eflags &= ~(EFLAGS_TF | EFLAGS_DF);
+}
 
-	/*
-	 * This works because we context switch into the signal handler, and then when it is done,
-	 * it will call a normal "ret", which will use the return address that this function
-	 * is supposed to use, which leads us to performing another context switch into the correct
-	 * original return place (kind of like ROP programming)
-	 */
+// Run the current thread's caught signal on the way back to the program from a syscall
+void signal_deliver_syscall(void* frame) {
+	if (!current_thread)
+		return;
+	
+	syscall_frame_t* f = (syscall_frame_t*)frame;
+	// Wait until we are going back to the program
+	if (f->iret.cs != USER_CS)
+		return;
 	
-	sigjmp(exec_addr, sigreturn, signum);
+	// Pick up anything sent during the syscall (like a kill() to ourselves)
+	if (current_thread->signal_deliver == 0)
+		signal_handle(current_pcb);
+	if (current_thread->signal_deliver == 0)
+		return;
+	
+	signal_regs_t regs = { &f->regs.edi, &f->regs.esi, &f->ebp, &f->regs.ebx,
+		&f->regs.edx, &f->regs.ecx, &f->eax, &f->iret };
+	signal_deliver(&regs);
 }
 
-void sigreturn_impl(int signum) {
-	// Restore the sigmask
-	current_pcb->signal_mask = current_pcb->signal_save_mask[signum];
-	if (current_pcb->signal_waiting) {
-		current_pcb->signal_mask = current_pcb->signal_save_mask[0];
-		current_pcb->signal_waiting = false;
+// Run the current thread's caught signal on the way back to the program from an interrupt
+void signal_deliver_interrupt(void* frame) {
+	if (!current_thread)
+		return;
+	
+	interrupt_frame_t* f = (interrupt_frame_t*)frame;
+	signal_regs_t regs = { &f->regs.edi, &f->regs.esi, &f->regs.ebp, &f->regs.ebx,
+		&f->regs.edx, &f->regs.ecx, NULL, NULL };
+	
+	// What the stub saved (in the order pushed) and the error code if there is one
+	uint32_t* stub = f->stub;
+	regs.eax = &stub[0];
+	switch (f->regs.eax) {
+		case 0:			// edx, eax
+			regs.edx = &stub[1];
+			stub += 2;
+			break;
+		case 7:			// ebx, edx, eax
+			regs.edx = &stub[1];
+			regs.ebx = &stub[2];
+			stub += 3;
+			break;
+		case 10:		// ebx, eax
+		case 11:
+		case 12:
+		case 17:
+			regs.ebx = &stub[1];
+			stub += 3;
+			break;
+		case 13:		// ebx, edx, eax
+		case 14:
+			regs.edx = &stub[1];
+			regs.ebx = &stub[2];
+			stub += 4;
+			break;
+		default:		// eax
+			stub += 1;
+			break;
+	}
+	regs.iret = (iret_t*)stub;
+	
+	// Wait until we are going back to the program
+	if (regs.iret->cs != USER_CS)
+		return;
+	
+	// Faults send their signal right before coming back here
+	if (current_thread->signal_deliver == 0)
+		signal_handle(current_pcb);
+	if (current_thread->signal_deliver == 0)
+		return;
+	
+	signal_deliver(&regs);
+}
+
+// Go back to where the program was before its handler ran (returns what eax should be)
+uint32_t signal_return() {
+	// This is always a syscall from the program, so it's at the top of the kernel stack
+	syscall_frame_t* f = (syscall_frame_t*)((uint32_t)current_thread + USER_KERNEL_STACK_SIZE -
+											sizeof(syscall_frame_t));
+	if (f->iret.cs != USER_CS)
+		return -EINVAL;
+	
+	// The handler's ret took the return address off
+	uint32_t addr = f->iret.esp - sizeof(uint32_t);
+	sigframe_t frame;
+	if (addr < USER_ADDRESS || addr > VM_KERNEL_ADDRESS - sizeof(sigframe_t) ||
+		!user_memcpy(&frame, (void*)addr, sizeof(sigframe_t))) {
+		// There's nothing to go back to
+		current_pcb->should_terminate = true;
+		return -EFAULT;
 	}
+	ucontext_t* context = &frame.context_data;
+	
+	current_pcb->signal_mask = (context->sigmask << 1) & ~SIGNAL_UNBLOCKABLE;
+	
+	f->regs.edi = context->mcontext.edi;
+	f->regs.esi = context->mcontext.esi;
+	f->ebp = context->mcontext.ebp;
+	f->regs.ebx = context->mcontext.ebx;
+	f->regs.edx = context->mcontext.edx;
+	f->regs.ecx = context->mcontext.ecx;
+	f->iret.eip = context->mcontext.eip;
+	f->iret.esp = context->mcontext.esp;
+	f->iret.eflags = (f->iret.eflags & ~EFLAGS_USER) | (context->mcontext.eflags & EFLAGS_USER);
+	
+	return context->mcontext.eax;
 }
@@ -49,6 +49,17 @@ struct pcb;
 /*   three arguments instead of one. */
 #define SA_ONSTACK   0x4   /* Signal delivery will be on a separate stack. */
 
+#define SIG_DFL		((sighandler_t)0)
+#define SIG_IGN		((sighandler_t)1)
+
+// Alternate stack flags
+#define SS_ONSTACK	0x1
+#define SS_DISABLE	0x2
+#define MINSIGSTKSZ	2048
+
+// si_code for signals sent with kill
+#define SI_USER		1
+
 typedef unsigned long sigset_t;
 typedef void (*sighandler_t)();
 
@@ -58,6 +69,41 @@ typedef struct {
 	unsigned int flags;
 } sigaction_t;
 
+// The rest match the C library's stack_t, siginfo_t, mcontext_t and ucontext_t
+typedef struct {
+	void* sp;
+	int flags;
+	uint32_t size;
+} sigstack_t;
+
+typedef struct {
+	int signo;
+	int code;
+	uint32_t value;
+} siginfo_t;
+
+// Registers of the program when the signal came
+typedef struct {
+	uint32_t edi;
+	uint32_t esi;
+	uint32_t ebp;
+	uint32_t ebx;
+	uint32_t edx;
+	uint32_t ecx;
+	uint32_t eax;
+	uint32_t eip;
+	uint32_t eflags;
+	uint32_t esp;
+} sigcontext_t;
+
+typedef struct ucontext {
+	uint32_t flags;
+	struct ucontext* link;
+	sigstack_t stack;
+	sigcontext_t mcontext;
+	sigset_t sigmask;				// Same bits as sigprocmask
+} ucontext_t;
+
 // Pending signals
 void signal_set_pending(struct pcb* pcb, uint32_t signum, bool pending);
 bool signal_is_pending(struct pcb* pcb, uint32_t signum);
@@ -86,4 +132,15 @@ void signal_send(struct pcb* pcb, uint32_t signum);
 // Handle signals
 void signal_handle(struct pcb* pcb);
 
+// Run the current thread's caught signal on the way back to the program from a syscall
+// or an interrupt (frame is the kernel stack right before it gets popped, see interrupt_asm.S)
+void signal_deliver_syscall(void* frame);
+void signal_deliver_interrupt(void* frame);
+
+// Go back to where the program was before its handler ran (returns what eax should be)
+uint32_t signal_return();
+
+// Whether the current thread's program is running on its alternate stack
+bool signal_on_alternate_stack();
+
 #endif /* SIGNAL_H */
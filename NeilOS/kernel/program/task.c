@@ -7,6 +7,7 @@
 #include <drivers/pic/i8259.h>
 #include <program/loader/elf.h>
 #include <syscalls/impl/sysproc.h>
+#include <syscalls/impl/sysfile.h>
 #include <drivers/filesystem/path.h>
 #include <common/concurrency/semaphore.h>
 
@@ -51,6 +52,11 @@ thread_t* thread_copy(thread_t* t, pcb_t* new_pcb, bool exact) {
 	n->pcb = new_pcb;
 	n->sse_registers = (uint8_t*)((uint32_t)n->sse_registers_unaligned + 16 -
 								  ((uint32_t)n->sse_registers_unaligned % 16));
+	n->ticks = 0;
+	n->switches = 0;
+	n->sleeping = false;
+	n->woken = false;
+	n->signal_deliver = 0;
 	
 	return n;
 }
@@ -177,6 +183,70 @@ pcb_t* pcb_from_pid(uint32_t pid) {
 	return NULL;
 }
 
+// Call a function with the locked pcb for a pid (returns false if there is no such task)
+bool pcb_perform_for_pid(uint32_t pid, void (*func)(pcb_t* pcb, void* data), void* data) {
+	for (;;) {
+		// Walk through the task list
+		down(&task_lock);
+		task_list_t* t = tasks;
+		if (t)
+			down(&t->lock);
+		up(&task_lock);
+		while (t && t->pid != pid) {
+			task_list_t* prev = t;
+			t = t->next;
+			if (t)
+				down(&t->lock);
+			up(&prev->lock);
+		}
+		if (!t)
+			return false;
+		
+		pcb_t* pcb = t->pcb;
+		if (!pcb) {
+			up(&t->lock);
+			return false;
+		}
+		
+		// The task can't be freed once we have its lock (terminate_task holds it until the end)
+		if (down_trylock(&pcb->lock)) {
+			up(&t->lock);
+			func(pcb, data);
+			up(&pcb->lock);
+			return true;
+		}
+		
+		// The task is busy (possibly exiting), so try again later
+		up(&t->lock);
+		schedule();
+	}
+}
+
+// Get the pids of all the tasks (returns the number of tasks, which can be more than max)
+uint32_t task_list_get_pids(uint32_t* pids, uint32_t max) {
+	uint32_t num = 0;
+	down(&task_lock);
+	task_list_t* t = tasks;
+	if (t)
+		down(&t->lock);
+	up(&task_lock);
+	while (t) {
+		if (t->pcb) {
+			if (num < max)
+				pids[num] = t->pid;
+			num++;
+		}
+		
+		task_list_t* prev = t;
+		t = t->next;
+		if (t)
+			down(&t->lock);
+		up(&prev->lock);
+	}
+	
+	return num;
+}
+
 // Vend the next avaiable pid as a task structure
 task_list_t* vend_pid() {
 	uint32_t max = 0;
@@ -227,9 +297,88 @@ task_list_t* vend_pid() {
 	return new_task;
 }
 
+// Where kernel threads return to when they are done
+void kernel_thread_exit() {
+	// Free the pcb and stack like any other finished task (a kernel thread is never in a syscall, so this doesn't return)
+	terminate_task(0);
+}
+
+// Create a thread that runs func(arg) in the kernel
+pcb_t* kernel_thread_create(void (*func)(void*), void* arg) {
+	task_list_t* task = vend_pid();
+	
+	pcb_t* pcb = (pcb_t*)kmalloc(sizeof(pcb_t));
+	if (!pcb)
+		return NULL;
+	memset(pcb, 0, sizeof(pcb_t));
+	pcb->threads = thread_create_main(pcb);
+	if (!pcb->threads) {
+		kfree(pcb);
+		return NULL;
+	}
+	pcb->task = task;
+	pcb->descriptor_lock = MUTEX_UNLOCKED;
+	pcb->lock = MUTEX_UNLOCKED;
+	pcb->kernel_thread = true;
+	
+	// Setup the stack so that the first context switch returns into func(arg)
+	// (registers for popa, func, the return address for func, and then arg)
+	uint32_t* stack = (uint32_t*)((uint32_t)pcb->threads + USER_KERNEL_STACK_SIZE);
+	*(--stack) = (uint32_t)arg;
+	*(--stack) = (uint32_t)kernel_thread_exit;
+	*(--stack) = (uint32_t)func;
+	stack -= 8;
+	memset(stack, 0, sizeof(uint32_t) * 8);
+	pcb->threads->saved_esp = (uint32_t)stack;
+	
+	// Allow it to be used
+	pcb->state = READY;
+	task->pcb = pcb;
+	
+	return pcb;
+}
+
 // Set the kernel stack for the next task to be switched to
 void set_kernel_stack(uint32_t address) {
 	tss.esp0 = address;
+	// sysenter doesn't use the TSS
+	wrmsr(IA32_SYSENTER_ESP, address);
+}
+
+// Sets the base of the TLS segment and reloads %gs with it
+void set_tls_base(uint32_t address) {
+	SET_TLS_BASE(tls_desc_ptr, address);
+	load_gs(USER_TLS);
+}
+
+// Set up a thread's TLS blocks and TCB with the thread pointer at tp
+void tls_setup_thread(pcb_t* pcb, thread_t* t, uint32_t tp) {
+	memset((void*)(tp - pcb->tls_total_size), 0, pcb->tls_total_size + TLS_TCB_SIZE);
+	// The first word of the TCB points to itself so that %gs:0 gives the thread pointer
+	*(uint32_t*)tp = tp;
+	
+	if (pcb->tls_image_size != 0)
+		memcpy((void*)(tp - pcb->tls_offset), (void*)pcb->tls_image, pcb->tls_image_size);
+	
+	dylib_list_t* d = pcb->dylibs ? pcb->dylibs->next : NULL;
+	if (d)
+		down(&d->lock);
+	while (d) {
+		down(&d->dylib->lock);
+		if (d->dylib->tls_image_size != 0) {
+			memcpy((void*)(tp - d->tls_offset), (void*)(d->offset + d->dylib->tls_image),
+				   d->dylib->tls_image_size);
+		}
+		up(&d->dylib->lock);
+		
+		dylib_list_t* prev = d;
+		d = d->next;
+		if (d)
+			down(&d->lock);
+		up(&prev->lock);
+	}
+	
+	t->tls_base = tp;
 }
 
 // Map a task's address space into memory
@@ -335,16 +484,15 @@ bool load_argv_and_envp(pcb_t* pcb, const char** argv, const char** envp, uint32
 
 // Helper to free descriptors of a pcb
 void pcb_free_descriptors(pcb_t* pcb) {
-	uint32_t z;
 	down(&pcb->descriptor_lock);
-	for (z = 0; z < NUMBER_OF_DESCRIPTORS; z++) {
-		if (pcb->descriptors[z]) {
-			pcb->descriptors[z]->closed = true;
-			file_descriptor_release(pcb->descriptors[z]);
-			pcb->descriptors[z] = NULL;
-		}
-	}
+	descriptor_table_t* t = pcb->descriptors;
+	pcb->descriptors = NULL;
+	if (pcb == current_pcb)
+		set_current_descriptors(NULL);
 	up(&pcb->descriptor_lock);
+	
+	if (t)
+		descriptor_table_free(t);
 }
 
 // Add a new child to the parent's children list
@@ -387,6 +535,7 @@ bool load_task_into_memory(pcb_t* pcb, char* filename) {
 // Helper to copy over the data in a pcb
 bool copy_pcb(pcb_t* in, pcb_t* out) {
 	memcpy(out, in, sizeof(pcb_t));
+	out->descriptors = NULL;
 	
 	out->working_dir = path_copy(in->working_dir);
 	if (!out->working_dir)
@@ -394,39 +543,14 @@ bool copy_pcb(pcb_t* in, pcb_t* out) {
 	
 	// Copy over descriptors
 	down(&in->descriptor_lock);
-	uint32_t z;
-	for (z = 0; z < NUMBER_OF_DESCRIPTORS; z++) {
-		if (in->descriptors[z]) {
-			down(&in->descriptors[z]->lock);
-			// Check if this is has already been duplicated
-			if (in->descriptors[z]->ref_count > 1) {
-				// Check if we've already seen it
-				uint32_t i;
-				bool found = false;
-				for (i = 0; i < z; i++) {
-					if (in->descriptors[i] == in->descriptors[z]) {
-						found = true;
-						break;
-					}
-				}
-				if (found) {
-					out->descriptors[z] = out->descriptors[i];
-					up(&in->descriptors[z]->lock);
-					continue;
-				}
-			}
-			// Otherwise, duplicate it
-			out->descriptors[z] = (file_descriptor_t*)in->descriptors[z]->duplicate((void*)in->descriptors[z]);
-			up(&in->descriptors[z]->lock);
-			if (!out->descriptors[z]) {
-				kfree(out->working_dir);
-				out->working_dir = NULL;
-				up(&current_pcb->descriptor_lock);
-				return false;
-			}
-		}
-	}
+	if (in->descriptors)
+		out->descriptors = descriptor_table_copy(in->descriptors);
 	up(&in->descriptor_lock);
+	if (in->descriptors && !out->descriptors) {
+		kfree(out->working_dir);
+		out->working_dir = NULL;
+		return false;
+	}
 		
 	return true;
 }
@@ -490,6 +614,8 @@ pcb_t* duplicate_current_task() {
 	pcb->signal_pending = 0;
 	pcb->should_terminate = false;
 	pcb->signal_occurred = false;
+	pcb->vfork_thread = NULL;
+	pcb->spawn_info = NULL;
 	
 	add_child_task(current, task->pid, pcb);
 	
@@ -554,11 +680,119 @@ pcb_t* duplicate_current_task() {
 	return pcb;
 }
 
+// Create a task that uses the current task's memory until it execs or exits (vfork)
+pcb_t* vfork_current_task() {
+	pcb_t* current = current_pcb;
+	
+	// Get a pid and task
+	task_list_t* task = vend_pid();
+	
+	pcb_t* pcb = (pcb_t*)kmalloc(sizeof(pcb_t));
+	copy_pcb(current, pcb);
+	
+	// Overwrite the needed things (the memory and dylibs stay the same as the current task's)
+	pcb->task = task;
+	pcb->parent = current;
+	pcb->children = NULL;
+	pcb->state = SUSPENDED;
+	pcb->alarm.val = 0;
+	pcb->descriptor_lock = MUTEX_UNLOCKED;
+	pcb->lock = MUTEX_UNLOCKED;
+	// Clear the current pending signals
+	pcb->signal_pending = 0;
+	pcb->should_terminate = false;
+	pcb->signal_occurred = false;
+	pcb->vfork_thread = current_thread;
+	pcb->spawn_info = NULL;
+	
+	// Only the calling thread comes along
+	pcb->threads = thread_copy(current_thread, pcb, true);
+	if (!pcb->threads) {
+		// Don't free the memory that belongs to the current task
+		pcb->page_list = NULL;
+		pcb->temporary_mappings = NULL;
+		pcb->user_mappings = NULL;
+		pcb->dylibs = NULL;
+		pcb_error(pcb, task);
+		return NULL;
+	}
+	pcb->threads->vfork_waiting = false;
+	
+	add_child_task(current, task->pid, pcb);
+	task->pcb = pcb;
+	
+	return pcb;
+}
+
+// Give a vfork'd task's memory back to the thread waiting for it
+void vfork_release(pcb_t* pcb, page_list_t* list, page_list_t* tlist, mmap_list_t* maps, dylib_list_t* dylibs, uint32_t brk) {
+	thread_t* t = pcb->vfork_thread;
+	pcb->vfork_thread = NULL;
+	if (!t)
+		return;
+	
+	// The child may have grown the memory (the parent can't have since it was waiting)
+	pcb_t* parent = t->pcb;
+	down(&parent->lock);
+	parent->page_list = list;
+	parent->temporary_mappings = tlist;
+	parent->user_mappings = maps;
+	parent->dylibs = dylibs;
+	parent->brk = brk;
+	up(&parent->lock);
+	
+	t->vfork_waiting = false;
+	thread_wake(t);
+}
+
+// Create a child task without any memory (posix_spawn loads the program into it once it runs)
+pcb_t* spawn_current_task() {
+	pcb_t* current = current_pcb;
+	
+	// Get a pid and task
+	task_list_t* task = vend_pid();
+	
+	pcb_t* pcb = (pcb_t*)kmalloc(sizeof(pcb_t));
+	copy_pcb(current, pcb);
+	
+	// Overwrite the needed things
+	pcb->task = task;
+	pcb->parent = current;
+	pcb->children = NULL;
+	pcb->state = SUSPENDED;
+	pcb->alarm.val = 0;
+	pcb->descriptor_lock = MUTEX_UNLOCKED;
+	pcb->lock = MUTEX_UNLOCKED;
+	// Clear the current pending signals
+	pcb->signal_pending = 0;
+	pcb->should_terminate = false;
+	pcb->signal_occurred = false;
+	pcb->vfork_thread = NULL;
+	pcb->spawn_info = NULL;
+	pcb->page_list = NULL;
+	pcb->temporary_mappings = NULL;
+	pcb->user_mappings = NULL;
+	pcb->dylibs = NULL;
+	pcb->argv = NULL;
+	pcb->envp = NULL;
+	
+	pcb->threads = thread_create_main(pcb);
+	if (!pcb->threads) {
+		pcb_error(pcb, task);
+		return NULL;
+	}
+	
+	add_child_task(current, task->pid, pcb);
+	task->pcb = pcb;
+	
+	return pcb;
+}
+
 bool setup_stack_and_heap(pcb_t* pcb, uint32_t argc) {
-	// Find the last memory mapped region and set the stack to that
+	// Find the last memory mapped region and set the stack to that (dylibs are off on their own)
 	page_list_t* t = pcb->page_list;
 	while (t) {
-		if (t->vaddr > pcb->threads->stack_address)
+		if (t->vaddr > pcb->threads->stack_address && (t->vaddr < VM_DYLIB_START || t->vaddr >= VM_DYLIB_END))
 			pcb->threads->stack_address = t->vaddr;
 		t = t->next;
 	}
@@ -572,8 +806,17 @@ bool setup_stack_and_heap(pcb_t* pcb, uint32_t argc) {
 	
 	// The stack grows downward
 	pcb->threads->stack_address += USER_STACK_SIZE;
-	// The heap grows upwards
-	pcb->brk = pcb->threads->stack_address;
+	// The heap grows upwards (after the main thread's TLS)
+	uint32_t align = (pcb->tls_total_align > sizeof(uint32_t)) ? pcb->tls_total_align : sizeof(uint32_t);
+	uint32_t tp = (pcb->threads->stack_address + pcb->tls_total_size + align - 1) & ~(align - 1);
+	pcb->brk = tp + TLS_TCB_SIZE;
+	pcb->threads->tls_base = tp;
+	for (uint32_t addr = stack_block->vaddr + FOUR_MB_SIZE; addr < pcb->brk; addr += FOUR_MB_SIZE) {
+		page_list_t* tls_block = page_list_get(&pcb->page_list, addr, MEMORY_RW, true);
+		if (!tls_block)
+			return false;
+		page_list_map(tls_block, false);
+	}
 	
 	// Copy over the argv, argc, envp
 	uint32_t* esp = (uint32_t*)(pcb->threads->stack_address - sizeof(uint32_t) * 3);
@@ -584,6 +827,21 @@ bool setup_stack_and_heap(pcb_t* pcb, uint32_t argc) {
 	return true;
 }
 
+// Returns true if LD_BIND_NOW is set in an environment (functions get bound at load instead of first call)
+bool envp_wants_bind_now(const char** envp) {
+	if (!envp)
+		return false;
+	
+	const char* name = "LD_BIND_NOW=";
+	uint32_t len = strlen(name);
+	for (uint32_t z = 0; envp[z]; z++) {
+		if (strncmp(envp[z], name, len) == 0 && envp[z][len] != 0)
+			return true;
+	}
+	
+	return false;
+}
+
 // Load a task into memory and initialize its pcb
 pcb_t* load_task(char* filename, const char** argv, const char** envp) {
 	// Initialize the pcb
@@ -593,6 +851,7 @@ pcb_t* load_task(char* filename, const char** argv, const char** envp) {
 	// Reserve a kernel stack and have the pcb be at the top of it
 	pcb_t* pcb = (pcb_t*)kmalloc(sizeof(pcb_t));
 	memset(pcb, 0, sizeof(pcb_t));
+	pcb->bind_now = envp_wants_bind_now(envp);
 	pcb->threads = thread_create_main(pcb);
 	if (!pcb->threads) {
 		kfree(pcb);
@@ -658,9 +917,12 @@ pcb_t* load_task(char* filename, const char** argv, const char** envp) {
 	current_pcb = pcb;
 	current_thread = pcb->threads;
 	page_list_map_list(pcb->page_list, false);
+	tls_setup_thread(pcb, pcb->threads, pcb->threads->tls_base);
+	set_tls_base(pcb->threads->tls_base);
 	dylib_list_perform_init(pcb->dylibs->next);
 	current_pcb = backup_pcb;
 	current_thread = backup_thread;
+	set_tls_base(backup_thread ? backup_thread->tls_base : 0);
 	
 	if (parent)
 		map_task_into_memory(pcb->parent);
@@ -671,6 +933,7 @@ pcb_t* load_task(char* filename, const char** argv, const char** envp) {
 	return pcb;
 }
 
+// Free the arguments from copy_task_arguments
 void copy_task_arguments_free(char* kfile, char** kargv, char** kenvp) {
 	if (kfile)
 		kfree(kfile);
@@ -802,7 +1065,11 @@ pcb_t* load_task_replace(char* filename, const char** argv, const char** envp) {
 	current_pcb->signal_pending = 0;
 	current_pcb->signal_mask = 0;
 	current_pcb->signal_waiting = false;
+	current_pcb->signal_suspended = false;
+	current_pcb->signal_from_user = 0;
 	current_pcb->signal_occurred = false;
+	current_thread->signal_deliver = 0;
+	memset(&current_thread->signal_stack, 0, sizeof(sigstack_t));
 	current_pcb->descriptor_lock = MUTEX_UNLOCKED;
 	current_pcb->lock = MUTEX_LOCKED;
 	memset(current_pcb->signal_handlers, 0, sizeof(sigaction_t) * NUMBER_OF_SIGNALS);
@@ -814,9 +1081,11 @@ pcb_t* load_task_replace(char* filename, const char** argv, const char** envp) {
 	current_pcb->user_mappings = NULL;
 	dylib_list_t* dylibs = current_pcb->dylibs;
 	current_pcb->dylibs = NULL;
+	current_pcb->bind_now = envp_wants_bind_now((const char**)kenvp);
 	thread_t* threads = current_pcb->threads;
 	
 	if (!load_task_into_memory(current_pcb, kfile)) {
+		mmap_list_dealloc_list(current_pcb->user_mappings);
 		*current_pcb = backup;
 		thread_list_restore_state(current_pcb->threads);
 		copy_task_arguments_free(kfile, kargv, kenvp);
@@ -828,6 +1097,7 @@ pcb_t* load_task_replace(char* filename, const char** argv, const char** envp) {
 	if (!load_argv_and_envp(current_pcb, (const char**)kargv, (const char**)kenvp, &argc)) {
 		kfree(current_pcb->threads);
 		page_list_dealloc(current_pcb->page_list);
+		mmap_list_dealloc_list(current_pcb->user_mappings);
 		*current_pcb = backup;
 		*current_thread = backup_thread;
 		thread_list_restore_state(current_pcb->threads);
@@ -842,6 +1112,7 @@ pcb_t* load_task_replace(char* filename, const char** argv, const char** envp) {
 	if (!setup_stack_and_heap(current_pcb, argc)) {
 		kfree(current_pcb->threads);
 		page_list_dealloc(current_pcb->page_list);
+		mmap_list_dealloc_list(current_pcb->user_mappings);
 		*current_pcb = backup;
 		*current_thread = backup_thread;
 		thread_list_restore_state(current_pcb->threads);
@@ -851,6 +1122,8 @@ pcb_t* load_task_replace(char* filename, const char** argv, const char** envp) {
 	
 	// Initialize the dylibs (TODO: perform this in userspace)
 	page_list_map_list(current_pcb->page_list, false);
+	tls_setup_thread(current_pcb, current_thread, current_thread->tls_base);
+	set_tls_base(current_thread->tls_base);
 	up(&current_pcb->lock);
 	dylib_list_perform_init(current_pcb->dylibs->next);
 	down(&current_pcb->lock);
@@ -865,15 +1138,22 @@ pcb_t* load_task_replace(char* filename, const char** argv, const char** envp) {
 	else
 		threads = next;
 	
-	// Free old memory
+	// Free old memory (or give it back if it was borrowed through vfork)
 	thread_list_dealloc(&threads);
-	page_list_dealloc(list);
-	page_list_dealloc(tlist);
-	mmap_list_dealloc_list(maps);
-	dylib_list_dealloc(dylibs);
+	if (current_pcb->vfork_thread)
+		vfork_release(current_pcb, list, tlist, maps, dylibs, backup.brk);
+	else {
+		page_list_dealloc(list);
+		page_list_dealloc(tlist);
+		mmap_list_dealloc_list(maps);
+		dylib_list_dealloc(dylibs);
+	}
 	
 	up(&current_pcb->lock);
 	
+	// Close the descriptors marked FD_CLOEXEC
+	descriptors_close_on_exec(current_pcb);
+	
 	map_task_into_memory(current_pcb);
 	
 	return current_pcb;
@@ -945,19 +1225,23 @@ void terminate_task(uint32_t ret) {
 	if (current->working_dir)
 		kfree(current->working_dir);
 	
-	// Free the task memory and dylibs allocated by the deleted task
+	// Free the task memory and dylibs allocated by the deleted task (or give them back if they were borrowed through vfork)
 	page_list_t* page_list = current->page_list;
 	page_list_t* temp_list = current->temporary_mappings;
 	mmap_list_t* maps = current->user_mappings;
+	dylib_list_t* dylibs = current->dylibs;
 	current->page_list = NULL;
 	current->temporary_mappings = NULL;
-	page_list_dealloc(page_list);
-	page_list_dealloc(temp_list);
-	mmap_list_dealloc_list(maps);
-	
-	dylib_list_t* dylibs = current->dylibs;
+	current->user_mappings = NULL;
 	current->dylibs = NULL;
-	dylib_list_dealloc(dylibs);
+	if (current->vfork_thread)
+		vfork_release(current, page_list, temp_list, maps, dylibs, current->brk);
+	else {
+		page_list_dealloc(page_list);
+		page_list_dealloc(temp_list);
+		mmap_list_dealloc_list(maps);
+		dylib_list_dealloc(dylibs);
+	}
 	
 	// Descriptors
 	pcb_free_descriptors(current);
@@ -1027,9 +1311,11 @@ void set_current_task(pcb_t* pcb, thread_t* thread) {
 	
 	if (pcb) {
 		set_kernel_stack((uint32_t)thread + USER_KERNEL_STACK_SIZE);
-		if (pcb != backup) {
+		set_tls_base(thread->tls_base);
+		// Kernel threads never touch user memory, so whatever program was mapped can stay
+		if (pcb != backup && !pcb->kernel_thread) {
 			map_task_into_memory(pcb);
-			descriptors = pcb->descriptors;
+			set_current_descriptors(pcb->descriptors);
 		}
 	}
 }
@@ -1060,6 +1346,9 @@ void context_switch(thread_t* from, thread_t* to) {
 			from->state = READY;
 		from->pcb->state = READY;
 	}
+	if (to != from)
+		to->switches++;
+	
 	// TODO: this is just for kernel shell test, also will never happen in real life
 	if (to->state != UNLOADED) {
 		to->state = RUNNING;
@@ -1072,6 +1361,61 @@ void context_switch(thread_t* from, thread_t* to) {
 	context_switch_asm(from, to);
 }
 
+// Get ready to sleep (must be called before checking the condition being waited for)
+void thread_sleep_prepare() {
+	if (current_thread)
+		current_thread->woken = false;
+}
+
+// Sleep the current thread until it is woken up, a signal occurs, or end is reached (if not NULL).
+// Returns whether the thread was woken up
+bool thread_sleep(struct timeval* end) {
+	thread_t* t = current_thread;
+	if (!t) {
+		// Nothing to sleep on before multitasking starts
+		schedule();
+		return false;
+	}
+	
+	// A wake up that happened after thread_sleep_prepare shouldn't be lost
+	uint32_t flags;
+	cli_and_save(flags);
+	if (!t->woken) {
+		t->sleep_timed = (end != NULL);
+		if (end)
+			t->sleep_end = *end;
+		t->sleeping = true;
+	}
+	restore_flags(flags);
+	
+	while (t->sleeping && !t->pcb->should_terminate && !signal_occurring(t->pcb))
+		schedule();
+	t->sleeping = false;
+	
+	return t->woken;
+}
+
+// Wake up a thread (safe to call from interrupts)
+void thread_wake(thread_t* t) {
+	if (!t)
+		return;
+	t->woken = true;
+	t->sleeping = false;
+}
+
+// Check if a sleeping thread should be woken up (timeouts, signals and termination)
+bool thread_awake(thread_t* t) {
+	if (!t->sleeping)
+		return true;
+	
+	if ((t->sleep_timed && !time_less(time_get(), t->sleep_end)) ||
+		t->pcb->should_terminate || signal_pending(t->pcb)) {
+		t->sleeping = false;
+		return true;
+	}
+	return false;
+}
+
 // Find the next runnable thread
 thread_t* get_next_runnable_thread(thread_t* hint) {
 	thread_t* t = hint;
@@ -1105,7 +1449,7 @@ thread_t* get_next_runnable_thread(thread_t* hint) {
 	pcb_t* pcb = t->pcb;
 	thread_t* initial = t;
 	do {
-		if (t->state == READY && (t->pcb->state == READY || t->pcb->state == RUNNING))
+		if (t->state == READY && (t->pcb->state == READY || t->pcb->state == RUNNING) && thread_awake(t))
 			return t;
 		thread_t* prev = t;
 		t = t->next;
@@ -1119,7 +1463,7 @@ thread_t* get_next_runnable_thread(thread_t* hint) {
 	} while (t != initial);
 	
 	if ((t->state == READY || t->state == RUNNING) &&
-		  (t->pcb->state == READY || t->pcb->state == RUNNING))
+		  (t->pcb->state == READY || t->pcb->state == RUNNING) && thread_awake(t))
 		return t;
 	return NULL;
 }
@@ -1129,6 +1473,8 @@ void scheduler_tick() {
 	static int counter = 0;
 	// Increment the current time and perform scheduling if needed
 	time_increment_ms(1);
+	if (current_thread)
+		current_thread->ticks++;
 	
 	counter++;
 	if (counter == 20) {
@@ -20,6 +20,10 @@
 #define INITIAL_TASK_PID			1
 #define MAIN_THREAD_TID				1
 
+// Space at each thread's thread pointer (%gs:0) for the C library. The first word points
+// to itself and the rest is the library's. The TLS blocks of the program and its dylibs sit below it
+#define TLS_TCB_SIZE				1024
+
 typedef enum {
 	UNLOADED = 0,					// Context is not on the stack
 	SUSPENDED,						// Not ready to execute (contents on stack)
@@ -29,6 +33,7 @@ typedef enum {
 } thread_state;
 
 struct pcb;
+struct spawn_info;
 
 // Linked List for keeping track of all the tasks
 typedef struct task_list {
@@ -46,6 +51,15 @@ typedef struct task_list {
 // List for all the running tasks
 extern task_list_t* tasks;
 
+// What the processor pushes when entering the kernel from a program (and pops with iret)
+typedef struct {
+	uint32_t eip;
+	uint32_t cs;
+	uint32_t eflags;
+	uint32_t esp;
+	uint32_t ss;
+} iret_t;
+
 typedef struct thread {
 	// The esp to return to when resuming a thread (must be first parameter, 0)
 	uint32_t saved_esp;
@@ -70,6 +84,27 @@ typedef struct thread {
 	uint8_t* sse_registers;
 	bool sse_used;
 	bool sse_init;
+	
+	// Scheduler statistics
+	uint32_t ticks;					// Timer ticks spent running
+	uint32_t switches;				// Times this thread was switched to
+	
+	// Sleeping on a wait queue (the scheduler skips sleeping threads)
+	volatile bool sleeping;
+	volatile bool woken;			// Set by thread_wake (cleared by thread_sleep_prepare)
+	bool sleep_timed;
+	struct timeval sleep_end;		// When to stop sleeping if sleep_timed is set
+	
+	// Lent the task's memory to a vfork'd child and waiting to get it back
+	volatile bool vfork_waiting;
+	
+	// Thread pointer (the base of %gs)
+	uint32_t tls_base;
+	
+	// Caught signal whose handler runs when the thread goes back to the program (0 if none)
+	uint32_t signal_deliver;
+	// Alternate stack for handlers (sigaltstack)
+	sigstack_t signal_stack;
 } thread_t;
 
 // The current thread
@@ -90,6 +125,8 @@ typedef struct pcb {
 	
 	// Overall state of the task
 	thread_state state;
+	// Runs only in the kernel and has no address space of its own (see kernel_thread_create)
+	bool kernel_thread;
 	
 	// Each entry in the list holds the physical address of the
 	// corresponding 4MB page starting at 0x8000000
@@ -101,7 +138,7 @@ typedef struct pcb {
 	mmap_list_t* user_mappings;
 	
 	// The file descriptors for this task
-	file_descriptor_t* descriptors[NUMBER_OF_DESCRIPTORS];
+	descriptor_table_t* descriptors;
 	mutex_t descriptor_lock;
 	mutex_t lock;
 	
@@ -125,13 +162,31 @@ typedef struct pcb {
 	// Signal things
 	sigset_t signal_pending;
 	sigset_t signal_mask;
-	sigset_t signal_save_mask[NUMBER_OF_SIGNALS];
+	sigset_t signal_suspend_mask;		// Mask from before sigsuspend
+	bool signal_suspended;				// sigsuspend ended with a caught signal (its handler restores the mask)
+	sigset_t signal_from_user;			// Pending signals sent with kill
 	sigaction_t signal_handlers[NUMBER_OF_SIGNALS];
 	volatile bool signal_waiting;
 	time_t alarm;
 	
 	// Dynamic objects
 	dylib_list_t* dylibs;
+	bool bind_now;					// Bind functions at load instead of on their first call (LD_BIND_NOW)
+	
+	// The program's TLS template (from PT_TLS) and how much space every module's TLS
+	// needs below the thread pointer
+	uint32_t tls_image;
+	uint32_t tls_image_size;
+	uint32_t tls_size;
+	uint32_t tls_align;
+	uint32_t tls_offset;			// The program's block is at the thread pointer minus this
+	uint32_t tls_total_size;
+	uint32_t tls_total_align;
+	
+	// Set while a vfork'd task is using its parent's memory (the parent's thread that is waiting for it)
+	thread_t* vfork_thread;
+	// What a posix_spawn'd task loads and does to its descriptors when it first runs
+	struct spawn_info* spawn_info;
 } pcb_t;
 
 // The current pcb
@@ -143,21 +198,63 @@ thread_t* thread_create(pcb_t* pcb);
 // Create a copy of a thread
 thread_t* thread_copy(thread_t* t, pcb_t* new_pcb, bool exact);
 
+// Create a thread that runs func(arg) in the kernel
+pcb_t* kernel_thread_create(void (*func)(void*), void* arg);
+
 // Gets the pcb for a pid
 pcb_t* pcb_from_pid(uint32_t pid);
 
+// Call a function with the locked pcb for a pid (returns false if there is no such task)
+bool pcb_perform_for_pid(uint32_t pid, void (*func)(pcb_t* pcb, void* data), void* data);
+
+// Get the pids of all the tasks (returns the number of tasks, which can be more than max)
+uint32_t task_list_get_pids(uint32_t* pids, uint32_t max);
+
+// Get ready to sleep (must be called before checking the condition being waited for)
+void thread_sleep_prepare();
+
+// Sleep the current thread until it is woken up, a signal occurs, or end is reached (if not NULL).
+// Returns whether the thread was woken up
+bool thread_sleep(struct timeval* end);
+
+// Wake up a thread (safe to call from interrupts)
+void thread_wake(thread_t* t);
+
 // Sets the kernel stack in the TSS
 void set_kernel_stack(uint32_t address);
 
+// Sets the base of the TLS segment and reloads %gs with it
+void set_tls_base(uint32_t address);
+
+// Set up a thread's TLS blocks and TCB with the thread pointer at tp
+void tls_setup_thread(pcb_t* pcb, thread_t* t, uint32_t tp);
+
 // Duplicate current task (fork)
 pcb_t* duplicate_current_task();
 
+// Create a task that uses the current task's memory until it execs or exits (vfork)
+pcb_t* vfork_current_task();
+
+// Create a child task without any memory (posix_spawn loads the program into it once it runs)
+pcb_t* spawn_current_task();
+
+// Give a vfork'd task's memory back to the thread waiting for it
+void vfork_release(pcb_t* pcb, page_list_t* list, page_list_t* tlist, mmap_list_t* maps, dylib_list_t* dylibs, uint32_t brk);
+
+// Close a task's descriptors
+void pcb_free_descriptors(pcb_t* pcb);
+
 // Load a task into memory
 pcb_t* load_task(char* filename, const char** argv, const char** envp);
 
 // Load a task into memory, replacing the current task
 pcb_t* load_task_replace(char* filename, const char** argv, const char** envp);
 
+// Copy a program's path and arguments into the kernel (and free them)
+bool copy_task_arguments(char* filename, const char** argv, const char** envp,
+						 char** file_out, char*** argv_out, char*** envp_out);
+void copy_task_arguments_free(char* kfile, char** kargv, char** kenvp);
+
 // Unload a task from page mappings
 pcb_t* unload_current_task();
 
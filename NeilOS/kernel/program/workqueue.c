@@ -0,0 +1,193 @@
+//
+//  workqueue.c
+//  NeilOS
+//
+
+#include "workqueue.h"
+#include <program/task.h>
+#include <common/lib.h>
+
+workqueue_t system_workqueue;
+
+// Tasklets waiting for the end of the interrupt
+tasklet_t* tasklet_head = NULL;
+tasklet_t* tasklet_tail = NULL;
+bool tasklets_running = false;
+
+// Take the next piece of work off a workqueue and mark it running (NULL if there isn't any)
+work_t* workqueue_next(workqueue_t* wq) {
+	uint32_t flags;
+	spin_lock_irqsave(&wq->lock, flags);
+	work_t* work = wq->head;
+	if (work) {
+		wq->head = work->next;
+		if (!wq->head)
+			wq->tail = NULL;
+		work->next = NULL;
+		work->pending = false;
+		wq->running = work;
+	}
+	spin_unlock_irqrestore(&wq->lock, flags);
+	
+	return work;
+}
+
+// The thread behind a workqueue
+void workqueue_thread(void* arg) {
+	workqueue_t* wq = (workqueue_t*)arg;
+	
+	for (;;) {
+		// Get on the wait queue before looking so work queued in between still wakes us up
+		wait_queue_entry_t entry;
+		wait_queue_add_current(&wq->worker_wait, &entry);
+		work_t* work = workqueue_next(wq);
+		if (!work)
+			thread_sleep(NULL);
+		wait_queue_remove(&entry);
+		if (!work)
+			continue;
+	
+		work->func(work);
+	
+		wq->running = NULL;
+		wait_queue_wake(&wq->flush_wait, 0);
+	}
+}
+
+// Initialize a workqueue and start its thread (NULL on failure)
+workqueue_t* workqueue_create(workqueue_t* wq) {
+	memset(wq, 0, sizeof(workqueue_t));
+	wq->lock = SPIN_LOCK_UNLOCKED;
+	wq->worker_wait = WAIT_QUEUE_EMPTY;
+	wq->flush_wait = WAIT_QUEUE_EMPTY;
+	wq->worker = kernel_thread_create(workqueue_thread, wq);
+	if (!wq->worker)
+		return NULL;
+	
+	return wq;
+}
+
+// Start the kernel's shared workqueue (work queued before this runs once it starts). Called with interrupts off
+void workqueue_init() {
+	// Drivers can queue work before this (like the keyboard), so keep it for the thread
+	work_t* head = system_workqueue.head;
+	work_t* tail = system_workqueue.tail;
+	if (!workqueue_create(&system_workqueue))
+		blue_screen("Unable to start the system workqueue");
+	system_workqueue.head = head;
+	system_workqueue.tail = tail;
+}
+
+// Queue work to run on a workqueue (NULL for the shared one). Returns false if it was already
+// waiting to run. Safe to call from interrupts
+bool queue_work(workqueue_t* wq, work_t* work) {
+	if (!wq)
+		wq = &system_workqueue;
+	
+	uint32_t flags;
+	spin_lock_irqsave(&wq->lock, flags);
+	if (work->pending) {
+		spin_unlock_irqrestore(&wq->lock, flags);
+		return false;
+	}
+	work->pending = true;
+	work->queue = wq;
+	work->next = NULL;
+	if (wq->tail)
+		wq->tail->next = work;
+	else
+		wq->head = work;
+	wq->tail = work;
+	spin_unlock_irqrestore(&wq->lock, flags);
+	
+	wait_queue_wake(&wq->worker_wait, 0);
+	return true;
+}
+
+// Wait until work isn't queued or running anymore
+void flush_work(work_t* work) {
+	workqueue_t* wq = work->queue;
+	// The workqueue's own thread would be waiting on itself
+	if (!wq || !current_pcb || current_pcb == wq->worker)
+		return;
+	
+	for (;;) {
+		wait_queue_entry_t entry;
+		wait_queue_add_current(&wq->flush_wait, &entry);
+		bool busy = (work->pending || wq->running == work);
+		if (busy)
+			thread_sleep(NULL);
+		wait_queue_remove(&entry);
+		if (!busy)
+			break;
+	}
+}
+
+// Marks where flush_workqueue has to wait until
+void workqueue_barrier(work_t* work) {
+}
+
+// Wait until everything queued on a workqueue so far has run
+void flush_workqueue(workqueue_t* wq) {
+	if (!wq)
+		wq = &system_workqueue;
+	// Nothing can sleep before the first task exists, and the barrier can't be left queued on our stack
+	if (!current_pcb)
+		return;
+	// The workqueue's own thread would never get to the barrier
+	if (current_pcb == wq->worker)
+		blue_screen("Flushing a workqueue from its own thread");
+	
+	work_t barrier = WORK_INIT(workqueue_barrier, NULL);
+	queue_work(wq, &barrier);
+	flush_work(&barrier);
+}
+
+// Have a tasklet run when the current interrupt finishes. Returns false if it was already waiting
+bool tasklet_schedule(tasklet_t* tasklet) {
+	uint32_t flags;
+	cli_and_save(flags);
+	if (tasklet->scheduled) {
+		restore_flags(flags);
+		return false;
+	}
+	tasklet->scheduled = true;
+	tasklet->next = NULL;
+	if (tasklet_tail)
+		tasklet_tail->next = tasklet;
+	else
+		tasklet_head = tasklet;
+	tasklet_tail = tasklet;
+	restore_flags(flags);
+	
+	return true;
+}
+
+// Run the tasklets that are waiting (called at the end of each PIC interrupt)
+void tasklet_run_pending() {
+	uint32_t flags;
+	cli_and_save(flags);
+	// An interrupt that comes in while they run leaves its tasklets to the loop already running
+	if (tasklets_running || !tasklet_head) {
+		restore_flags(flags);
+		return;
+	}
+	tasklets_running = true;
+	
+	while (tasklet_head) {
+		tasklet_t* tasklet = tasklet_head;
+		tasklet_head = tasklet->next;
+		if (!tasklet_head)
+			tasklet_tail = NULL;
+		tasklet->next = NULL;
+		// It can be scheduled again while it runs
+		tasklet->scheduled = false;
+	
+		sti();
+		tasklet->func(tasklet->data);
+		cli();
+	}
+	
+	tasklets_running = false;
+	restore_flags(flags);
+}
@@ -0,0 +1,76 @@
+//
+//  workqueue.h
+//  NeilOS
+//
+
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <common/types.h>
+#include <common/concurrency/spinlock.h>
+#include <common/concurrency/wait_queue.h>
+
+struct pcb;
+struct workqueue;
+
+#define WORK_INIT(f, d)			(work_t){ .func = f, .data = d, .pending = false, .queue = NULL, .next = NULL }
+#define TASKLET_INIT(f, d)		(tasklet_t){ .func = f, .data = d, .scheduled = false, .next = NULL }
+
+// Something to run later in a kernel thread (so it can sleep and take semaphores)
+typedef struct work {
+	void (*func)(struct work* work);
+	void* data;
+	
+	volatile bool pending;			// Queued but hasn't started running yet
+	struct workqueue* queue;		// Where it was last queued
+	struct work* next;
+} work_t;
+
+// A kernel thread that runs queued work in order
+typedef struct workqueue {
+	spinlock_t lock;
+	work_t* head;
+	work_t* tail;
+	work_t* volatile running;		// What the thread is in the middle of
+	
+	wait_queue_t worker_wait;		// The thread waits here for work
+	wait_queue_t flush_wait;		// flush_work waits here for the thread to finish something
+	struct pcb* worker;
+} workqueue_t;
+
+// Something to run on the way out of an interrupt with interrupts back on (can't sleep, but
+// the interrupt handler can return right away). A tasklet never runs more than once at a time
+typedef struct tasklet {
+	void (*func)(void* data);
+	void* data;
+	
+	volatile bool scheduled;
+	struct tasklet* next;
+} tasklet_t;
+
+// The kernel's shared workqueue
+extern workqueue_t system_workqueue;
+
+// Initialize a workqueue and start its thread (NULL on failure)
+workqueue_t* workqueue_create(workqueue_t* wq);
+
+// Start the kernel's shared workqueue
+void workqueue_init();
+
+// Queue work to run on a workqueue (NULL for the shared one). Returns false if it was already
+// waiting to run. Safe to call from interrupts
+bool queue_work(workqueue_t* wq, work_t* work);
+
+// Wait until work isn't queued or running anymore
+void flush_work(work_t* work);
+
+// Wait until everything queued on a workqueue so far has run
+void flush_workqueue(workqueue_t* wq);
+
+// Have a tasklet run when the current interrupt finishes. Returns false if it was already waiting
+bool tasklet_schedule(tasklet_t* tasklet);
+
+// Run the tasklets that are waiting (called at the end of each PIC interrupt)
+void tasklet_run_pending();
+
+#endif /* WORKQUEUE_H */
@@ -8,6 +8,7 @@
 
 #include "descriptor.h"
 #include <memory/allocation/heap.h>
+#include <common/lib.h>
 
 bool file_descriptor_release(file_descriptor_t* f) {
 	if (--f->ref_count == 0) {
@@ -19,3 +20,227 @@ bool file_descriptor_release(file_descriptor_t* f) {
 	}
 	return false;
 }
+
+// Read into multiple buffers using the vectored call if the descriptor has one
+uint32_t file_descriptor_readv(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt) {
+	if (f->readv)
+		return f->readv(f, iov, iovcnt);
+	
+	// Otherwise read each buffer in turn until a short read
+	uint32_t total = 0;
+	for (uint32_t z = 0; z < iovcnt; z++) {
+		if (iov[z].length == 0)
+			continue;
+		
+		uint32_t ret = f->read(f, iov[z].base, iov[z].length);
+		if ((int32_t)ret < 0) {
+			if (total == 0)
+				total = ret;
+			break;
+		}
+		
+		total += ret;
+		if (ret < iov[z].length)
+			break;
+	}
+	
+	return total;
+}
+
+// Write from multiple buffers using the vectored call if the descriptor has one
+uint32_t file_descriptor_writev(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt) {
+	if (f->writev)
+		return f->writev(f, iov, iovcnt);
+	
+	// Otherwise write each buffer in turn until a short write
+	uint32_t total = 0;
+	for (uint32_t z = 0; z < iovcnt; z++) {
+		if (iov[z].length == 0)
+			continue;
+		
+		uint32_t ret = f->write(f, iov[z].base, iov[z].length);
+		if ((int32_t)ret < 0) {
+			if (total == 0)
+				total = ret;
+			break;
+		}
+		
+		total += ret;
+		if (ret < iov[z].length)
+			break;
+	}
+	
+	return total;
+}
+
+// Check which of POLLIN / POLLOUT are ready on a descriptor (must hold its lock)
+uint32_t file_descriptor_poll(file_descriptor_t* f, uint32_t events) {
+	if (f->closed)
+		return POLLNVAL;
+	
+	// Regular files never block
+	bool regular = (f->mode & FILE_TYPE_ALL) == FILE_TYPE_REGULAR;
+	uint32_t ret = 0;
+	if ((events & POLLIN) && (f->can_read ? f->can_read(f) : (regular && f->read)))
+		ret |= POLLIN;
+	if ((events & POLLOUT) && (f->can_write ? f->can_write(f) : (regular && f->write)))
+		ret |= POLLOUT;
+	
+	return ret;
+}
+
+// Bytes needed for a table's entries (descriptors, then flags, then the used bitmap)
+static inline uint32_t descriptor_table_bytes(uint32_t size) {
+	return size * (sizeof(file_descriptor_t*) + sizeof(uint8_t)) + size / 8;
+}
+
+// Point a table's entries into a block of memory
+static inline void descriptor_table_layout(descriptor_table_t* t, void* mem, uint32_t size) {
+	t->files = (file_descriptor_t**)mem;
+	t->flags = (uint8_t*)&t->files[size];
+	t->used = (uint32_t*)&t->flags[size];
+	t->size = size;
+}
+
+// Create an empty table
+descriptor_table_t* descriptor_table_alloc(uint32_t size) {
+	size = (size + 31) & ~31;
+	if (size == 0 || size > NUMBER_OF_DESCRIPTORS)
+		return NULL;
+	
+	descriptor_table_t* t = (descriptor_table_t*)kmalloc(sizeof(descriptor_table_t));
+	if (!t)
+		return NULL;
+	void* mem = kmalloc(descriptor_table_bytes(size));
+	if (!mem) {
+		kfree(t);
+		return NULL;
+	}
+	memset(mem, 0, descriptor_table_bytes(size));
+	descriptor_table_layout(t, mem, size);
+	
+	return t;
+}
+
+// Copy a table for a forked task (the descriptors get duplicated)
+descriptor_table_t* descriptor_table_copy(descriptor_table_t* t) {
+	descriptor_table_t* c = descriptor_table_alloc(t->size);
+	if (!c)
+		return NULL;
+	
+	for (uint32_t z = 0; z < t->size; z++) {
+		file_descriptor_t* f = t->files[z];
+		if (!f)
+			continue;
+		
+		down(&f->lock);
+		// Check if this is has already been duplicated
+		if (f->ref_count > 1) {
+			// Check if we've already seen it
+			uint32_t i;
+			bool found = false;
+			for (i = 0; i < z; i++) {
+				if (t->files[i] == f) {
+					found = true;
+					break;
+				}
+			}
+			if (found) {
+				descriptor_table_set(c, z, c->files[i], t->flags[z]);
+				up(&f->lock);
+				continue;
+			}
+		}
+		// Otherwise, duplicate it
+		file_descriptor_t* d = f->duplicate(f);
+		up(&f->lock);
+		if (!d) {
+			descriptor_table_free(c);
+			return NULL;
+		}
+		descriptor_table_set(c, z, d, t->flags[z]);
+	}
+	
+	return c;
+}
+
+// Make room for at least size descriptors
+bool descriptor_table_grow(descriptor_table_t* t, uint32_t size) {
+	if (size <= t->size)
+		return true;
+	if (size > NUMBER_OF_DESCRIPTORS)
+		return false;
+	
+	// Double the size so that growing one at a time doesn't copy every time
+	uint32_t nsize = t->size * 2;
+	if (nsize < size)
+		nsize = (size + 31) & ~31;
+	if (nsize > NUMBER_OF_DESCRIPTORS)
+		nsize = NUMBER_OF_DESCRIPTORS;
+	
+	void* mem = kmalloc(descriptor_table_bytes(nsize));
+	if (!mem)
+		return false;
+	memset(mem, 0, descriptor_table_bytes(nsize));
+	descriptor_table_t n;
+	descriptor_table_layout(&n, mem, nsize);
+	memcpy(n.files, t->files, t->size * sizeof(file_descriptor_t*));
+	memcpy(n.flags, t->flags, t->size * sizeof(uint8_t));
+	memcpy(n.used, t->used, t->size / 8);
+	
+	// Interrupt handlers can walk the table (see rtc.c), so swap it in atomically
+	void* old = t->files;
+	uint32_t flags;
+	cli_and_save(flags);
+	descriptor_table_layout(t, mem, nsize);
+	restore_flags(flags);
+	kfree(old);
+	
+	return true;
+}
+
+// Close the descriptors and free a table
+void descriptor_table_free(descriptor_table_t* t) {
+	for (uint32_t z = 0; z < t->size; z++) {
+		file_descriptor_t* f = t->files[z];
+		if (!f)
+			continue;
+		down(&f->lock);
+		f->closed = true;
+		// Let anything waiting on it know
+		if (f->wait_queue)
+			wait_queue_wake(f->wait_queue, POLLNVAL);
+		if (!file_descriptor_release(f))
+			up(&f->lock);
+	}
+	kfree(t->files);
+	kfree(t);
+}
+
+// Find the lowest unused descriptor at or above start (-1 if the table is full)
+int32_t descriptor_table_find_free(descriptor_table_t* t, uint32_t start) {
+	for (uint32_t word = start / 32; word < t->size / 32; word++) {
+		uint32_t free = ~t->used[word];
+		// Skip the descriptors before start in its word
+		if (word == start / 32)
+			free &= ~((1 << (start % 32)) - 1);
+		if (free)
+			return word * 32 + __builtin_ctz(free);
+	}
+	
+	return -1;
+}
+
+// Set an entry
+void descriptor_table_set(descriptor_table_t* t, uint32_t fd, file_descriptor_t* f, uint8_t flags) {
+	t->files[fd] = f;
+	t->flags[fd] = flags;
+	t->used[fd / 32] |= (1 << (fd % 32));
+}
+
+// Clear an entry
+void descriptor_table_clear(descriptor_table_t* t, uint32_t fd) {
+	t->files[fd] = NULL;
+	t->flags[fd] = 0;
+	t->used[fd / 32] &= ~(1 << (fd % 32));
+}
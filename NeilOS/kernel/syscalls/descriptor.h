@@ -11,6 +11,7 @@
 
 #include <common/time.h>
 #include <common/concurrency/semaphore.h>
+#include <common/concurrency/wait_queue.h>
 
 // File types
 #define FILE_FILE_TYPE			0
@@ -34,6 +35,7 @@
 #define FILE_MODE_DELETE_ON_CLOSE	0x100
 #define FILE_MODE_EXCLUSIVE			0x800
 #define FILE_MODE_NONBLOCKING		0x4000
+#define FILE_MODE_CLOSE_ON_EXEC		0x40000		// Only for open (becomes FD_CLOEXEC)
 
 // Types of device (goes in mode)
 #define		FILE_TYPE_DIRECTORY		0040000
@@ -45,6 +47,14 @@
 #define		FILE_TYPE_PIPE			0010000
 #define		FILE_TYPE_ALL			(~(0010000 - 1))
 
+// Readiness events (for poll, epoll and wait queues)
+#define POLLIN			0x001
+#define POLLPRI			0x002
+#define POLLOUT			0x004
+#define POLLERR			0x008
+#define POLLHUP			0x010
+#define POLLNVAL		0x020
+
 // For llseek
 #define SEEK_SET		0
 #define SEEK_CUR		1
@@ -87,6 +97,15 @@ typedef	struct {
 	uint32_t bits[2];
 } fd_set;
 
+// Buffer for readv / writev (same layout as struct iovec)
+typedef struct {
+	void* base;
+	uint32_t length;
+} iovec_t;
+
+// Max number of buffers in a readv / writev
+#define IOV_MAX			1024
+
 // File descriptor
 typedef struct file_descriptor {
 	char* filename;
@@ -97,13 +116,22 @@ typedef struct file_descriptor {
 	
 	// File dependent data
 	void* info;
+	// Woken up when the descriptor may have become readable or writable (NULL means it has to be polled)
+	wait_queue_t* wait_queue;
 	
 	// Pointers for the syscalls
 	uint32_t (*read)(struct file_descriptor* f, void* buf, uint32_t nbytes);
 	uint32_t (*write)(struct file_descriptor* f, const void* buf, uint32_t nbytes);
 	uint64_t (*llseek)(struct file_descriptor* f, uint64_t offset, int whence);
+	// Optional positional and vectored I/O (readv / writev fall back to read / write)
+	uint32_t (*pread)(struct file_descriptor* f, void* buf, uint32_t nbytes, uint64_t offset);
+	uint32_t (*pwrite)(struct file_descriptor* f, const void* buf, uint32_t nbytes, uint64_t offset);
+	uint32_t (*readv)(struct file_descriptor* f, const iovec_t* iov, uint32_t iovcnt);
+	uint32_t (*writev)(struct file_descriptor* f, const iovec_t* iov, uint32_t iovcnt);
+	uint32_t (*getdents)(struct file_descriptor* f, void* buf, uint32_t size);
 	uint64_t (*truncate)(struct file_descriptor* f, uint64_t nsize);
 	uint32_t (*stat)(struct file_descriptor* f, sys_stat_type* data);
+	uint32_t (*fsync)(struct file_descriptor* f);
 	uint32_t (*ioctl)(struct file_descriptor* f, int request, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
 	bool (*can_read)(struct file_descriptor* f);
 	bool (*can_write)(struct file_descriptor* f);
@@ -120,9 +148,46 @@ static inline void file_descriptor_retain(file_descriptor_t* f) {
 
 bool file_descriptor_release(file_descriptor_t* f);
 
-// Avaiable descriptors
-#define NUMBER_OF_DESCRIPTORS	64
+// Read into / write from multiple buffers using the vectored call if the descriptor has one
+uint32_t file_descriptor_readv(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt);
+uint32_t file_descriptor_writev(file_descriptor_t* f, const iovec_t* iov, uint32_t iovcnt);
+
+// Check which of POLLIN / POLLOUT are ready on a descriptor (must hold its lock)
+uint32_t file_descriptor_poll(file_descriptor_t* f, uint32_t events);
+
+// Avaiable descriptors (a table starts smaller and grows up to this)
+#define NUMBER_OF_DESCRIPTORS			1024
+#define DESCRIPTOR_TABLE_INITIAL_SIZE	64			// Multiple of 32
+
+// Per-descriptor flags
+#define FD_CLOEXEC		0x1							// Close the descriptor on exec
+
+// A task's descriptors
+typedef struct {
+	file_descriptor_t** files;
+	uint8_t* flags;
+	uint32_t* used;					// Bit set for each open descriptor
+	uint32_t size;					// Multiple of 32
+} descriptor_table_t;
+
+// Create an empty table
+descriptor_table_t* descriptor_table_alloc(uint32_t size);
+// Copy a table for a forked task (the descriptors get duplicated)
+descriptor_table_t* descriptor_table_copy(descriptor_table_t* t);
+// Make room for at least size descriptors
+bool descriptor_table_grow(descriptor_table_t* t, uint32_t size);
+
+// Close the descriptors and free a table
+void descriptor_table_free(descriptor_table_t* t);
+
+// Find the lowest unused descriptor at or above start (-1 if the table is full)
+int32_t descriptor_table_find_free(descriptor_table_t* t, uint32_t start);
+// Set or clear an entry
+void descriptor_table_set(descriptor_table_t* t, uint32_t fd, file_descriptor_t* f, uint8_t flags);
+void descriptor_table_clear(descriptor_table_t* t, uint32_t fd);
+
 // Current task's descriptors
+extern descriptor_table_t* descriptor_table;
 extern file_descriptor_t** descriptors;
 
 #endif
@@ -20,8 +20,75 @@
 #include <syscalls/interrupt.h>
 #include <drivers/devices/devices.h>
 
+descriptor_table_t* descriptor_table = NULL;
 file_descriptor_t** descriptors = NULL;
 
+// Stands in for the table of a task without descriptors (so every descriptor is out of range)
+static descriptor_table_t no_descriptors = { .files = NULL, .size = 0 };
+
+// Make a table the current task's descriptors (NULL for a task without any)
+void set_current_descriptors(descriptor_table_t* t) {
+	descriptor_table = t ? t : &no_descriptors;
+	descriptors = descriptor_table->files;
+}
+
+// Get a descriptor ready to be set by growing the table (must hold descriptor_lock)
+int32_t descriptor_reserve(pcb_t* pcb, uint32_t fd) {
+	if (!pcb->descriptors || fd >= NUMBER_OF_DESCRIPTORS)
+		return -EBADF;
+	if (!descriptor_table_grow(pcb->descriptors, fd + 1))
+		return -ENOMEM;
+	if (pcb == current_pcb)
+		set_current_descriptors(pcb->descriptors);
+	
+	return 0;
+}
+
+// Reserve the lowest free descriptor at or above start (must hold descriptor_lock)
+int32_t descriptor_alloc(pcb_t* pcb, uint32_t start) {
+	if (!pcb->descriptors)
+		return -EBADF;
+	
+	int32_t fd = descriptor_table_find_free(pcb->descriptors, start);
+	if (fd != -1)
+		return fd;
+	
+	// The table is full, so the next one is past the end of it
+	fd = (start > pcb->descriptors->size) ? start : pcb->descriptors->size;
+	if (fd >= NUMBER_OF_DESCRIPTORS)
+		return -EMFILE;
+	int32_t ret = descriptor_reserve(pcb, fd);
+	
+	return (ret < 0) ? ret : fd;
+}
+
+// Take a descriptor out of the table and drop its reference (must hold descriptor_lock)
+void descriptor_remove(pcb_t* pcb, uint32_t fd) {
+	file_descriptor_t* d = pcb->descriptors->files[fd];
+	descriptor_table_clear(pcb->descriptors, fd);
+	
+	down(&d->lock);
+	d->closed = true;
+	// Let anything waiting on it know
+	if (d->wait_queue)
+		wait_queue_wake(d->wait_queue, POLLNVAL);
+	if (!file_descriptor_release(d))
+		up(&d->lock);
+}
+
+// Close the descriptors marked FD_CLOEXEC (for exec)
+void descriptors_close_on_exec(pcb_t* pcb) {
+	down(&pcb->descriptor_lock);
+	descriptor_table_t* t = pcb->descriptors;
+	if (t) {
+		for (uint32_t z = 0; z < t->size; z++) {
+			if (t->files[z] && (t->flags[z] & FD_CLOEXEC))
+				descriptor_remove(pcb, z);
+		}
+	}
+	up(&pcb->descriptor_lock);
+}
+
 file_descriptor_t* open_handle(const char* filename, uint32_t mode, uint32_t type) {
 	file_descriptor_t* f = NULL;
 	
@@ -58,31 +125,29 @@ file_descriptor_t* open_handle(const char* filename, uint32_t mode, uint32_t typ
 uint32_t open(const char* filename, uint32_t mode, uint32_t type) {
 	LOG_DEBUG_INFO_STR("(%s, %d, %d)", filename, mode, type);
 	
+	uint8_t flags = (mode & FILE_MODE_CLOSE_ON_EXEC) ? FD_CLOEXEC : 0;
+	mode &= ~FILE_MODE_CLOSE_ON_EXEC;
+	
 	// Find and open descriptor
 	pcb_t* pcb = current_pcb;
 	down(&pcb->descriptor_lock);
-	uint32_t current_fd = -1;
-	int z;								// Looping over descriptors
-	for (z = 0; z < NUMBER_OF_DESCRIPTORS; z++) {
-		if (!descriptors[z]) {
-			current_fd = z;
-			break;
-		}
-	}
+	int32_t current_fd = descriptor_alloc(pcb, 0);
 	
 	// We have no more descriptors available so we can't open anything
-	if (current_fd == -1) {
+	if (current_fd < 0) {
 		up(&pcb->descriptor_lock);
-        return -ENFILE;
+		return current_fd;
 	}
 	
 	char* path = path_absolute(filename, pcb->working_dir);
 
-	pcb->descriptors[current_fd] = open_handle(path, mode, type);
+	file_descriptor_t* f = open_handle(path, mode, type);
+	if (f)
+		descriptor_table_set(pcb->descriptors, current_fd, f, flags);
 	up(&pcb->descriptor_lock);
 	kfree(path);
 	
-	if (!pcb->descriptors[current_fd])
+	if (!f)
         return -ENOENT;
 	
 	return current_fd;
@@ -93,7 +158,7 @@ uint32_t read(uint32_t fd, void* buf, uint32_t nbytes) {
 	LOG_DEBUG_INFO_STR("(%d, 0x%x, 0x%x)", fd, buf, nbytes);
 	
 	// Check if the arguments are in range
-	if (fd >= NUMBER_OF_DESCRIPTORS)
+	if (fd >= descriptor_table->size)
 		return -EBADF;
 	if (!buf)
 		return -EFAULT;
@@ -130,7 +195,7 @@ uint32_t write(uint32_t fd, const void* buf, uint32_t nbytes) {
 	LOG_DEBUG_INFO_STR("(%d, 0x%x, %d)", fd, buf, nbytes);
 
     // Check if the arguments are in range
-	if (fd >= NUMBER_OF_DESCRIPTORS)
+	if (fd >= descriptor_table->size)
         return -EBADF;
 	if (!buf)
 		return -EFAULT;
@@ -162,12 +227,193 @@ uint32_t write(uint32_t fd, const void* buf, uint32_t nbytes) {
 	return ret;
 }
 
+// Read from a file descriptor at an offset without changing its position
+uint32_t pread(uint32_t fd, void* buf, uint32_t nbytes, uint32_t offset_high, uint32_t offset_low) {
+	LOG_DEBUG_INFO_STR("(%d, 0x%x, 0x%x, 0x%x, 0x%x)", fd, buf, nbytes, offset_high, offset_low);
+	
+	// Check if the arguments are in range
+	if (fd >= descriptor_table->size)
+		return -EBADF;
+	if (!buf)
+		return -EFAULT;
+	if ((int32_t)offset_high < 0)
+		return -EINVAL;
+	
+	down(&current_pcb->descriptor_lock);
+	
+	// If we are trying to use an invalid descriptor, return failure
+	if (!descriptors[fd] || !descriptors[fd]->read) {
+		up(&current_pcb->descriptor_lock);
+		return -EBADF;
+	}
+	
+	file_descriptor_t* d = descriptors[fd];
+	down(&d->lock);
+	file_descriptor_retain(d);
+	up(&current_pcb->descriptor_lock);
+	
+	uint32_t ret;
+	if (!(d->mode & FILE_MODE_READ))
+		ret = -EACCES;
+	else if (!d->pread)
+		ret = -ESPIPE;
+	else {
+		// The position isn't touched, so other threads can use the descriptor while we read
+		up(&d->lock);
+		ret = d->pread(d, buf, nbytes, ((uint64_t)offset_high << 32) | offset_low);
+		down(&d->lock);
+	}
+	
+	if (!file_descriptor_release(d))
+		up(&d->lock);
+	
+	return ret;
+}
+
+// Write to a file descriptor at an offset without changing its position
+uint32_t pwrite(uint32_t fd, const void* buf, uint32_t nbytes, uint32_t offset_high, uint32_t offset_low) {
+	LOG_DEBUG_INFO_STR("(%d, 0x%x, 0x%x, 0x%x, 0x%x)", fd, buf, nbytes, offset_high, offset_low);
+	
+	// Check if the arguments are in range
+	if (fd >= descriptor_table->size)
+		return -EBADF;
+	if (!buf)
+		return -EFAULT;
+	if ((int32_t)offset_high < 0)
+		return -EINVAL;
+	
+	down(&current_pcb->descriptor_lock);
+	
+	// If we are trying to use an invalid descriptor, return failure
+	if (!descriptors[fd] || !descriptors[fd]->write) {
+		up(&current_pcb->descriptor_lock);
+		return -EBADF;
+	}
+	
+	file_descriptor_t* d = descriptors[fd];
+	down(&d->lock);
+	file_descriptor_retain(d);
+	up(&current_pcb->descriptor_lock);
+	
+	uint32_t ret;
+	if (!((d->mode & FILE_MODE_WRITE) || (d->mode & FILE_MODE_APPEND)))
+		ret = -EACCES;
+	else if (!d->pwrite)
+		ret = -ESPIPE;
+	else {
+		// The position isn't touched, so other threads can use the descriptor while we write
+		up(&d->lock);
+		ret = d->pwrite(d, buf, nbytes, ((uint64_t)offset_high << 32) | offset_low);
+		down(&d->lock);
+	}
+	
+	if (!file_descriptor_release(d))
+		up(&d->lock);
+	
+	return ret;
+}
+
+// Check that a list of buffers is usable and doesn't overflow the return value
+uint32_t iovec_check(const iovec_t* iov, uint32_t iovcnt) {
+	if (iovcnt > IOV_MAX)
+		return -EINVAL;
+	if (!iov)
+		return -EFAULT;
+	
+	uint32_t total = 0;
+	for (uint32_t z = 0; z < iovcnt; z++) {
+		if (!iov[z].base && iov[z].length != 0)
+			return -EFAULT;
+		if (iov[z].length > 0x7FFFFFFF - total)
+			return -EINVAL;
+		total += iov[z].length;
+	}
+	
+	return 0;
+}
+
+// Read from a file descriptor into multiple buffers
+uint32_t readv(uint32_t fd, const iovec_t* iov, uint32_t iovcnt) {
+	LOG_DEBUG_INFO_STR("(%d, 0x%x, %d)", fd, iov, iovcnt);
+	
+	// Check if the arguments are in range
+	if (fd >= descriptor_table->size)
+		return -EBADF;
+	uint32_t ret = iovec_check(iov, iovcnt);
+	if (ret != 0)
+		return ret;
+	
+	down(&current_pcb->descriptor_lock);
+	
+	// If we are trying to use an invalid descriptor, return failure
+	if (!descriptors[fd] || !descriptors[fd]->read) {
+		up(&current_pcb->descriptor_lock);
+		return -EBADF;
+	}
+	
+	file_descriptor_t* d = descriptors[fd];
+	down(&d->lock);
+	file_descriptor_retain(d);
+	up(&current_pcb->descriptor_lock);
+	
+	if (!(d->mode & FILE_MODE_READ)) {
+		if (!file_descriptor_release(d))
+			up(&d->lock);
+		return -EACCES;
+	}
+	
+	// Call to the driver specific call
+	ret = file_descriptor_readv(d, iov, iovcnt);
+	if (!file_descriptor_release(d))
+		up(&d->lock);
+	
+	return ret;
+}
+
+// Write to a file descriptor from multiple buffers
+uint32_t writev(uint32_t fd, const iovec_t* iov, uint32_t iovcnt) {
+	LOG_DEBUG_INFO_STR("(%d, 0x%x, %d)", fd, iov, iovcnt);
+	
+	// Check if the arguments are in range
+	if (fd >= descriptor_table->size)
+		return -EBADF;
+	uint32_t ret = iovec_check(iov, iovcnt);
+	if (ret != 0)
+		return ret;
+	
+	down(&current_pcb->descriptor_lock);
+	
+	// If we are trying to use an invalid descriptor, return failure
+	if (!descriptors[fd] || !descriptors[fd]->write) {
+		up(&current_pcb->descriptor_lock);
+		return -EBADF;
+	}
+	
+	file_descriptor_t* d = descriptors[fd];
+	down(&d->lock);
+	file_descriptor_retain(d);
+	up(&current_pcb->descriptor_lock);
+	
+	if (!((d->mode & FILE_MODE_WRITE) || (d->mode & FILE_MODE_APPEND))) {
+		if (!file_descriptor_release(d))
+			up(&d->lock);
+		return -EACCES;
+	}
+	
+	// Call to the driver specific call
+	ret = file_descriptor_writev(d, iov, iovcnt);
+	if (!file_descriptor_release(d))
+		up(&d->lock);
+	
+	return ret;
+}
+
 // Seek to an offset
 uint32_t llseek(uint32_t fd, uint32_t offset_high, uint32_t offset_low, int whence) {
 	LOG_DEBUG_INFO_STR("(%d, 0x%x, 0x%x, %d)", fd, offset_high, offset_low, whence);
 
 	// Check if the arguments are in range
-	if (fd >= NUMBER_OF_DESCRIPTORS)
+	if (fd >= descriptor_table->size)
         return -EBADF;
 	if (!(whence >= SEEK_SET && whence <= SEEK_END))
 		return -EINVAL;
@@ -187,7 +433,7 @@ uint32_t llseek(uint32_t fd, uint32_t offset_high, uint32_t offset_low, int when
 	
 	// Call to the driver specific call
 	// TODO: for now only return the lower 32 bits
-	uint32_t ret = d->llseek(d, uint64_make(offset_high, offset_low), whence).low;
+	uint32_t ret = (uint32_t)d->llseek(d, ((uint64_t)offset_high << 32) | offset_low, whence);
 	if (!file_descriptor_release(d))
 		up(&d->lock);
 	
@@ -199,7 +445,7 @@ uint32_t truncate(uint32_t fd, uint32_t length_high, uint32_t length_low) {
 	LOG_DEBUG_INFO_STR("(%d, 0x%x, 0x%x)", fd, length_high, length_low);
 
     // Check if the arguments are in range
-    if (fd >= NUMBER_OF_DESCRIPTORS)
+    if (fd >= descriptor_table->size)
 		return -EBADF;
 	
 	down(&current_pcb->descriptor_lock);
@@ -217,7 +463,7 @@ uint32_t truncate(uint32_t fd, uint32_t length_high, uint32_t length_low) {
 	
 	// Call to the driver specific call
 	// TODO: for now just return the lower 32 bits
-	uint32_t ret = d->truncate(d, uint64_make(length_high, length_low)).low;
+	uint32_t ret = (uint32_t)d->truncate(d, ((uint64_t)length_high << 32) | length_low);
 	if (!file_descriptor_release(d))
 		up(&d->lock);
 	
@@ -229,7 +475,7 @@ uint32_t stat(uint32_t fd, sys_stat_type* data) {
 	LOG_DEBUG_INFO_STR("(%d, 0x%x)", fd, data);
 	
     // Check if the arguments are in range
-    if (fd >= NUMBER_OF_DESCRIPTORS)
+    if (fd >= descriptor_table->size)
 		return -EBADF;
 	
 	down(&current_pcb->descriptor_lock);
@@ -252,12 +498,46 @@ uint32_t stat(uint32_t fd, sys_stat_type* data) {
 	return ret;
 }
 
+// Write a file's cached data to the disk
+uint32_t fsync(uint32_t fd) {
+	LOG_DEBUG_INFO_STR("(%d)", fd);
+	
+	// Check if the arguments are in range
+	if (fd >= descriptor_table->size)
+		return -EBADF;
+	
+	down(&current_pcb->descriptor_lock);
+	
+	// If we are trying to use an invalid descriptor, return failure
+	if (!descriptors[fd]) {
+		up(&current_pcb->descriptor_lock);
+		return -EBADF;
+	}
+	// Nothing is buffered for this type of file
+	if (!descriptors[fd]->fsync) {
+		up(&current_pcb->descriptor_lock);
+		return -EINVAL;
+	}
+	
+	file_descriptor_t* d = descriptors[fd];
+	down(&d->lock);
+	file_descriptor_retain(d);
+	up(&current_pcb->descriptor_lock);
+	
+	// Call to the driver specific call
+	uint32_t ret = d->fsync(d);
+	if (!file_descriptor_release(d))
+		up(&d->lock);
+	
+	return ret;
+}
+
 // Close a file descriptor
 uint32_t close(uint32_t fd) {
 	LOG_DEBUG_INFO_STR("(%d)", fd);
 
 	// Check if this descriptor is within the bounds
-	if (fd >= NUMBER_OF_DESCRIPTORS)
+	if (fd >= descriptor_table->size)
 		return -EBADF;
 	
 	// If we are trying to close an invalid descriptor, return failure
@@ -267,12 +547,7 @@ uint32_t close(uint32_t fd) {
 		return -EBADF;
 	}
 	
-	file_descriptor_t* d = descriptors[fd];
-	down(&d->lock);
-	d->closed = true;
-	if (!file_descriptor_release(d))
-		up(&d->lock);
-	current_pcb->descriptors[fd] = NULL;
+	descriptor_remove(current_pcb, fd);
 	
 	up(&current_pcb->descriptor_lock);
 	
@@ -284,7 +559,7 @@ uint32_t isatty(uint32_t fd) {
 	LOG_DEBUG_INFO_STR("(%d)", fd);
 
 	// Check if this descriptor is within the bounds
-	if (fd >= NUMBER_OF_DESCRIPTORS)
+	if (fd >= descriptor_table->size)
 		return -EBADF;
 	
 	down(&current_pcb->descriptor_lock);
@@ -304,58 +579,45 @@ uint32_t isatty(uint32_t fd) {
 	return ret;
 }
 
-// Duplicate a file descriptor
-uint32_t dup(uint32_t fd) {
-	LOG_DEBUG_INFO_STR("(%d)", fd);
-
-	down(&current_pcb->descriptor_lock);
+// Duplicate a file descripter into the first available fd after the argument
+uint32_t dup2_greater(int32_t fd, int32_t new_fd, uint8_t flags) {
+	LOG_DEBUG_INFO_STR("(%d, %d)", fd, new_fd);
 	
-	// Find and open descriptor
-	uint32_t current_fd = -1;
-	int z;								// Looping over descriptors
-	for (z = 0; z < NUMBER_OF_DESCRIPTORS; z++) {
-		if (!descriptors[z]) {
-			current_fd = z;
-			break;
-		}
+	if (fd < 0 || fd >= descriptor_table->size)
+		return -EBADF;
+	if (new_fd < 0 || new_fd >= NUMBER_OF_DESCRIPTORS)
+		return -EINVAL;
+	
+	pcb_t* pcb = current_pcb;
+	down(&pcb->descriptor_lock);
+	if (!descriptors[fd]) {
+		up(&pcb->descriptor_lock);
+		return -EBADF;
 	}
 	
-	// We have no more descriptors available so we can't open anything
-	if (current_fd == -1) {
-		up(&current_pcb->descriptor_lock);
-		return -ENFILE;
+	int32_t current_fd = descriptor_alloc(pcb, new_fd);
+	if (current_fd < 0) {
+		up(&pcb->descriptor_lock);
+		return current_fd;
 	}
 	
 	// Point the new file handle to the old one
-	descriptors[current_fd] = descriptors[fd];
-	file_descriptor_retain(descriptors[current_fd]);
+	file_descriptor_t* d = descriptors[fd];
+	descriptor_table_set(pcb->descriptors, current_fd, d, flags);
+	down(&d->lock);
+	file_descriptor_retain(d);
+	up(&d->lock);
 	
-	up(&current_pcb->descriptor_lock);
+	up(&pcb->descriptor_lock);
 	
 	return current_fd;
 }
 
-// Duplicate a file descripter into the first available fd after the argument
-uint32_t dup2_greater(int32_t fd, int32_t new_fd) {
-	LOG_DEBUG_INFO_STR("(%d, %d)", fd, new_fd);
-	
-	down(&current_pcb->descriptor_lock);
+// Duplicate a file descriptor
+uint32_t dup(uint32_t fd) {
+	LOG_DEBUG_INFO_STR("(%d)", fd);
 
-	while (new_fd < NUMBER_OF_DESCRIPTORS && current_pcb->descriptors[new_fd] && new_fd >= 0)
-		new_fd++;
-	
-    if (new_fd >= NUMBER_OF_DESCRIPTORS || new_fd < 0) {
-		up(&current_pcb->descriptor_lock);
-		return -EINVAL;
-    }
-	
-	// Point the new file handle to the old one
-	descriptors[new_fd] = descriptors[fd];
-	file_descriptor_retain(descriptors[new_fd]);
-	
-	up(&current_pcb->descriptor_lock);
-	
-	return new_fd;
+	return dup2_greater(fd, 0, 0);
 }
 
 // Duplicate a file descriptor into the specific file descriptor
@@ -363,7 +625,7 @@ uint32_t dup2(uint32_t fd, uint32_t new_fd) {
 	LOG_DEBUG_INFO_STR("(%d, %d)", fd, new_fd);
 
 	// Check if this descriptor is within the bounds
-	if (fd >= NUMBER_OF_DESCRIPTORS || new_fd >= NUMBER_OF_DESCRIPTORS)
+	if (fd >= descriptor_table->size || new_fd >= NUMBER_OF_DESCRIPTORS)
 		return -EBADF;
 	
 	pcb_t* pcb = current_pcb;
@@ -373,20 +635,26 @@ uint32_t dup2(uint32_t fd, uint32_t new_fd) {
 		up(&pcb->descriptor_lock);
 		return -EBADF;
 	}
+	if (fd == new_fd) {
+		up(&pcb->descriptor_lock);
+		return new_fd;
+	}
 	
-	// Close the file handle if opened
-	if (pcb->descriptors[new_fd]) {
-		down(&pcb->descriptors[new_fd]->lock);
-		pcb->descriptors[new_fd]->close(pcb->descriptors[new_fd]);
-		if ((--pcb->descriptors[new_fd]->ref_count) == 0) {
-			up(&pcb->descriptors[new_fd]->lock);
-			kfree(pcb->descriptors[new_fd]);
-		} else
-			up(&pcb->descriptors[new_fd]->lock);
+	int32_t ret = descriptor_reserve(pcb, new_fd);
+	if (ret < 0) {
+		up(&pcb->descriptor_lock);
+		return ret;
 	}
-	// Point the new file handle to the old one
-	pcb->descriptors[new_fd] = pcb->descriptors[fd];
-	file_descriptor_retain(pcb->descriptors[new_fd]);
+	
+	// Close the file handle if opened
+	if (descriptors[new_fd])
+		descriptor_remove(pcb, new_fd);
+	// Point the new file handle to the old one (the close-on-exec flag isn't copied)
+	file_descriptor_t* d = descriptors[fd];
+	descriptor_table_set(pcb->descriptors, new_fd, d, 0);
+	down(&d->lock);
+	file_descriptor_retain(d);
+	up(&d->lock);
 	
 	up(&pcb->descriptor_lock);
 	
@@ -400,35 +668,31 @@ uint32_t pipe(uint32_t pipefd[2]) {
 	if (!pipefd)
 		return -EFAULT;
 
-	// Find and open descriptor
-	down(&current_pcb->descriptor_lock);
-	uint32_t current_fd[2] = { -1, -1 };
-	int z, i = 0;								// Looping over descriptors
-	for (z = 0; z < NUMBER_OF_DESCRIPTORS; z++) {
-		if (!descriptors[z]) {
-			current_fd[i++] = z;
-			if (i == 2)
-				break;
-		}
-	}
+	// Find and open descriptor (the second search skips the first one since it isn't set yet)
+	pcb_t* pcb = current_pcb;
+	down(&pcb->descriptor_lock);
+	int32_t current_fd[2];
+	current_fd[0] = descriptor_alloc(pcb, 0);
+	current_fd[1] = (current_fd[0] < 0) ? current_fd[0] : descriptor_alloc(pcb, current_fd[0] + 1);
 	
 	// We have no more descriptors available so we can't open anything
-	if (current_fd[0] == -1 || current_fd[1] == -1) {
-		up(&current_pcb->descriptor_lock);
-		return -ENFILE;
+	if (current_fd[1] < 0) {
+		up(&pcb->descriptor_lock);
+		return current_fd[1];
 	}
 	
-	pcb_t* pcb = current_pcb;
-	
 	// Open the input pipe
 	file_descriptor_t* input = pipe_open(NULL, FILE_MODE_READ);
-	if (!input)
+	if (!input) {
+		up(&pcb->descriptor_lock);
 		return -ENFILE;
+	}
 	
 	// Open the output pipe
 	file_descriptor_t* output = pipe_open(NULL, FILE_MODE_WRITE);
 	if (!output) {
 		pipe_close(input);
+		up(&pcb->descriptor_lock);
 		return -ENFILE;
 	}
 	
@@ -436,21 +700,231 @@ uint32_t pipe(uint32_t pipefd[2]) {
 	if (!pipe_connect(input, output)) {
 		pipe_close(input);
 		pipe_close(output);
+		up(&pcb->descriptor_lock);
 		return -ENFILE;
 	}
 	
 	// Assign
-	pcb->descriptors[current_fd[0]] = input;
-	pcb->descriptors[current_fd[1]] = output;
+	descriptor_table_set(pcb->descriptors, current_fd[0], input, 0);
+	descriptor_table_set(pcb->descriptors, current_fd[1], output, 0);
 	pipefd[0] = current_fd[0];
 	pipefd[1] = current_fd[1];
-	descriptors = pcb->descriptors;
 	
 	up(&pcb->descriptor_lock);
 	
 	return 0;
 }
 
+// Retain two descriptors (returns false if either isn't open)
+bool retain_descriptor_pair(uint32_t fd1, uint32_t fd2, file_descriptor_t** f1, file_descriptor_t** f2) {
+	if (fd1 >= descriptor_table->size || fd2 >= descriptor_table->size)
+		return false;
+	
+	down(&current_pcb->descriptor_lock);
+	if (!descriptors[fd1] || !descriptors[fd2]) {
+		up(&current_pcb->descriptor_lock);
+		return false;
+	}
+	*f1 = descriptors[fd1];
+	*f2 = descriptors[fd2];
+	down(&(*f1)->lock);
+	file_descriptor_retain(*f1);
+	up(&(*f1)->lock);
+	down(&(*f2)->lock);
+	file_descriptor_retain(*f2);
+	up(&(*f2)->lock);
+	up(&current_pcb->descriptor_lock);
+	
+	return true;
+}
+
+// Release a descriptor that was retained
+void release_descriptor(file_descriptor_t* f) {
+	down(&f->lock);
+	if (!file_descriptor_release(f))
+		up(&f->lock);
+}
+
+// Move data between a pipe and another descriptor without copying it through user space
+uint32_t splice(uint32_t fd_in, uint64_t* off_in, uint32_t fd_out, uint64_t* off_out, uint32_t len, uint32_t flags) {
+	LOG_DEBUG_INFO_STR("(%d, 0x%x, %d, 0x%x, %d, 0x%x)", fd_in, off_in, fd_out, off_out, len, flags);
+	
+	file_descriptor_t* in = NULL;
+	file_descriptor_t* out = NULL;
+	if (!retain_descriptor_pair(fd_in, fd_out, &in, &out))
+		return -EBADF;
+	
+	uint64_t in_offset = off_in ? *off_in : 0;
+	uint64_t out_offset = off_out ? *off_out : 0;
+	uint32_t ret = pipe_splice(in, off_in ? &in_offset : NULL, out, off_out ? &out_offset : NULL, len, flags);
+	if ((int32_t)ret > 0) {
+		if (off_in)
+			*off_in = in_offset;
+		if (off_out)
+			*off_out = out_offset;
+	}
+	
+	release_descriptor(in);
+	release_descriptor(out);
+	
+	return ret;
+}
+
+// Duplicate data from one pipe into another without consuming it
+uint32_t tee(uint32_t fd_in, uint32_t fd_out, uint32_t len, uint32_t flags) {
+	LOG_DEBUG_INFO_STR("(%d, %d, %d, 0x%x)", fd_in, fd_out, len, flags);
+	
+	file_descriptor_t* in = NULL;
+	file_descriptor_t* out = NULL;
+	if (!retain_descriptor_pair(fd_in, fd_out, &in, &out))
+		return -EBADF;
+	
+	uint32_t ret = pipe_tee(in, out, len, flags);
+	
+	release_descriptor(in);
+	release_descriptor(out);
+	
+	return ret;
+}
+
+// Lock two descriptors in address order (only once if they are the same)
+void lock_descriptor_pair(file_descriptor_t* f1, file_descriptor_t* f2) {
+	if (f1 == f2) {
+		down(&f1->lock);
+		return;
+	}
+	down((f1 < f2) ? &f1->lock : &f2->lock);
+	down((f1 < f2) ? &f2->lock : &f1->lock);
+}
+
+// Unlock two descriptors locked with lock_descriptor_pair
+void unlock_descriptor_pair(file_descriptor_t* f1, file_descriptor_t* f2) {
+	up(&f1->lock);
+	if (f1 != f2)
+		up(&f2->lock);
+}
+
+// Copy data between two descriptors through a kernel buffer (for descriptors that have
+// no faster way to do it). The descriptors must be locked
+uint32_t copy_descriptor_data(file_descriptor_t* in, uint64_t* in_offset, file_descriptor_t* out,
+							  uint64_t* out_offset, uint32_t len) {
+	if ((in_offset && !in->pread) || (out_offset && !out->pwrite))
+		return -ESPIPE;
+	if (!in->read || !out->write)
+		return -EINVAL;
+	
+	uint8_t* buffer = kmalloc(COPY_BUFFER_SIZE);
+	if (!buffer)
+		return -ENOMEM;
+	
+	uint32_t total = 0;
+	while (total < len) {
+		uint32_t amount = (len - total < COPY_BUFFER_SIZE) ? (len - total) : COPY_BUFFER_SIZE;
+		uint32_t ret = in_offset ? in->pread(in, buffer, amount, *in_offset) : in->read(in, buffer, amount);
+		if ((int32_t)ret <= 0) {
+			if (total == 0)
+				total = ret;
+			break;
+		}
+		if (in_offset)
+			*in_offset += ret;
+		
+		uint32_t written = out_offset ? out->pwrite(out, buffer, ret, *out_offset) : out->write(out, buffer, ret);
+		if ((int32_t)written <= 0) {
+			if (total == 0)
+				total = written;
+			break;
+		}
+		if (out_offset)
+			*out_offset += written;
+		
+		total += written;
+		if (written < ret || ret < amount)
+			break;
+	}
+	
+	kfree(buffer);
+	
+	return total;
+}
+
+// Copy data from one descriptor to another without going through user space
+uint32_t sendfile(uint32_t out_fd, uint32_t in_fd, uint64_t* offset, uint32_t count) {
+	LOG_DEBUG_INFO_STR("(%d, %d, 0x%x, %d)", out_fd, in_fd, offset, count);
+	
+	file_descriptor_t* in = NULL;
+	file_descriptor_t* out = NULL;
+	if (!retain_descriptor_pair(in_fd, out_fd, &in, &out))
+		return -EBADF;
+	
+	uint32_t ret = 0;
+	uint64_t in_offset = offset ? *offset : 0;
+	if (!(in->mode & FILE_MODE_READ) || !(out->mode & (FILE_MODE_WRITE | FILE_MODE_APPEND)))
+		ret = -EBADF;
+	else if (count == 0)
+		ret = 0;
+	else if (pipe_is_pipe(in) || pipe_is_pipe(out)) {
+		// Pipes read and write their pages directly
+		ret = pipe_splice(in, offset ? &in_offset : NULL, out, NULL, count, 0);
+	} else {
+		lock_descriptor_pair(in, out);
+		if (filesystem_is_file(in) && filesystem_is_file(out) && !(out->mode & FILE_MODE_APPEND))
+			ret = filesystem_copy_file_range(in, offset ? &in_offset : NULL, out, NULL, count);
+		else
+			ret = copy_descriptor_data(in, offset ? &in_offset : NULL, out, NULL, count);
+		unlock_descriptor_pair(in, out);
+	}
+	if ((int32_t)ret > 0 && offset)
+		*offset = in_offset;
+	
+	release_descriptor(in);
+	release_descriptor(out);
+	
+	return ret;
+}
+
+// Copy a range of one file to another without going through user space
+uint32_t copy_file_range(uint32_t fd_in, uint64_t* off_in, uint32_t fd_out, uint64_t* off_out, uint32_t len,
+						 uint32_t flags) {
+	LOG_DEBUG_INFO_STR("(%d, 0x%x, %d, 0x%x, %d, 0x%x)", fd_in, off_in, fd_out, off_out, len, flags);
+	
+	if (flags != 0)
+		return -EINVAL;
+	
+	file_descriptor_t* in = NULL;
+	file_descriptor_t* out = NULL;
+	if (!retain_descriptor_pair(fd_in, fd_out, &in, &out))
+		return -EBADF;
+	
+	uint32_t ret = 0;
+	uint64_t in_offset = off_in ? *off_in : 0;
+	uint64_t out_offset = off_out ? *off_out : 0;
+	if (!(in->mode & FILE_MODE_READ) || !(out->mode & FILE_MODE_WRITE) || (out->mode & FILE_MODE_APPEND))
+		ret = -EBADF;
+	else if (!(in->mode & FILE_TYPE_REGULAR) || !(out->mode & FILE_TYPE_REGULAR))
+		ret = -EINVAL;
+	else if (len != 0) {
+		lock_descriptor_pair(in, out);
+		if (filesystem_is_file(in) && filesystem_is_file(out)) {
+			ret = filesystem_copy_file_range(in, off_in ? &in_offset : NULL, out, off_out ? &out_offset : NULL,
+											 len);
+		} else
+			ret = copy_descriptor_data(in, off_in ? &in_offset : NULL, out, off_out ? &out_offset : NULL, len);
+		unlock_descriptor_pair(in, out);
+	}
+	if ((int32_t)ret > 0) {
+		if (off_in)
+			*off_in = in_offset;
+		if (off_out)
+			*off_out = out_offset;
+	}
+	
+	release_descriptor(in);
+	release_descriptor(out);
+	
+	return ret;
+}
+
 #define	F_DUPFD		0		/* duplicate file descriptor */
 #define	F_GETFD		1		/* get file descriptor flags */
 #define	F_SETFD		2		/* set file descriptor flags */
@@ -467,6 +941,28 @@ uint32_t pipe(uint32_t pipefd[2]) {
 #define	F_RSETLKW 	13		/* Set or Clear remote record-lock(Blocking) */
 #define	F_DUPFD_CLOEXEC	14	/* As F_DUPFD, but set close-on-exec flag */
 
+// Get or set a descriptor's flags (FD_CLOEXEC)
+uint32_t descriptor_flags(uint32_t fd, bool set, uint32_t flags) {
+	if (fd >= descriptor_table->size)
+		return -EBADF;
+	
+	pcb_t* pcb = current_pcb;
+	down(&pcb->descriptor_lock);
+	if (!descriptors[fd]) {
+		up(&pcb->descriptor_lock);
+		return -EBADF;
+	}
+	
+	uint32_t ret = descriptor_table->flags[fd];
+	if (set) {
+		pcb->descriptors->flags[fd] = flags & FD_CLOEXEC;
+		ret = 0;
+	}
+	up(&pcb->descriptor_lock);
+	
+	return ret;
+}
+
 // Extensions
 int fcntl(uint32_t fd, int32_t cmd, ...) {
 	LOG_DEBUG_INFO_STR("(%d, %d, %d)", fd, cmd, (uint32_t)*(&cmd + 1));
@@ -474,23 +970,20 @@ int fcntl(uint32_t fd, int32_t cmd, ...) {
 	uint32_t* esp = ((uint32_t*)&cmd) + 1;
 	switch (cmd) {
 		case F_DUPFD:
-			return dup2_greater(fd, *esp);
+			return dup2_greater(fd, *esp, 0);
 		case F_GETFD:
-			// TODO: implement CLOSE_ON_EXEC
-			return 0;
+			return descriptor_flags(fd, false, 0);
 		case F_SETFD:
-			// TODO: implement CLOSE_ON_EXEC
-			return 0;
+			return descriptor_flags(fd, true, *esp);
 		case F_GETFL:
-			if (!descriptors[fd]) {
+			if (fd >= descriptor_table->size || !descriptors[fd]) {
                 return -ENOENT;
 			}
 			return descriptors[fd]->mode;
 		case F_SETFL:
 			return 0;
 		case F_DUPFD_CLOEXEC:
-			// TODO: implement CLOSE_ON_EXEC
-			return dup2_greater(fd, *esp);
+			return dup2_greater(fd, *esp, FD_CLOEXEC);
 		default:
 #if DEBUG
 			blue_screen("Unimplemented fctnl %d", cmd);
@@ -499,118 +992,3 @@ int fcntl(uint32_t fd, int32_t cmd, ...) {
 	}
 	return 0;
 }
-
-// Helper to clear fds
-void clear_fds(fd_set* read, fd_set* write, fd_set* except) {
-	if (read)
-		memset(read, 0, sizeof(fd_set));
-	if (write)
-		memset(write, 0, sizeof(fd_set));
-	if (except)
-		memset(except, 0, sizeof(fd_set));
-}
-
-// Wait for changes to file descriptors
-int select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout) {
-	LOG_DEBUG_INFO_STR("(%d, 0x%x, 0x%x, 0x%x, 0x%x)", nfds, readfds, writefds, exceptfds, timeout);
-	
-	if ((!readfds && !writefds && !exceptfds && !timeout) || nfds == 0)
-		return -EINVAL;
-	
-	if (nfds > NUMBER_OF_DESCRIPTORS || nfds < 0)
-		nfds = NUMBER_OF_DESCRIPTORS;
-	
-	// Copy over fd sets and clear them
-	fd_set rc;
-	if (readfds)
-		rc = *readfds;
-	else
-		memset(&rc, 0, sizeof(fd_set));
-	fd_set wc;
-	if (writefds)
-		wc = *writefds;
-	else
-		memset(&wc, 0, sizeof(fd_set));
-	clear_fds(readfds, writefds, exceptfds);
-	
-	down(&current_pcb->descriptor_lock);
-	uint32_t num_desc = 0;
-	for (int z = 0; z < nfds; z++) {
-		int index = z / 32;
-		int bit = z % 32;
-		if ((rc.bits[index] >> bit) & 0x1 || (wc.bits[index] >> bit) & 0x1) {
-			num_desc++;
-			if (!descriptors[z]) {
-				up(&current_pcb->descriptor_lock);
-				return -EBADF;
-			}
-		}
-	}
-	file_descriptor_t* select_desc[num_desc];
-	uint32_t desc_num = 0;
-	for (int z = 0; z < nfds; z++) {
-		int index = z / 32;
-		int bit = z % 32;
-		if ((rc.bits[index] >> bit) & 0x1 || (wc.bits[index] >> bit) & 0x1) {
-			select_desc[desc_num++] = descriptors[z];
-			file_descriptor_retain(descriptors[z]);
-		}
-	}
-	up(&current_pcb->descriptor_lock);
-	
-	// Keep on checking until something works or the timeout has expired
-	struct timeval end = { 0, 0 };
-	if (timeout)
-		end = time_add(time_get(), *timeout);
-	int total = 0;
-	while (!current_pcb->should_terminate) {
-		if (signal_occurring(current_pcb)) {
-			total = -EINTR;
-			break;
-		}
-		// Check all file descriptors and see if they can read or write
-		desc_num = 0;
-		for (int z = 0; z < nfds; z++) {
-			int index = z / 32;
-			int bit = z % 32;
-			bool rb = (rc.bits[index] >> bit) & 0x1;
-			bool wb = (wc.bits[index] >> bit) & 0x1;
-			if (!rb && !wb)
-				continue;
-			
-			file_descriptor_t* d = select_desc[desc_num++];
-			down(&d->lock);
-			if (d->closed) {
-				up(&d->lock);
-				total = -EBADF;
-				goto cleanup;
-			}
-			
-			if (rb && d->can_read && d->can_read(d)) {
-				readfds->bits[index] |= (1 << bit);
-				total++;
-			}
-			if (wb && d->can_write && d->can_write(d)) {
-				writefds->bits[index] |= (1 << bit);
-				total++;
-			}
-			up(&d->lock);
-		}
-		if (total != 0)
-			break;
-		
-		if (timeout && !time_less(time_get(), end))
-			break;
-		
-		schedule();
-	}
-	
-cleanup:
-	for (uint32_t z = 0; z < num_desc; z++) {
-		down(&select_desc[z]->lock);
-		if (!file_descriptor_release(select_desc[z]))
-			up(&select_desc[z]->lock);
-	}
-	
-	return total;
-}
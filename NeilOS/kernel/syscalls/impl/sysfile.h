@@ -13,6 +13,20 @@
 #include <syscalls/descriptor.h>
 #include <common/time.h>
 
+// Size of the kernel buffer used to copy between descriptors that can't do it directly
+#define COPY_BUFFER_SIZE		(16 * 1024)
+
+struct pcb;
+
+// Make a table the current task's descriptors (NULL for a task without any)
+void set_current_descriptors(descriptor_table_t* t);
+// Get a descriptor ready to be set by growing the table (must hold descriptor_lock)
+int32_t descriptor_reserve(struct pcb* pcb, uint32_t fd);
+// Reserve the lowest free descriptor at or above start (must hold descriptor_lock)
+int32_t descriptor_alloc(struct pcb* pcb, uint32_t start);
+// Close the descriptors marked FD_CLOEXEC (for exec)
+void descriptors_close_on_exec(struct pcb* pcb);
+
 // Helper for open
 file_descriptor_t* open_handle(const char* filename, uint32_t mode, uint32_t type);
 // Open a file descriptor
@@ -24,6 +38,18 @@ uint32_t read(uint32_t fd, void* buf, uint32_t nbytes);
 // Write to a file descriptor
 uint32_t write(uint32_t fd, const void* buf, uint32_t nbytes);
 
+// Read from a file descriptor at an offset without changing its position
+uint32_t pread(uint32_t fd, void* buf, uint32_t nbytes, uint32_t offset_high, uint32_t offset_low);
+
+// Write to a file descriptor at an offset without changing its position
+uint32_t pwrite(uint32_t fd, const void* buf, uint32_t nbytes, uint32_t offset_high, uint32_t offset_low);
+
+// Read from a file descriptor into multiple buffers
+uint32_t readv(uint32_t fd, const iovec_t* iov, uint32_t iovcnt);
+
+// Write to a file descriptor from multiple buffers
+uint32_t writev(uint32_t fd, const iovec_t* iov, uint32_t iovcnt);
+
 // Seek to an offset
 uint32_t llseek(uint32_t fd, uint32_t offset_high, uint32_t offset_low, int whence);
 
@@ -33,6 +59,9 @@ uint32_t truncate(uint32_t fd, uint32_t length_high, uint32_t length_low);
 // Get information about a file descriptor
 uint32_t stat(uint32_t fd, sys_stat_type* data);
 
+// Write a file's cached data to the disk
+uint32_t fsync(uint32_t fd);
+
 // Close a file descriptor
 uint32_t close(uint32_t fd);
 
@@ -48,10 +77,20 @@ uint32_t dup2(uint32_t fd, uint32_t new_fd);
 // Create a pipe
 uint32_t pipe(uint32_t pipefd[2]);
 
+// Move data between a pipe and another descriptor without copying it through user space
+uint32_t splice(uint32_t fd_in, uint64_t* off_in, uint32_t fd_out, uint64_t* off_out, uint32_t len, uint32_t flags);
+
+// Duplicate data from one pipe into another without consuming it
+uint32_t tee(uint32_t fd_in, uint32_t fd_out, uint32_t len, uint32_t flags);
+
+// Copy data from one descriptor to another without going through user space
+uint32_t sendfile(uint32_t out_fd, uint32_t in_fd, uint64_t* offset, uint32_t count);
+
+// Copy a range of one file to another without going through user space
+uint32_t copy_file_range(uint32_t fd_in, uint64_t* off_in, uint32_t fd_out, uint64_t* off_out, uint32_t len,
+						 uint32_t flags);
+
 // Extensions
 int fcntl(uint32_t fd, int32_t cmd, ...);
 
-// Wait for changes to file descriptors
-int select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout);
-
 #endif /* SYSFILE_H */
@@ -58,13 +58,50 @@ uint32_t link(const char* filename, const char* new_name) {
 }
 
 uint32_t readdir(uint32_t fd, void* buf, int size, dirent_t* dirent) {
-	if (fd >= NUMBER_OF_DESCRIPTORS)
+	if (fd >= descriptor_table->size)
 		return -EBADF;
 	if (!descriptors[fd])
 		return -EBADF;
+	// Only ext2 directories support the old interface
+	if (descriptors[fd]->getdents != filesystem_getdents)
+		return -ENOTDIR;
 	return filesystem_readdir(descriptors[fd], buf, size, dirent);
 }
 
+// Read as many directory entries as fit into a buffer (returns the number of bytes used)
+uint32_t getdents(uint32_t fd, void* buf, uint32_t size) {
+	LOG_DEBUG_INFO_STR("(%d, 0x%x, %d)", fd, buf, size);
+	
+	// Check if the arguments are in range
+	if (fd >= descriptor_table->size)
+		return -EBADF;
+	if (!buf)
+		return -EFAULT;
+	
+	down(&current_pcb->descriptor_lock);
+	
+	// If we are trying to use an invalid descriptor, return failure
+	if (!descriptors[fd]) {
+		up(&current_pcb->descriptor_lock);
+		return -EBADF;
+	}
+	
+	file_descriptor_t* d = descriptors[fd];
+	down(&d->lock);
+	file_descriptor_retain(d);
+	up(&current_pcb->descriptor_lock);
+	
+	uint32_t ret;
+	if (!d->getdents)
+		ret = -ENOTDIR;
+	else
+		ret = d->getdents(d, buf, size);
+	if (!file_descriptor_release(d))
+		up(&d->lock);
+	
+	return ret;
+}
+
 // Unlink a file or directory (note: deletes the file if it is the last remaining link)
 uint32_t unlink(const char* filename, bool dir, uint32_t type) {
 	LOG_DEBUG_INFO_STR("(%s)", filename);
@@ -114,3 +151,12 @@ uint32_t utime(const char* filename, uint32_t* times) {
 	
 	return 0;
 }
+
+// Write all cached filesystem data to the disk
+uint32_t sync() {
+	LOG_DEBUG_INFO();
+	
+	filesystem_sync();
+	
+	return 0;
+}
@@ -20,6 +20,17 @@ typedef struct
 	char name[256];
 } dirent_t;
 
+// Entry packed into a getdents buffer (the name is null terminated and records are padded to 4 bytes)
+typedef struct {
+	uint32_t ino;
+	uint32_t off;				// Position to seek to for the entry after this one
+	uint16_t reclen;			// Size of this record
+	uint8_t type;
+	char name[];
+} getdents_entry_t;
+
+#define GETDENTS_ENTRY_HEADER_SIZE		11
+
 // Make a directory
 uint32_t mkdir(const char* name);
 
@@ -32,7 +43,13 @@ uint32_t unlink(const char* filename, bool dir, uint32_t type);
 // Read a directory entry
 uint32_t readdir(uint32_t fd, void* buf, int size, dirent_t* dirent);
 
+// Read as many directory entries as fit into a buffer (returns the number of bytes used)
+uint32_t getdents(uint32_t fd, void* buf, uint32_t size);
+
 // Update a file's access and modification time
 uint32_t utime(const char* filename, uint32_t* times);
 
+// Write all cached filesystem data to the disk
+uint32_t sync();
+
 #endif /* SYSFS_H */
@@ -0,0 +1,439 @@
+//
+//  sysioring.c
+//  NeilOS
+//
+
+#include "sysioring.h"
+#include "syspoll.h"
+#include <common/lib.h>
+#include <memory/memory.h>
+#include <memory/allocation/heap.h>
+#include <program/task.h>
+#include <common/log.h>
+#include <drivers/ipc/mq.h>
+#include <drivers/graphics/graphics.h>
+#include <syscalls/interrupt.h>
+
+// Most entries a queue can have
+#define IO_RING_MAX_ENTRIES		4096
+
+// An operation that couldn't finish right away
+typedef struct io_request {
+	io_sqe_t sqe;
+	file_descriptor_t* file;		// NULL for fence waits
+	wait_queue_entry_t wait;		// On the descriptor's wait queue
+	struct io_ring_info* info;
+	volatile bool ready;			// The descriptor had an event since the last try
+	struct io_request* next;
+} io_request_t;
+
+// A ring instance
+typedef struct io_ring_info {
+	io_ring_t* ring;				// In the owner's memory (only the indices are used after setup)
+	uint32_t pid;					// Only the process that set up the ring can use it
+	
+	// Copied from the ring at setup, so the program can't point them somewhere else later
+	io_sqe_t* sqes;
+	io_cqe_t* cqes;
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+	
+	io_request_t* pending;
+	uint32_t num_pending;
+	uint32_t num_polled;			// Pending requests that have to be checked every time
+	
+	// Woken up when a pending request may be able to finish
+	wait_queue_t wait;
+} io_ring_info_t;
+
+// Check that size bytes at addr are in the program's part of memory
+bool io_ring_range_valid(const void* addr, uint32_t size) {
+	uint32_t start = (uint32_t)addr;
+	return start >= USER_ADDRESS && start <= VM_KERNEL_ADDRESS && size <= VM_KERNEL_ADDRESS - start;
+}
+
+// Post a completion (there is always room since submissions are only taken when there is)
+void io_ring_complete(io_ring_info_t* info, uint64_t user_data, int32_t res, uint32_t flags) {
+	io_ring_t* ring = info->ring;
+	io_cqe_t* cqe = &info->cqes[ring->cq_tail & (info->cq_entries - 1)];
+	cqe->user_data = user_data;
+	cqe->res = res;
+	cqe->flags = flags;
+	
+	// The entry has to be written before the program can see it
+	asm volatile("" : : : "memory");
+	ring->cq_tail++;
+}
+
+// Called when a pending request's descriptor has an event
+void io_request_wake(wait_queue_entry_t* entry, uint32_t events) {
+	io_request_t* req = (io_request_t*)entry->data;
+	req->ready = true;
+	wait_queue_wake(&req->info->wait, POLLIN);
+}
+
+// Try to do an operation without sleeping. Returns false if it has to wait
+bool io_request_try(io_request_t* req, int32_t* res, uint32_t* flags) {
+	io_sqe_t* sqe = &req->sqe;
+	*flags = 0;
+	
+	if (sqe->opcode == IO_RING_OP_FENCE_WAIT) {
+		if (!graphics_fence_passed(sqe->len))
+			return false;
+		*res = 0;
+		return true;
+	}
+	
+	file_descriptor_t* f = req->file;
+	down(&f->lock);
+	if (f->closed) {
+		up(&f->lock);
+		*res = -EBADF;
+		return true;
+	}
+	
+	bool writing = (sqe->opcode == IO_RING_OP_WRITE || sqe->opcode == IO_RING_OP_MQ_SEND);
+	uint32_t wanted = writing ? POLLOUT : POLLIN;
+	if (!(file_descriptor_poll(f, wanted) & (wanted | POLLERR | POLLHUP | POLLNVAL))) {
+		up(&f->lock);
+		return false;
+	}
+	
+	// Make sure the operation can't sleep (it gets -EAGAIN instead)
+	uint32_t nonblocking = f->mode & FILE_MODE_NONBLOCKING;
+	f->mode |= FILE_MODE_NONBLOCKING;
+	uint32_t ret = 0;
+	switch (sqe->opcode) {
+		case IO_RING_OP_READ:
+			if (sqe->offset == IO_RING_OFFSET_NONE)
+				ret = f->read(f, sqe->addr, sqe->len);
+			else
+				ret = f->pread(f, sqe->addr, sqe->len, sqe->offset);
+			break;
+		case IO_RING_OP_WRITE:
+			if (sqe->offset == IO_RING_OFFSET_NONE)
+				ret = f->write(f, sqe->addr, sqe->len);
+			else
+				ret = f->pwrite(f, sqe->addr, sqe->len, sqe->offset);
+			break;
+		case IO_RING_OP_MQ_SEND:
+			ret = mq_send(f, sqe->addr, sqe->len, sqe->priority);
+			break;
+		case IO_RING_OP_MQ_RECEIVE:
+			ret = mq_receive(f, sqe->addr, sqe->len, flags);
+			break;
+	}
+	f->mode = (f->mode & ~FILE_MODE_NONBLOCKING) | nonblocking;
+	up(&f->lock);
+	
+	if (ret == -EAGAIN)
+		return false;
+	*res = ret;
+	return true;
+}
+
+// Check that a submission makes sense and retain its descriptor. Returns 0 or an error
+int32_t io_request_prepare(io_request_t* req) {
+	io_sqe_t* sqe = &req->sqe;
+	req->file = NULL;
+	if (sqe->opcode > IO_RING_OP_FENCE_WAIT)
+		return -EINVAL;
+	if (sqe->opcode == IO_RING_OP_NOP || sqe->opcode == IO_RING_OP_FENCE_WAIT)
+		return 0;
+	if (!sqe->addr)
+		return -EFAULT;
+	if (sqe->fd < 0 || sqe->fd >= descriptor_table->size)
+		return -EBADF;
+	
+	down(&current_pcb->descriptor_lock);
+	file_descriptor_t* f = descriptors[sqe->fd];
+	if (!f) {
+		up(&current_pcb->descriptor_lock);
+		return -EBADF;
+	}
+	down(&f->lock);
+	
+	int32_t ret = 0;
+	bool mq = (f->close == mq_close);
+	switch (sqe->opcode) {
+		case IO_RING_OP_READ:
+			if (!(f->mode & FILE_MODE_READ) || !f->read)
+				ret = -EBADF;
+			else if (sqe->offset != IO_RING_OFFSET_NONE && !f->pread)
+				ret = -ESPIPE;
+			break;
+		case IO_RING_OP_WRITE:
+			if (!(f->mode & (FILE_MODE_WRITE | FILE_MODE_APPEND)) || !f->write)
+				ret = -EBADF;
+			else if (sqe->offset != IO_RING_OFFSET_NONE && !f->pwrite)
+				ret = -ESPIPE;
+			break;
+		case IO_RING_OP_MQ_SEND:
+		case IO_RING_OP_MQ_RECEIVE:
+			if (!mq)
+				ret = -EBADF;
+			break;
+	}
+	if (ret == 0) {
+		file_descriptor_retain(f);
+		req->file = f;
+	}
+	up(&f->lock);
+	up(&current_pcb->descriptor_lock);
+	
+	return ret;
+}
+
+// Stop waiting on a pending request and free it
+void io_request_free(io_ring_info_t* info, io_request_t* req) {
+	if (req->file && req->file->wait_queue)
+		wait_queue_remove(&req->wait);
+	else
+		info->num_polled--;
+	if (req->file)
+		poll_release(req->file);
+	info->num_pending--;
+	kfree(req);
+}
+
+// Start an operation. It either completes right away or is kept until it can
+void io_ring_start(io_ring_info_t* info, io_sqe_t* sqe) {
+	io_request_t r;
+	r.sqe = *sqe;
+	int32_t res = io_request_prepare(&r);
+	uint32_t flags = 0;
+	if (res != 0 || io_request_try(&r, &res, &flags)) {
+		io_ring_complete(info, sqe->user_data, res, flags);
+		if (r.file)
+			poll_release(r.file);
+		return;
+	}
+	
+	io_request_t* req = (io_request_t*)kmalloc(sizeof(io_request_t));
+	if (!req) {
+		io_ring_complete(info, sqe->user_data, -ENOMEM, 0);
+		if (r.file)
+			poll_release(r.file);
+		return;
+	}
+	*req = r;
+	req->info = info;
+	// Try again after it's on the wait queue in case the event came before that
+	req->ready = true;
+	req->wait.thread = NULL;
+	req->wait.queue = NULL;
+	req->wait.func = io_request_wake;
+	req->wait.data = req;
+	
+	req->next = info->pending;
+	info->pending = req;
+	info->num_pending++;
+	if (req->file && req->file->wait_queue)
+		wait_queue_add(req->file->wait_queue, &req->wait);
+	else
+		info->num_polled++;
+}
+
+// Take submissions off the ring (only while there is guaranteed room for their completions).
+// Returns the number taken
+uint32_t io_ring_submit(io_ring_info_t* info, uint32_t to_submit) {
+	io_ring_t* ring = info->ring;
+	uint32_t num = 0;
+	while (num < to_submit && ring->sq_head != ring->sq_tail) {
+		if (ring->cq_tail - ring->cq_head + info->num_pending >= info->cq_entries)
+			break;
+	
+		io_sqe_t sqe = info->sqes[ring->sq_head & (info->sq_entries - 1)];
+		ring->sq_head++;
+		num++;
+		io_ring_start(info, &sqe);
+	}
+	
+	return num;
+}
+
+// Retry pending requests that may be able to finish now
+void io_ring_run_pending(io_ring_info_t* info) {
+	io_request_t** prev = &info->pending;
+	while (*prev) {
+		io_request_t* req = *prev;
+		bool polled = !req->file || !req->file->wait_queue;
+		if (!polled && !req->ready) {
+			prev = &req->next;
+			continue;
+		}
+	
+		req->ready = false;
+		int32_t res = 0;
+		uint32_t flags = 0;
+		if (!io_request_try(req, &res, &flags)) {
+			prev = &req->next;
+			continue;
+		}
+	
+		*prev = req->next;
+		io_ring_complete(info, req->sqe.user_data, res, flags);
+		io_request_free(info, req);
+	}
+}
+
+// Get info about a ring
+uint32_t io_ring_stat(file_descriptor_t* f, sys_stat_type* data) {
+	memset(data, 0, sizeof(sys_stat_type));
+	data->mode = f->mode;
+	return 0;
+}
+
+// Seek a ring (returns error)
+uint64_t io_ring_llseek(file_descriptor_t* f, uint64_t offset, int whence) {
+	return (uint64_t)-ESPIPE;
+}
+
+// Duplicate a ring
+file_descriptor_t* io_ring_duplicate(file_descriptor_t* f) {
+	f->ref_count++;
+	return f;
+}
+
+// Close a ring (operations that haven't finished are dropped)
+uint32_t io_ring_close(file_descriptor_t* f) {
+	if (f->ref_count == 0) {
+		io_ring_info_t* info = (io_ring_info_t*)f->info;
+		while (info->pending) {
+			io_request_t* req = info->pending;
+			info->pending = req->next;
+			io_request_free(info, req);
+		}
+		kfree(info);
+	}
+	
+	return 0;
+}
+
+// Set up a ring (returns a descriptor for it)
+uint32_t io_ring_setup(io_ring_t* ring) {
+	LOG_DEBUG_INFO_STR("(0x%x)", ring);
+	
+	if (!io_ring_range_valid(ring, sizeof(io_ring_t)))
+		return -EFAULT;
+	
+	// Read everything once (the program could change it while we check)
+	io_sqe_t* sqes = ring->sqes;
+	io_cqe_t* cqes = ring->cqes;
+	uint32_t sq_entries = ring->sq_entries;
+	uint32_t cq_entries = ring->cq_entries;
+	asm volatile("" : : : "memory");
+	
+	if (sq_entries == 0 || sq_entries > IO_RING_MAX_ENTRIES || (sq_entries & (sq_entries - 1)) != 0)
+		return -EINVAL;
+	if (cq_entries == 0 || cq_entries > IO_RING_MAX_ENTRIES || (cq_entries & (cq_entries - 1)) != 0)
+		return -EINVAL;
+	// All of both queues has to be in the program's memory
+	if (!io_ring_range_valid(sqes, sq_entries * sizeof(io_sqe_t)) ||
+		!io_ring_range_valid(cqes, cq_entries * sizeof(io_cqe_t)))
+		return -EFAULT;
+	
+	file_descriptor_t* d = (file_descriptor_t*)kmalloc(sizeof(file_descriptor_t));
+	if (!d)
+		return -ENOMEM;
+	memset(d, 0, sizeof(file_descriptor_t));
+	io_ring_info_t* info = (io_ring_info_t*)kmalloc(sizeof(io_ring_info_t));
+	if (!info) {
+		kfree(d);
+		return -ENOMEM;
+	}
+	memset(info, 0, sizeof(io_ring_info_t));
+	info->ring = ring;
+	info->sqes = sqes;
+	info->cqes = cqes;
+	info->sq_entries = sq_entries;
+	info->cq_entries = cq_entries;
+	info->pid = current_pcb->task->pid;
+	wait_queue_init(&info->wait);
+	ring->sq_head = ring->sq_tail = 0;
+	ring->cq_head = ring->cq_tail = 0;
+	
+	d->lock = MUTEX_UNLOCKED;
+	d->mode = FILE_MODE_READ;
+	d->ref_count = 1;
+	d->info = info;
+	d->stat = io_ring_stat;
+	d->llseek = io_ring_llseek;
+	d->duplicate = io_ring_duplicate;
+	d->close = io_ring_close;
+	
+	// Find a free descriptor
+	down(&current_pcb->descriptor_lock);
+	int32_t fd = descriptor_alloc(current_pcb, 0);
+	if (fd >= 0)
+		descriptor_table_set(current_pcb->descriptors, fd, d, 0);
+	up(&current_pcb->descriptor_lock);
+	
+	if (fd < 0) {
+		kfree(info);
+		kfree(d);
+	}
+	return fd;
+}
+
+// Submit up to to_submit operations and optionally wait for completions.
+// Returns the number of submissions taken
+uint32_t io_ring_enter(uint32_t fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+	LOG_DEBUG_INFO_STR("(%d, %d, %d, 0x%x)", fd, to_submit, min_complete, flags);
+	
+	if (fd >= descriptor_table->size)
+		return -EBADF;
+	
+	down(&current_pcb->descriptor_lock);
+	if (!descriptors[fd]) {
+		up(&current_pcb->descriptor_lock);
+		return -EBADF;
+	}
+	if (descriptors[fd]->close != io_ring_close) {
+		up(&current_pcb->descriptor_lock);
+		return -EINVAL;
+	}
+	file_descriptor_t* d = descriptors[fd];
+	down(&d->lock);
+	file_descriptor_retain(d);
+	up(&current_pcb->descriptor_lock);
+	
+	io_ring_info_t* info = (io_ring_info_t*)d->info;
+	io_ring_t* ring = info->ring;
+	uint32_t ret = 0;
+	if (info->pid != current_pcb->task->pid) {
+		// The ring's memory is in another process
+		ret = -EBADF;
+	} else if (!(flags & IO_RING_ENTER_GETEVENTS)) {
+		ret = io_ring_submit(info, to_submit);
+		io_ring_run_pending(info);
+	} else {
+		// Keep going until there are enough completions or nothing left that could complete
+		if (min_complete > info->cq_entries)
+			min_complete = info->cq_entries;
+		wait_queue_entry_t entry;
+		wait_queue_add_current(&info->wait, &entry);
+		while (!current_pcb->should_terminate && !d->closed) {
+			thread_sleep_prepare();
+			ret += io_ring_submit(info, to_submit - ret);
+			io_ring_run_pending(info);
+			if (ring->cq_tail - ring->cq_head >= min_complete || info->num_pending == 0)
+				break;
+			if (signal_occurring(current_pcb)) {
+				if (ret == 0)
+					ret = -EINTR;
+				break;
+			}
+	
+			up(&d->lock);
+			poll_sleep(NULL, info->num_polled != 0);
+			down(&d->lock);
+		}
+		wait_queue_remove(&entry);
+	}
+	
+	if (!file_descriptor_release(d))
+		up(&d->lock);
+	
+	return ret;
+}
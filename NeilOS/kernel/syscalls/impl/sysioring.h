@@ -0,0 +1,64 @@
+//
+//  sysioring.h
+//  NeilOS
+//
+
+#ifndef SYSIORING_H
+#define SYSIORING_H
+
+#include <common/types.h>
+#include <syscalls/descriptor.h>
+
+// Operations
+#define IO_RING_OP_NOP			0
+#define IO_RING_OP_READ			1
+#define IO_RING_OP_WRITE		2
+#define IO_RING_OP_MQ_SEND		3
+#define IO_RING_OP_MQ_RECEIVE	4
+#define IO_RING_OP_FENCE_WAIT	5
+
+// Use (and move) the descriptor's position instead of an offset
+#define IO_RING_OFFSET_NONE		((uint64_t)-1)
+
+// Flags for io_ring_enter
+#define IO_RING_ENTER_GETEVENTS	0x1		// Wait for min_complete completions
+
+// A submission
+typedef struct {
+	uint32_t opcode;
+	int32_t fd;
+	uint64_t offset;			// For read and write
+	void* addr;					// Buffer
+	uint32_t len;				// Buffer length (the fence for IO_RING_OP_FENCE_WAIT)
+	uint32_t priority;			// For IO_RING_OP_MQ_SEND
+	uint32_t reserved;
+	uint64_t user_data;			// Passed back in the completion
+} io_sqe_t;
+
+// A completion
+typedef struct {
+	uint64_t user_data;
+	int32_t res;				// Return value of the operation
+	uint32_t flags;				// Message priority for IO_RING_OP_MQ_RECEIVE
+} io_cqe_t;
+
+// Submission and completion queues (lives in the program's memory)
+typedef struct {
+	volatile uint32_t sq_head;	// Next submission the kernel will take (written by the kernel)
+	volatile uint32_t sq_tail;	// Where the next submission goes (written by the program)
+	volatile uint32_t cq_head;	// Next completion the program will take (written by the program)
+	volatile uint32_t cq_tail;	// Where the next completion goes (written by the kernel)
+	uint32_t sq_entries;		// Powers of two
+	uint32_t cq_entries;
+	io_sqe_t* sqes;
+	io_cqe_t* cqes;
+} io_ring_t;
+
+// Set up a ring (returns a descriptor for it)
+uint32_t io_ring_setup(io_ring_t* ring);
+
+// Submit up to to_submit operations and optionally wait for completions.
+// Returns the number of submissions taken
+uint32_t io_ring_enter(uint32_t fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags);
+
+#endif /* SYSIORING_H */
@@ -216,14 +216,17 @@ void* mmap(void* addr, uint32_t length, int prot, int flags, int fd, uint32_t of
 		return (void*)-EINVAL;
 	if ((offset % FOUR_KB_SIZE) != 0)
 		return (void*)-EINVAL;
-	if (!(flags & MAP_ANONYMOUS) && !descriptors[fd])
+	if (!(flags & MAP_ANONYMOUS) && (fd < 0 || fd >= descriptor_table->size || !descriptors[fd]))
 		return (void*)-EBADF;
 	if (((flags & MAP_PRIVATE) != 0) == ((flags & MAP_SHARED) != 0))
 		return (void*)-EINVAL;
 	
 	// Adjust addr to nearest 4kb
 	addr = (void*)((uint32_t)addr - ((uint32_t)addr % FOUR_KB_SIZE));
-	down(&descriptors[fd]->lock);
+	// Anonymous mappings don't have a descriptor (fd is usually -1)
+	file_descriptor_t* d = (flags & MAP_ANONYMOUS) ? NULL : descriptors[fd];
+	if (d)
+		down(&d->lock);
 	
 	// Only allow files that are seekable
 	if (!(flags & MAP_ANONYMOUS)) {
@@ -231,8 +234,8 @@ void* mmap(void* addr, uint32_t length, int prot, int flags, int fd, uint32_t of
 			up(&descriptors[fd]->lock);
 			return (void*)-EBADF;
 		}
-		uint64_t ret = descriptors[fd]->llseek(descriptors[fd], uint64_make(0, 0), SEEK_CUR);
-		if ((int32_t)ret.high < 0) {
+		uint64_t ret = descriptors[fd]->llseek(descriptors[fd], 0, SEEK_CUR);
+		if ((int64_t)ret < 0) {
 			up(&descriptors[fd]->lock);
 			return (void*)-EBADF;
 		}
@@ -260,7 +263,8 @@ void* mmap(void* addr, uint32_t length, int prot, int flags, int fd, uint32_t of
 	mmap_list_t* mapping = mmap_list_create((uint32_t)addr, (uint32_t)addr + length,
 											perm, (flags & MAP_ANONYMOUS) ? NULL : descriptors[fd],
 											offset, (flags & MAP_SHARED) != 0);
-	up(&descriptors[fd]->lock);
+	if (d)
+		up(&d->lock);
 	if (!mapping) {
 		return (void*)-ENOMEM;
 	}
@@ -11,6 +11,8 @@
 
 #include <common/types.h>
 
+struct pcb;
+
 // Set the program break to a specific address
 uint32_t brk(uint32_t addr);
 
@@ -26,5 +28,9 @@ int munmap(void* addr, uint32_t length);
 // Flush memory contents
 int msync(void* addr, uint32_t length, int flags);
 
+// Helper to map contiguous 4kb pages into a pcb (allocating physical memory as needed)
+bool map_contigous_pages(struct pcb* pcb, uint32_t start, uint32_t num_pages, uint32_t permissions, bool shared,
+						 uint32_t* paddrs, uint32_t paddr_length, uint32_t initial_offset);
+
 #endif /* SYSMEM_H */
 
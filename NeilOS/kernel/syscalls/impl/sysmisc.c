@@ -217,7 +217,7 @@ int ioctl(uint32_t fd, int request, uint32_t arg1, uint32_t arg2, uint32_t arg3,
 	LOG_DEBUG_INFO_STR("(%d, %d, %d, %d, %d, %d)", fd, request, arg1, arg2, arg3, arg4);
 
 	// Check if the arguments are in range
-	if (fd >= NUMBER_OF_DESCRIPTORS)
+	if (fd >= descriptor_table->size)
 		return -EBADF;
 	
 	down(&current_pcb->descriptor_lock);
@@ -0,0 +1,699 @@
+//
+//  syspoll.c
+//  NeilOS
+//
+
+#include "syspoll.h"
+#include <common/lib.h>
+#include <memory/allocation/heap.h>
+#include <program/task.h>
+#include <common/log.h>
+#include <syscalls/interrupt.h>
+
+// How often to check descriptors that don't have a wait queue
+#define POLL_INTERVAL_MS		10
+
+// A descriptor being watched by an epoll instance
+typedef struct epoll_item {
+	uint32_t fd;
+	file_descriptor_t* file;		// NULL once a close has taken back the item's reference
+	epoll_event_t event;
+	wait_queue_entry_t wait;		// On the descriptor's wait queue
+	struct epoll_info* ep;
+	
+	bool ready;						// On the ready list
+	struct epoll_item* next_ready;
+	
+	bool closed;					// The descriptor was closed (and the item is off its wait queue)
+	bool in_use;					// The descriptor is being used, so a close has to leave the reference alone
+	
+	struct epoll_item* next;
+	struct epoll_item* prev;
+} epoll_item_t;
+
+// An epoll instance
+typedef struct epoll_info {
+	epoll_item_t* items;
+	uint32_t num_polled;			// Items whose descriptors don't have a wait queue
+	
+	// Items that may have events (added to from interrupts)
+	epoll_item_t* ready_head;
+	epoll_item_t* ready_tail;
+	spinlock_t ready_lock;
+	
+	// Woken up when an item becomes ready
+	wait_queue_t wait;
+} epoll_info_t;
+
+// Release a descriptor that was retained
+void poll_release(file_descriptor_t* f) {
+	down(&f->lock);
+	if (!file_descriptor_release(f))
+		up(&f->lock);
+}
+
+// Put the current thread on the wait queues of a list of descriptors (NULL entries are skipped).
+// Returns whether any of them have to be polled instead
+bool poll_add_waits(file_descriptor_t** files, wait_queue_entry_t* entries, uint32_t num) {
+	bool needs_polling = false;
+	for (uint32_t z = 0; z < num; z++) {
+		entries[z].queue = NULL;
+		if (!files[z])
+			continue;
+		if (files[z]->wait_queue)
+			wait_queue_add_current(files[z]->wait_queue, &entries[z]);
+		else
+			needs_polling = true;
+	}
+	return needs_polling;
+}
+
+// Take the current thread off the wait queues
+void poll_remove_waits(wait_queue_entry_t* entries, uint32_t num) {
+	for (uint32_t z = 0; z < num; z++)
+		wait_queue_remove(&entries[z]);
+}
+
+// Sleep until woken up or end is reached (if not NULL). Wakes up periodically if something needs polling
+void poll_sleep(struct timeval* end, bool needs_polling) {
+	struct timeval poll_end;
+	if (needs_polling) {
+		poll_end = time_add(time_get(), (struct timeval){ 0, POLL_INTERVAL_MS * US_IN_MS });
+		if (!end || time_less(poll_end, *end))
+			end = &poll_end;
+	}
+	thread_sleep(end);
+}
+
+// Get the time to stop waiting from a timeout in ms
+struct timeval poll_end_time(int32_t timeout) {
+	return time_add(time_get(), (struct timeval){ timeout / MS_IN_SEC, (timeout % MS_IN_SEC) * US_IN_MS });
+}
+
+// Helper to clear fds
+void clear_fds(fd_set* read, fd_set* write, fd_set* except) {
+	if (read)
+		memset(read, 0, sizeof(fd_set));
+	if (write)
+		memset(write, 0, sizeof(fd_set));
+	if (except)
+		memset(except, 0, sizeof(fd_set));
+}
+
+// Wait for changes to file descriptors
+int select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout) {
+	LOG_DEBUG_INFO_STR("(%d, 0x%x, 0x%x, 0x%x, 0x%x)", nfds, readfds, writefds, exceptfds, timeout);
+	
+	if ((!readfds && !writefds && !exceptfds && !timeout) || nfds == 0)
+		return -EINVAL;
+	
+	// An fd_set only has room for the first few descriptors
+	int max_fds = sizeof(fd_set) * 8;
+	if (max_fds > descriptor_table->size)
+		max_fds = descriptor_table->size;
+	if (nfds > max_fds || nfds < 0)
+		nfds = max_fds;
+	
+	// Copy over fd sets and clear them
+	fd_set rc;
+	if (readfds)
+		rc = *readfds;
+	else
+		memset(&rc, 0, sizeof(fd_set));
+	fd_set wc;
+	if (writefds)
+		wc = *writefds;
+	else
+		memset(&wc, 0, sizeof(fd_set));
+	clear_fds(readfds, writefds, exceptfds);
+	
+	down(&current_pcb->descriptor_lock);
+	uint32_t num_desc = 0;
+	for (int z = 0; z < nfds; z++) {
+		int index = z / 32;
+		int bit = z % 32;
+		if ((rc.bits[index] >> bit) & 0x1 || (wc.bits[index] >> bit) & 0x1) {
+			num_desc++;
+			if (!descriptors[z]) {
+				up(&current_pcb->descriptor_lock);
+				return -EBADF;
+			}
+		}
+	}
+	file_descriptor_t* select_desc[num_desc];
+	wait_queue_entry_t* select_waits = (wait_queue_entry_t*)kmalloc(num_desc * sizeof(wait_queue_entry_t));
+	if (!select_waits && num_desc != 0) {
+		up(&current_pcb->descriptor_lock);
+		return -ENOMEM;
+	}
+	uint32_t desc_num = 0;
+	for (int z = 0; z < nfds; z++) {
+		int index = z / 32;
+		int bit = z % 32;
+		if ((rc.bits[index] >> bit) & 0x1 || (wc.bits[index] >> bit) & 0x1) {
+			select_desc[desc_num++] = descriptors[z];
+			file_descriptor_retain(descriptors[z]);
+		}
+	}
+	up(&current_pcb->descriptor_lock);
+	
+	// Sleep until something can be done or the timeout has expired
+	bool needs_polling = poll_add_waits(select_desc, select_waits, num_desc);
+	struct timeval end = { 0, 0 };
+	if (timeout)
+		end = time_add(time_get(), *timeout);
+	int total = 0;
+	while (!current_pcb->should_terminate) {
+		if (signal_occurring(current_pcb)) {
+			total = -EINTR;
+			break;
+		}
+		// Check all file descriptors and see if they can read or write
+		thread_sleep_prepare();
+		desc_num = 0;
+		for (int z = 0; z < nfds; z++) {
+			int index = z / 32;
+			int bit = z % 32;
+			bool rb = (rc.bits[index] >> bit) & 0x1;
+			bool wb = (wc.bits[index] >> bit) & 0x1;
+			if (!rb && !wb)
+				continue;
+	
+			file_descriptor_t* d = select_desc[desc_num++];
+			down(&d->lock);
+			uint32_t events = file_descriptor_poll(d, (rb ? POLLIN : 0) | (wb ? POLLOUT : 0));
+			up(&d->lock);
+			if (events & POLLNVAL) {
+				total = -EBADF;
+				goto cleanup;
+			}
+	
+			if (events & POLLIN) {
+				readfds->bits[index] |= (1 << bit);
+				total++;
+			}
+			if (events & POLLOUT) {
+				writefds->bits[index] |= (1 << bit);
+				total++;
+			}
+		}
+		if (total != 0)
+			break;
+	
+		if (timeout && !time_less(time_get(), end))
+			break;
+	
+		poll_sleep(timeout ? &end : NULL, needs_polling);
+	}
+
+cleanup:
+	poll_remove_waits(select_waits, num_desc);
+	if (select_waits)
+		kfree(select_waits);
+	for (uint32_t z = 0; z < num_desc; z++)
+		poll_release(select_desc[z]);
+	
+	return total;
+}
+
+// Wait for events on a list of file descriptors (timeout is in ms, negative for none)
+uint32_t poll(pollfd_t* fds, uint32_t nfds, int32_t timeout) {
+	LOG_DEBUG_INFO_STR("(0x%x, %d, %d)", fds, nfds, timeout);
+	
+	if (nfds > NUMBER_OF_DESCRIPTORS)
+		return -EINVAL;
+	if (!fds && nfds != 0)
+		return -EFAULT;
+	
+	// Too many descriptors can be polled to keep their pointers on the stack
+	file_descriptor_t** files = NULL;
+	wait_queue_entry_t* waits = NULL;
+	if (nfds != 0) {
+		files = (file_descriptor_t**)kmalloc(nfds * sizeof(file_descriptor_t*));
+		waits = (wait_queue_entry_t*)kmalloc(nfds * sizeof(wait_queue_entry_t));
+		if (!files || !waits) {
+			if (files)
+				kfree(files);
+			if (waits)
+				kfree(waits);
+			return -ENOMEM;
+		}
+	}
+	
+	// Retain the descriptors (ones that aren't open get POLLNVAL)
+	down(&current_pcb->descriptor_lock);
+	for (uint32_t z = 0; z < nfds; z++) {
+		files[z] = NULL;
+		fds[z].revents = 0;
+		if (fds[z].fd >= 0 && fds[z].fd < descriptor_table->size && descriptors[fds[z].fd]) {
+			files[z] = descriptors[fds[z].fd];
+			file_descriptor_retain(files[z]);
+		}
+	}
+	up(&current_pcb->descriptor_lock);
+	
+	// Sleep until something is ready or the timeout has expired
+	bool needs_polling = poll_add_waits(files, waits, nfds);
+	struct timeval end = { 0, 0 };
+	if (timeout > 0)
+		end = poll_end_time(timeout);
+	uint32_t total = 0;
+	while (!current_pcb->should_terminate) {
+		if (signal_occurring(current_pcb)) {
+			total = -EINTR;
+			break;
+		}
+	
+		thread_sleep_prepare();
+		for (uint32_t z = 0; z < nfds; z++) {
+			if (fds[z].fd < 0)
+				continue;
+	
+			uint32_t revents = POLLNVAL;
+			if (files[z]) {
+				down(&files[z]->lock);
+				revents = file_descriptor_poll(files[z], fds[z].events);
+				up(&files[z]->lock);
+				revents &= (fds[z].events | POLLERR | POLLHUP | POLLNVAL);
+			}
+			fds[z].revents = revents;
+			if (revents)
+				total++;
+		}
+		if (total != 0 || timeout == 0)
+			break;
+	
+		if (timeout > 0 && !time_less(time_get(), end))
+			break;
+	
+		poll_sleep(timeout > 0 ? &end : NULL, needs_polling);
+	}
+	
+	poll_remove_waits(waits, nfds);
+	if (waits)
+		kfree(waits);
+	for (uint32_t z = 0; z < nfds; z++) {
+		if (files[z])
+			poll_release(files[z]);
+	}
+	if (files)
+		kfree(files);
+	
+	return total;
+}
+
+// Put an item on the ready list (safe to call from interrupts)
+void epoll_item_ready(epoll_item_t* item) {
+	epoll_info_t* ep = item->ep;
+	
+	uint32_t flags;
+	spin_lock_irqsave(&ep->ready_lock, flags);
+	if (!item->ready) {
+		item->ready = true;
+		item->next_ready = NULL;
+		if (ep->ready_tail)
+			ep->ready_tail->next_ready = item;
+		else
+			ep->ready_head = item;
+		ep->ready_tail = item;
+	}
+	spin_unlock_irqrestore(&ep->ready_lock, flags);
+}
+
+// Called when an item's descriptor has an event
+void epoll_item_wake(wait_queue_entry_t* entry, uint32_t events) {
+	epoll_item_t* item = (epoll_item_t*)entry->data;
+	epoll_info_t* ep = item->ep;
+	
+	if (events & POLLNVAL) {
+		// The descriptor was closed (the closer holds its lock), so give back the item's reference
+		// now instead of keeping the file open until the next epoll_wait
+		uint32_t flags;
+		spin_lock_irqsave(&ep->ready_lock, flags);
+		if (!item->closed) {
+			item->closed = true;
+			wait_queue_remove_locked(entry);
+			if (!item->in_use) {
+				item->file->ref_count--;
+				item->file = NULL;
+			}
+		}
+		spin_unlock_irqrestore(&ep->ready_lock, flags);
+	}
+	
+	epoll_item_ready(item);
+	wait_queue_wake(&ep->wait, POLLIN);
+}
+
+// Remove an item from an epoll instance and free it
+void epoll_item_free(epoll_item_t* item) {
+	epoll_info_t* ep = item->ep;
+	
+	// Keep a close from letting go of the descriptor while it's being taken off its wait queue
+	uint32_t flags;
+	spin_lock_irqsave(&ep->ready_lock, flags);
+	item->in_use = true;
+	spin_unlock_irqrestore(&ep->ready_lock, flags);
+	
+	// Stop getting events
+	if (item->file && !item->file->wait_queue)
+		ep->num_polled--;
+	else
+		wait_queue_remove(&item->wait);
+	
+	// Take it off the ready list
+	spin_lock_irqsave(&ep->ready_lock, flags);
+	if (item->ready) {
+		epoll_item_t* prev = NULL;
+		for (epoll_item_t* t = ep->ready_head; t; prev = t, t = t->next_ready) {
+			if (t != item)
+				continue;
+			if (prev)
+				prev->next_ready = t->next_ready;
+			else
+				ep->ready_head = t->next_ready;
+			if (ep->ready_tail == t)
+				ep->ready_tail = prev;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&ep->ready_lock, flags);
+	
+	if (item->prev)
+		item->prev->next = item->next;
+	else
+		ep->items = item->next;
+	if (item->next)
+		item->next->prev = item->prev;
+	
+	if (item->file)
+		poll_release(item->file);
+	kfree(item);
+}
+
+// Collect events from the ready list (must hold the epoll descriptor's lock)
+uint32_t epoll_collect(epoll_info_t* ep, epoll_event_t* events, uint32_t maxevents) {
+	// Descriptors without wait queues have to be checked every time
+	if (ep->num_polled != 0) {
+		for (epoll_item_t* item = ep->items; item; item = item->next) {
+			if (item->file && !item->file->wait_queue)
+				epoll_item_ready(item);
+		}
+	}
+	
+	// Take the whole ready list (events that happen while checking go on a new list)
+	uint32_t flags;
+	spin_lock_irqsave(&ep->ready_lock, flags);
+	epoll_item_t* item = ep->ready_head;
+	ep->ready_head = ep->ready_tail = NULL;
+	for (epoll_item_t* t = item; t; t = t->next_ready)
+		t->ready = false;
+	spin_unlock_irqrestore(&ep->ready_lock, flags);
+	
+	uint32_t num = 0;
+	while (item) {
+		epoll_item_t* next = item->next_ready;
+	
+		// Keep a close from letting go of the descriptor while it is checked
+		spin_lock_irqsave(&ep->ready_lock, flags);
+		file_descriptor_t* f = item->file;
+		item->in_use = true;
+		spin_unlock_irqrestore(&ep->ready_lock, flags);
+	
+		uint32_t wanted = item->event.events & ~(EPOLLET | EPOLLONESHOT);
+		if (!f || f->closed) {
+			// The descriptor was closed, so stop watching it
+			epoll_item_free(item);
+			item = next;
+			continue;
+		}
+	
+		if (wanted && num == maxevents) {
+			// No room, so check it next time
+			epoll_item_ready(item);
+		} else if (wanted) {
+			down(&f->lock);
+			uint32_t revents = file_descriptor_poll(f, wanted) & (wanted | POLLERR | POLLHUP);
+			up(&f->lock);
+	
+			if (revents) {
+				events[num].events = revents;
+				events[num].data = item->event.data;
+				num++;
+	
+				if (item->event.events & EPOLLONESHOT)
+					item->event.events &= (EPOLLET | EPOLLONESHOT);
+				else if (!(item->event.events & EPOLLET))
+					epoll_item_ready(item);
+			}
+		}
+	
+		// A close that happened while checking it left the reference to us
+		spin_lock_irqsave(&ep->ready_lock, flags);
+		item->in_use = false;
+		bool closed = item->closed;
+		spin_unlock_irqrestore(&ep->ready_lock, flags);
+		if (closed)
+			epoll_item_free(item);
+	
+		item = next;
+	}
+	
+	return num;
+}
+
+// Whether an epoll instance may have events
+bool epoll_can_read(file_descriptor_t* f) {
+	epoll_info_t* ep = (epoll_info_t*)f->info;
+	return ep->ready_head != NULL || ep->num_polled != 0;
+}
+
+// Get info about an epoll instance
+uint32_t epoll_stat(file_descriptor_t* f, sys_stat_type* data) {
+	memset(data, 0, sizeof(sys_stat_type));
+	data->mode = f->mode;
+	return 0;
+}
+
+// Seek an epoll instance (returns error)
+uint64_t epoll_llseek(file_descriptor_t* f, uint64_t offset, int whence) {
+	return (uint64_t)-ESPIPE;
+}
+
+// Duplicate an epoll instance
+file_descriptor_t* epoll_duplicate(file_descriptor_t* f) {
+	f->ref_count++;
+	return f;
+}
+
+// Close an epoll instance
+uint32_t epoll_close(file_descriptor_t* f) {
+	if (f->ref_count == 0) {
+		epoll_info_t* ep = (epoll_info_t*)f->info;
+		while (ep->items)
+			epoll_item_free(ep->items);
+		kfree(ep);
+	}
+	
+	return 0;
+}
+
+// Create an epoll instance
+uint32_t epoll_create(uint32_t flags) {
+	LOG_DEBUG_INFO_STR("(0x%x)", flags);
+	
+	file_descriptor_t* d = (file_descriptor_t*)kmalloc(sizeof(file_descriptor_t));
+	if (!d)
+		return -ENOMEM;
+	memset(d, 0, sizeof(file_descriptor_t));
+	epoll_info_t* ep = (epoll_info_t*)kmalloc(sizeof(epoll_info_t));
+	if (!ep) {
+		kfree(d);
+		return -ENOMEM;
+	}
+	memset(ep, 0, sizeof(epoll_info_t));
+	ep->ready_lock = SPIN_LOCK_UNLOCKED;
+	wait_queue_init(&ep->wait);
+	
+	d->lock = MUTEX_UNLOCKED;
+	d->mode = FILE_MODE_READ;
+	d->ref_count = 1;
+	d->info = ep;
+	d->wait_queue = &ep->wait;
+	d->can_read = epoll_can_read;
+	d->stat = epoll_stat;
+	d->llseek = epoll_llseek;
+	d->duplicate = epoll_duplicate;
+	d->close = epoll_close;
+	
+	// Find a free descriptor
+	down(&current_pcb->descriptor_lock);
+	int32_t fd = descriptor_alloc(current_pcb, 0);
+	if (fd >= 0)
+		descriptor_table_set(current_pcb->descriptors, fd, d, (flags & EPOLL_CLOEXEC) ? FD_CLOEXEC : 0);
+	up(&current_pcb->descriptor_lock);
+	
+	if (fd < 0) {
+		kfree(ep);
+		kfree(d);
+	}
+	return fd;
+}
+
+// Add, modify or remove a file descriptor from an epoll instance
+uint32_t epoll_ctl(uint32_t epfd, uint32_t op, uint32_t fd, epoll_event_t* event) {
+	LOG_DEBUG_INFO_STR("(%d, %d, %d, 0x%x)", epfd, op, fd, event);
+	
+	if (epfd >= descriptor_table->size || fd >= descriptor_table->size)
+		return -EBADF;
+	if (epfd == fd)
+		return -EINVAL;
+	if (op != EPOLL_CTL_DEL && !event)
+		return -EFAULT;
+	
+	down(&current_pcb->descriptor_lock);
+	if (!descriptors[epfd] || !descriptors[fd]) {
+		up(&current_pcb->descriptor_lock);
+		return -EBADF;
+	}
+	if (descriptors[epfd]->close != epoll_close) {
+		up(&current_pcb->descriptor_lock);
+		return -EINVAL;
+	}
+	file_descriptor_t* d = descriptors[epfd];
+	file_descriptor_t* f = descriptors[fd];
+	down(&d->lock);
+	file_descriptor_retain(d);
+	down(&f->lock);
+	file_descriptor_retain(f);
+	up(&f->lock);
+	up(&current_pcb->descriptor_lock);
+	
+	epoll_info_t* ep = (epoll_info_t*)d->info;
+	epoll_item_t* item = ep->items;
+	while (item && (item->fd != fd || item->file != f))
+		item = item->next;
+	
+	uint32_t ret = 0;
+	switch (op) {
+		case EPOLL_CTL_ADD:
+			if (item) {
+				ret = -EEXIST;
+				break;
+			}
+			item = (epoll_item_t*)kmalloc(sizeof(epoll_item_t));
+			if (!item) {
+				ret = -ENOMEM;
+				break;
+			}
+			memset(item, 0, sizeof(epoll_item_t));
+			item->fd = fd;
+			item->file = f;
+			item->event = *event;
+			item->ep = ep;
+			item->wait.func = epoll_item_wake;
+			item->wait.data = item;
+	
+			item->next = ep->items;
+			if (ep->items)
+				ep->items->prev = item;
+			ep->items = item;
+	
+			if (f->wait_queue)
+				wait_queue_add(f->wait_queue, &item->wait);
+			else
+				ep->num_polled++;
+	
+			// The item keeps the reference
+			f = NULL;
+	
+			// Check it on the next wait
+			epoll_item_ready(item);
+			wait_queue_wake(&ep->wait, POLLIN);
+			break;
+		case EPOLL_CTL_MOD:
+			if (!item) {
+				ret = -ENOENT;
+				break;
+			}
+			item->event = *event;
+			epoll_item_ready(item);
+			wait_queue_wake(&ep->wait, POLLIN);
+			break;
+		case EPOLL_CTL_DEL:
+			if (!item) {
+				ret = -ENOENT;
+				break;
+			}
+			epoll_item_free(item);
+			break;
+		default:
+			ret = -EINVAL;
+			break;
+	}
+	
+	if (f)
+		poll_release(f);
+	if (!file_descriptor_release(d))
+		up(&d->lock);
+	
+	return ret;
+}
+
+// Wait for events on an epoll instance (timeout is in ms, negative for none)
+uint32_t epoll_wait(uint32_t epfd, epoll_event_t* events, uint32_t maxevents, int32_t timeout) {
+	LOG_DEBUG_INFO_STR("(%d, 0x%x, %d, %d)", epfd, events, maxevents, timeout);
+	
+	if (epfd >= descriptor_table->size)
+		return -EBADF;
+	if (!events || maxevents == 0)
+		return -EINVAL;
+	
+	down(&current_pcb->descriptor_lock);
+	if (!descriptors[epfd]) {
+		up(&current_pcb->descriptor_lock);
+		return -EBADF;
+	}
+	if (descriptors[epfd]->close != epoll_close) {
+		up(&current_pcb->descriptor_lock);
+		return -EINVAL;
+	}
+	file_descriptor_t* d = descriptors[epfd];
+	down(&d->lock);
+	file_descriptor_retain(d);
+	up(&current_pcb->descriptor_lock);
+	
+	// Sleep until an item has events or the timeout has expired
+	epoll_info_t* ep = (epoll_info_t*)d->info;
+	wait_queue_entry_t entry;
+	wait_queue_add_current(&ep->wait, &entry);
+	struct timeval end = { 0, 0 };
+	if (timeout > 0)
+		end = poll_end_time(timeout);
+	uint32_t total = 0;
+	while (!current_pcb->should_terminate && !d->closed) {
+		if (signal_occurring(current_pcb)) {
+			total = -EINTR;
+			break;
+		}
+	
+		thread_sleep_prepare();
+		total = epoll_collect(ep, events, maxevents);
+		if (total != 0 || timeout == 0)
+			break;
+	
+		if (timeout > 0 && !time_less(time_get(), end))
+			break;
+	
+		// Let other threads change the instance while sleeping
+		up(&d->lock);
+		poll_sleep(timeout > 0 ? &end : NULL, ep->num_polled != 0);
+		down(&d->lock);
+	}
+	wait_queue_remove(&entry);
+	
+	if (!file_descriptor_release(d))
+		up(&d->lock);
+	
+	return total;
+}
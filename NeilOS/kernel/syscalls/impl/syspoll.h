@@ -0,0 +1,59 @@
+//
+//  syspoll.h
+//  NeilOS
+//
+
+#ifndef SYSPOLL_H
+#define SYSPOLL_H
+
+#include <common/types.h>
+#include <syscalls/descriptor.h>
+#include <common/time.h>
+
+// Operations for epoll_ctl
+#define EPOLL_CTL_ADD			1
+#define EPOLL_CTL_DEL			2
+#define EPOLL_CTL_MOD			3
+
+// Flags for epoll_create
+#define EPOLL_CLOEXEC			02000000
+
+// Flags for epoll events (the rest are the same as poll's)
+#define EPOLLONESHOT			(1 << 30)
+#define EPOLLET					(1 << 31)
+
+// Same layout as struct pollfd
+typedef struct {
+	int32_t fd;
+	int16_t events;
+	int16_t revents;
+} pollfd_t;
+
+// Same layout as struct epoll_event
+typedef struct {
+	uint32_t events;
+	uint64_t data;
+} __attribute__((packed)) epoll_event_t;
+
+// Release a descriptor that was retained
+void poll_release(file_descriptor_t* f);
+
+// Sleep until woken up or end is reached (if not NULL). Wakes up periodically if something needs polling
+void poll_sleep(struct timeval* end, bool needs_polling);
+
+// Wait for changes to file descriptors
+int select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout);
+
+// Wait for events on a list of file descriptors (timeout is in ms, negative for none)
+uint32_t poll(pollfd_t* fds, uint32_t nfds, int32_t timeout);
+
+// Create an epoll instance
+uint32_t epoll_create(uint32_t flags);
+
+// Add, modify or remove a file descriptor from an epoll instance
+uint32_t epoll_ctl(uint32_t epfd, uint32_t op, uint32_t fd, epoll_event_t* event);
+
+// Wait for events on an epoll instance (timeout is in ms, negative for none)
+uint32_t epoll_wait(uint32_t epfd, epoll_event_t* events, uint32_t maxevents, int32_t timeout);
+
+#endif /* SYSPOLL_H */
@@ -9,19 +9,12 @@
 #include "sysproc.h"
 #include <common/types.h>
 #include <program/task.h>
+#include <program/loader/elf.h>
 #include <common/log.h>
 #include <syscalls/interrupt.h>
 #include <drivers/filesystem/path.h>
 #include <boot/x86_desc.h>
-
-typedef struct {
-	uint32_t eip;
-	uint32_t cs;
-	uint32_t eflags;
-	uint32_t esp;
-	uint32_t ss;
-} iret_t;
-
+#include <syscalls/impl/sysfile.h>
 
 // Returns to a user space program
 extern void return_to_user(thread_t* thread, pcb_t* pcb, thread_t* parent_thread);
@@ -37,17 +30,21 @@ extern void implicit_thread_exit_end();
 // Initialize the descriptors for a pcb
 void init_descriptors(pcb_t* pcb) {
 	// Open default descriptors
-	descriptors = pcb->descriptors;
 	down(&pcb->descriptor_lock);
-	pcb->descriptors[STDIN] = terminal_open("stdin", FILE_MODE_READ);
-	pcb->descriptors[STDIN]->ref_count = 1;
-	pcb->descriptors[STDOUT] = terminal_open("stdout", FILE_MODE_WRITE);
-	pcb->descriptors[STDOUT]->ref_count = 1;
-	pcb->descriptors[STDERR] = terminal_open("stderr", FILE_MODE_WRITE);
-	pcb->descriptors[STDERR]->ref_count = 1;
+	pcb->descriptors = descriptor_table_alloc(DESCRIPTOR_TABLE_INITIAL_SIZE);
+	if (!pcb->descriptors) {
+		up(&pcb->descriptor_lock);
+		return;
+	}
+	descriptor_table_set(pcb->descriptors, STDIN, terminal_open("stdin", FILE_MODE_READ), 0);
+	pcb->descriptors->files[STDIN]->ref_count = 1;
+	descriptor_table_set(pcb->descriptors, STDOUT, terminal_open("stdout", FILE_MODE_WRITE), 0);
+	pcb->descriptors->files[STDOUT]->ref_count = 1;
+	descriptor_table_set(pcb->descriptors, STDERR, terminal_open("stderr", FILE_MODE_WRITE), 0);
+	pcb->descriptors->files[STDERR]->ref_count = 1;
 	up(&pcb->descriptor_lock);
 	
-	descriptors = pcb->descriptors;
+	set_current_descriptors(pcb->descriptors);
 }
 
 // Queue a task in the currently loaded task's spot
@@ -156,6 +153,199 @@ uint32_t fork() {
 	return pcb->task->pid;
 }
 
+// Create a child that uses this task's memory and wait until the child execs or exits
+uint32_t vfork() {
+	LOG_DEBUG_INFO();
+	
+	pcb_t* pcb = NULL;
+	if ((pcb = vfork_current_task()) == NULL)
+		return -ENOMEM;
+	
+	// Same as fork but there is only the one thread
+	thread_t* t = pcb->threads;
+	t->saved_esp = t->context.esp + (uint32_t)t - (uint32_t)current_thread;
+	t->context.eax = 0;
+	t->saved_esp -= sizeof(uint32_t) + sizeof(context_state_t);
+	char* esp = (char*)t->saved_esp;
+	memcpy(esp, &t->context, sizeof(context_state_t));
+	uint32_t addr = (uint32_t)fork_return;
+	memcpy(&esp[sizeof(context_state_t)], &addr, sizeof(uint32_t));
+	t->in_syscall = false;
+	t->state = READY;
+	
+	// The child can be gone by the time we get the memory back
+	uint32_t pid = pcb->task->pid;
+	thread_t* thread = current_thread;
+	thread->vfork_waiting = true;
+	
+	// Enable the child to be scheduled and jump into it
+	pcb->state = READY;
+	context_switch(current_thread, t);
+	
+	// The child is using our stack, so don't return until it is done with it
+	while (thread->vfork_waiting) {
+		thread_sleep_prepare();
+		if (!thread->vfork_waiting)
+			break;
+		thread_sleep(NULL);
+	}
+	
+	return pid;
+}
+
+// Free what a spawned task was going to do
+void spawn_info_free(spawn_info_t* info) {
+	copy_task_arguments_free(info->filename, info->argv, info->envp);
+	for (uint32_t z = 0; z < info->num_actions; z++) {
+		if (info->actions[z].action == SPAWN_ACTION_OPEN && info->actions[z].path)
+			kfree((char*)info->actions[z].path);
+	}
+	kfree(info);
+}
+
+// Copy the program, arguments and file actions for a spawned task
+spawn_info_t* spawn_info_copy(char* filename, const char* argv[], const char* envp[],
+							  const spawn_file_action_t* actions, uint32_t num_actions) {
+	spawn_info_t* info = (spawn_info_t*)kmalloc(sizeof(spawn_info_t) + sizeof(spawn_file_action_t) * num_actions);
+	if (!info)
+		return NULL;
+	memset(info, 0, sizeof(spawn_info_t));
+	
+	if (!copy_task_arguments(filename, argv, envp, &info->filename, &info->argv, &info->envp)) {
+		kfree(info);
+		return NULL;
+	}
+	
+	// The paths get their own copies too
+	for (uint32_t z = 0; z < num_actions; z++) {
+		info->actions[z] = actions[z];
+		info->num_actions = z + 1;
+		if (actions[z].action != SPAWN_ACTION_OPEN || !actions[z].path)
+			continue;
+		
+		uint32_t len = strlen(actions[z].path);
+		char* path = (char*)kmalloc(len + 1);
+		if (!path) {
+			info->actions[z].path = NULL;
+			spawn_info_free(info);
+			return NULL;
+		}
+		memcpy(path, actions[z].path, len + 1);
+		info->actions[z].path = path;
+	}
+	
+	return info;
+}
+
+// Perform file actions on the current task's descriptors
+bool spawn_actions_perform(spawn_file_action_t* actions, uint32_t num_actions) {
+	for (uint32_t z = 0; z < num_actions; z++) {
+		spawn_file_action_t* action = &actions[z];
+		int32_t ret = 0;
+		switch (action->action) {
+			case SPAWN_ACTION_OPEN:
+				if (!action->path)
+					return false;
+				ret = open(action->path, action->mode, 0);
+				// Move it to where it was asked for
+				if (ret >= 0 && ret != action->fd) {
+					int32_t fd = ret;
+					ret = dup2(fd, action->fd);
+					close(fd);
+				}
+				break;
+			case SPAWN_ACTION_CLOSE:
+				ret = close(action->fd);
+				break;
+			case SPAWN_ACTION_DUP2:
+				ret = dup2(action->fd, action->new_fd);
+				break;
+			default:
+				ret = -EINVAL;
+				break;
+		}
+		
+		if (ret < 0)
+			return false;
+	}
+	
+	return true;
+}
+
+// Where a spawned task starts (performs its file actions and then loads its program)
+void spawn_start() {
+	pcb_t* pcb = current_pcb;
+	spawn_info_t* info = pcb->spawn_info;
+	pcb->spawn_info = NULL;
+	
+	// Like a failed exec in a forked child
+	pcb_t* loaded = NULL;
+	if (!info || !spawn_actions_perform(info->actions, info->num_actions) ||
+		queue_task(info->filename, (const char**)info->argv, (const char**)info->envp, &loaded) != 0) {
+		if (info)
+			spawn_info_free(info);
+		terminate_task(127);
+	}
+	// Exec clears the signal mask
+	if (info->attr.flags & SPAWN_SETSIGMASK)
+		signal_set_mask(loaded, info->attr.sigmask);
+	spawn_info_free(info);
+	
+	run_with_fake_parent(loaded, NULL);
+}
+
+// Start a program as a child of this task without copying this task first (returns the child's pid)
+uint32_t posix_spawn(const char* filename, const char* argv[], const char* envp[],
+					 const spawn_file_action_t* actions, uint32_t num_actions, const spawn_attr_t* attr) {
+	LOG_DEBUG_INFO_STR("(%s, 0x%x, 0x%x, 0x%x, %d, 0x%x)", filename, argv, envp, actions, num_actions, attr);
+	
+	if (!filename || (num_actions && !actions))
+		return -EFAULT;
+	if (num_actions > SPAWN_MAX_ACTIONS)
+		return -EINVAL;
+	
+	// Catch a missing program here since the child can only report failures through its exit status
+	char* path = path_absolute(filename, current_pcb->working_dir);
+	if (!path)
+		return -ENOMEM;
+	file_descriptor_t f;
+	if (fisdir(path) || !fopen(path, FILE_MODE_READ, &f)) {
+		kfree(path);
+		return -ENOENT;
+	}
+	fclose(&f);
+	
+	// The child loads the program once it runs, so it needs its own copy of everything
+	spawn_info_t* info = spawn_info_copy(path, argv, envp, actions, num_actions);
+	kfree(path);
+	if (!info)
+		return -ENOMEM;
+	
+	pcb_t* pcb = spawn_current_task();
+	if (!pcb) {
+		spawn_info_free(info);
+		return -ENOMEM;
+	}
+	pcb->spawn_info = info;
+	if (attr)
+		info->attr = *attr;
+	
+	// Have the first context switch into the child go to spawn_start() (popa, ret)
+	thread_t* t = pcb->threads;
+	t->saved_esp = (uint32_t)t + USER_KERNEL_STACK_SIZE;
+	t->saved_esp -= sizeof(context_state_t) + sizeof(uint32_t) * 2;
+	char* esp = (char*)t->saved_esp;
+	memset(esp, 0, sizeof(context_state_t) + sizeof(uint32_t) * 2);
+	uint32_t addr = (uint32_t)spawn_start;
+	memcpy(&esp[sizeof(context_state_t)], &addr, sizeof(uint32_t));
+	t->state = READY;
+	
+	// Enable the child to be scheduled
+	pcb->state = READY;
+	
+	return pcb->task->pid;
+}
+
 // Load a new program into the current memory space
 uint32_t execve(const char* filename, const char* argv[], const char* envp[]) {
 	LOG_DEBUG_INFO_STR("(%s, 0x%x, 0x%x)", filename, argv, envp);
@@ -266,23 +456,8 @@ uint32_t exit(int status) {
 
 	pcb_t* pcb = current_pcb;
 	
-	down(&pcb->descriptor_lock);
-	
-	// Close all open file handles
-	int z;
-	for (z = 0; z < NUMBER_OF_DESCRIPTORS; z++) {
-		if (descriptors[z]) {
-			down(&descriptors[z]->lock);
-			if ((--descriptors[z]->ref_count) == 0) {
-				descriptors[z]->close(descriptors[z]);
-				up(&descriptors[z]->lock);
-				kfree(descriptors[z]);
-			} else
-				up(&descriptors[z]->lock);
-			pcb->descriptors[z] = NULL;
-		}
-	}
-	up(&pcb->descriptor_lock);
+	// Close all open file handles (a table shared with a forked task stays open for it)
+	pcb_free_descriptors(pcb);
 	
 	// Terminate the task
 	current_thread->in_syscall = false;
@@ -325,11 +500,28 @@ uint32_t chdir(const char* path) {
 
 // Create a new thread
 uint32_t sys_thread_create(void (*func)(), void* user_stack) {
+	// The thread's TLS and TCB go at the top of its stack with an implicit call to thread_exit() below them
+	uint32_t align = (current_pcb->tls_total_align > sizeof(uint32_t)) ?
+		current_pcb->tls_total_align : sizeof(uint32_t);
+	uint32_t func_size = (uint32_t)implicit_thread_exit_end - (uint32_t)implicit_thread_exit_start;
+	uint32_t stack = (uint32_t)user_stack;
+	if (stack < USER_ADDRESS + TLS_TCB_SIZE || stack > VM_KERNEL_ADDRESS)
+		return -EFAULT;
+	uint32_t tp = (stack - TLS_TCB_SIZE) & ~(align - 1);
+	// Make sure all of that is in the program's memory before writing it
+	uint32_t below = tp - USER_ADDRESS;
+	if (tp < USER_ADDRESS || below < current_pcb->tls_total_size ||
+		below - current_pcb->tls_total_size < 0xF + sizeof(uint32_t) + func_size)
+		return -EFAULT;
+	
 	// Create an exact copy of this thread
 	thread_t* t = thread_create(current_pcb);
 	if (!t)
 		return -ENOMEM;
 	
+	tls_setup_thread(current_pcb, t, tp);
+	user_stack = (void*)((tp - current_pcb->tls_total_size) & ~0xF);
+	
 	// Add this thread in
 	t->state = SUSPENDED;
 	t->stack_address = (uint32_t)user_stack;
@@ -350,7 +542,6 @@ uint32_t sys_thread_create(void (*func)(), void* user_stack) {
 	iret_t* iret = (iret_t*)&esp[sizeof(context_state_t) + sizeof(uint32_t)];
 	iret->ss = *(uint32_t*)(t->context.esp+0x10);
 	// Also push an implicit call to thread_exit() on the stack
-	uint32_t func_size = (uint32_t)implicit_thread_exit_end - (uint32_t)implicit_thread_exit_start;
 	iret->esp = (uint32_t)user_stack - sizeof(uint32_t) - func_size;
 	uint32_t implicit_eip = iret->esp + sizeof(uint32_t);
 	memcpy((void*)iret->esp, &implicit_eip, sizeof(uint32_t));
@@ -491,3 +682,15 @@ uint32_t thread_exit() {
 	
 	return 0;
 }
+
+// Set the thread pointer (returns the selector to load %gs with)
+uint32_t set_thread_area(void* base) {
+	current_thread->tls_base = (uint32_t)base;
+	set_tls_base(current_thread->tls_base);
+	return USER_TLS;
+}
+
+// Bind a lazily linked function on its first call (returns the function's address)
+uint32_t dl_bind(uint32_t object, uint32_t rel_offset) {
+	return (uint32_t)elf_bind_lazy_symbol(current_pcb, object, rel_offset);
+}
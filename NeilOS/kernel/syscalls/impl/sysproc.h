@@ -12,6 +12,43 @@
 #include <common/types.h>
 #include <program/task.h>
 
+// posix_spawn file actions
+#define SPAWN_ACTION_OPEN		0
+#define SPAWN_ACTION_CLOSE		1
+#define SPAWN_ACTION_DUP2		2
+
+// Max number of file actions for posix_spawn
+#define SPAWN_MAX_ACTIONS		1024
+
+// posix_spawn attribute flags
+#define SPAWN_SETSIGMASK		0x20
+
+// A file action for a spawned task to perform before it runs (same layout as newlib's)
+typedef struct {
+	uint32_t action;
+	int32_t fd;
+	int32_t new_fd;					// Where to duplicate fd to for SPAWN_ACTION_DUP2
+	const char* path;				// For SPAWN_ACTION_OPEN (which makes fd refer to it)
+	uint32_t mode;					// Open mode for SPAWN_ACTION_OPEN
+} spawn_file_action_t;
+
+// Attributes for posix_spawn (same layout as the start of newlib's)
+typedef struct {
+	uint32_t flags;
+	sigset_t sigmask;				// For SPAWN_SETSIGMASK
+	sigset_t sigdefault;			// Signals always start with their default action in a new program
+} spawn_attr_t;
+
+// What a spawned task loads and does when it first runs (kernel copies)
+typedef struct spawn_info {
+	char* filename;
+	char** argv;
+	char** envp;
+	spawn_attr_t attr;
+	uint32_t num_actions;
+	spawn_file_action_t actions[];
+} spawn_info_t;
+
 // Helpers for execute
 int32_t queue_task_load(const char* cmd, const char** argv, const char** envp, pcb_t** ret);
 int32_t run(pcb_t* pcb);
@@ -22,6 +59,13 @@ int32_t run_with_fake_parent(pcb_t* pcb, pcb_t* parent);
 // Duplicate a program and memory space
 uint32_t fork();
 
+// Create a child that uses this task's memory and wait until the child execs or exits
+uint32_t vfork();
+
+// Start a program as a child of this task without copying this task first (returns the child's pid)
+uint32_t posix_spawn(const char* filename, const char* argv[], const char* envp[],
+					 const spawn_file_action_t* actions, uint32_t num_actions, const spawn_attr_t* attr);
+
 // Load a new program into the current memory space
 uint32_t execve(const char* filename, const char* argv[], const char* envp[]);
 
@@ -58,4 +102,10 @@ uint32_t thread_wait(uint32_t tid);
 // Exit a thread
 uint32_t thread_exit();
 
+// Set the thread pointer (returns the selector to load %gs with)
+uint32_t set_thread_area(void* base);
+
+// Bind a lazily linked function on its first call (returns the function's address)
+uint32_t dl_bind(uint32_t object, uint32_t rel_offset);
+
 #endif /* SYSPROC_H */
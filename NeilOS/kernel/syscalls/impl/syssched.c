@@ -30,7 +30,8 @@ uint32_t nanosleep(const struct timespec* req, struct timespec* rem) {
 			return -EINTR;
 		}
 		up(&current_pcb->lock);
-		schedule();
+		thread_sleep_prepare();
+		thread_sleep(&end);
 	}
 	
 	return 0;
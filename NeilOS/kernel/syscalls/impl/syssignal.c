@@ -10,6 +10,7 @@
 #include <program/task.h>
 #include <program/signal.h>
 #include <common/log.h>
+#include <common/lib.h>
 #include <syscalls/interrupt.h>
 
 // Send a signal to a process
@@ -22,8 +23,12 @@ uint32_t kill(uint32_t pid, uint32_t signum) {
 	pcb_t* pcb = pcb_from_pid(pid);
 	if (!pcb)
 		return -ENOMEM;
+	// Kernel threads don't take signals
+	if (pcb->kernel_thread)
+		return -EPERM;
 	
 	signal_send(pcb, signum);
+	pcb->signal_from_user |= (1 << signum);
 	return 0;
 }
 
@@ -37,14 +42,8 @@ uint32_t sigaction(uint32_t signum, sigaction_t* act, sigaction_t* oldact) {
 	down(&current_pcb->lock);
 	if (oldact)
 		*oldact = current_pcb->signal_handlers[signum];
-	if (act) {
-		if (act->flags & SA_SIGINFO) {
-#if DEBUG
-			blue_screen("SIGINFO requested but not supported.");
-#endif
-		}
+	if (act)
 		signal_set_handler(current_pcb, signum, *act);
-	}
 	up(&current_pcb->lock);
 	return 0;
 }
@@ -125,3 +124,42 @@ uint32_t alarm(uint32_t seconds) {
 	
 	return (prev == 0 ? 0 : (prev - time));
 }
+
+// Return from a signal handler (called by the trampoline on the signal frame)
+uint32_t sigreturn() {
+	LOG_DEBUG_INFO();
+	
+	return signal_return();
+}
+
+// Set or get the stack that signal handlers can run on
+uint32_t sigaltstack(const sigstack_t* ss, sigstack_t* old_ss) {
+	LOG_DEBUG_INFO_STR("(0x%x, 0x%x)", ss, old_ss);
+	
+	bool on_stack = signal_on_alternate_stack();
+	if (old_ss) {
+		*old_ss = current_thread->signal_stack;
+		if (old_ss->size == 0)
+			old_ss->flags = SS_DISABLE;
+		else if (on_stack)
+			old_ss->flags |= SS_ONSTACK;
+	}
+	
+	if (ss) {
+		// Can't change it out from under a running handler
+		if (on_stack)
+			return -EPERM;
+		if (ss->flags & ~SS_DISABLE)
+			return -EINVAL;
+		
+		if (ss->flags & SS_DISABLE)
+			memset(&current_thread->signal_stack, 0, sizeof(sigstack_t));
+		else {
+			if (ss->size < MINSIGSTKSZ)
+				return -ENOMEM;
+			current_thread->signal_stack = *ss;
+		}
+	}
+	
+	return 0;
+}
@@ -35,4 +35,10 @@ uint32_t sigsuspend(const sigset_t* mask);
 // Set up alarm
 uint32_t alarm(uint32_t seconds);
 
+// Return from a signal handler
+uint32_t sigreturn();
+
+// Set or get the stack that signal handlers can run on
+uint32_t sigaltstack(const sigstack_t* ss, sigstack_t* old_ss);
+
 #endif /* SYSSIGNAL_H */
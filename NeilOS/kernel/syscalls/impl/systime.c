@@ -32,7 +32,7 @@ uint32_t gettimeofday(struct timeval* t) {
 	LOG_DEBUG_INFO_STR("(0x%x)", t);
 
 	if (t)
-		*t = time_get();
+		*t = time_get_precise();
 	
 	return 0;
 }
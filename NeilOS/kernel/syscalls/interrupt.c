@@ -2,6 +2,7 @@
 #include <boot/x86_desc.h>
 #include <common/lib.h>
 #include <drivers/pic/i8259.h>
+#include <program/workqueue.h>
 #include <memory/mmap_list.h>
 #include <drivers/graphics/graphics.h>
 #include <drivers/graphics/svga/svga_3d.h>
@@ -9,15 +10,31 @@
 // External defintions for the assembly interrupt functions
 extern int* intx80;\
 extern int* idt_vectors[NUMBER_OF_INTERRUPTS];
+extern int* sysenter_entry;
 extern int* idt_vectors_user[NUMBER_OF_USER_INTERRUPTS];
 extern void load_lidt();
 
+// Kernel code that touches the program's memory and where to go if that faults (see interrupt_asm.S)
+typedef struct {
+	uint32_t start;
+	uint32_t end;
+	uint32_t fixup;
+} page_fault_fixup_t;
+extern page_fault_fixup_t page_fault_fixups[];
+extern page_fault_fixup_t page_fault_fixups_end[];
+
+// Where the page fault stub sends the code that faulted instead of going back to it (0 if nowhere)
+uint32_t page_fault_fixup = 0;
+
 // Array of functions for specific pic IRQ's
 void (*pic_table[NUMBER_OF_USER_INTERRUPTS])() = {
 	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
 	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
 };
 
+// Number of times each pic IRQ has fired
+uint32_t pic_counts[NUMBER_OF_USER_INTERRUPTS];
+
 /* More system calls
  * For vi:
 	sigjump_buf??
@@ -26,7 +43,6 @@ void (*pic_table[NUMBER_OF_USER_INTERRUPTS])() = {
 	 timeout - hangs
  * More 
 	timer_create, timer_delete, timer_settime
-	select (implemented for terminal, need others - files), poll
  	sockets stuff
  */
 
@@ -53,6 +69,16 @@ void* syscalls[] = { fork, execve, getpid, getppid, waitpid, exit,
 		svga3d_state_texture_state, svga3d_state_render_state, svga3d_transform_set, svga3d_light_material,
 		svga3d_light_data, svga3d_light_enabled, svga3d_shader_create, svga3d_shader_const, svga3d_shader_set_active,
 		svga3d_shader_destroy,
+	// Filesystem
+	fsync, sync,
+	pread, pwrite, readv, writev,
+	getdents,
+	poll, epoll_create, epoll_ctl, epoll_wait,
+	splice, tee, sendfile, copy_file_range,
+	io_ring_setup, io_ring_enter,
+	// Dynamic linking
+	dl_bind,
+	vfork, posix_spawn, set_thread_area, sigreturn, sigaltstack,
 };
 
 
@@ -226,13 +252,29 @@ void page_fault(uint32_t code, uint32_t eip) {
 	if (current_pcb && mmap_list_process(current_pcb->user_mappings, address, code, current_pcb))
 		return;
 	
+	// Check if the kernel was using the program's memory somewhere that can handle it failing
+	for (page_fault_fixup_t* f = page_fault_fixups; f < page_fault_fixups_end; f++) {
+		if (eip >= f->start && eip < f->end) {
+			// Interrupts stay off until the stub's iret so nothing else can fault before it uses this
+			cli();
+			page_fault_fixup = f->fixup;
+			return;
+		}
+	}
+	
 	signal_send(current_pcb, SIGSEGV);
 	
 #if DEBUG
-	blue_screen("Page fault - 0x%x at address 0x%x (eip: 0x%x)", code, address, eip);
-#else
-	schedule();
+	// Programs that catch their own faults get a chance to handle them
+	if (current_pcb->signal_handlers[SIGSEGV].handler == SIG_DFL)
+		blue_screen("Page fault - 0x%x at address 0x%x (eip: 0x%x)", code, address, eip);
 #endif
+	schedule();
+}
+
+// Interrupt 15 (reserved, so sysenter_entry uses it when it can't read the program's stack)
+void bad_syscall_stack(uint32_t code, uint32_t eip) {
+	signal_send(current_pcb, SIGSEGV);
 }
 
 // Interrupt 16
@@ -280,9 +322,14 @@ void smid_floating_point_exception(uint32_t code, uint32_t eip) {
 // PIC interrupt (0x20-0x2F)
 // Inputs: irq number
 void PIC_int(int irq) {
+	pic_counts[irq - 0x20]++;
+	
 	// Call through to the assigned handler if it exists
 	if (pic_table[irq - 0x20])
 		pic_table[irq - 0x20](irq - 0x20);
+	
+	// Then the rest of the work the handlers put off
+	tasklet_run_pending();
 }
 
 /*
@@ -300,7 +347,7 @@ void (*interrupt_table[NUMBER_OF_INTERRUPTS])(uint32_t code, uint32_t eip) = {
 	divide_error, NULL, NMI_interrupt, breakpoint, overflow, bound_range_exception,
 	invalid_opcode, device_not_available, double_fault, coprocessor_segment_overrun,
 	invalid_tss, segment_not_present, stack_segment_fault, general_protection, page_fault,
-	NULL, floating_point_error, alignment_check, machine_check, smid_floating_point_exception,
+	bad_syscall_stack, floating_point_error, alignment_check, machine_check, smid_floating_point_exception,
 };
 
 /*
@@ -335,6 +382,10 @@ void load_idt() {
 	// Don't forget about the syscall
 	set_idt_entry(&idt[0x80], (int*)&intx80, USER_PRIVILEGE);
 	
+	// Faster way in for syscalls (int 0x80 still works; the stack is set with the TSS's one)
+	wrmsr(IA32_SYSENTER_CS, KERNEL_CS);
+	wrmsr(IA32_SYSENTER_EIP, (uint32_t)&sysenter_entry);
+	
 	// Avoids error in xcode
 #ifndef __APPLE__
 	// Load the IDT
@@ -3,8 +3,10 @@
 
 #include <syscalls/impl/sysfile.h>
 #include <syscalls/impl/sysfs.h>
+#include <syscalls/impl/sysioring.h>
 #include <syscalls/impl/sysmem.h>
 #include <syscalls/impl/sysmisc.h>
+#include <syscalls/impl/syspoll.h>
 #include <syscalls/impl/sysproc.h>
 #include <syscalls/impl/syssched.h>
 #include <syscalls/impl/syssignal.h>
@@ -151,4 +153,11 @@ void load_idt();
 //handles a requested irq by calling a specific function for the interrupt
 void request_irq(unsigned int irq, void (*handler)(int));
 
+// Number of times each pic IRQ has fired
+extern uint32_t pic_counts[NUMBER_OF_USER_INTERRUPTS];
+
+// Copy to or from the program's memory without the kernel faulting on it (returns false if part of
+// it isn't mapped, or isn't writable when copying to it). The caller checks it's below the kernel
+bool user_memcpy(void* dest, const void* src, uint32_t size);
+
 #endif	/* INTERRUPT_H */
@@ -8,36 +8,28 @@
 
 #include "NSThread.h"
 #include <pthread.h>
-#include <map>
-
-#define MAIN_THREAD_TID				1
 
 namespace {
-	// Maps tid to NSThread
-	std::unordered_map<uint32_t, NSThread*> threads;
-	pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+	// Each thread's NSThread
+	pthread_key_t thread_key;
+	NSThread* main_thread = NULL;
 };
 
 void NSThread::Setup() {
+	pthread_key_create(&thread_key, NULL);
 	NSThread* main = new NSThread;
 	main->thread = pthread_self();
 	main->SetExitsWhenDone(false);
-	threads[MAIN_THREAD_TID] = main;
+	main_thread = main;
+	pthread_setspecific(thread_key, main);
 }
 
 NSThread* NSThread::MainThread() {
-	pthread_mutex_lock(&threads_lock);
-	NSThread* ret = threads[MAIN_THREAD_TID];
-	pthread_mutex_unlock(&threads_lock);
-	return ret;
+	return main_thread;
 }
 
 NSThread* NSThread::CurrentThread() {
-	uint32_t tid = gettid();
-	pthread_mutex_lock(&threads_lock);
-	NSThread* ret = threads[tid];
-	pthread_mutex_unlock(&threads_lock);
-	return ret;
+	return reinterpret_cast<NSThread*>(pthread_getspecific(thread_key));
 }
 
 void NSThread::Exit() {
@@ -96,16 +88,11 @@ bool NSThread::GetExitsWhenDone() const {
 void* NSThread::NSThreadFunction(void* info) {
 	NSThread* thread = reinterpret_cast<NSThread*>(info);
 
-	uint32_t tid = gettid();
-	pthread_mutex_lock(&threads_lock);
-	threads[tid] = thread;
-	pthread_mutex_unlock(&threads_lock);
+	pthread_setspecific(thread_key, thread);
 	
 	thread->GetRunLoop()->Run();
 	
-	pthread_mutex_lock(&threads_lock);
-	threads.erase(tid);
-	pthread_mutex_unlock(&threads_lock);
+	pthread_setspecific(thread_key, NULL);
 	
 	thread->thread = NULL;
 	
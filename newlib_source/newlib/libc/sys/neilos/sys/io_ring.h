@@ -0,0 +1,89 @@
+#ifndef _SYS_IO_RING_H
+#define _SYS_IO_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Operations */
+#define IO_RING_OP_NOP			0
+#define IO_RING_OP_READ			1
+#define IO_RING_OP_WRITE		2
+#define IO_RING_OP_MQ_SEND		3
+#define IO_RING_OP_MQ_RECEIVE	4
+#define IO_RING_OP_FENCE_WAIT	5
+
+/* Use (and move) the descriptor's position instead of an offset */
+#define IO_RING_OFFSET_NONE		((uint64_t)-1)
+
+/* Flags for io_ring_enter */
+#define IO_RING_ENTER_GETEVENTS	0x1
+
+/* A submission */
+struct io_sqe {
+	uint32_t opcode;
+	int32_t fd;
+	uint64_t offset;		/* For read and write */
+	void* addr;				/* Buffer */
+	uint32_t len;			/* Buffer length (the fence for IO_RING_OP_FENCE_WAIT) */
+	uint32_t priority;		/* For IO_RING_OP_MQ_SEND */
+	uint32_t reserved;
+	uint64_t user_data;		/* Passed back in the completion */
+};
+
+/* A completion */
+struct io_cqe {
+	uint64_t user_data;
+	int32_t res;			/* Return value of the operation (-errno on failure) */
+	uint32_t flags;			/* Message priority for IO_RING_OP_MQ_RECEIVE */
+};
+
+/* Submission and completion queues (entries must be powers of two) */
+struct io_ring {
+	volatile uint32_t sq_head;
+	volatile uint32_t sq_tail;
+	volatile uint32_t cq_head;
+	volatile uint32_t cq_tail;
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+	struct io_sqe* sqes;
+	struct io_cqe* cqes;
+};
+
+int io_ring_setup(struct io_ring* ring);
+int io_ring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags);
+
+/* Get the next free submission slot (NULL if the queue is full) */
+static inline struct io_sqe* io_ring_get_sqe(struct io_ring* ring) {
+	if (ring->sq_tail - ring->sq_head >= ring->sq_entries)
+		return 0;
+	return &ring->sqes[ring->sq_tail & (ring->sq_entries - 1)];
+}
+
+/* Hand the slot from io_ring_get_sqe to the kernel */
+static inline void io_ring_queue_sqe(struct io_ring* ring) {
+	__asm__ volatile("" : : : "memory");
+	ring->sq_tail++;
+}
+
+/* Get the next completion (NULL if there are none) */
+static inline struct io_cqe* io_ring_peek_cqe(struct io_ring* ring) {
+	if (ring->cq_head == ring->cq_tail)
+		return 0;
+	__asm__ volatile("" : : : "memory");
+	return &ring->cqes[ring->cq_head & (ring->cq_entries - 1)];
+}
+
+/* Give a completion slot back to the kernel */
+static inline void io_ring_cqe_seen(struct io_ring* ring) {
+	__asm__ volatile("" : : : "memory");
+	ring->cq_head++;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SYS_IO_RING_H */
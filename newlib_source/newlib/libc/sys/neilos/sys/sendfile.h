@@ -0,0 +1,17 @@
+#ifndef _SYS_SENDFILE_H
+#define _SYS_SENDFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count);
+ssize_t copy_file_range(int fd_in, long long* off_in, int fd_out, long long* off_out, size_t len, unsigned int flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SYS_SENDFILE_H */
@@ -0,0 +1,21 @@
+#ifndef _SYS_SPLICE_H
+#define _SYS_SPLICE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+
+#define SPLICE_F_MOVE		0x1
+#define SPLICE_F_NONBLOCK	0x2
+#define SPLICE_F_MORE		0x4
+
+ssize_t splice(int fd_in, long long* off_in, int fd_out, long long* off_out, size_t len, unsigned int flags);
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SYS_SPLICE_H */
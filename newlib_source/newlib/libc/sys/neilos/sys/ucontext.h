@@ -0,0 +1,37 @@
+#ifndef _SYS_UCONTEXT_H
+#define _SYS_UCONTEXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <signal.h>
+
+/* The registers a signal interrupted (sigreturn puts these back) */
+typedef struct {
+	unsigned int edi;
+	unsigned int esi;
+	unsigned int ebp;
+	unsigned int ebx;
+	unsigned int edx;
+	unsigned int ecx;
+	unsigned int eax;
+	unsigned int eip;
+	unsigned int eflags;
+	unsigned int esp;
+} mcontext_t;
+
+/* The third argument of an SA_SIGINFO handler */
+typedef struct ucontext {
+	unsigned long uc_flags;
+	struct ucontext* uc_link;
+	stack_t uc_stack;
+	mcontext_t uc_mcontext;
+	sigset_t uc_sigmask;
+} ucontext_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _SYS_UIO_H
+#define _SYS_UIO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX		1024
+#endif
+
+struct iovec {
+	void* iov_base;
+	size_t iov_len;
+};
+
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt);
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SYS_UIO_H */
@@ -15,6 +15,12 @@
 #include <string.h>
 #include <sys/select.h>
 #include <sys/signal.h>
+#include <sys/uio.h>
+#include <sys/poll.h>
+#include <sys/epoll.h>
+#include <sys/splice.h>
+#include <sys/sendfile.h>
+#include <sys/io_ring.h>
 #include "include/mqueue.h"
 
 typedef struct {
@@ -34,9 +40,14 @@ typedef struct {
 extern unsigned int sys_open(const char* filename, unsigned int mode, unsigned int type);
 extern unsigned int sys_read(int fd, void* buf, unsigned int nbytes);
 extern unsigned int sys_write(int fd, const void* buf, unsigned int nbytes);
+extern unsigned int sys_pread(int fd, void* buf, unsigned int nbytes, uint32_t offset_high, uint32_t offset_low);
+extern unsigned int sys_pwrite(int fd, const void* buf, unsigned int nbytes, uint32_t offset_high, uint32_t offset_low);
+extern unsigned int sys_readv(int fd, const struct iovec* iov, int iovcnt);
+extern unsigned int sys_writev(int fd, const struct iovec* iov, int iovcnt);
 extern unsigned int sys_llseek(int fd, uint32_t offset_high, uint32_t offset_low, int whence);
 extern unsigned int sys_truncate(int fd, uint32_t length_high, uint32_t length_low);
 extern unsigned int sys_stat(int fd, __sys_stat_type* data);
+extern unsigned int sys_fsync(int fd);
 extern unsigned int sys_close(int fd);
 extern unsigned int sys_isatty(int fd);
 extern unsigned int sys_dup(unsigned int fd);
@@ -46,6 +57,16 @@ extern unsigned int sys_fcntl(int fd, int cmd, ...);
 extern unsigned int sys_ioctl(int fd, int cmd, ...);
 extern unsigned int sys_select(int nfds, fd_set* readfds, fd_set* writefds,
 							   fd_set* exceptfds, struct timeval* timeout);
+extern unsigned int sys_splice(int fd_in, long long* off_in, int fd_out, long long* off_out, size_t len, unsigned int flags);
+extern unsigned int sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+extern unsigned int sys_sendfile(int out_fd, int in_fd, long long* offset, size_t count);
+extern unsigned int sys_copy_file_range(int fd_in, long long* off_in, int fd_out, long long* off_out, size_t len, unsigned int flags);
+extern unsigned int sys_io_ring_setup(struct io_ring* ring);
+extern unsigned int sys_io_ring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags);
+extern unsigned int sys_poll(struct pollfd* fds, nfds_t nfds, int timeout);
+extern unsigned int sys_epoll_create(int flags);
+extern unsigned int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event);
+extern unsigned int sys_epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout);
 
 extern unsigned int sys_unlink(const char* filename, char dir, int type);
 
@@ -80,6 +101,50 @@ int write(int file, char* ptr, int len) {
 	return ret;
 }
 
+ssize_t pread(int fd, void* buf, size_t nbytes, off_t offset) {
+	int ret = sys_pread(fd, buf, nbytes, (offset < 0) ? -1 : 0, offset);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+	return ret;
+}
+
+ssize_t pwrite(int fd, const void* buf, size_t nbytes, off_t offset) {
+	int ret = sys_pwrite(fd, buf, nbytes, (offset < 0) ? -1 : 0, offset);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+	return ret;
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+	if (iovcnt < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	int ret = sys_readv(fd, iov, iovcnt);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+	return ret;
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+	if (iovcnt < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	int ret = sys_writev(fd, iov, iovcnt);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+	return ret;
+}
+
 int lseek(int file, int ptr, int dir) {
 	int ret = sys_llseek(file, (ptr < 0) ? -1 : 0, ptr, dir);
     if (ret < 0) {
@@ -173,13 +238,16 @@ int fstat(int file, struct stat *st) {
 }
 
 int fsync(int fd) {
-	// TOOD: come back to this if we ever buffer anything
-	return 0;
+	int ret = sys_fsync(fd);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+	return ret;
 }
 
 int fdatasync(int fd) {
-	// TOOD: come back to this if we ever buffer anything
-	return 0;
+	return fsync(fd);
 }
 
 int lstat(const char* file, struct stat* st) {
@@ -287,6 +355,111 @@ int select (int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, stru
 	return ret;
 }
 
+ssize_t splice(int fd_in, long long* off_in, int fd_out, long long* off_out, size_t len, unsigned int flags) {
+	int ret = sys_splice(fd_in, off_in, fd_out, off_out, len, flags);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+	int ret = sys_tee(fd_in, fd_out, len, flags);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+	long long off = offset ? *offset : 0;
+	int ret = sys_sendfile(out_fd, in_fd, offset ? &off : NULL, count);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	if (offset)
+		*offset = off;
+	return ret;
+}
+
+ssize_t copy_file_range(int fd_in, long long* off_in, int fd_out, long long* off_out, size_t len, unsigned int flags) {
+	int ret = sys_copy_file_range(fd_in, off_in, fd_out, off_out, len, flags);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+int io_ring_setup(struct io_ring* ring) {
+	int ret = sys_io_ring_setup(ring);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+int io_ring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+	int ret = sys_io_ring_enter(fd, to_submit, min_complete, flags);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+int poll(struct pollfd* fds, nfds_t nfds, int timeout) {
+	int ret = sys_poll(fds, nfds, timeout);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+int epoll_create(int size) {
+	if (size <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	return epoll_create1(0);
+}
+
+int epoll_create1(int flags) {
+	int ret = sys_epoll_create(flags);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+	int ret = sys_epoll_ctl(epfd, op, fd, event);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout) {
+	if (maxevents <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	int ret = sys_epoll_wait(epfd, events, maxevents, timeout);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
 int pselect (int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds,
 			 const struct timespec* timeout, const sigset_t* sigmask) {
 	sigset_t origmask;
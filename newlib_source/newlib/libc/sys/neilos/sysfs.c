@@ -24,8 +24,21 @@ extern unsigned int sys_errno();
 extern unsigned int sys_mkdir(const char* name);
 extern unsigned int sys_link(const char* filename, const char* new_name);
 extern unsigned int sys_unlink(const char* filename, char dir, int type);
-extern unsigned int sys_readdir(int fd, void* buf, int size, struct dirent* dirent);
+extern unsigned int sys_getdents(int fd, void* buf, unsigned int size);
 extern unsigned int sys_utime(const char* filename, unsigned int* times);
+extern unsigned int sys_sync();
+
+// Entry packed into the buffer by sys_getdents
+typedef struct {
+	uint32_t d_ino;
+	uint32_t d_off;
+	uint16_t d_reclen;
+	uint8_t d_type;
+	char d_name[];
+} __sys_dirent;
+
+// Size of the buffer entries are read into
+#define DIRENT_BUFFER_SIZE	4096
 
 // Helpers
 extern unsigned int sys_open(const char* filename, unsigned int mode, unsigned int type);
@@ -130,6 +143,10 @@ int utime(const char* filename, const struct utimbuf* times) {
 	return ret;
 }
 
+void sync() {
+	sys_sync();
+}
+
 DIR *opendir(const char* filename) {
 	if (!filename) {
 		errno = ENOENT;
@@ -142,13 +159,13 @@ DIR *opendir(const char* filename) {
 		return NULL;
 	}
 	memset(ret, 0, sizeof(DIR));
-	ret->dd_buf = malloc(256);
+	ret->dd_buf = malloc(DIRENT_BUFFER_SIZE);
 	if (!ret->dd_buf) {
 		free(ret);
 		errno = ENOMEM;
 		return NULL;
 	}
-	ret->dd_size = 256;
+	ret->dd_size = DIRENT_BUFFER_SIZE;
 		
 	int fd = sys_open(filename, O_RDONLY, 0);
 	if (fd < 0) {
@@ -161,6 +178,7 @@ DIR *opendir(const char* filename) {
 	struct stat st;
 	if (fstat(fd, &st) < 0 || !(st.st_mode & _IFDIR)) {
 		errno = ENOTDIR;
+		sys_close(fd);
 		free(ret->dd_buf);
 		free(ret);
 		return NULL;
@@ -172,14 +190,27 @@ DIR *opendir(const char* filename) {
 
 struct dirent dirent_rd;
 struct dirent* readdir(DIR* dir) {
-	dir->dd_len = sys_readdir(dir->dd_fd, dir->dd_buf, dir->dd_size, &dirent_rd);
-	if ((int)dir->dd_len < 0) {
-		errno = -(int)dir->dd_len;
-		return NULL;
-	} else if (dir->dd_len == 0)
-		return NULL;
-	memcpy(dirent_rd.d_name, dir->dd_buf, dir->dd_len);
-	dirent_rd.d_name[dir->dd_len] = 0;
+	// Get as many entries as fit once the buffer has been used up
+	if (dir->dd_loc >= dir->dd_len) {
+		int ret = sys_getdents(dir->dd_fd, dir->dd_buf, dir->dd_size);
+		if (ret < 0) {
+			errno = -ret;
+			return NULL;
+		} else if (ret == 0)
+			return NULL;
+		dir->dd_len = ret;
+		dir->dd_loc = 0;
+	}
+	
+	__sys_dirent* entry = (__sys_dirent*)(dir->dd_buf + dir->dd_loc);
+	dir->dd_loc += entry->d_reclen;
+	dir->dd_seek = entry->d_off;
+	
+	dirent_rd.d_ino = entry->d_ino;
+	dirent_rd.d_off = entry->d_off;
+	dirent_rd.d_reclen = entry->d_reclen;
+	dirent_rd.d_type = entry->d_type;
+	strcpy(dirent_rd.d_name, entry->d_name);
 
 	return &dirent_rd;
 }
@@ -194,14 +225,19 @@ long telldir(DIR* dir) {
 		return -1;
 	}
 	
-	return lseek(dir->dd_fd, 0, SEEK_CUR);
+	// The descriptor is ahead of what has been returned, so use the position of the next entry
+	return dir->dd_seek;
 }
 
 void seekdir(DIR * dir, off_t loc) {
 	if (!dir)
 		return;
 	
-	lseek(dir->dd_fd, loc, SEEK_SET);
+	if (lseek(dir->dd_fd, loc, SEEK_SET) < 0)
+		return;
+	dir->dd_seek = loc;
+	dir->dd_loc = 0;
+	dir->dd_len = 0;
 }
 
 int closedir(DIR * dir) {
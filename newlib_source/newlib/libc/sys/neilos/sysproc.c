@@ -14,6 +14,9 @@
 #include <sys/vfs.h>
 #include <stdlib.h>
 #include <string.h>
+#include <spawn.h>
+#include <sched.h>
+#include <reent.h>
 
 extern char** environ;
 
@@ -31,6 +34,51 @@ extern unsigned int sys_thread_create(void (*func)(), void* user_stack);
 extern unsigned int sys_gettid();
 extern unsigned int sys_thread_wait(unsigned int tid);
 extern unsigned int sys_thread_exit();
+extern unsigned int sys_set_thread_area(void* base);
+
+extern void __sinit(struct _reent* ptr);
+
+/* Thread control block at %gs:0 (the kernel reserves TLS_TCB_SIZE for it) */
+#define TCB_SELF		0		// Thread pointer
+#define TCB_REENT		4		// This thread's struct _reent
+#define TCB_KEYS		16		// pthread_setspecific values
+
+#define MAIN_THREAD_TID					1
+#define TLS_KEYS_MAX					128		// PTHREAD_KEYS_MAX
+#define TLS_DESTRUCTOR_ITERATIONS		4
+
+/* posix_spawn file actions (same layout as the kernel's) */
+#define SPAWN_ACTION_OPEN		0
+#define SPAWN_ACTION_CLOSE		1
+#define SPAWN_ACTION_DUP2		2
+
+struct __spawn_file_action {
+	unsigned int action;
+	int fd;
+	int new_fd;
+	const char* path;
+	unsigned int mode;
+};
+
+struct __posix_spawn_file_actions {
+	struct __spawn_file_action* actions;
+	unsigned int num_actions;
+	unsigned int capacity;
+};
+
+/* The kernel reads up to sigdefault */
+struct __posix_spawnattr {
+	unsigned int flags;
+	sigset_t sigmask;
+	sigset_t sigdefault;
+	pid_t pgroup;
+	int policy;
+	struct sched_param param;
+};
+
+extern unsigned int sys_posix_spawn(const char* path, char* const argv[], char* const envp[],
+									const struct __spawn_file_action* actions, unsigned int num_actions,
+									const struct __posix_spawnattr* attr);
 
 int fork() {
 	int ret = sys_fork();
@@ -41,9 +89,10 @@ int fork() {
 	return ret;
 }
 
-int vfork() {
-	// Lazy but probably works
-	return fork();
+// vfork itself is in syscalls.S since it can't use the stack after the syscall
+int __vfork_error(int ret) {
+	errno = -ret;
+	return -1;
 }
 
 int _execve(const char *name, char **argv, char **env) {
@@ -263,7 +312,132 @@ unsigned int thread_wait(pid_t tid) {
 	return ret;
 }
 
+// Give a thread its own reentrancy structure (the main thread uses the global one)
+static __attribute__((noinline)) struct _reent* tls_reent_create() {
+	struct _reent* reent = _global_impure_ptr;
+	if (sys_gettid() != MAIN_THREAD_TID) {
+		reent = _malloc_r(_global_impure_ptr, sizeof(struct _reent));
+		if (!reent)
+			return _global_impure_ptr;
+		_REENT_INIT_PTR(reent);
+		
+		// Share the standard streams with the rest of the program
+		if (!_global_impure_ptr->__sdidinit)
+			__sinit(_global_impure_ptr);
+		reent->_stdin = _global_impure_ptr->_stdin;
+		reent->_stdout = _global_impure_ptr->_stdout;
+		reent->_stderr = _global_impure_ptr->_stderr;
+		reent->__sdidinit = 1;
+	}
+	
+	asm volatile("movl %0, %%gs:%c1" : : "r"(reent), "i"(TCB_REENT) : "memory");
+	return reent;
+}
+
+// The current thread's reentrancy structure (errno and friends)
+struct _reent* __getreent() {
+	struct _reent* reent;
+	asm volatile("movl %%gs:%c1, %0" : "=r"(reent) : "i"(TCB_REENT));
+	if (reent)
+		return reent;
+	return tls_reent_create();
+}
+
+// Address of a TLS variable (the module id is where the module's block is below the thread pointer)
+typedef struct {
+	unsigned long module;
+	unsigned long offset;
+} tls_index;
+
+__attribute__((regparm(1))) void* ___tls_get_addr(tls_index* index) {
+	unsigned long tp;
+	asm volatile("movl %%gs:%c1, %0" : "=r"(tp) : "i"(TCB_SELF));
+	return (void*)(tp - index->module + index->offset);
+}
+
+void* __tls_get_addr(tls_index* index) {
+	return ___tls_get_addr(index);
+}
+
+static volatile int tls_keys_used[TLS_KEYS_MAX];
+static void (*tls_key_destructors[TLS_KEYS_MAX])(void*);
+
+// Values of keys created after a thread last used them are only NULL for threads that start afterwards
+int pthread_key_create(unsigned int* key, void (*destructor)(void*)) {
+	unsigned int z;
+	for (z = 0; z < TLS_KEYS_MAX; z++) {
+		if (__sync_bool_compare_and_swap(&tls_keys_used[z], 0, 1)) {
+			tls_key_destructors[z] = destructor;
+			asm volatile("movl $0, %%gs:%c0(,%1,4)" : : "i"(TCB_KEYS), "r"(z) : "memory");
+			*key = z;
+			return 0;
+		}
+	}
+	return EAGAIN;
+}
+
+int pthread_key_delete(unsigned int key) {
+	if (key >= TLS_KEYS_MAX || !tls_keys_used[key])
+		return EINVAL;
+	tls_key_destructors[key] = NULL;
+	tls_keys_used[key] = 0;
+	return 0;
+}
+
+void* pthread_getspecific(unsigned int key) {
+	void* value;
+	asm volatile("movl %%gs:%c1(,%2,4), %0" : "=r"(value) : "i"(TCB_KEYS), "r"(key));
+	return value;
+}
+
+int pthread_setspecific(unsigned int key, const void* value) {
+	if (key >= TLS_KEYS_MAX)
+		return EINVAL;
+	asm volatile("movl %0, %%gs:%c1(,%2,4)" : : "r"(value), "i"(TCB_KEYS), "r"(key) : "memory");
+	return 0;
+}
+
+// Run the destructors of this thread's keys and free its reentrancy structure
+static void tls_thread_cleanup() {
+	int z;
+	for (z = 0; z < TLS_DESTRUCTOR_ITERATIONS; z++) {
+		int called = 0;
+		unsigned int key;
+		for (key = 0; key < TLS_KEYS_MAX; key++) {
+			void (*destructor)(void*) = tls_key_destructors[key];
+			void* value = pthread_getspecific(key);
+			if (!tls_keys_used[key] || !destructor || !value)
+				continue;
+			pthread_setspecific(key, NULL);
+			destructor(value);
+			called = 1;
+		}
+		if (!called)
+			break;
+	}
+	
+	struct _reent* reent;
+	asm volatile("movl %%gs:%c1, %0" : "=r"(reent) : "i"(TCB_REENT));
+	if (reent && reent != _global_impure_ptr) {
+		asm volatile("movl %0, %%gs:%c1" : : "r"(_global_impure_ptr), "i"(TCB_REENT) : "memory");
+		_reclaim_reent(reent);
+		_free_r(_global_impure_ptr, reent);
+	}
+}
+
+unsigned int set_thread_area(void* base) {
+	int ret = sys_set_thread_area(base);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	// Reload %gs so that the new base is used
+	asm volatile("movw %w0, %%gs" : : "r"(ret) : "memory");
+	return ret;
+}
+
 unsigned int thread_exit() {
+	tls_thread_cleanup();
 	int ret = sys_thread_exit();
 	if (ret < 0) {
 		errno = -ret;
@@ -271,3 +445,214 @@ unsigned int thread_exit() {
 	}
 	return ret;
 }
+
+int posix_spawn(pid_t* pid, const char* path, const posix_spawn_file_actions_t* file_actions,
+				const posix_spawnattr_t* attrp, char* const argv[], char* const envp[]) {
+	const struct __spawn_file_action* actions = NULL;
+	unsigned int num_actions = 0;
+	if (file_actions && *file_actions) {
+		actions = (*file_actions)->actions;
+		num_actions = (*file_actions)->num_actions;
+	}
+	
+	int ret = sys_posix_spawn(path, argv, envp ? envp : environ, actions, num_actions,
+							  (attrp && *attrp) ? *attrp : NULL);
+	if (ret < 0)
+		return -ret;
+	if (pid)
+		*pid = ret;
+	return 0;
+}
+
+int posix_spawnp(pid_t* pid, const char* file, const posix_spawn_file_actions_t* file_actions,
+				 const posix_spawnattr_t* attrp, char* const argv[], char* const envp[]) {
+	if (strchr(file, '/'))
+		return posix_spawn(pid, file, file_actions, attrp, argv, envp);
+	
+	const char* path = getenv("PATH");
+	if (!path)
+		path = "/bin:/usr/bin";
+	
+	// The kernel fails with ENOENT up front, so just try each directory
+	unsigned int file_len = strlen(file);
+	int ret = ENOENT;
+	while (*path) {
+		const char* end = strchr(path, ':');
+		unsigned int len = end ? (unsigned int)(end - path) : strlen(path);
+		char* buffer = malloc(len + file_len + 2);
+		if (!buffer)
+			return ENOMEM;
+		memcpy(buffer, path, len);
+		buffer[len] = '/';
+		memcpy(&buffer[len + 1], file, file_len + 1);
+		ret = posix_spawn(pid, buffer, file_actions, attrp, argv, envp);
+		free(buffer);
+		if (ret != ENOENT)
+			return ret;
+		
+		if (!end)
+			break;
+		path = end + 1;
+	}
+	
+	return ret;
+}
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t* file_actions) {
+	struct __posix_spawn_file_actions* fa = malloc(sizeof(struct __posix_spawn_file_actions));
+	if (!fa)
+		return ENOMEM;
+	memset(fa, 0, sizeof(struct __posix_spawn_file_actions));
+	*file_actions = fa;
+	return 0;
+}
+
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t* file_actions) {
+	struct __posix_spawn_file_actions* fa = *file_actions;
+	if (!fa)
+		return EINVAL;
+	for (unsigned int z = 0; z < fa->num_actions; z++) {
+		if (fa->actions[z].action == SPAWN_ACTION_OPEN)
+			free((char*)fa->actions[z].path);
+	}
+	free(fa->actions);
+	free(fa);
+	*file_actions = NULL;
+	return 0;
+}
+
+// Add a blank file action to the end of the list
+static struct __spawn_file_action* spawn_file_actions_add(posix_spawn_file_actions_t* file_actions) {
+	struct __posix_spawn_file_actions* fa = *file_actions;
+	if (fa->num_actions == fa->capacity) {
+		unsigned int capacity = fa->capacity ? fa->capacity * 2 : 4;
+		struct __spawn_file_action* actions = realloc(fa->actions, sizeof(struct __spawn_file_action) * capacity);
+		if (!actions)
+			return NULL;
+		fa->actions = actions;
+		fa->capacity = capacity;
+	}
+	
+	struct __spawn_file_action* action = &fa->actions[fa->num_actions++];
+	memset(action, 0, sizeof(struct __spawn_file_action));
+	return action;
+}
+
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t* file_actions, int fd,
+									 const char* path, int oflag, mode_t mode) {
+	if (fd < 0)
+		return EBADF;
+	char* copy = strdup(path);
+	if (!copy)
+		return ENOMEM;
+	struct __spawn_file_action* action = spawn_file_actions_add(file_actions);
+	if (!action) {
+		free(copy);
+		return ENOMEM;
+	}
+	action->action = SPAWN_ACTION_OPEN;
+	action->fd = fd;
+	action->path = copy;
+	action->mode = oflag + 1;		// Same as open()
+	return 0;
+}
+
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t* file_actions, int fd, int new_fd) {
+	if (fd < 0 || new_fd < 0)
+		return EBADF;
+	struct __spawn_file_action* action = spawn_file_actions_add(file_actions);
+	if (!action)
+		return ENOMEM;
+	action->action = SPAWN_ACTION_DUP2;
+	action->fd = fd;
+	action->new_fd = new_fd;
+	return 0;
+}
+
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t* file_actions, int fd) {
+	if (fd < 0)
+		return EBADF;
+	struct __spawn_file_action* action = spawn_file_actions_add(file_actions);
+	if (!action)
+		return ENOMEM;
+	action->action = SPAWN_ACTION_CLOSE;
+	action->fd = fd;
+	return 0;
+}
+
+int posix_spawnattr_init(posix_spawnattr_t* attr) {
+	struct __posix_spawnattr* a = malloc(sizeof(struct __posix_spawnattr));
+	if (!a)
+		return ENOMEM;
+	memset(a, 0, sizeof(struct __posix_spawnattr));
+	*attr = a;
+	return 0;
+}
+
+int posix_spawnattr_destroy(posix_spawnattr_t* attr) {
+	free(*attr);
+	*attr = NULL;
+	return 0;
+}
+
+int posix_spawnattr_getflags(const posix_spawnattr_t* attr, short* flags) {
+	*flags = (*attr)->flags;
+	return 0;
+}
+
+int posix_spawnattr_setflags(posix_spawnattr_t* attr, short flags) {
+	(*attr)->flags = flags;
+	return 0;
+}
+
+// Process groups and scheduling parameters are kept but not used
+int posix_spawnattr_getpgroup(const posix_spawnattr_t* attr, pid_t* pgroup) {
+	*pgroup = (*attr)->pgroup;
+	return 0;
+}
+
+int posix_spawnattr_setpgroup(posix_spawnattr_t* attr, pid_t pgroup) {
+	(*attr)->pgroup = pgroup;
+	return 0;
+}
+
+int posix_spawnattr_getschedparam(const posix_spawnattr_t* attr, struct sched_param* param) {
+	*param = (*attr)->param;
+	return 0;
+}
+
+int posix_spawnattr_setschedparam(posix_spawnattr_t* attr, const struct sched_param* param) {
+	(*attr)->param = *param;
+	return 0;
+}
+
+int posix_spawnattr_getschedpolicy(const posix_spawnattr_t* attr, int* policy) {
+	*policy = (*attr)->policy;
+	return 0;
+}
+
+int posix_spawnattr_setschedpolicy(posix_spawnattr_t* attr, int policy) {
+	(*attr)->policy = policy;
+	return 0;
+}
+
+// A new program always starts with the default signal actions
+int posix_spawnattr_getsigdefault(const posix_spawnattr_t* attr, sigset_t* sigdefault) {
+	*sigdefault = (*attr)->sigdefault;
+	return 0;
+}
+
+int posix_spawnattr_setsigdefault(posix_spawnattr_t* attr, const sigset_t* sigdefault) {
+	(*attr)->sigdefault = *sigdefault;
+	return 0;
+}
+
+int posix_spawnattr_getsigmask(const posix_spawnattr_t* attr, sigset_t* sigmask) {
+	*sigmask = (*attr)->sigmask;
+	return 0;
+}
+
+int posix_spawnattr_setsigmask(posix_spawnattr_t* attr, const sigset_t* sigmask) {
+	(*attr)->sigmask = *sigmask;
+	return 0;
+}
@@ -22,6 +22,7 @@ extern unsigned int sys_sigprocmask(int how, const sigset_t* set, sigset_t* olds
 extern unsigned int sys_sigaction(int signum, const struct sigaction* act, struct sigaction* oldact);
 extern unsigned int sys_sigsuspend(const sigset_t* mask);
 extern unsigned int sys_alarm(int seconds);
+extern unsigned int sys_sigaltstack(const stack_t* ss, stack_t* old_ss);
 
 int kill(int pid, int sig) {
 	int ret = sys_kill(pid, sig);
@@ -106,3 +107,12 @@ int alarm(unsigned int seconds) {
     }
 	return ret;
 }
+
+int sigaltstack(const stack_t* ss, stack_t* old_ss) {
+	int ret = sys_sigaltstack(ss, old_ss);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+	return ret;
+}
@@ -18,6 +18,65 @@ extern unsigned int sys_errno();
 extern unsigned int sys_times(struct tms* buf);
 extern unsigned int sys_gettimeofday(struct timeval* t);
 
+// Read only page the kernel keeps the time in (matches the kernel's clock_page_t)
+#define CLOCK_PAGE_ADDRESS		0x3FF000
+#define NANOS_IN_MS				(1000 * 1000)
+#define NANOS_IN_SEC			(1000 * 1000 * 1000)
+
+typedef struct {
+	volatile unsigned int sequence;
+	unsigned int tv_sec;
+	unsigned int tv_nsec;
+	unsigned long long tsc_base;
+	unsigned int tsc_mult;
+	unsigned int tsc_shift;
+} clock_page_t;
+
+static inline unsigned long long rdtsc() {
+	unsigned int low, high;
+	asm volatile("rdtsc" : "=a"(low), "=d"(high));
+	return ((unsigned long long)high << 32) | low;
+}
+
+// Get the time from the clock page without a syscall. Returns 0 if the clock page can't be used
+static int clock_page_read(unsigned int* sec, unsigned int* nsec) {
+	const clock_page_t* page = (const clock_page_t*)CLOCK_PAGE_ADDRESS;
+	unsigned int sequence, tv_sec, tv_nsec, mult, shift;
+	unsigned long long tsc_base, tsc;
+	do {
+		sequence = page->sequence;
+		asm volatile("" : : : "memory");
+		mult = page->tsc_mult;
+		if (!mult)
+			return 0;
+		tv_sec = page->tv_sec;
+		tv_nsec = page->tv_nsec;
+		tsc_base = page->tsc_base;
+		shift = page->tsc_shift;
+		tsc = rdtsc();
+		asm volatile("" : : : "memory");
+	} while ((sequence & 0x1) || sequence != page->sequence);
+	
+	// A stale page means ticks aren't getting through, so ask the kernel
+	unsigned long long delta = tsc - tsc_base;
+	if (delta >> 32)
+		return 0;
+	
+	// Never go past the next tick so the time can't jump backwards when it comes
+	unsigned int ns = ((unsigned long long)(unsigned int)delta * mult) >> shift;
+	if (ns >= NANOS_IN_MS)
+		ns = NANOS_IN_MS - 1;
+	tv_nsec += ns;
+	if (tv_nsec >= NANOS_IN_SEC) {
+		tv_nsec -= NANOS_IN_SEC;
+		tv_sec++;
+	}
+	
+	*sec = tv_sec;
+	*nsec = tv_nsec;
+	return 1;
+}
+
 clock_t times(struct tms *buf) {
 	int ret = sys_times(buf);
     if (ret < 0) {
@@ -33,6 +92,13 @@ int gettimeofday(struct timeval* p, void* z) {
 		return -1;
 	}
 	
+	unsigned int sec, nsec;
+	if (clock_page_read(&sec, &nsec)) {
+		p->tv_sec = sec;
+		p->tv_usec = nsec / 1000;
+		return 0;
+	}
+	
 	int ret = sys_gettimeofday(p);
 	if (ret < 0) {
 		errno = -ret;
@@ -48,8 +114,10 @@ int settimeofday(const struct timeval* tv, const struct timezone* tz) {
 
 int clock_getres(clockid_t clk_id, struct timespec* res) {
 	if (res) {
+		// Anything finer than a tick comes from the time stamp counter
+		unsigned int sec, nsec;
 		res->tv_sec = 0;
-		res->tv_nsec = 1000 * 1000;
+		res->tv_nsec = clock_page_read(&sec, &nsec) ? 1 : 1000 * 1000;
 	}
 	return 0;
 }
@@ -58,6 +126,13 @@ int clock_gettime(clockid_t clk_id, struct timespec* tp) {
 	if (!tp)
 		return 0;
 	
+	unsigned int sec, nsec;
+	if (clock_page_read(&sec, &nsec)) {
+		tp->tv_sec = sec;
+		tp->tv_nsec = nsec;
+		return 0;
+	}
+	
 	struct timeval p;
 	int ret = sys_gettimeofday(&p);
 	if (ret < 0) {
@@ -0,0 +1,57 @@
+//
+//  clock_page_test.c
+//  Programs
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define NUM_CALLS		1000000
+
+// The syscall gettimeofday used to make every time
+extern unsigned int sys_gettimeofday(struct timeval* t);
+
+// Time in seconds since a previous time
+double time_since(struct timeval* start) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+int main(int argc, char* argv[]) {
+	int calls = (argc > 1) ? atoi(argv[1]) : NUM_CALLS;
+	if (calls <= 0)
+		calls = NUM_CALLS;
+
+	struct timeval start, t;
+	gettimeofday(&start, NULL);
+	int z;
+	for (z = 0; z < calls; z++)
+		gettimeofday(&t, NULL);
+	double page_time = time_since(&start);
+
+	gettimeofday(&start, NULL);
+	for (z = 0; z < calls; z++)
+		sys_gettimeofday(&t);
+	double syscall_time = time_since(&start);
+
+	printf("clock page: %d calls in %.3fs (%.0fns each)\n", calls, page_time, page_time * 1000000000.0 / calls);
+	printf("syscall: %d calls in %.3fs (%.0fns each)\n", calls, syscall_time, syscall_time * 1000000000.0 / calls);
+
+	// Count how many different times come back in a row and make sure they never go backwards
+	struct timeval prev, now;
+	gettimeofday(&prev, NULL);
+	int changes = 0, backwards = 0;
+	for (z = 0; z < calls; z++) {
+		gettimeofday(&now, NULL);
+		if (now.tv_sec < prev.tv_sec || (now.tv_sec == prev.tv_sec && now.tv_usec < prev.tv_usec))
+			backwards++;
+		else if (now.tv_sec != prev.tv_sec || now.tv_usec != prev.tv_usec)
+			changes++;
+		prev = now;
+	}
+	printf("gettimeofday: %d distinct readings in %d calls, %d went backwards\n", changes, calls, backwards);
+
+	return 0;
+}
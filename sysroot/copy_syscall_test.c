@@ -0,0 +1,133 @@
+//
+//  copy_syscall_test.c
+//  Programs
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/time.h>
+
+#define CHUNK_SIZE		4096
+#define NUM_CHUNKS		16
+
+char buffers[NUM_CHUNKS][CHUNK_SIZE];
+
+// Time in seconds since a previous time
+double time_since(struct timeval* start) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+// Copy with one read and one write per chunk (what cp and stdio do)
+int copy_plain(int in, int out, int* calls) {
+	int total = 0;
+	for (;;) {
+		int n = read(in, buffers[0], CHUNK_SIZE);
+		(*calls)++;
+		if (n <= 0)
+			break;
+		write(out, buffers[0], n);
+		(*calls)++;
+		total += n;
+	}
+	return total;
+}
+
+// Copy NUM_CHUNKS chunks per readv / writev
+int copy_vectored(int in, int out, int* calls) {
+	struct iovec iov[NUM_CHUNKS];
+	int z;
+	for (z = 0; z < NUM_CHUNKS; z++) {
+		iov[z].iov_base = buffers[z];
+		iov[z].iov_len = CHUNK_SIZE;
+	}
+
+	int total = 0;
+	for (;;) {
+		int n = readv(in, iov, NUM_CHUNKS);
+		(*calls)++;
+		if (n <= 0)
+			break;
+
+		// Only write back what was read
+		int count = 0, left = n;
+		while (left > 0) {
+			iov[count].iov_len = (left < CHUNK_SIZE) ? left : CHUNK_SIZE;
+			left -= iov[count].iov_len;
+			count++;
+		}
+		writev(out, iov, count);
+		(*calls)++;
+		for (z = 0; z < count; z++)
+			iov[z].iov_len = CHUNK_SIZE;
+		total += n;
+	}
+	return total;
+}
+
+// Copy entirely in the kernel with copy_file_range
+int copy_in_kernel(int in, int out, int* calls) {
+	int total = 0;
+	for (;;) {
+		int n = copy_file_range(in, NULL, out, NULL, CHUNK_SIZE * NUM_CHUNKS * 16, 0);
+		(*calls)++;
+		if (n <= 0)
+			break;
+		total += n;
+	}
+	return total;
+}
+
+// Copy a file one of the ways
+int run(const char* src, const char* dst, int method) {
+	int in = open(src, O_RDONLY);
+	if (in < 0) {
+		printf("Could not open %s\n", src);
+		return 1;
+	}
+	int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (out < 0) {
+		printf("Could not create %s\n", dst);
+		close(in);
+		return 1;
+	}
+
+	int calls = 0;
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	int bytes = 0;
+	if (method == 0)
+		bytes = copy_plain(in, out, &calls);
+	else if (method == 1)
+		bytes = copy_vectored(in, out, &calls);
+	else
+		bytes = copy_in_kernel(in, out, &calls);
+	double t = time_since(&start);
+	const char* names[] = { "read/write", "readv/writev", "copy_file_range" };
+	printf("%s: copied %d bytes with %d syscalls in %.2fs\n", names[method], bytes, calls, t);
+
+	close(in);
+	close(out);
+	unlink(dst);
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		printf("Usage: %s file [copy]\n", argv[0]);
+		return 1;
+	}
+	const char* dst = (argc > 2) ? argv[2] : "copy_syscall_test.out";
+
+	int z;
+	for (z = 0; z < 3; z++) {
+		if (run(argv[1], dst, z) != 0)
+			return 1;
+	}
+	return 0;
+}
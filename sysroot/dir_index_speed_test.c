@@ -0,0 +1,77 @@
+//
+//  dir_index_speed_test.c
+//  Programs
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define NUM_ENTRIES		10000
+#define NUM_LOOKUPS		10000
+
+// Time in seconds since a previous time
+double time_since(struct timeval* start) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+int main(int argc, char* argv[]) {
+	const char* dir = (argc > 1) ? argv[1] : "dir_index_test";
+	int entries = (argc > 2) ? atoi(argv[2]) : NUM_ENTRIES;
+	if (entries <= 0)
+		entries = NUM_ENTRIES;
+
+	if (mkdir(dir, 0777) != 0) {
+		printf("Could not create %s\n", dir);
+		return 1;
+	}
+
+	// Fill the directory
+	char name[256];
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	int z;
+	for (z = 0; z < entries; z++) {
+		snprintf(name, sizeof(name), "%s/entry_%d", dir, z);
+		int fd = open(name, O_CREAT | O_WRONLY, 0666);
+		if (fd < 0) {
+			printf("Could not create %s\n", name);
+			entries = z;
+			break;
+		}
+		close(fd);
+	}
+	double create_time = time_since(&start);
+	printf("Created %d entries in %.2fs\n", entries, create_time);
+
+	// Look up random entries (and some that don't exist)
+	struct stat st;
+	int found = 0;
+	srand(entries);
+	gettimeofday(&start, NULL);
+	for (z = 0; z < NUM_LOOKUPS && entries > 0; z++) {
+		int n = rand() % (entries + entries / 10);
+		snprintf(name, sizeof(name), "%s/entry_%d", dir, n);
+		if (stat(name, &st) == 0)
+			found++;
+	}
+	double lookup_time = time_since(&start);
+	printf("%d random lookups (%d found) in %.2fs (%.2fus per lookup)\n", NUM_LOOKUPS, found,
+		   lookup_time, lookup_time * 1000000.0 / NUM_LOOKUPS);
+
+	// Clean up
+	gettimeofday(&start, NULL);
+	for (z = 0; z < entries; z++) {
+		snprintf(name, sizeof(name), "%s/entry_%d", dir, z);
+		unlink(name);
+	}
+	rmdir(dir);
+	printf("Removed %d entries in %.2fs\n", entries, time_since(&start));
+
+	return 0;
+}
@@ -0,0 +1,50 @@
+//
+//  null_syscall_test.c
+//  Programs
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define NUM_CALLS		1000000
+#define SYS_GETPPID		3
+
+// Time in seconds since a previous time
+double time_since(struct timeval* start) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+// The same syscall through the old int 0x80 gate
+int getppid_int80() {
+	int ret;
+	asm volatile("int $0x80" : "=a"(ret) : "a"(SYS_GETPPID) : "memory");
+	return ret;
+}
+
+int main(int argc, char* argv[]) {
+	int calls = (argc > 1) ? atoi(argv[1]) : NUM_CALLS;
+	if (calls <= 0)
+		calls = NUM_CALLS;
+
+	// getppid does next to nothing in the kernel, so this is mostly the cost of getting there and back
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	int z;
+	for (z = 0; z < calls; z++)
+		getppid();
+	double sysenter_time = time_since(&start);
+
+	gettimeofday(&start, NULL);
+	for (z = 0; z < calls; z++)
+		getppid_int80();
+	double int80_time = time_since(&start);
+
+	printf("sysenter: %d calls in %.3fs (%.0fns each)\n", calls, sysenter_time, sysenter_time * 1000000000.0 / calls);
+	printf("int 0x80: %d calls in %.3fs (%.0fns each)\n", calls, int80_time, int80_time * 1000000000.0 / calls);
+
+	return 0;
+}
@@ -0,0 +1,129 @@
+//
+//  signal_test.c
+//  Programs
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define NUM_SIGNALS		10000
+#define NUM_FAULTS		1000
+
+jmp_buf env;
+volatile int handled = 0;
+volatile int bad_info = 0;
+volatile int on_stack = 0;
+char* alt_stack = NULL;
+
+// Time in seconds since a previous time
+double time_since(struct timeval* start) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+// Returns normally so sigreturn has to put everything back
+void count_handler(int sig) {
+	handled++;
+}
+
+// Never returns
+void jump_handler(int sig) {
+	handled++;
+	longjmp(env, 1);
+}
+
+// Faults are sent by the kernel, not by kill()
+void fault_handler(int sig, siginfo_t* info, void* context) {
+	if (info->si_signo != SIGSEGV || info->si_code == SI_USER || !context)
+		bad_info++;
+	handled++;
+	longjmp(env, 1);
+}
+
+// Should be running on the alternate stack
+void stack_handler(int sig) {
+	char local;
+	on_stack = (&local >= alt_stack && &local < alt_stack + SIGSTKSZ);
+	handled++;
+}
+
+int main(int argc, char* argv[]) {
+	int count = (argc > 1) ? atoi(argv[1]) : NUM_SIGNALS;
+	if (count <= 0)
+		count = NUM_SIGNALS;
+	int failed = 0;
+
+	// Handlers that return (the registers around the kill() have to survive)
+	signal(SIGHUP, count_handler);
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	int z;
+	for (z = 0; z < count; z++)
+		kill(getpid(), SIGHUP);
+	double return_time = time_since(&start);
+	printf("returning handler: %d of %d signals in %.3fs (%.0fns each)\n", handled, count, return_time,
+		   return_time * 1000000000.0 / count);
+	failed += (handled != count);
+
+	// Handlers that never return (longjmp skips sigreturn, so the mask has to be put back by hand)
+	sigset_t mask;
+	sigprocmask(SIG_SETMASK, NULL, &mask);
+	signal(SIGINT, jump_handler);
+	handled = 0;
+	gettimeofday(&start, NULL);
+	for (z = 0; z < count; z++) {
+		if (setjmp(env) == 0) {
+			kill(getpid(), SIGINT);
+			break;
+		}
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+	}
+	double jump_time = time_since(&start);
+	printf("longjmp out of handler: %d of %d signals in %.3fs (%.0fns each)\n", handled, count, jump_time,
+		   jump_time * 1000000000.0 / count);
+	failed += (handled != count);
+
+	// Faults with SA_SIGINFO
+	struct sigaction act;
+	memset(&act, 0, sizeof(act));
+	act.sa_sigaction = fault_handler;
+	act.sa_flags = SA_SIGINFO;
+	sigaction(SIGSEGV, &act, NULL);
+	handled = 0;
+	volatile int* null = NULL;
+	for (z = 0; z < NUM_FAULTS; z++) {
+		if (setjmp(env) == 0) {
+			*null = z;
+			break;
+		}
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+	}
+	printf("SIGSEGV: %d of %d faults caught, %d with bad siginfo\n", handled, NUM_FAULTS, bad_info);
+	failed += (handled != NUM_FAULTS || bad_info != 0);
+
+	// The alternate stack
+	alt_stack = malloc(SIGSTKSZ);
+	stack_t ss;
+	ss.ss_sp = alt_stack;
+	ss.ss_size = SIGSTKSZ;
+	ss.ss_flags = 0;
+	if (sigaltstack(&ss, NULL) != 0)
+		printf("sigaltstack failed\n");
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = stack_handler;
+	act.sa_flags = SA_ONSTACK;
+	sigaction(SIGQUIT, &act, NULL);
+	handled = 0;
+	kill(getpid(), SIGQUIT);
+	printf("sigaltstack: handler %s on the alternate stack\n", on_stack ? "ran" : "did not run");
+	failed += (handled != 1 || !on_stack);
+
+	printf("%s\n", failed ? "FAILED" : "PASSED");
+	return failed ? 1 : 0;
+}
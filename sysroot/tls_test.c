@@ -0,0 +1,75 @@
+//
+//  tls_test.c
+//  Programs
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define NUM_CALLS		1000000
+#define NUM_THREADS		4
+
+pthread_key_t key;
+__thread int counter = 0;
+
+// Time in seconds since a previous time
+double time_since(struct timeval* start) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+// Each thread should only ever see its own values
+void* thread_func(void* arg) {
+	int id = (int)arg;
+	pthread_setspecific(key, arg);
+	errno = id;
+	int z;
+	for (z = 0; z < NUM_CALLS; z++)
+		counter++;
+
+	int ok = (pthread_getspecific(key) == arg && errno == id && counter == NUM_CALLS);
+	return (void*)ok;
+}
+
+int main(int argc, char* argv[]) {
+	int calls = (argc > 1) ? atoi(argv[1]) : NUM_CALLS;
+	if (calls <= 0)
+		calls = NUM_CALLS;
+
+	pthread_key_create(&key, NULL);
+	pthread_setspecific(key, &key);
+
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	volatile void* value;
+	int z;
+	for (z = 0; z < calls; z++)
+		value = pthread_getspecific(key);
+	double key_time = time_since(&start);
+
+	gettimeofday(&start, NULL);
+	for (z = 0; z < calls; z++)
+		errno = z;
+	double errno_time = time_since(&start);
+	(void)value;
+
+	printf("pthread_getspecific: %d calls in %.3fs (%.0fns each)\n", calls, key_time, key_time * 1000000000.0 / calls);
+	printf("errno: %d writes in %.3fs (%.0fns each)\n", calls, errno_time, errno_time * 1000000000.0 / calls);
+
+	pthread_t threads[NUM_THREADS];
+	for (z = 0; z < NUM_THREADS; z++)
+		pthread_create(&threads[z], NULL, thread_func, (void*)(z + 1));
+	int passed = 0;
+	for (z = 0; z < NUM_THREADS; z++) {
+		void* ret = NULL;
+		pthread_join(threads[z], &ret);
+		passed += (ret != NULL);
+	}
+	printf("%d of %d threads kept their own TLS (main: counter = %d)\n", passed, NUM_THREADS, counter);
+
+	return (passed == NUM_THREADS) ? 0 : 1;
+}
@@ -18,6 +18,8 @@ extern "C"{
 #include <time.h>
 
 #define PTHREAD_THREADS_MAX			128
+#define PTHREAD_KEYS_MAX			128
+#define PTHREAD_DESTRUCTOR_ITERATIONS	4
 #define PTHREAD_CANCELLED 			((void*)-1)
 
 enum {
@@ -217,6 +219,9 @@ typedef struct {
 
 #define PTHREAD_ONCE_INIT ((pthread_once_t){ PTHREAD_MUTEX_INITIALIZER, 0 })
 
+// Index into the thread's slots at %gs
+typedef unsigned int pthread_key_t;
+
 int   pthread_create(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *);
 pthread_t pthread_self(void);
 int   pthread_join(pthread_t, void **);
@@ -239,11 +244,11 @@ int   pthread_setcanceltype(int, int *);
 int   pthread_setconcurrency(int);
 int   pthread_setschedparam(pthread_t, int , const struct sched_param *);
 
-// TODO: key functions
-/*int   pthread_setspecific(pthread_key_t, const void *);
+// Key functions (in libc)
+int   pthread_setspecific(pthread_key_t, const void *);
 void *pthread_getspecific(pthread_key_t);
 int   pthread_key_create(pthread_key_t *, void (*)(void *));
-int   pthread_key_delete(pthread_key_t);*/
+int   pthread_key_delete(pthread_key_t);
 
 #ifdef __cplusplus
 }
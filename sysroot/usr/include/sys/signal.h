@@ -111,16 +111,38 @@ struct sigaction {
 #elif defined(__CYGWIN__)
 #include <cygwin/signal.h>
 #else
-#define SA_NOCLDSTOP 1  /* only value supported now for sa_flags */
+#define SA_NOCLDSTOP 0x1   /* Do not generate SIGCHLD when children stop */
+#define SA_SIGINFO   0x2   /* Invoke the signal catching function with */
+                           /*   three arguments instead of one. */
+#define SA_ONSTACK   0x4   /* Signal delivery will be on a separate stack. */
+
+union sigval {
+  int    sival_int;    /* Integer signal value */
+  void  *sival_ptr;    /* Pointer signal value */
+};
+
+#define SI_USER    1    /* Sent by a user. kill(), abort(), etc */
+
+typedef struct {
+  int          si_signo;    /* Signal number */
+  int          si_code;     /* Cause of the signal */
+  union sigval si_value;    /* Signal value */
+} siginfo_t;
 
 typedef void (*_sig_func_ptr)(int);
 
 struct sigaction 
 {
-	_sig_func_ptr sa_handler;
+	union {
+		_sig_func_ptr _handler;
+		void (*_sigaction)(int, siginfo_t *, void *);
+	} _signal_handlers;
 	sigset_t sa_mask;
 	int sa_flags;
 };
+
+#define sa_handler    _signal_handlers._handler
+#define sa_sigaction  _signal_handlers._sigaction
 #endif /* defined(__rtems__) */
 
 #if __BSD_VISIBLE || __XSI_VISIBLE >= 4 || __POSIX_VISIBLE >= 200809